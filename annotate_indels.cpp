@@ -43,6 +43,7 @@ class Igor : Program
     bool debug;
     bool override_tag;
     bool add_flank_annotation;     //add flank annotation
+    int32_t nthreads;
 
     //exact alignment related statistics
     std::string EX_MOTIF;
@@ -140,6 +141,7 @@ class Igor : Program
             fexp = arg_fexp.getValue();
             debug = arg_debug.getValue();
             ref_fasta_file = arg_ref_fasta_file.getValue();
+            nthreads = hts_get_shared_thread_pool_size();
         }
         catch (TCLAP::ArgException &e)
         {
@@ -148,6 +150,21 @@ class Igor : Program
         }
     };
 
+    /**
+     * Constructs a worker that annotates the records of a shard with the options of igor.
+     */
+    Igor(Igor& igor, RegionShard *shard)
+    {
+        version = igor.version;
+        input_vcf_file = igor.input_vcf_file;
+        output_vcf_file = shard->output_vcf_file;
+        intervals = shard->intervals;
+        ref_fasta_file = igor.ref_fasta_file;
+        debug = igor.debug;
+        fexp = igor.fexp;
+        nthreads = 1;
+    };
+
     ~Igor()
     {
     };
@@ -282,6 +299,18 @@ class Igor : Program
     {
         odw->write_hdr();
 
+        if (nthreads>1 && odr->is_index_loaded())
+        {
+            annotate_indels_shards();
+            return;
+        }
+
+        //the header is finalized and synced when it is written
+        if (odr->ftype.format==bcf && hts_get_shared_thread_pool_size())
+        {
+            odr->enable_prefetch();
+        }
+
         bcf1_t *v = odw->get_bcf1_from_pool();
         bcf_hdr_t *h = odw->hdr;
         Variant variant;
@@ -413,6 +442,49 @@ class Igor : Program
         odr->close();
     };
 
+    /**
+     * Annotates shards of the input in parallel and stitches the results.
+     */
+    void annotate_indels_shards()
+    {
+        //the variance table of LogTool used by the alignment models is filled on first use and shared by the workers
+        LogTool::pl2log10_varp(3236);
+
+        RegionSharder sharder(odr, intervals, nthreads);
+        sharder.run(annotate_indels_shard, this);
+
+        for (size_t i=0; i<sharder.shards.size(); ++i)
+        {
+            Igor *worker = (Igor*) sharder.shards[i].data;
+
+            no_indels_annotated += worker->no_indels_annotated;
+
+            delete worker->odr;
+            delete worker->odw;
+            delete worker->vm;
+            delete worker->va;
+            delete worker->rs;
+            delete worker;
+        }
+
+        sharder.stitch(odw);
+
+        odw->close();
+        odr->close();
+    }
+
+    /**
+     * Annotates the records of a shard, called by the worker threads of RegionSharder.
+     */
+    static void annotate_indels_shard(void *arg, RegionShard *shard)
+    {
+        Igor *worker = new Igor(*((Igor*) arg), shard);
+        worker->initialize();
+        worker->odr->set_interval_start_only(shard->interval_start_only);
+        worker->annotate_indels();
+        shard->data = worker;
+    }
+
     private:
 };
 }
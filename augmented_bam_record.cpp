@@ -28,6 +28,10 @@
  */
 AugmentedBAMRecord::AugmentedBAMRecord()
 {
+    ref_index = NULL;
+    arena_l = 0;
+    ref_window_tid = -1;
+    ref_window_beg1 = 0;
     clear();
 }
 
@@ -36,12 +40,20 @@ AugmentedBAMRecord::AugmentedBAMRecord()
  */
 AugmentedBAMRecord::AugmentedBAMRecord(bam_hdr_t* h, bam1_t* s)
 {
+    ref_index = NULL;
+    arena_l = 0;
+    ref_window_tid = -1;
+    ref_window_beg1 = 0;
     clear();
     initialize(h, s);
 }
 
 /**
  * Initialize.
+ *
+ * Mismatches are read from the MD tag, if it is absent, they are
+ * obtained by comparing the read against the reference in ref_index,
+ * without a reference all aligned bases are treated as matches.
  */
 void AugmentedBAMRecord::initialize(bam_hdr_t* h, bam1_t* s)
 {
@@ -52,7 +64,135 @@ void AugmentedBAMRecord::initialize(bam_hdr_t* h, bam1_t* s)
     beg1  = bam_get_pos1(s);
     end1  = beg1;
 
+    //every sequence is copied from either the read or the aligned reference,
+    //so the arena is sized once and the views into it stay valid
+    uint32_t arena_size = bam_get_l_qseq(s) + bam_cigar2rlen(bam_get_n_cigar_op(s), bam_get_cigar(s));
+    if (arena.size()<arena_size)
+    {
+        arena.resize(arena_size);
+    }
+
+    //get MD tag
+    uint8_t *md_aux;
+    char* md = 0;
+    ((md_aux=bam_aux_get(s, "MD")) &&  (md = bam_aux2Z(md_aux)));
+
+    if (md)
+    {
+        augment_with_md(md);
+    }
+    else
+    {
+        augment_with_reference();
+    }
+
+    //count number of mismatches
+    //compute end1 position of alignment
+    uint8_t* qual = bam_get_qual(s);
+    uint32_t rpos0 = 0;
+    for (uint32_t i=0; i<aug_cigar.size(); ++i)
+    {
+        uint32_t oplen = bam_cigar_oplen(aug_cigar[i]);
+        char opchr = bam_cigar_opchr(aug_cigar[i]);
+
+        if (opchr=='S')
+        {
+            rpos0 += oplen;
+        }
+        else if (opchr=='=')
+        {
+            rpos0 += oplen;
+            end1 +=oplen;
+        }
+        else if (opchr=='X')
+        {
+            if (qual[rpos0]>=20)
+            {
+                ++no_mismatches;
+            }
+            ++rpos0;
+            ++end1;
+        }
+        else if (opchr=='I')
+        {
+            rpos0 += oplen;
+            ++no_mismatches;
+        }
+        else if (opchr=='D')
+        {
+            ++no_mismatches;
+            end1 +=oplen;
+        }
+        else
+        {
+            std::cerr << "unrecognized cigar state " << opchr << "\n";
+        }
+    }
+
+    --end1;
+}
+
+/**
+ * Adds an operation to the augmented cigar.
+ */
+void AugmentedBAMRecord::add_op(uint32_t op, AugmentedSeq ref, AugmentedSeq alt)
+{
+    aug_cigar.push_back(op);
+    aug_ref.push_back(ref);
+    aug_alt.push_back(alt);
+}
+
+/**
+ * Copies the read bases from rpos0 to the arena.
+ */
+AugmentedSeq AugmentedBAMRecord::copy_read_seq(uint32_t rpos0, uint32_t len)
+{
+    if (arena_l+len>arena.size() || rpos0+len>(uint32_t)bam_get_l_qseq(s))
+    {
+        fprintf(stderr, "[%s:%d %s] Inconsistent CIGAR and MD.\n", __FILE__, __LINE__, __FUNCTION__);
+        exit(1);
+    }
+
     uint8_t* seq = bam_get_seq(s);
+    char* p = &arena[arena_l];
+    for (uint32_t i=0; i<len; ++i)
+    {
+        p[i] = bam_base2char(bam_seqi(seq, rpos0+i));
+    }
+    arena_l += len;
+
+    AugmentedSeq view = {p, len};
+    return view;
+}
+
+/**
+ * Copies reference bases to the arena.
+ */
+AugmentedSeq AugmentedBAMRecord::copy_ref_seq(int32_t pos1, uint32_t len)
+{
+    if (arena_l+len>arena.size())
+    {
+        fprintf(stderr, "[%s:%d %s] Inconsistent CIGAR and MD.\n", __FILE__, __LINE__, __FUNCTION__);
+        exit(1);
+    }
+
+    char* p = &arena[arena_l];
+    for (uint32_t i=0; i<len; ++i)
+    {
+        p[i] = get_ref_base(pos1+i);
+    }
+    arena_l += len;
+
+    AugmentedSeq view = {p, len};
+    return view;
+}
+
+/**
+ * Augments the cigar with the MD tag.
+ */
+void AugmentedBAMRecord::augment_with_md(char* md)
+{
+    AugmentedSeq none = {"", 0};
 
     //CIGAR related variables
     int32_t n_cigar_op = bam_get_n_cigar_op(s);
@@ -60,13 +200,8 @@ void AugmentedBAMRecord::initialize(bam_hdr_t* h, bam1_t* s)
     char opchr;
     int32_t oplen;
 
-    //get MD tag
-    uint8_t *md_aux;
-    char* md = 0;
-    ((md_aux=bam_aux_get(s, "MD")) &&  (md = bam_aux2Z(md_aux)));
     char* mdp = md; //pointer to md
 
-
     //variables for keep track of CIGAR and MD tag
     uint32_t rpos0 = 0;                //current 0-based position in read sequence and qual field
     uint32_t md_mlen_left = 0;         //unprocessed MD matches that embeds insertions
@@ -86,9 +221,7 @@ void AugmentedBAMRecord::initialize(bam_hdr_t* h, bam1_t* s)
 
         if (opchr=='S')
         {
-            aug_cigar.push_back(cigar[i]);
-            aug_ref.push_back("");
-            aug_alt.push_back("");
+            add_op(cigar[i], none, none);
 
             rpos0 += oplen;
         }
@@ -107,9 +240,7 @@ void AugmentedBAMRecord::initialize(bam_hdr_t* h, bam1_t* s)
                 //to process the next insertion or SNP
                 if (md_mlen_left>mlen)
                 {
-                    aug_cigar.push_back(bam_cigar_gen(mlen, BAM_CEQUAL));
-                    aug_ref.push_back("");
-                    aug_alt.push_back("");
+                    add_op(bam_cigar_gen(mlen, BAM_CEQUAL), none, none);
 
                     md_mlen_left -= mlen;
                     rpos0 += mlen;
@@ -127,9 +258,7 @@ void AugmentedBAMRecord::initialize(bam_hdr_t* h, bam1_t* s)
                 //to process the next insertion or SNP
                 else
                 {
-                    aug_cigar.push_back(bam_cigar_gen(md_mlen_left, BAM_CEQUAL));
-                    aug_ref.push_back("");
-                    aug_alt.push_back("");
+                    add_op(bam_cigar_gen(md_mlen_left, BAM_CEQUAL), none, none);
 
                     mlen -= md_mlen_left;
                     rpos0 += md_mlen_left;
@@ -139,17 +268,21 @@ void AugmentedBAMRecord::initialize(bam_hdr_t* h, bam1_t* s)
                 }
             }
 
-            //might have multiple mismatches
-            while (*mdp)
+            //might have multiple mismatches,
+            //stops when the M operation is consumed so that MD is not
+            //attributed beyond an insertion that follows it
+            while (mlen && *mdp)
             {
                 if (isalpha(*mdp)) //mismatches
                 {
-                    aug_cigar.push_back(bam_cigar_gen(1, BAM_CDIFF));
-
-//                    std::cerr << "ADDING " << ((char)toupper(*mdp)) << " " << bam_base2char(bam_seqi(seq, rpos0)) << "\n";
-
-                    aug_ref.push_back(std::string(1, toupper(*mdp)));
-                    aug_alt.push_back(std::string(1, bam_base2char(bam_seqi(seq, rpos0))));
+                    if (arena_l>=arena.size())
+                    {
+                        fprintf(stderr, "[%s:%d %s] Inconsistent CIGAR and MD.\n", __FILE__, __LINE__, __FUNCTION__);
+                        exit(1);
+                    }
+                    AugmentedSeq ref = {&arena[arena_l], 1};
+                    arena[arena_l++] = toupper(*mdp);
+                    add_op(bam_cigar_gen(1, BAM_CDIFF), ref, copy_read_seq(rpos0, 1));
 
                     ++mdp;
                     ++rpos0;
@@ -166,9 +299,7 @@ void AugmentedBAMRecord::initialize(bam_hdr_t* h, bam1_t* s)
                         //another I
                         if (len>mlen)
                         {
-                            aug_cigar.push_back(bam_cigar_gen(mlen, BAM_CEQUAL));
-                            aug_ref.push_back("");
-                            aug_alt.push_back("");
+                            add_op(bam_cigar_gen(mlen, BAM_CEQUAL), none, none);
 
                             md_mlen_left = len - mlen;
                             rpos0 += mlen;
@@ -180,9 +311,7 @@ void AugmentedBAMRecord::initialize(bam_hdr_t* h, bam1_t* s)
                         //another mismatch
                         else
                         {
-                            aug_cigar.push_back(bam_cigar_gen(len, BAM_CEQUAL));
-                            aug_ref.push_back("");
-                            aug_alt.push_back("");
+                            add_op(bam_cigar_gen(len, BAM_CEQUAL), none, none);
 
                             mlen -= len;
                             rpos0 += len;
@@ -200,8 +329,6 @@ void AugmentedBAMRecord::initialize(bam_hdr_t* h, bam1_t* s)
         }
         else if (opchr=='D')
         {
-            bool is_del = false;
-
             if (*mdp=='0') ++mdp;
 
             if (*mdp!='^')
@@ -213,17 +340,25 @@ void AugmentedBAMRecord::initialize(bam_hdr_t* h, bam1_t* s)
             }
 
             ++mdp;
-            std::string del = "";
+            if (arena_l+oplen>arena.size())
+            {
+                fprintf(stderr, "[%s:%d %s] Inconsistent CIGAR and MD.\n", __FILE__, __LINE__, __FUNCTION__);
+                exit(1);
+            }
+            AugmentedSeq del = {&arena[arena_l], 0};
 
             while (isalpha(*mdp))
             {
-                del += toupper(*mdp);
+                //deleted bases beyond the length of the D operation are dropped
+                if (del.l<(uint32_t)oplen)
+                {
+                    arena[arena_l++] = toupper(*mdp);
+                    ++del.l;
+                }
                 ++mdp;
             }
 
-            aug_cigar.push_back(cigar[i]);
-            aug_ref.push_back(del);
-            aug_alt.push_back("");
+            add_op(cigar[i], del, none);
         }
         else if (opchr=='I')
         {
@@ -233,18 +368,14 @@ void AugmentedBAMRecord::initialize(bam_hdr_t* h, bam1_t* s)
             if (!seenM)
             {
                 //convert to Ss
-                aug_cigar.push_back(bam_cigar_gen(oplen, BAM_CSOFT_CLIP));
-                aug_ref.push_back("");
-                aug_alt.push_back("");
+                add_op(bam_cigar_gen(oplen, BAM_CSOFT_CLIP), none, none);
 
                 rpos0 += oplen;
             }
             //trailing Is
             else if (i==n_cigar_op-1 || (i+2==n_cigar_op && bam_cigar_opchr(cigar[n_cigar_op-1])=='S'))
             {
-                aug_cigar.push_back(bam_cigar_gen(oplen, BAM_CSOFT_CLIP));
-                aug_ref.push_back("");
-                aug_alt.push_back("");
+                add_op(bam_cigar_gen(oplen, BAM_CSOFT_CLIP), none, none);
 
                 rpos0 += oplen;
             }
@@ -252,15 +383,7 @@ void AugmentedBAMRecord::initialize(bam_hdr_t* h, bam1_t* s)
             {
                 //insertions are not present in MD tags
                 //may be handled independently of future matches
-                std::string ins = "";
-                for (size_t i=0; i<oplen ; ++i)
-                {
-                    ins += bam_base2char(bam_seqi(seq, rpos0+i));
-                }
-
-                aug_cigar.push_back(bam_cigar_gen(oplen, BAM_CINS));
-                aug_ref.push_back("");
-                aug_alt.push_back(ins);
+                add_op(bam_cigar_gen(oplen, BAM_CINS), none, copy_read_seq(rpos0, oplen));
 
                 rpos0 += oplen;
             }
@@ -271,53 +394,140 @@ void AugmentedBAMRecord::initialize(bam_hdr_t* h, bam1_t* s)
             exit(1);
         }
     }
+}
 
-    //count number of mismatches
-    //compute end1 position of alignment
-    uint8_t* qual = bam_get_qual(s);
-    rpos0 = 0;
-    for (uint32_t i=0; i<aug_cigar.size(); ++i)
+/**
+ * Augments the cigar by comparing the read against the reference.
+ */
+void AugmentedBAMRecord::augment_with_reference()
+{
+    AugmentedSeq none = {"", 0};
+
+    int32_t n_cigar_op = bam_get_n_cigar_op(s);
+    uint32_t *cigar = bam_get_cigar(s);
+    uint8_t* seq = bam_get_seq(s);
+    char opchr;
+    int32_t oplen;
+
+    if (ref_index)
     {
-        uint32_t oplen = bam_cigar_oplen(aug_cigar[i]);
-        char opchr = bam_cigar_opchr(aug_cigar[i]);
+        fetch_ref_window(bam_get_tid(s), beg1, beg1+bam_cigar2rlen(n_cigar_op, cigar)-1);
+    }
+    else
+    {
+        ref_window_beg1 = 0;
+    }
+
+    uint32_t rpos0 = 0;                //current 0-based position in read sequence and qual field
+    int32_t pos1 = beg1;               //current 1-based position in the reference
+    bool seenM = false;                //to check read is aligned
+
+    for (int32_t i = 0; i < n_cigar_op; ++i)
+    {
+        opchr = bam_cigar_opchr(cigar[i]);
+        oplen = bam_cigar_oplen(cigar[i]);
 
         if (opchr=='S')
         {
+            add_op(cigar[i], none, none);
+
             rpos0 += oplen;
         }
-        else if (opchr=='=')
+        else if (opchr=='M' || opchr=='=' || opchr=='X')
         {
+            seenM = true;
+
+            //no reference to compare against
+            if (!ref_window_beg1)
+            {
+                add_op(bam_cigar_gen(oplen, BAM_CEQUAL), none, none);
+            }
+            else
+            {
+                uint32_t mlen = 0;
+                for (int32_t j=0; j<oplen; ++j)
+                {
+                    char ref = get_ref_base(pos1+j);
+                    if (bam_base2char(bam_seqi(seq, rpos0+j))==ref)
+                    {
+                        ++mlen;
+                        continue;
+                    }
+
+                    if (mlen)
+                    {
+                        add_op(bam_cigar_gen(mlen, BAM_CEQUAL), none, none);
+                        mlen = 0;
+                    }
+
+                    add_op(bam_cigar_gen(1, BAM_CDIFF), copy_ref_seq(pos1+j, 1), copy_read_seq(rpos0+j, 1));
+                }
+
+                if (mlen)
+                {
+                    add_op(bam_cigar_gen(mlen, BAM_CEQUAL), none, none);
+                }
+            }
+
             rpos0 += oplen;
-            end1 +=oplen;
+            pos1 += oplen;
         }
-        else if (opchr=='X')
+        else if (opchr=='D')
         {
-            if (qual[rpos0]>=20)
-            {
-                ++no_mismatches;
-            }
-            ++rpos0;
-            ++end1;
+            add_op(cigar[i], copy_ref_seq(pos1, oplen), none);
+
+            pos1 += oplen;
         }
         else if (opchr=='I')
         {
+            //leading and trailing Is are converted to Ss
+            if (!seenM || i==n_cigar_op-1 || (i+2==n_cigar_op && bam_cigar_opchr(cigar[n_cigar_op-1])=='S'))
+            {
+                add_op(bam_cigar_gen(oplen, BAM_CSOFT_CLIP), none, none);
+            }
+            else
+            {
+                add_op(bam_cigar_gen(oplen, BAM_CINS), none, copy_read_seq(rpos0, oplen));
+            }
+
             rpos0 += oplen;
-            ++no_mismatches;
-        }
-        else if (opchr=='D')
-        {
-            ++no_mismatches;
-            end1 +=oplen;
         }
         else
         {
-            std::cerr << "unrecognized cigar state " << opchr << "\n";
+            fprintf(stderr, "[%s:%d %s] Cigar state not handled %c\n", __FILE__, __LINE__, __FUNCTION__, opchr);
+            exit(1);
         }
     }
-    
-    --end1;
+}
+
+/**
+ * Caches a reference window that contains tid:beg1-end1.
+ */
+void AugmentedBAMRecord::fetch_ref_window(int32_t tid, int32_t beg1, int32_t end1)
+{
+    if (ref_window_beg1 && tid==ref_window_tid &&
+        beg1>=ref_window_beg1 && end1<ref_window_beg1+(int32_t)ref_window.size())
+    {
+        return;
+    }
+
+    ref_window_beg1 = 0;
+    if (tid<0)
+    {
+        return;
+    }
 
-     print();
+    //reads are mostly sorted, so the window extends well beyond this read
+    int32_t window_end1 = std::max(end1, beg1+AUGMENTED_BAM_RECORD_REF_WINDOW_SIZE-1);
+    int32_t ref_len = 0;
+    char* refseq = ref_index->fetch_uc_seq(h->target_name[tid], beg1-1, window_end1-1, &ref_len);
+    if (refseq && ref_len>0)
+    {
+        ref_window.assign(refseq, ref_len);
+        ref_window_tid = tid;
+        ref_window_beg1 = beg1;
+    }
+    if (refseq) free(refseq);
 }
 
 /**
@@ -345,6 +555,7 @@ bool AugmentedBAMRecord::right_align()
 void AugmentedBAMRecord::clear()
 {
     s = NULL;
+    arena_l = 0;
     aug_cigar.clear();
     aug_ref.clear();
     aug_alt.clear();
@@ -498,8 +709,8 @@ void AugmentedBAMRecord::print()
         {
             //assume oplen is always 1.
 
-            ref.append(aug_ref[i]);
-            seq.append(aug_alt[i]);
+            ref.append(aug_ref[i].s, aug_ref[i].l);
+            seq.append(aug_alt[i].s, aug_alt[i].l);
             align.append(1, 'X');
             quals.append(1, qual[spos0]+33);
 
@@ -508,7 +719,7 @@ void AugmentedBAMRecord::print()
         else if (opchr=='I')
         {
             ref.append(oplen, '-');
-            seq.append(aug_alt[i]);
+            seq.append(aug_alt[i].s, aug_alt[i].l);
             align.append( oplen, 'I');
 
             for (uint32_t j=0; j<oplen; ++j)
@@ -520,7 +731,7 @@ void AugmentedBAMRecord::print()
         }
         else if (opchr=='D')
         {
-            ref.append(aug_ref[i]);
+            ref.append(aug_ref[i].s, aug_ref[i].l);
             seq.append(oplen, '-');
             align.append(oplen, 'D');
         }
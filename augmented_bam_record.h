@@ -26,6 +26,34 @@
 
 #include "hts_utils.h"
 #include "utils.h"
+#include "packed_reference.h"
+
+//size of the cached reference window used when the MD tag is absent
+#define AUGMENTED_BAM_RECORD_REF_WINDOW_SIZE 65536
+
+/**
+ * A sequence in the arena of an augmented BAM record,
+ * valid till the record is initialized again.
+ */
+struct AugmentedSeq
+{
+    const char* s;
+    uint32_t l;
+
+    uint32_t size() const { return l; }
+
+    char at(uint32_t i) const { return s[i]; }
+
+    bool operator==(const std::string& seq) const
+    {
+        return seq.size()==l && (!l || !memcmp(seq.c_str(), s, l));
+    }
+};
+
+inline bool operator==(const std::string& seq, const AugmentedSeq& a)
+{
+    return a==seq;
+}
 
 /**
  * The augmented BAM record adds functionalities to process the
@@ -45,13 +73,16 @@
  * 1. seq from bam1_t
  * 2. qual from bam1_t
  * 3. cigar from bam1_t
- * 4. MD from bam1_t (or reconstructed)
+ * 4. MD from bam1_t (or reconstructed from the reference)
  * 5. aux_cigar that includes mismatches
  * 6. aux_seq that points to
  *    a. base substitution in MD
  *    b. inserted sequence in seq (I)
  *    c. deleted sequence in MD (D)
  *
+ * The sequences are views into an arena that is sized once per read,
+ * so records are reused without allocating once the buffers are warm.
+ *
  * For ease of left alignment of indels, and extracting a SNP
  */
 class AugmentedBAMRecord
@@ -66,14 +97,17 @@ class AugmentedBAMRecord
     std::vector<uint32_t> aug_cigar;
 
     //points to mismatch, deleted and inserted sequences
-    std::vector<std::string> aug_ref;
+    std::vector<AugmentedSeq> aug_ref;
 
     //points to mismatch, deleted and inserted sequences
-    std::vector<std::string> aug_alt;
+    std::vector<AugmentedSeq> aug_alt;
 
     //statistics
     uint32_t no_mismatches;
 
+    //reference for reads without MD tags, not owned
+    ReferenceIndex *ref_index;
+
     /**
      * Constructor.
      */
@@ -86,6 +120,10 @@ class AugmentedBAMRecord
 
     /**
      * Initialize.
+     *
+     * Mismatches are read from the MD tag, if it is absent, they are
+     * obtained by comparing the read against the reference in ref_index,
+     * without a reference all aligned bases are treated as matches.
      */
     void initialize(bam_hdr_t* h, bam1_t* s);
 
@@ -118,6 +156,56 @@ class AugmentedBAMRecord
      * Prints alignment of record.
      */
     void print();
+
+    private:
+
+    //bases of the sequences in aug_ref and aug_alt
+    std::vector<char> arena;
+    uint32_t arena_l;
+
+    //cached reference window, ref_window_beg1 is 0 when empty
+    int32_t ref_window_tid;
+    int32_t ref_window_beg1;
+    std::string ref_window;
+
+    /**
+     * Adds an operation to the augmented cigar.
+     */
+    void add_op(uint32_t op, AugmentedSeq ref, AugmentedSeq alt);
+
+    /**
+     * Copies the read bases from rpos0 to the arena.
+     */
+    AugmentedSeq copy_read_seq(uint32_t rpos0, uint32_t len);
+
+    /**
+     * Copies reference bases to the arena.
+     */
+    AugmentedSeq copy_ref_seq(int32_t pos1, uint32_t len);
+
+    /**
+     * Augments the cigar with the MD tag.
+     */
+    void augment_with_md(char* md);
+
+    /**
+     * Augments the cigar by comparing the read against the reference.
+     */
+    void augment_with_reference();
+
+    /**
+     * Caches a reference window that contains tid:beg1-end1.
+     */
+    void fetch_ref_window(int32_t tid, int32_t beg1, int32_t end1);
+
+    /**
+     * Gets a base from the reference window, N if it is not available.
+     */
+    char get_ref_base(int32_t pos1)
+    {
+        int32_t i = pos1-ref_window_beg1;
+        return (ref_window_beg1 && i>=0 && i<(int32_t)ref_window.size()) ? ref_window[i] : 'N';
+    }
 };
 
 #endif
\ No newline at end of file
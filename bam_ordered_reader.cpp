@@ -74,15 +74,22 @@ BAMOrderedReader::BAMOrderedReader(std::string file_name, std::vector<GenomeInte
         fprintf(stderr, "[%s:%d %s] Not a SAM/BAM/CRAM file: %s\n", __FILE__, __LINE__, __FUNCTION__, file_name.c_str());
         exit(1);
     }
+    hts_attach_shared_thread_pool(file);
 
-    if (ref_fasta_file!="")
+    char* fai = ref_fasta_file!="" ? samfaipath(ref_fasta_file.c_str()) : NULL;
+    if (fai && ftype.format!=cram)
     {
-        char* fai = samfaipath(ref_fasta_file.c_str());
         hts_set_fai_filename(file, fai);
-        free(fai);
     }
 
     hdr = sam_hdr_read(file);
+
+    //CRAM files share the reference sequences loaded for other readers
+    if (fai && hdr && ftype.format==cram)
+    {
+        hts_set_shared_cram_reference(file, hdr, fai);
+    }
+    free(fai);
     
     s = bam_init1();
 
@@ -115,6 +122,10 @@ bool BAMOrderedReader::jump_to_interval(GenomeInterval& interval)
         intervals.push_back(interval);
         interval_index = 0;
 
+        if (itr)
+        {
+            hts_itr_destroy(itr);
+        }
         intervals[interval_index++].to_string(&str);
         itr = sam_itr_querys(idx, hdr, str.s);
 
@@ -135,6 +146,10 @@ bool BAMOrderedReader::initialize_next_interval()
 {
     while (interval_index!=intervals.size())
     {
+        if (itr)
+        {
+            hts_itr_destroy(itr);
+        }
         intervals[interval_index++].to_string(&str);
         itr = sam_itr_querys(idx, hdr, str.s);
 
@@ -186,5 +201,6 @@ bool BAMOrderedReader::read(bam1_t *s)
  */
 void BAMOrderedReader::close()
 {
+    hts_release_shared_cram_reference(file);
     sam_close(file);
 }
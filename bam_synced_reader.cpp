@@ -0,0 +1,346 @@
+/* The MIT License
+
+   Copyright (c) 2018 Adrian Tan <atks@umich.edu>
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "bam_synced_reader.h"
+
+/**
+ * Constructor.
+ */
+BAMReadQueue::BAMReadQueue(int32_t file_index, BAMOrderedReader *odr, uint32_t capacity)
+{
+    this->file_index = file_index;
+    this->odr = odr;
+    this->capacity = capacity;
+
+    done = false;
+    closed = false;
+
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&not_empty, NULL);
+    pthread_cond_init(&not_full, NULL);
+
+    if (pthread_create(&thread, NULL, work, this))
+    {
+        fprintf(stderr, "[E:%s:%d %s] cannot create thread for %s\n", __FILE__, __LINE__, __FUNCTION__, odr->file_name.c_str());
+        exit(1);
+    }
+}
+
+/**
+ * Destroys the remaining records.
+ */
+BAMReadQueue::~BAMReadQueue()
+{
+    close();
+
+    while (!reads.empty())
+    {
+        bam_destroy1(reads.front());
+        reads.pop_front();
+    }
+
+    for (size_t i=0; i<pool.size(); ++i)
+    {
+        bam_destroy1(pool[i]);
+    }
+
+    pthread_mutex_destroy(&mutex);
+    pthread_cond_destroy(&not_empty);
+    pthread_cond_destroy(&not_full);
+}
+
+/**
+ * Takes the next read, blocks when the queue is empty.
+ * Returns NULL when all reads are decoded and taken.
+ */
+bam1_t* BAMReadQueue::take()
+{
+    pthread_mutex_lock(&mutex);
+    while (reads.empty() && !done)
+    {
+        pthread_cond_wait(&not_empty, &mutex);
+    }
+
+    bam1_t *s = NULL;
+    if (!reads.empty())
+    {
+        s = reads.front();
+        reads.pop_front();
+        pthread_cond_signal(&not_full);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    return s;
+}
+
+/**
+ * Returns a read that was taken for reuse.
+ */
+void BAMReadQueue::give_back(bam1_t *s)
+{
+    pthread_mutex_lock(&mutex);
+    pool.push_back(s);
+    pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Stops the worker thread.
+ */
+void BAMReadQueue::close()
+{
+    pthread_mutex_lock(&mutex);
+    if (closed)
+    {
+        pthread_mutex_unlock(&mutex);
+        return;
+    }
+    closed = true;
+    pthread_cond_broadcast(&not_full);
+    pthread_mutex_unlock(&mutex);
+
+    pthread_join(thread, NULL);
+}
+
+/**
+ * Reads the file into the queue, runs in the worker thread.
+ */
+void* BAMReadQueue::work(void *arg)
+{
+    BAMReadQueue *q = (BAMReadQueue*) arg;
+    BAMOrderedReader *odr = q->odr;
+    bam1_t *s = NULL;
+
+    while (true)
+    {
+        if (!s)
+        {
+            pthread_mutex_lock(&q->mutex);
+            if (q->pool.size())
+            {
+                s = q->pool.back();
+                q->pool.pop_back();
+            }
+            pthread_mutex_unlock(&q->mutex);
+
+            if (!s) s = bam_init1();
+        }
+
+        if (!odr->read(s))
+        {
+            break;
+        }
+
+        //reads overlapping the previous interval were returned for that interval
+        if (odr->random_access_enabled && odr->interval_index>=2)
+        {
+            GenomeInterval& interval = odr->intervals[odr->interval_index-2];
+            if (bam_get_pos1(s)<=interval.end1 && interval.seq==bam_get_chrom(odr->hdr, s))
+            {
+                continue;
+            }
+        }
+
+        pthread_mutex_lock(&q->mutex);
+        while (q->reads.size()>=q->capacity && !q->closed)
+        {
+            pthread_cond_wait(&q->not_full, &q->mutex);
+        }
+
+        if (q->closed)
+        {
+            pthread_mutex_unlock(&q->mutex);
+            break;
+        }
+
+        q->reads.push_back(s);
+        s = NULL;
+        pthread_cond_signal(&q->not_empty);
+        pthread_mutex_unlock(&q->mutex);
+    }
+
+    if (s) bam_destroy1(s);
+
+    pthread_mutex_lock(&q->mutex);
+    q->done = true;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->mutex);
+
+    return NULL;
+}
+
+/**
+ * Initialize files and intervals.
+ *
+ * @file_names       list of BAM files
+ * @intervals        list of intervals, if empty, all records are selected.
+ * @ref_fasta_file   reference FASTA file for CRAM
+ */
+BAMSyncedReader::BAMSyncedReader(std::vector<std::string>& file_names, std::vector<GenomeInterval>& intervals, std::string ref_fasta_file)
+{
+    this->file_names = file_names;
+    this->intervals = intervals;
+    nfiles = file_names.size();
+
+    if (nfiles==0)
+    {
+        fprintf(stderr, "[E:%s:%d %s] no input BAM files\n", __FILE__, __LINE__, __FUNCTION__);
+        exit(1);
+    }
+
+    for (int32_t i=0; i<nfiles; ++i)
+    {
+        odrs.push_back(new BAMOrderedReader(file_names[i], intervals, ref_fasta_file));
+    }
+    hdr = odrs[0]->hdr;
+
+    //the reads are ordered by the sequence IDs of the first file
+    for (int32_t i=1; i<nfiles; ++i)
+    {
+        bam_hdr_t *h = odrs[i]->hdr;
+        bool consistent = h->n_targets==hdr->n_targets;
+        for (int32_t j=0; consistent && j<hdr->n_targets; ++j)
+        {
+            consistent = strcmp(h->target_name[j], hdr->target_name[j])==0;
+        }
+
+        if (!consistent)
+        {
+            fprintf(stderr, "[E:%s:%d %s] reference sequences of %s differ from %s\n", __FILE__, __LINE__, __FUNCTION__, file_names[i].c_str(), file_names[0].c_str());
+            exit(1);
+        }
+    }
+
+    for (int32_t i=0; i<nfiles; ++i)
+    {
+        queues.push_back(new BAMReadQueue(i, odrs[i], BAM_SYNCED_READER_CAPACITY));
+    }
+
+    heads.resize(nfiles, NULL);
+    last = NULL;
+    last_index = -1;
+    tree = new LoserTree(nfiles, less, this);
+    started = false;
+}
+
+/**
+ * Destructor.
+ */
+BAMSyncedReader::~BAMSyncedReader()
+{
+    close();
+    delete tree;
+}
+
+/**
+ * Compares the heads of the queues.
+ */
+bool BAMSyncedReader::less(void *arg, int32_t i, int32_t j)
+{
+    BAMSyncedReader *sr = (BAMSyncedReader*) arg;
+    bam1_t *a = sr->heads[i];
+    bam1_t *b = sr->heads[j];
+
+    if (!a || !b)
+    {
+        return a ? true : (b ? false : i<j);
+    }
+
+    //unmapped reads with no sequence ID are placed last
+    uint32_t atid = bam_get_tid(a);
+    uint32_t btid = bam_get_tid(b);
+    if (atid!=btid)
+    {
+        return atid<btid;
+    }
+
+    if (a->core.pos!=b->core.pos)
+    {
+        return a->core.pos<b->core.pos;
+    }
+
+    return i<j;
+}
+
+/**
+ * Gets the next read in order of position and the index of its file,
+ * the read is valid till the next call.  Returns false when all files
+ * are read.
+ */
+bool BAMSyncedReader::read(bam1_t*& s, int32_t& file_index)
+{
+    if (!started)
+    {
+        for (int32_t i=0; i<nfiles; ++i)
+        {
+            heads[i] = queues[i]->take();
+        }
+        tree->build();
+        started = true;
+    }
+    else if (last)
+    {
+        queues[last_index]->give_back(last);
+        heads[last_index] = queues[last_index]->take();
+        tree->update();
+    }
+
+    int32_t i = tree->top();
+    if (!heads[i])
+    {
+        last = NULL;
+        return false;
+    }
+
+    last = s = heads[i];
+    last_index = file_index = i;
+
+    return true;
+}
+
+/**
+ * Closes the files.
+ */
+void BAMSyncedReader::close()
+{
+    for (size_t i=0; i<queues.size(); ++i)
+    {
+        queues[i]->close();
+        if (heads[i] && heads[i]!=last) bam_destroy1(heads[i]);
+        heads[i] = NULL;
+        delete queues[i];
+    }
+    queues.clear();
+
+    if (last)
+    {
+        bam_destroy1(last);
+        last = NULL;
+    }
+
+    for (size_t i=0; i<odrs.size(); ++i)
+    {
+        odrs[i]->close();
+        delete odrs[i];
+    }
+    odrs.clear();
+}
@@ -0,0 +1,173 @@
+/* The MIT License
+
+   Copyright (c) 2018 Adrian Tan <atks@umich.edu>
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef BAM_SYNCED_READER_H
+#define BAM_SYNCED_READER_H
+
+#include <deque>
+#include <pthread.h>
+#include "hts_utils.h"
+#include "utils.h"
+#include "genome_interval.h"
+#include "bam_ordered_reader.h"
+#include "loser_tree.h"
+
+#define BAM_SYNCED_READER_CAPACITY 1024
+
+/**
+ * A bounded queue of reads decoded from a BAM file by a worker thread.
+ *
+ * Records are recycled through a pool so that a record is allocated
+ * at most once for every slot in the queue.
+ */
+class BAMReadQueue
+{
+    public:
+
+    int32_t file_index;
+    BAMOrderedReader *odr;
+    uint32_t capacity;
+
+    //decoded reads, oldest in the front
+    std::deque<bam1_t*> reads;
+
+    //records returned by the consumer for reuse
+    std::vector<bam1_t*> pool;
+
+    //for control
+    bool done;
+    bool closed;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+
+    /**
+     * Constructor.
+     */
+    BAMReadQueue(int32_t file_index, BAMOrderedReader *odr, uint32_t capacity);
+
+    /**
+     * Destroys the remaining records.
+     */
+    ~BAMReadQueue();
+
+    /**
+     * Takes the next read, blocks when the queue is empty.
+     * Returns NULL when all reads are decoded and taken.
+     */
+    bam1_t* take();
+
+    /**
+     * Returns a read that was taken for reuse.
+     */
+    void give_back(bam1_t *s);
+
+    /**
+     * Stops the worker thread.
+     */
+    void close();
+
+    /**
+     * Reads the file into the queue, runs in the worker thread.
+     */
+    static void* work(void *arg);
+};
+
+/**
+ * Reads multiple BAM files in a single pass, the reads are returned in
+ * order of position together with the index of their file.
+ *
+ * Each file is decoded in its own thread into a bounded queue and the
+ * heads of the queues are merged with a loser tree, ties are returned in
+ * the order of the files.  The files must share the same reference
+ * sequences.
+ *
+ * A read that overlaps consecutive intervals is returned only for the
+ * first interval.
+ */
+class BAMSyncedReader
+{
+    public:
+
+    ///////
+    //i/o//
+    ///////
+    std::vector<std::string> file_names;
+    int32_t nfiles;
+    std::vector<BAMOrderedReader*> odrs;
+
+    //header of the first file
+    bam_hdr_t *hdr;
+
+    //list of intervals
+    std::vector<GenomeInterval> intervals;
+
+    /**
+     * Initialize files and intervals.
+     *
+     * @file_names       list of BAM files
+     * @intervals        list of intervals, if empty, all records are selected.
+     * @ref_fasta_file   reference FASTA file for CRAM
+     */
+    BAMSyncedReader(std::vector<std::string>& file_names, std::vector<GenomeInterval>& intervals, std::string ref_fasta_file="");
+
+    /**
+     * Destructor.
+     */
+    ~BAMSyncedReader();
+
+    /**
+     * Gets the next read in order of position and the index of its file,
+     * the read is valid till the next call.  Returns false when all files
+     * are read.
+     */
+    bool read(bam1_t*& s, int32_t& file_index);
+
+    /**
+     * Closes the files.
+     */
+    void close();
+
+    private:
+
+    std::vector<BAMReadQueue*> queues;
+
+    //first read of each queue, NULL if the queue is exhausted
+    std::vector<bam1_t*> heads;
+
+    //read returned by the last call to read
+    bam1_t *last;
+    int32_t last_index;
+
+    LoserTree *tree;
+    bool started;
+
+    /**
+     * Compares the heads of the queues.
+     */
+    static bool less(void *arg, int32_t i, int32_t j);
+};
+
+#endif
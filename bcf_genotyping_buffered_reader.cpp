@@ -32,11 +32,13 @@ BCFGenotypingBufferedReader::BCFGenotypingBufferedReader(std::string filename, s
     //io initialization//
     /////////////////////
     odr = new BCFOrderedReader(filename, intervals);
+    v = bcf_init();
 
     //////////////////////////
     //options initialization//
     //////////////////////////
     output_annotations = false;
+    nsamples = 0;
 
     ////////////////////////
     //stats initialization//
@@ -49,12 +51,26 @@ BCFGenotypingBufferedReader::BCFGenotypingBufferedReader(std::string filename, s
     //tools initialization//
     ////////////////////////
     vm = new VariantManip();
-    fai = fai_load(ref_fasta_file.c_str());
-    if (fai==NULL)
+    ref_index = ReferenceIndex::load(ref_fasta_file);
+    if (ref_index==NULL)
     {
         fprintf(stderr, "[%s:%d %s] Cannot load genome index: %s\n", __FILE__, __LINE__, __FUNCTION__, ref_fasta_file.c_str());
         exit(1);
     }
+
+    //mismatches of reads without MD tags are found against the reference
+    as.ref_index = ref_index;
+}
+
+/**
+ * Constructor for genotyping samples jointly, each VCF record is genotyped
+ * in a single record with a slot for every sample.
+ */
+BCFGenotypingBufferedReader::BCFGenotypingBufferedReader(std::string filename, std::vector<GenomeInterval>& intervals, std::string ref_fasta_file, std::vector<double>& contams)
+    : BCFGenotypingBufferedReader(filename, intervals, ref_fasta_file)
+{
+    this->contams = contams;
+    nsamples = contams.size();
 }
 
 /**
@@ -67,55 +83,23 @@ void BCFGenotypingBufferedReader::process_read(bam_hdr_t *h, bam1_t *s)
     //wrap bam1_t in AugmentBAMRecord
     as.initialize(h, s);
 
-    uint32_t tid = bam_get_tid(s);
-    uint32_t beg1 = as.beg1;
-    uint32_t end1 = as.end1;
+    int32_t tid = bam_get_tid(s);
+    int32_t beg1 = as.beg1;
+    int32_t end1 = as.end1;
 
     //collect statistics for variant records that are in the buffer and overlap with the read
     GenotypingRecord* g;
-    for (std::list<GenotypingRecord*>::iterator i=buffer.begin(); i!=buffer.end(); ++i)
+    for (std::deque<GenotypingRecord*>::iterator i=first_record_from(tid, beg1); i!=buffer.end(); ++i)
     {
         g = *i;
 
-//        std::cerr << g->pos1 << " " << g->beg1 << " " << g->end1 << " ";
-
-        //same chromosome
-        if (tid==g->rid)
-        {
-            if (end1 < g->beg1)
-            {
-                //can terminate
-                return;
-            }
-            else if (beg1 > g->end1)
-            {
-                //this should not occur if the buffer was flushed before invoking process read
-                continue;
-            }
-            //else if (beg1 <= g->beg1 && g->end1 <= end1)
-            else if (beg1 <= g->pos1 && g->pos1 <= end1)
-            {
-                collect_sufficient_statistics(*i, as);
-            }
-            else
-            {
-                //other types of overlap, just ignore
-            }
-
-//            std::cerr << "\n";
-        }
-        //prior chromosome
-        else if (tid<g->rid)
+        //VCF record occurs after the read
+        if (tid!=g->rid || end1 < g->pos1)
         {
-            //this should not occur if the buffer was flushed before invoking process read
             return;
         }
-        //latter chromosome
-        else if (tid>g->rid)
-        {
-            //in case if the buffer has a VCF record later in the list which matches it
-            continue;
-        }
+
+        collect_sufficient_statistics(g, as);
     }
 
     //you will only reach here if a read occurs after or overlaps the last record in the buffer
@@ -125,10 +109,11 @@ void BCFGenotypingBufferedReader::process_read(bam_hdr_t *h, bam1_t *s)
     {
         int32_t vtype = vm->classify_variant(odr->hdr, v, variant);
         
-        if (vtype==VT_INDEL)
-        {    
-            g = new GenotypingRecord(odr->hdr, v, 10, 2);
+        if (vtype!=VT_INDEL)
+        {
+            continue;
         }
+        g = new GenotypingRecord(odr->hdr, v, 10, 2);
         buffer.push_back(g);
 
         if (tid==g->rid)
@@ -180,8 +165,8 @@ void BCFGenotypingBufferedReader::process_read(bam_hdr_t *h, bam1_t *s)
 //            int32_t cycle = 0;
 //
 //            std::vector<uint32_t>& aug_cigar = as.aug_cigar;
-//            std::vector<std::string>& aug_ref = as.aug_ref;
-//            std::vector<std::string>& aug_alt = as.aug_alt;
+//            std::vector<AugmentedSeq>& aug_ref = as.aug_ref;
+//            std::vector<AugmentedSeq>& aug_alt = as.aug_alt;
 //
 //            int32_t vpos1 = g->pos1;
 //            int32_t cpos1 = bam_get_pos1(s);
@@ -324,8 +309,8 @@ void BCFGenotypingBufferedReader::process_read(bam_hdr_t *h, bam1_t *s)
 //                uint32_t cycle = 10;
 //
 //                std::vector<uint32_t>& aug_cigar = as.aug_cigar;
-//                std::vector<std::string>& aug_ref = as.aug_ref;
-//                std::vector<std::string>& aug_alt = as.aug_alt;
+//                std::vector<AugmentedSeq>& aug_ref = as.aug_ref;
+//                std::vector<AugmentedSeq>& aug_alt = as.aug_alt;
 //
 //                int32_t vpos1 = g->pos1;
 //
@@ -515,8 +500,8 @@ void BCFGenotypingBufferedReader::process_read(bam_hdr_t *h, bam1_t *s)
 //        uint8_t mapq = bam_get_mapq(s);
 //
 //        std::vector<uint32_t>& aug_cigar = as.aug_cigar;
-//        std::vector<std::string>& aug_ref = as.aug_ref;
-//        std::vector<std::string>& aug_alt = as.aug_alt;
+//        std::vector<AugmentedSeq>& aug_ref = as.aug_ref;
+//        std::vector<AugmentedSeq>& aug_alt = as.aug_alt;
 //
 //        //genomic bookend positions of VNTR
 //        int32_t vpos1 = g->beg1-1;
@@ -631,8 +616,7 @@ void BCFGenotypingBufferedReader::collect_sufficient_statistics(GenotypingRecord
             int32_t cycle = 0;
 
             std::vector<uint32_t>& aug_cigar = as.aug_cigar;
-            std::vector<std::string>& aug_ref = as.aug_ref;
-            std::vector<std::string>& aug_alt = as.aug_alt;
+            std::vector<AugmentedSeq>& aug_alt = as.aug_alt;
 
             int32_t vpos1 = g->pos1;
             int32_t cpos1 = bam_get_pos1(s);
@@ -761,8 +745,7 @@ void BCFGenotypingBufferedReader::collect_sufficient_statistics(GenotypingRecord
             int32_t cycle = 0;
 
             std::vector<uint32_t>& aug_cigar = as.aug_cigar;
-            std::vector<std::string>& aug_ref = as.aug_ref;
-            std::vector<std::string>& aug_alt = as.aug_alt;
+            std::vector<AugmentedSeq>& aug_alt = as.aug_alt;
 
             int32_t vpos1 = g->pos1;
             int32_t cpos1 = bam_get_pos1(s);
@@ -900,8 +883,7 @@ void BCFGenotypingBufferedReader::collect_sufficient_statistics(GenotypingRecord
                 uint32_t cycle = 10;
 
                 std::vector<uint32_t>& aug_cigar = as.aug_cigar;
-                std::vector<std::string>& aug_ref = as.aug_ref;
-                std::vector<std::string>& aug_alt = as.aug_alt;
+                std::vector<AugmentedSeq>& aug_alt = as.aug_alt;
 
                 int32_t vpos1 = g->pos1;
 
@@ -1068,7 +1050,7 @@ void BCFGenotypingBufferedReader::collect_sufficient_statistics(GenotypingRecord
 
                         if (cpos1-1==end1)
                         {
-                            observed_allele.append(aug_alt[i]);
+                            observed_allele.append(aug_alt[i].s, aug_alt[i].l);
                             cycle = strand == 'F' ? (rpos0+1) : (rlen - rpos0);
                         }
 
@@ -1185,8 +1167,7 @@ void BCFGenotypingBufferedReader::collect_sufficient_statistics(GenotypingRecord
                 uint32_t cycle = 10;
 
                 std::vector<uint32_t>& aug_cigar = as.aug_cigar;
-                std::vector<std::string>& aug_ref = as.aug_ref;
-                std::vector<std::string>& aug_alt = as.aug_alt;
+                std::vector<AugmentedSeq>& aug_alt = as.aug_alt;
 
                 int32_t vpos1 = g->pos1;
 
@@ -1353,7 +1334,7 @@ void BCFGenotypingBufferedReader::collect_sufficient_statistics(GenotypingRecord
 
                         if (cpos1-1==end1)
                         {
-                            observed_allele.append(aug_alt[i]);
+                            observed_allele.append(aug_alt[i].s, aug_alt[i].l);
                             cycle = strand == 'F' ? (rpos0+1) : (rlen - rpos0);
                         }
 
@@ -1463,8 +1444,6 @@ void BCFGenotypingBufferedReader::collect_sufficient_statistics(GenotypingRecord
         uint8_t mapq = bam_get_mapq(s);
 
         std::vector<uint32_t>& aug_cigar = as.aug_cigar;
-        std::vector<std::string>& aug_ref = as.aug_ref;
-        std::vector<std::string>& aug_alt = as.aug_alt;
 
         //genomic bookend positions of VNTR
         int32_t vpos1 = g->beg1-1;
@@ -1577,8 +1556,7 @@ void BCFGenotypingBufferedReader::collect_sufficient_statistics(GenotypingRecord
                 uint32_t cycle = 10;
 
                 std::vector<uint32_t>& aug_cigar = as.aug_cigar;
-                std::vector<std::string>& aug_ref = as.aug_ref;
-                std::vector<std::string>& aug_alt = as.aug_alt;
+                std::vector<AugmentedSeq>& aug_alt = as.aug_alt;
 
                 int32_t vpos1 = g->pos1;
 
@@ -1745,7 +1723,7 @@ void BCFGenotypingBufferedReader::collect_sufficient_statistics(GenotypingRecord
 
                         if (cpos1-1==end1)
                         {
-                            observed_allele.append(aug_alt[i]);
+                            observed_allele.append(aug_alt[i].s, aug_alt[i].l);
                             cycle = strand == 'F' ? (rpos0+1) : (rlen - rpos0);
                         }
 
@@ -1847,6 +1825,137 @@ void BCFGenotypingBufferedReader::collect_sufficient_statistics(GenotypingRecord
     }
 }
 
+/**
+ * Collects sufficient statistics from read of a sample for variants to be genotyped,
+ * the reads of all the samples are expected in order of position.
+ */
+void BCFGenotypingBufferedReader::process_read(bam_hdr_t *h, bam1_t *s, int32_t sample_index)
+{
+    as.initialize(h, s);
+
+    int32_t tid = bam_get_tid(s);
+    int32_t beg1 = as.beg1;
+    int32_t end1 = as.end1;
+    double contam = contams[sample_index];
+
+    //collect statistics for variant records that are in the buffer and overlap with the read
+    GenotypingRecord* g;
+    for (std::deque<GenotypingRecord*>::iterator i=first_record_from(tid, beg1); i!=buffer.end(); ++i)
+    {
+        g = *i;
+
+        if (tid!=g->rid || end1 < g->pos1)
+        {
+            return;
+        }
+
+        g->process_read(as, sample_index, contam);
+    }
+
+    //add VCF records up to the first record after the read
+    while (odr->read(v))
+    {
+        g = create_genotyping_record(odr->hdr, v, 2);
+        buffer.push_back(g);
+
+        if (tid==g->rid && beg1 <= g->pos1 && g->pos1 <= end1)
+        {
+            g->process_read(as, sample_index, contam);
+        }
+
+        if (tid < g->rid || (tid==g->rid && end1 < g->beg1))
+        {
+            break;
+        }
+    }
+}
+
+/**
+ * Creates a genotyping record for samples genotyped jointly.
+ * Exits if the variant type is not genotyped jointly.
+ */
+GenotypingRecord* BCFGenotypingBufferedReader::create_genotyping_record(bcf_hdr_t *h, bcf1_t *v, int32_t ploidy)
+{
+    int32_t vtype = vm->classify_variant(h, v, variant);
+
+    if (vtype!=VT_SNP && !(vtype==VT_INDEL && bcf_get_n_allele(v)==2))
+    {
+        std::string type = vtype==VT_INDEL ? "multiallelic INDEL" : Variant::vtype2string(vtype);
+        fprintf(stderr, "[%s:%d %s] %s sites cannot be genotyped jointly, remove %s:%d from the candidate variants or genotype the samples separately\n", __FILE__, __LINE__, __FUNCTION__, type.c_str(), bcf_get_chrom(h, v), bcf_get_pos1(v));
+        exit(1);
+    }
+
+    return acquire_record(vtype, h, v, nsamples, ploidy);
+}
+
+/**
+ * Returns a SNP or Indel genotyping record for a VCF record,
+ * a flushed record of the same type is reused if available.
+ */
+GenotypingRecord* BCFGenotypingBufferedReader::acquire_record(int32_t vtype, bcf_hdr_t *h, bcf1_t *v, int32_t nsamples, int32_t ploidy)
+{
+    std::vector<GenotypingRecord*>& pool = vtype==VT_SNP ? snp_pool : indel_pool;
+    if (pool.size())
+    {
+        GenotypingRecord* g = pool.back();
+        pool.pop_back();
+        g->initialize(h, v, nsamples, ploidy);
+        return g;
+    }
+
+    if (vtype==VT_SNP)
+    {
+        return new SNPGenotypingRecord(h, v, nsamples, ploidy, NULL);
+    }
+    else
+    {
+        return new IndelGenotypingRecord(h, v, nsamples, ploidy);
+    }
+}
+
+/**
+ * Deletes a flushed record or keeps it for reuse.
+ */
+void BCFGenotypingBufferedReader::recycle(GenotypingRecord* g)
+{
+    if (nsamples && g->vtype==VT_SNP)
+    {
+        snp_pool.push_back(g);
+    }
+    else if (nsamples && g->vtype==VT_INDEL)
+    {
+        indel_pool.push_back(g);
+    }
+    else
+    {
+        delete g;
+    }
+}
+
+/**
+ * Returns the first record in the buffer at or after a position.
+ */
+std::deque<GenotypingRecord*>::iterator BCFGenotypingBufferedReader::first_record_from(int32_t rid, int32_t pos1)
+{
+    size_t lo = 0;
+    size_t hi = buffer.size();
+    while (lo<hi)
+    {
+        size_t mid = (lo+hi)>>1;
+        GenotypingRecord* g = buffer[mid];
+        if (g->rid<rid || (g->rid==rid && g->pos1<pos1))
+        {
+            lo = mid+1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return buffer.begin()+lo;
+}
+
 /**
  * Flush records.
  */
@@ -1855,26 +1964,28 @@ void BCFGenotypingBufferedReader::flush(BCFOrderedWriter* odw, bam_hdr_t *h, bam
     if (flush_all)
     {
         //read all the remaining from the reference genotyping file
-        bcf1_t *v = bcf_init();
         while (odr->read(v))
         {
+            if (nsamples)
+            {
+                buffer.push_back(create_genotyping_record(odr->hdr, v, 2));
+                continue;
+            }
+
             int32_t vtype = vm->classify_variant(odr->hdr, v, variant);
-            GenotypingRecord* g;
             if (vtype==VT_INDEL)
             {
-                g = new IndelGenotypingRecord(odr->hdr, v, 10, 2);
+                buffer.push_back(new IndelGenotypingRecord(odr->hdr, v, 10, 2));
+                v = bcf_init();
             }
-            buffer.push_back(g);
-            v = bcf_init();
         }
-        bcf_destroy(v);
 
         GenotypingRecord* g;
         while (!buffer.empty())
         {
             g = buffer.front();
             genotype_and_print(odw, g);
-            delete g;
+            recycle(g);
             buffer.pop_front();
         }
     }
@@ -1882,7 +1993,7 @@ void BCFGenotypingBufferedReader::flush(BCFOrderedWriter* odw, bam_hdr_t *h, bam
     {
         //std::cerr << "partial flush\n";
 
-        uint32_t tid = bam_get_tid(s);
+        int32_t tid = bam_get_tid(s);
         GenotypingRecord* g;
 
         while (!buffer.empty())
@@ -1894,7 +2005,7 @@ void BCFGenotypingBufferedReader::flush(BCFOrderedWriter* odw, bam_hdr_t *h, bam
                 if (bam_get_pos1(s) > g->end1)
                 {
                     genotype_and_print(odw, g);
-                    delete g;
+                    recycle(g);
                     buffer.pop_front();
                 }
                 else
@@ -1905,7 +2016,7 @@ void BCFGenotypingBufferedReader::flush(BCFOrderedWriter* odw, bam_hdr_t *h, bam
             else if (tid>g->rid)
             {
                 genotype_and_print(odw, g);
-                delete g;
+                recycle(g);
                 buffer.pop_front();
             }
             else
@@ -2291,6 +2402,25 @@ void BCFGenotypingBufferedReader::compute_indel_al(char lflank_state[], uint32_t
  */
 void BCFGenotypingBufferedReader::genotype_and_print(BCFOrderedWriter* odw, GenotypingRecord* g)
 {
+    if (nsamples)
+    {
+        g->flush_samples(contams);
+        bcf1_t *nv = g->flush_variant(odw->hdr);
+        odw->write(nv);
+        bcf_destroy(nv);
+
+        if (g->vtype==VT_SNP)
+        {
+            ++no_snps_genotyped;
+        }
+        else if (g->vtype==VT_INDEL)
+        {
+            ++no_indels_genotyped;
+        }
+
+        return;
+    }
+
     if (g->vtype==VT_SNP)
     {
         bcf1_t *v = bcf_init();
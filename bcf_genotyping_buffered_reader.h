@@ -24,10 +24,12 @@
 #ifndef BCF_GENOTYPING_BUFFERED_READER_H
 #define BCF_GENOTYPING_BUFFERED_READER_H
 
+#include <deque>
 #include "hts_utils.h"
 #include "utils.h"
 #include "genotyping_record.h"
 #include "indel_genotyping_record.h"
+#include "snp_genotyping_record.h"
 #include "bcf_ordered_reader.h"
 #include "variant.h"
 #include "variant_manip.h"
@@ -53,7 +55,12 @@ class BCFGenotypingBufferedReader
     //////////////////
     //buffer related//
     //////////////////
-    std::list<GenotypingRecord*> buffer;
+    //records in order of position, searched by binary search for the reads
+    std::deque<GenotypingRecord*> buffer;
+    //flushed records kept for reuse when samples are genotyped jointly
+    std::vector<GenotypingRecord*> snp_pool;
+    std::vector<GenotypingRecord*> indel_pool;
+    bcf1_t *v;
     std::string chrom;
     AugmentedBAMRecord as;
 
@@ -64,6 +71,10 @@ class BCFGenotypingBufferedReader
     ///////////
     bool output_annotations;
 
+    //when samples are genotyped jointly, the contamination fraction of each sample
+    int32_t nsamples;
+    std::vector<double> contams;
+
     /////////
     //stats//
     /////////
@@ -76,18 +87,52 @@ class BCFGenotypingBufferedReader
     /////////
     VariantManip *vm;
     LogTool lt;
-    faidx_t *fai;
+    ReferenceIndex *ref_index;
 
     /**
      * Constructor.
      */
     BCFGenotypingBufferedReader(std::string filename, std::vector<GenomeInterval>& intervals, std::string ref_fasta_file);
 
+    /**
+     * Constructor for genotyping samples jointly, each VCF record is genotyped
+     * in a single record with a slot for every sample.
+     */
+    BCFGenotypingBufferedReader(std::string filename, std::vector<GenomeInterval>& intervals, std::string ref_fasta_file, std::vector<double>& contams);
+
     /**
      * Collects sufficient statistics from read for variants to be genotyped.
      */
     void process_read(bam_hdr_t *h, bam1_t *s);
 
+    /**
+     * Collects sufficient statistics from read of a sample for variants to be genotyped,
+     * the reads of all the samples are expected in order of position.
+     */
+    void process_read(bam_hdr_t *h, bam1_t *s, int32_t sample_index);
+
+    /**
+     * Creates a genotyping record for samples genotyped jointly.
+     * Exits if the variant type is not genotyped jointly.
+     */
+    GenotypingRecord* create_genotyping_record(bcf_hdr_t *h, bcf1_t *v, int32_t ploidy);
+
+    /**
+     * Returns a SNP or Indel genotyping record for a VCF record,
+     * a flushed record of the same type is reused if available.
+     */
+    GenotypingRecord* acquire_record(int32_t vtype, bcf_hdr_t *h, bcf1_t *v, int32_t nsamples, int32_t ploidy);
+
+    /**
+     * Deletes a flushed record or keeps it for reuse.
+     */
+    void recycle(GenotypingRecord* g);
+
+    /**
+     * Returns the first record in the buffer at or after a position.
+     */
+    std::deque<GenotypingRecord*>::iterator first_record_from(int32_t rid, int32_t pos1);
+
     /**
      * Compute SNP genotype likelihoods in PHRED scale.
      */
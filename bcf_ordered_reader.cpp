@@ -28,19 +28,11 @@
  *
  * @input_vcf_file_name     name of the input VCF file
  * @intervals               list of intervals, if empty, all records are selected.
- * 
- * todo: add option for comparing if only beg1 overlaps with the interval
- *       this allows a mechanism such that cut up files do not contain 
- *       a variant that straddles across a boundary in 2 separate files
- *       resulting in duplicates when you concatenate the files again.
- *
- *       might be a good idea to implement this only in a specifc program that
- *       cuts up such files but it is also common to perform the cutting up by
- *       selection via index.  
- *
- *       option1 : chr1:2000-3000 is a pure overlap 
- *                 chr1:2000+3000 considers only start positions?
  *
+ * Records overlapping the intervals are selected, set_interval_start_only()
+ * restricts this to records beginning in the intervals so that cut up files
+ * do not contain a variant that straddles across a boundary in 2 separate
+ * files resulting in duplicates when you concatenate the files again.
  */
 BCFOrderedReader::BCFOrderedReader(std::string file_name, std::vector<GenomeInterval>& intervals)
 {
@@ -57,6 +49,34 @@ BCFOrderedReader::BCFOrderedReader(std::string file_name, std::vector<GenomeInte
     this->intervals = intervals;
     interval_index = 0;
     index_loaded = false;
+    interval_start_only = false;
+    max_unpack = 0;
+    intervals_present = false;
+    random_access_enabled = false;
+
+    prefetch_enabled = false;
+    prefetch_eof = false;
+    prefetch_stop = false;
+    prefetch_head = 0;
+    prefetch_size = 0;
+
+    s = {0, 0, 0};
+
+    if ((pipe = BCFPipe::get_pipe(this->file_name)))
+    {
+        if (intervals.size())
+        {
+            fprintf(stderr, "[%s:%d %s] Intervals are ignored when reading from %s\n", __FILE__, __LINE__, __FUNCTION__, file_name.c_str());
+        }
+        ftype.format = bcf;
+        ftype.compression = no_compression;
+        if (!(hdr = pipe->read_hdr()))
+        {
+            fprintf(stderr, "[%s:%d %s] Unable to read in header: %s\n", __FILE__, __LINE__, __FUNCTION__, file_name.c_str());
+            exit(1);
+        }
+        return;
+    }
 
     file = hts_open(this->file_name.c_str(), "r");
     if (!file)
@@ -71,8 +91,8 @@ BCFOrderedReader::BCFOrderedReader(std::string file_name, std::vector<GenomeInte
         fprintf(stderr, "[%s:%d %s] Not a VCF/BCF file: %s\n", __FILE__, __LINE__, __FUNCTION__, file_name.c_str());
         exit(1);
     }
+    hts_attach_shared_thread_pool(file);
 
-    s = {0, 0, 0};
     hdr = bcf_alt_hdr_read(file);
     if (!hdr) 
     {
@@ -84,7 +104,8 @@ BCFOrderedReader::BCFOrderedReader(std::string file_name, std::vector<GenomeInte
 
     if (ftype.format==bcf)
     {
-        if ((idx = bcf_index_load(file_name.c_str())))
+        //uncompressed BCF files cannot be indexed
+        if (ftype.compression==bgzf && (idx = bcf_index_load(file_name.c_str())))
         {
             index_loaded = true;
         }
@@ -139,8 +160,12 @@ BCFOrderedReader::~BCFOrderedReader()
  */
 bool BCFOrderedReader::jump_to_interval(GenomeInterval& interval)
 {
+    bool jumped = false;
+
     if (index_loaded)
     {
+        stop_prefetch();
+
         intervals_present = true;
         random_access_enabled = true;
         intervals.clear();
@@ -152,10 +177,7 @@ bool BCFOrderedReader::jump_to_interval(GenomeInterval& interval)
             hts_itr_destroy(itr);
             itr = NULL;
             itr = bcf_itr_querys(idx, hdr, s.s);
-            if (itr)
-            {
-                return true;
-            }
+            jumped = itr!=NULL;
         }
         else if (ftype.format==vcf && ftype.compression==bgzf)
         {
@@ -163,16 +185,36 @@ bool BCFOrderedReader::jump_to_interval(GenomeInterval& interval)
             hts_itr_destroy(itr);
             itr = NULL;
             itr = tbx_itr_querys(tbx, s.s);
-            if (itr)
-            {
-                return true;
-            }
+            jumped = itr!=NULL;
         }
+
+        if (prefetch_enabled) start_prefetch();
     }
 
-    return false;
+    return jumped;
 };
 
+/**
+ * Selects only records that begin in an interval instead of all records
+ * that overlap it.  This ensures that a record straddling the boundary
+ * of adjacent intervals is read exactly once.
+ */
+void BCFOrderedReader::set_interval_start_only(bool interval_start_only)
+{
+    this->interval_start_only = interval_start_only;
+}
+
+/**
+ * Limits the fields parsed from VCF records to BCF_UN_STR, BCF_UN_FLT,
+ * BCF_UN_INFO or BCF_UN_FMT, the remaining fields are skipped and are not
+ * available in the records read.  BCF records are not affected as
+ * they are unpacked on demand.
+ */
+void BCFOrderedReader::set_max_unpack(int32_t max_unpack)
+{
+    this->max_unpack = max_unpack;
+}
+
 /**
  * Gets sequence name of a record.
  */
@@ -237,6 +279,192 @@ bool BCFOrderedReader::initialize_next_interval()
  */
 bool BCFOrderedReader::read(bcf1_t *v)
 {
+    if (pipe)
+    {
+        bcf1_t *u = pipe->read();
+        if (!u) return false;
+
+        //swap contents with the record from the pipe
+        bcf1_t t = *v;
+        *v = *u;
+        *u = t;
+        bcf_destroy(u);
+
+        return true;
+    }
+
+    if (!prefetch_enabled)
+    {
+        return read_next(v);
+    }
+
+    pthread_mutex_lock(&prefetch_mutex);
+    while (!prefetch_size && !prefetch_eof)
+    {
+        pthread_cond_wait(&prefetch_not_empty, &prefetch_mutex);
+    }
+
+    if (!prefetch_size)
+    {
+        pthread_mutex_unlock(&prefetch_mutex);
+        return false;
+    }
+
+    //swap contents with the prefetched record and recycle the latter
+    bcf1_t *u = prefetch_buffer[prefetch_head];
+    prefetch_head = (prefetch_head+1) % prefetch_buffer.size();
+    --prefetch_size;
+    bcf1_t t = *v;
+    *v = *u;
+    *u = t;
+    pool.push_back(u);
+
+    pthread_cond_signal(&prefetch_not_full);
+    pthread_mutex_unlock(&prefetch_mutex);
+
+    return true;
+};
+
+/**
+ * Starts prefetching records in a background thread.
+ * Records are parsed ahead into a ring buffer of the
+ * given capacity and swapped out by read().
+ *
+ * The background thread decodes records against hdr, so
+ * the caller must not modify hdr or a header linked to it
+ * while prefetching.  For VCF files, the header should also
+ * define all INFO and FORMAT fields as htslib updates the
+ * header when an undefined field is parsed.
+ *
+ * @capacity - maximum number of records read ahead
+ */
+void BCFOrderedReader::enable_prefetch(uint32_t capacity)
+{
+    if (prefetch_enabled || !file) return;
+
+    //fields appended to the header must be available before records are decoded ahead
+    if (bcf_hdr_sync(hdr))
+    {
+        fprintf(stderr, "[%s:%d %s] syncing of header failed.\n", __FILE__, __LINE__, __FUNCTION__);
+        exit(1);
+    }
+
+    pthread_mutex_init(&prefetch_mutex, NULL);
+    pthread_cond_init(&prefetch_not_empty, NULL);
+    pthread_cond_init(&prefetch_not_full, NULL);
+    prefetch_buffer.resize(capacity ? capacity : 1, NULL);
+    prefetch_enabled = true;
+
+    start_prefetch();
+}
+
+/**
+ * Stops the background thread and returns prefetched records to the pool.
+ */
+void BCFOrderedReader::disable_prefetch()
+{
+    if (!prefetch_enabled) return;
+
+    stop_prefetch();
+    pthread_mutex_destroy(&prefetch_mutex);
+    pthread_cond_destroy(&prefetch_not_empty);
+    pthread_cond_destroy(&prefetch_not_full);
+    prefetch_buffer.clear();
+    prefetch_enabled = false;
+}
+
+/**
+ * Starts the background thread.
+ */
+void BCFOrderedReader::start_prefetch()
+{
+    prefetch_head = 0;
+    prefetch_size = 0;
+    prefetch_eof = false;
+    prefetch_stop = false;
+
+    if (pthread_create(&prefetch_thread, NULL, prefetch, this))
+    {
+        fprintf(stderr, "[%s:%d %s] Cannot create prefetch thread for %s\n", __FILE__, __LINE__, __FUNCTION__, file_name.c_str());
+        exit(1);
+    }
+}
+
+/**
+ * Stops the background thread, prefetched records are returned to the pool.
+ */
+void BCFOrderedReader::stop_prefetch()
+{
+    if (!prefetch_enabled) return;
+
+    pthread_mutex_lock(&prefetch_mutex);
+    prefetch_stop = true;
+    pthread_cond_signal(&prefetch_not_full);
+    pthread_mutex_unlock(&prefetch_mutex);
+    pthread_join(prefetch_thread, NULL);
+
+    while (prefetch_size)
+    {
+        pool.push_back(prefetch_buffer[prefetch_head]);
+        prefetch_head = (prefetch_head+1) % prefetch_buffer.size();
+        --prefetch_size;
+    }
+}
+
+/**
+ * Fills the ring buffer, run by the background thread.
+ */
+void* BCFOrderedReader::prefetch(void *arg)
+{
+    BCFOrderedReader *odr = (BCFOrderedReader*) arg;
+    uint32_t capacity = odr->prefetch_buffer.size();
+
+    pthread_mutex_lock(&odr->prefetch_mutex);
+    while (true)
+    {
+        while (odr->prefetch_size==capacity && !odr->prefetch_stop)
+        {
+            pthread_cond_wait(&odr->prefetch_not_full, &odr->prefetch_mutex);
+        }
+
+        if (odr->prefetch_stop) break;
+
+        bcf1_t *v = NULL;
+        if (!odr->pool.empty())
+        {
+            v = odr->pool.front();
+            odr->pool.pop_front();
+        }
+        pthread_mutex_unlock(&odr->prefetch_mutex);
+
+        if (!v) v = bcf_init1();
+        bool read = odr->read_next(v);
+
+        pthread_mutex_lock(&odr->prefetch_mutex);
+        if (!read)
+        {
+            odr->pool.push_back(v);
+            odr->prefetch_eof = true;
+            pthread_cond_signal(&odr->prefetch_not_empty);
+            break;
+        }
+
+        odr->prefetch_buffer[(odr->prefetch_head+odr->prefetch_size) % capacity] = v;
+        ++odr->prefetch_size;
+        pthread_cond_signal(&odr->prefetch_not_empty);
+    }
+    pthread_mutex_unlock(&odr->prefetch_mutex);
+
+    return NULL;
+}
+
+/**
+ * Reads next record on the calling thread.
+ */
+bool BCFOrderedReader::read_next(bcf1_t *v)
+{
+    v->max_unpack = max_unpack;
+
     if (random_access_enabled)
     {
         if (ftype.format==bcf)
@@ -245,6 +473,11 @@ bool BCFOrderedReader::read(bcf1_t *v)
             {
                 if (itr && bcf_itr_next(file, itr, v)>=0)
                 {
+                    if (interval_start_only && bcf_get_pos1(v)<intervals[interval_index-1].start1)
+                    {
+                        continue;
+                    }
+
                     return true;
                 }
                 else if (!initialize_next_interval())
@@ -260,6 +493,12 @@ bool BCFOrderedReader::read(bcf1_t *v)
                 if (itr && tbx_itr_next(file, tbx, itr, &s)>=0)
                 {
                     vcf_parse1(&s, hdr, v);
+
+                    if (interval_start_only && bcf_get_pos1(v)<intervals[interval_index-1].start1)
+                    {
+                        continue;
+                    }
+
                     return true;
                 }
                 else if (!initialize_next_interval())
@@ -302,6 +541,19 @@ bool BCFOrderedReader::read(bcf1_t *v)
  */
 void BCFOrderedReader::close()
 {
+    if (pipe)
+    {
+        pipe->close_read();
+        pipe = NULL;
+    }
+
+    disable_prefetch();
+    while (!pool.empty())
+    {
+        bcf_destroy(pool.front());
+        pool.pop_front();
+    }
+
     if (file && bcf_close(file))
     {
         fprintf(stderr, "[%s:%d %s] Cannot close %s\n", __FILE__, __LINE__, __FUNCTION__, file_name.c_str());
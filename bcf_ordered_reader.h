@@ -24,9 +24,13 @@
 #ifndef BCF_ORDERED_READER_H
 #define BCF_ORDERED_READER_H
 
+#include <pthread.h>
 #include "hts_utils.h"
 #include "utils.h"
 #include "genome_interval.h"
+#include "bcf_pipe.h"
+
+#define BCF_PREFETCH_CAPACITY 64
 
 /**
  * A class for reading ordered VCF/BCF files.
@@ -49,6 +53,14 @@
  * This class hides the handling of indices from
  * the user and also allows for the selection of
  * records in intervals in both cases 1 and 2.
+ *
+ * Records may optionally be prefetched by a background
+ * thread into a bounded ring buffer so that I/O and parsing
+ * overlap with the processing of records by the caller.
+ * Prefetching is opt-in through enable_prefetch().
+ *
+ * When the file name refers to a BCFPipe, records are read
+ * from the pipe instead of a file.
  */
 
 class BCFOrderedReader
@@ -65,12 +77,15 @@ class BCFOrderedReader
     tbx_t *tbx;
     hts_itr_t *itr;
     bcf1_t *v;
+    BCFPipe *pipe;
 
     //for control
     htsFormat ftype;
     bool intervals_present;
     bool index_loaded;
     bool random_access_enabled;
+    bool interval_start_only;
+    int32_t max_unpack;
 
     //for checks
     int32_t last_rid;
@@ -83,6 +98,18 @@ class BCFOrderedReader
     //for storing unused bcf records
     std::list<bcf1_t*> pool;
 
+    //for prefetching records in a background thread
+    bool prefetch_enabled;
+    bool prefetch_eof;
+    bool prefetch_stop;
+    std::vector<bcf1_t*> prefetch_buffer;
+    uint32_t prefetch_head;
+    uint32_t prefetch_size;
+    pthread_t prefetch_thread;
+    pthread_mutex_t prefetch_mutex;
+    pthread_cond_t prefetch_not_empty;
+    pthread_cond_t prefetch_not_full;
+
     //shared objects for string manipulation
     kstring_t s;
 
@@ -112,10 +139,39 @@ class BCFOrderedReader
     bool read(bcf1_t *v);
 
     /**
-    * Initialize next interval.
-    * Returns false only if all intervals are accessed.
-    */
-    bool initialize_next_interval();
+     * Selects only records that begin in an interval instead of all records
+     * that overlap it.  This ensures that a record straddling the boundary
+     * of adjacent intervals is read exactly once.
+     */
+    void set_interval_start_only(bool interval_start_only);
+
+    /**
+     * Limits the fields parsed from VCF records to BCF_UN_STR, BCF_UN_FLT,
+     * BCF_UN_INFO or BCF_UN_FMT, the remaining fields are skipped and are not
+     * available in the records read.  BCF records are not affected as
+     * they are unpacked on demand.
+     */
+    void set_max_unpack(int32_t max_unpack);
+
+    /**
+     * Starts prefetching records in a background thread.
+     * Records are parsed ahead into a ring buffer of the
+     * given capacity and swapped out by read().
+     *
+     * The background thread decodes records against hdr, so
+     * the caller must not modify hdr or a header linked to it
+     * while prefetching.  For VCF files, the header should also
+     * define all INFO and FORMAT fields as htslib updates the
+     * header when an undefined field is parsed.
+     *
+     * @capacity - maximum number of records read ahead
+     */
+    void enable_prefetch(uint32_t capacity=BCF_PREFETCH_CAPACITY);
+
+    /**
+     * Stops the background thread and returns prefetched records to the pool.
+     */
+    void disable_prefetch();
 
     /**
      * Gets sequence name of a record.
@@ -138,6 +194,32 @@ class BCFOrderedReader
     void close();
 
     private:
+
+    /**
+    * Initialize next interval.
+    * Returns false only if all intervals are accessed.
+    */
+    bool initialize_next_interval();
+
+    /**
+     * Reads next record on the calling thread.
+     */
+    bool read_next(bcf1_t *v);
+
+    /**
+     * Stops the background thread, prefetched records are returned to the pool.
+     */
+    void stop_prefetch();
+
+    /**
+     * Starts the background thread.
+     */
+    void start_prefetch();
+
+    /**
+     * Fills the ring buffer, run by the background thread.
+     */
+    static void* prefetch(void *arg);
 };
 
 #endif
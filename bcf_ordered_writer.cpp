@@ -27,8 +27,25 @@ BCFOrderedWriter::BCFOrderedWriter(std::string output_vcf_file_name, int32_t win
 {
     this->file_name = output_vcf_file_name;
     this->window = window;
+    adaptive_window = false;
+    initial_window = window;
+    max_window = BCF_ORDERED_WRITER_MAX_WINDOW;
+    buffer_rid = -1;
+    buffer_max_pos1 = 0;
+    buffer_order = 0;
+    last_written_rid = -1;
+    last_written_pos1 = 0;
     file = NULL;
 
+    hdr = bcf_hdr_init("w");
+    bcf_hdr_set_version(hdr, "VCFv4.2");
+    linked_hdr = false;
+
+    if ((pipe = BCFPipe::get_pipe(file_name)))
+    {
+        return;
+    }
+
     kstring_t mode = {0,0,0};
     kputc('w', &mode);
 
@@ -88,10 +105,21 @@ BCFOrderedWriter::BCFOrderedWriter(std::string output_vcf_file_name, int32_t win
         fprintf(stderr, "[%s:%d %s] Cannot open VCF/BCF file for writing: %s\n", __FILE__,__LINE__,__FUNCTION__, file_name.c_str());
         exit(1);
     }
+    hts_attach_shared_thread_pool(file);
+    if (mode.m) free(mode.s);
+}
 
-    hdr = bcf_hdr_init("w");
-    bcf_hdr_set_version(hdr, "VCFv4.2");
-    linked_hdr = false;
+/**
+ * Sets adaptive window mode.  When a record arrives that is further than the
+ * window size behind the furthest buffered record, the window is enlarged
+ * instead of only warning that the output might not be sorted.  The window
+ * is not enlarged beyond max_window and shrinks back to its initial size
+ * when the buffer is flushed.
+ */
+void BCFOrderedWriter::set_adaptive_window(bool adaptive_window, int32_t max_window)
+{
+    this->adaptive_window = adaptive_window;
+    this->max_window = std::max(max_window, initial_window);
 }
 
 /**
@@ -125,7 +153,20 @@ void BCFOrderedWriter::link_hdr(bcf_hdr_t *hdr)
  */
 void BCFOrderedWriter::write_hdr()
 {
-    if (bcf_hdr_write(file, hdr))
+    if (pipe)
+    {
+        //as in bcf_hdr_write, fields appended to the header are made available
+        if (bcf_hdr_sync(hdr))
+        {
+            fprintf(stderr, "[%s:%d %s] syncing of header failed.\n",
+                                              __FILE__,
+                                              __LINE__,
+                                              __FUNCTION__);
+            exit(1);
+        }
+        pipe->write_hdr(hdr);
+    }
+    else if (bcf_hdr_write(file, hdr))
     {
         fprintf(stderr, "[%s:%d %s] writing of header failed.\n",
                                           __FILE__,
@@ -143,58 +184,89 @@ void BCFOrderedWriter::write(bcf1_t *v)
     //place into appropriate position in the buffer
     if (window)
     {
-        if (!buffer.empty())
+        int32_t rid = bcf_get_rid(v);
+        int32_t pos1 = bcf_get_pos1(v);
+
+        if (!buffer.empty() && rid!=buffer_rid)
         {
-            if (bcf_get_rid(v)==bcf_get_rid(buffer.back()))
-            {
-                std::list<bcf1_t*>::iterator i = buffer.begin();
+            flush(true);
+        }
 
-                for (i=buffer.begin(); i!=buffer.end(); ++i)
+        if (buffer.empty())
+        {
+            buffer_rid = rid;
+            buffer_max_pos1 = pos1;
+        }
+        else
+        {
+            int32_t cutoff_pos1 =  std::max(buffer_max_pos1-window,1);
+            if (pos1<cutoff_pos1)
+            {
+                if (adaptive_window)
                 {
-                    //equal sign ensures records are kept in original order
-                    if (bcf_get_pos1(v)>=bcf_get_pos1(*i))
+                    int32_t new_window = std::max(2*window, buffer_max_pos1-pos1+1);
+
+                    if (new_window>max_window)
                     {
-                        buffer.insert(i,v);
-                        flush(false);
-                        return;
+                        new_window = max_window;
+
+                        if (window<max_window)
+                        {
+                            fprintf(stderr, "[%s:%d %s] Maximum window size %d reached at current record %s:%d, output might not be sorted.\n",
+                                              __FILE__,
+                                              __LINE__,
+                                              __FUNCTION__,
+                                              max_window,
+                                              bcf_get_chrom(hdr, v),
+                                              pos1);
+                        }
                     }
-                }
 
-                if (i==buffer.end())
-                {
-                    int32_t cutoff_pos1 =  std::max((int32_t) bcf_get_pos1(buffer.front())-window,1);
-                    if (bcf_get_pos1(v)<cutoff_pos1)
+                    if (rid==last_written_rid && pos1<last_written_pos1)
                     {
-                        fprintf(stderr, "[%s:%d %s] Might not be sorted for window size %d at current record %s:%d < %d (%d [last record] - %d), please increase window size to at least %d.\n",
+                        fprintf(stderr, "[%s:%d %s] Not sorted for window size %d at current record %s:%d < %d [last written record], increasing window size to %d.\n",
                                           __FILE__,
                                           __LINE__,
                                           __FUNCTION__,
                                           window,
                                           bcf_get_chrom(hdr, v),
-                                          bcf_get_pos1(v),
-                                          (int32_t) cutoff_pos1,
-                                          (int32_t) bcf_get_pos1(buffer.front()),
-                                          (int32_t) window,
-                                          ((int32_t) bcf_get_pos1(buffer.front()))-bcf_get_pos1(v)+1);
+                                          pos1,
+                                          last_written_pos1,
+                                          new_window);
                     }
-                }
 
-                buffer.insert(i,v);
-                flush(false);
-            }
-            else
-            {
-                flush(true);
-                buffer.push_front(v);
+                    window = new_window;
+                }
+                else
+                {
+                    fprintf(stderr, "[%s:%d %s] Might not be sorted for window size %d at current record %s:%d < %d (%d [last record] - %d), please increase window size to at least %d.\n",
+                                      __FILE__,
+                                      __LINE__,
+                                      __FUNCTION__,
+                                      window,
+                                      bcf_get_chrom(hdr, v),
+                                      pos1,
+                                      cutoff_pos1,
+                                      buffer_max_pos1,
+                                      window,
+                                      buffer_max_pos1-pos1+1);
+                }
             }
+
+            buffer_max_pos1 = std::max(buffer_max_pos1, pos1);
         }
-        else
-        {
-            buffer.push_front(v);
-        }
+
+        //insertion order ensures records are kept in original order
+        buffer.push(bcfbufptr(v, pos1, buffer_order++));
+        flush(false);
 
         v = NULL;
     }
+    else if (pipe)
+    {
+        //the record remains with the caller
+        pipe->write(bcf_dup(v));
+    }
     else
     {
         //todo:  add a mechanism to populate header similar to vcf_parse in vcf_format which is called by bcf_write
@@ -255,71 +327,68 @@ void BCFOrderedWriter::flush(bool force)
     {
         while (!buffer.empty())
         {
-            if (bcf_write(file, hdr, buffer.back()))
-            {
-                fprintf(stderr, "[%s:%d %s] writing of VCF record failed.\n",
-                                                  __FILE__,
-                                                  __LINE__,
-                                                  __FUNCTION__);
-                exit(1);
-            }
-            bcf_destroy(buffer.back());
-            //store_bcf1_into_pool(buffer.back());
-            buffer.pop_back();
+            write_buffer_top();
         }
+
+        //an enlarged window is only kept for the records it was enlarged for
+        window = initial_window;
     }
     else
     {
         if (buffer.size()>1)
         {
-            int32_t cutoff_pos1 =  std::max((int32_t) bcf_get_pos1(buffer.front())-window,1);
+            int32_t cutoff_pos1 =  std::max(buffer_max_pos1-window,1);
 
-            while (buffer.size()>1)
+            while (buffer.size()>1 && buffer.top().pos1<=cutoff_pos1)
             {
-                if (bcf_get_pos1(buffer.back())<=cutoff_pos1)
-                {
-                    if (bcf_write(file, hdr, buffer.back()))
-                    {
-                        fprintf(stderr, "[%s:%d %s] writing of VCF record failed.\n",
-                                                          __FILE__,
-                                                          __LINE__,
-                                                          __FUNCTION__);
-                        exit(1);
-                    }
-                    bcf_destroy(buffer.back());
-                    //store_bcf1_into_pool(buffer.back());
-                    buffer.pop_back();
-                }
-                else
-                {
-                    return;
-                }
+                write_buffer_top();
             }
         }
     }
 }
 
+/**
+ * Writes out the record at the top of the buffer.
+ */
+void BCFOrderedWriter::write_buffer_top()
+{
+    bcf1_t *v = buffer.top().v;
+    last_written_rid = buffer_rid;
+    last_written_pos1 = buffer.top().pos1;
+    buffer.pop();
+
+    if (pipe)
+    {
+        pipe->write(v);
+        return;
+    }
+
+    if (bcf_write(file, hdr, v))
+    {
+        fprintf(stderr, "[%s:%d %s] writing of VCF record failed.\n",
+                                          __FILE__,
+                                          __LINE__,
+                                          __FUNCTION__);
+        exit(1);
+    }
+    bcf_destroy(v);
+    //store_bcf1_into_pool(v);
+}
+
 /**
  * Closes the file.
  */
 void BCFOrderedWriter::close()
 {
     flush(true);
-    bcf_close(file);
+    if (pipe)
+    {
+        pipe->close_write();
+        pipe = NULL;
+    }
+    else
+    {
+        bcf_close(file);
+    }
     if (!linked_hdr && hdr) bcf_hdr_destroy(hdr);
-//    while (buffer.size()!=0)
-//    {
-//        bcf_destroy(buffer.pop_back());
-//        buffer.pop_back();
-//        if (bcf_get_pos1(buffer.back())<=cutoff_pos1)
-//        {
-//            bcf_write(file, hdr, buffer.back());
-//            store_bcf1_into_pool(buffer.back());
-//            buffer.pop_back();
-//        }
-//        else
-//        {
-//            return;
-//        }
-//    }
 }
@@ -26,6 +26,47 @@
 
 #include "hts_utils.h"
 #include "utils.h"
+#include "bcf_pipe.h"
+
+#define BCF_ORDERED_WRITER_MAX_WINDOW 10000000
+
+/**
+ * Wrapper for a record in the local sorting buffer of BCFOrderedWriter.
+ * The insertion order is kept so that records with the same position
+ * are written out in the order they were received.
+ */
+class bcfbufptr
+{
+    public:
+    int32_t pos1;
+    uint64_t order;
+    bcf1_t *v;
+
+    bcfbufptr(bcf1_t *v, int32_t pos1, uint64_t order)
+    {
+        this->v = v;
+        this->pos1 = pos1;
+        this->order = order;
+    };
+};
+
+/**
+ * Comparator for bcfbufptr.  Used in priority_queue; ensures that the
+ * record with the smallest position and earliest insertion is on top.
+ */
+class CompareBCFBufPtr
+{
+    public:
+    bool operator()(const bcfbufptr& a, const bcfbufptr& b)
+    {
+        if (a.pos1 == b.pos1)
+        {
+            return a.order > b.order;
+        }
+
+        return a.pos1 > b.pos1;
+    }
+};
 
 /**
  * A class for writing ordered VCF/BCF files.
@@ -35,6 +76,12 @@
  * instead of sorting the VCF wholesale, this class buffers the output
  * and sorts locally in a 10K base pair region before writing the records
  * out.
+ *
+ * The buffer is a heap ordered by position, insertion and flushing of
+ * a record are logarithmic in the number of buffered records.
+ *
+ * When the file name refers to a BCFPipe, records are passed to
+ * the pipe instead of being written to a file.
  */
 class BCFOrderedWriter
 {
@@ -47,12 +94,27 @@ class BCFOrderedWriter
     vcfFile *file;
     bcf_hdr_t *hdr;
     bool linked_hdr;
+    BCFPipe *pipe;
 
     //buffer for containing records to be written out
-    std::list<bcf1_t*> buffer; //most recent records in the front
+    std::priority_queue<bcfbufptr, std::vector<bcfbufptr>, CompareBCFBufPtr> buffer;
     std::list<bcf1_t*> pool;
 
+    //state of buffered records
+    int32_t buffer_rid;
+    int32_t buffer_max_pos1;
+    uint64_t buffer_order;
+
+    //last record written out from the buffer
+    int32_t last_written_rid;
+    int32_t last_written_pos1;
+
     int32_t window;
+    bool adaptive_window;
+    //window the adaptive window shrinks back to after a flush
+    int32_t initial_window;
+    //size the adaptive window is never enlarged beyond
+    int32_t max_window;
 
     /**
      * Initialize output file.
@@ -62,6 +124,15 @@ class BCFOrderedWriter
      */
     BCFOrderedWriter(std::string output_vcf_file_name, int32_t window=0, int32_t compression=6);
 
+    /**
+     * Sets adaptive window mode.  When a record arrives that is further than the
+     * window size behind the furthest buffered record, the window is enlarged
+     * instead of only warning that the output might not be sorted.  The window
+     * is not enlarged beyond max_window and shrinks back to its initial size
+     * when the buffer is flushed.
+     */
+    void set_adaptive_window(bool adaptive_window, int32_t max_window=BCF_ORDERED_WRITER_MAX_WINDOW);
+
     /**
      * Duplicates a hdr and sets it.
      */
@@ -111,6 +182,11 @@ class BCFOrderedWriter
      * Flush writable records from buffer.
      */
     void flush(bool force);
+
+    /**
+     * Writes out the record at the top of the buffer.
+     */
+    void write_buffer_top();
 };
 
 #endif
\ No newline at end of file
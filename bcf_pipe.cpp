@@ -0,0 +1,197 @@
+/* The MIT License
+
+   Copyright (c) 2018 Adrian Tan <atks@umich.edu>
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+#include "bcf_pipe.h"
+
+std::map<std::string, BCFPipe*> BCFPipe::pipes;
+pthread_mutex_t BCFPipe::pipes_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Creates and registers a pipe.
+ *
+ * @name     - name used to open the pipe
+ * @capacity - maximum number of records in the pipe
+ */
+BCFPipe::BCFPipe(std::string name, uint32_t capacity)
+{
+    this->name = name;
+    this->capacity = capacity ? capacity : 1;
+    hdr = NULL;
+    hdr_written = false;
+    write_closed = false;
+    read_closed = false;
+
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&not_empty, NULL);
+    pthread_cond_init(&not_full, NULL);
+
+    pthread_mutex_lock(&pipes_mutex);
+    pipes[name] = this;
+    pthread_mutex_unlock(&pipes_mutex);
+}
+
+/**
+ * Unregisters the pipe and destroys remaining records.
+ */
+BCFPipe::~BCFPipe()
+{
+    pthread_mutex_lock(&pipes_mutex);
+    pipes.erase(name);
+    pthread_mutex_unlock(&pipes_mutex);
+
+    while (!records.empty())
+    {
+        bcf_destroy(records.front());
+        records.pop_front();
+    }
+    if (hdr) bcf_hdr_destroy(hdr);
+
+    pthread_mutex_destroy(&mutex);
+    pthread_cond_destroy(&not_empty);
+    pthread_cond_destroy(&not_full);
+}
+
+/**
+ * Gets a registered pipe, NULL if the name does not refer to a pipe.
+ */
+BCFPipe* BCFPipe::get_pipe(std::string name)
+{
+    BCFPipe *pipe = NULL;
+
+    pthread_mutex_lock(&pipes_mutex);
+    std::map<std::string, BCFPipe*>::iterator i = pipes.find(name);
+    if (i!=pipes.end())
+    {
+        pipe = i->second;
+    }
+    pthread_mutex_unlock(&pipes_mutex);
+
+    return pipe;
+}
+
+/**
+ * Writes the header, a copy is made.
+ */
+void BCFPipe::write_hdr(bcf_hdr_t *h)
+{
+    bcf_hdr_t *hdup = bcf_hdr_dup(h);
+
+    pthread_mutex_lock(&mutex);
+    if (hdr) bcf_hdr_destroy(hdr);
+    hdr = hdup;
+    hdr_written = true;
+    pthread_cond_broadcast(&not_empty);
+    pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Reads the header, blocks till the header is written.
+ * The copy returned is owned by the caller.
+ */
+bcf_hdr_t* BCFPipe::read_hdr()
+{
+    pthread_mutex_lock(&mutex);
+    while (!hdr_written && !write_closed)
+    {
+        pthread_cond_wait(&not_empty, &mutex);
+    }
+    bcf_hdr_t *h = hdr ? bcf_hdr_dup(hdr) : NULL;
+    pthread_mutex_unlock(&mutex);
+
+    return h;
+}
+
+/**
+ * Writes a record, blocks when the pipe is full.
+ * The pipe takes ownership of the record.
+ */
+void BCFPipe::write(bcf1_t *v)
+{
+    pthread_mutex_lock(&mutex);
+    while (records.size()>=capacity && !read_closed)
+    {
+        pthread_cond_wait(&not_full, &mutex);
+    }
+
+    if (read_closed)
+    {
+        pthread_mutex_unlock(&mutex);
+        bcf_destroy(v);
+        return;
+    }
+
+    records.push_back(v);
+    pthread_cond_signal(&not_empty);
+    pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Reads a record, blocks when the pipe is empty.
+ * The caller takes ownership of the record.
+ * Returns NULL when the writer is closed and all records are read.
+ */
+bcf1_t* BCFPipe::read()
+{
+    pthread_mutex_lock(&mutex);
+    while (records.empty() && !write_closed)
+    {
+        pthread_cond_wait(&not_empty, &mutex);
+    }
+
+    bcf1_t *v = NULL;
+    if (!records.empty())
+    {
+        v = records.front();
+        records.pop_front();
+        pthread_cond_signal(&not_full);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    return v;
+}
+
+/**
+ * Closes the writing end.
+ */
+void BCFPipe::close_write()
+{
+    pthread_mutex_lock(&mutex);
+    write_closed = true;
+    pthread_cond_broadcast(&not_empty);
+    pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Closes the reading end, records written subsequently are discarded.
+ */
+void BCFPipe::close_read()
+{
+    pthread_mutex_lock(&mutex);
+    read_closed = true;
+    while (!records.empty())
+    {
+        bcf_destroy(records.front());
+        records.pop_front();
+    }
+    pthread_cond_broadcast(&not_full);
+    pthread_mutex_unlock(&mutex);
+}
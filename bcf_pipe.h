@@ -0,0 +1,126 @@
+/* The MIT License
+
+   Copyright (c) 2018 Adrian Tan <atks@umich.edu>
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+#ifndef BCF_PIPE_H
+#define BCF_PIPE_H
+
+#include <deque>
+#include <pthread.h>
+#include "hts_utils.h"
+#include "utils.h"
+
+#define BCF_PIPE_CAPACITY 1024
+
+/**
+ * A bounded in-memory queue of bcf records connecting a BCFOrderedWriter
+ * in one thread to a BCFOrderedReader in another thread.
+ *
+ * Pipes are registered under a name such as pipe:1 and a reader or writer
+ * opened with that name is connected to the pipe instead of a file.  Records
+ * are passed as bcf1_t pointers, they are neither formatted nor parsed.
+ *
+ * The header is passed as a copy that keeps the IDs of the writer's header,
+ * fields that are added to the writer's header after it is written are not
+ * seen by the reader.
+ */
+class BCFPipe
+{
+    public:
+
+    std::string name;
+    uint32_t capacity;
+
+    //header from the writer
+    bcf_hdr_t *hdr;
+
+    //records from the writer, oldest in the front
+    std::deque<bcf1_t*> records;
+
+    //for control
+    bool hdr_written;
+    bool write_closed;
+    bool read_closed;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+
+    /**
+     * Creates and registers a pipe.
+     *
+     * @name     - name used to open the pipe
+     * @capacity - maximum number of records in the pipe
+     */
+    BCFPipe(std::string name, uint32_t capacity=BCF_PIPE_CAPACITY);
+
+    /**
+     * Unregisters the pipe and destroys remaining records.
+     */
+    ~BCFPipe();
+
+    /**
+     * Gets a registered pipe, NULL if the name does not refer to a pipe.
+     */
+    static BCFPipe* get_pipe(std::string name);
+
+    /**
+     * Writes the header, a copy is made.
+     */
+    void write_hdr(bcf_hdr_t *h);
+
+    /**
+     * Reads the header, blocks till the header is written.
+     * The copy returned is owned by the caller.
+     */
+    bcf_hdr_t* read_hdr();
+
+    /**
+     * Writes a record, blocks when the pipe is full.
+     * The pipe takes ownership of the record.
+     */
+    void write(bcf1_t *v);
+
+    /**
+     * Reads a record, blocks when the pipe is empty.
+     * The caller takes ownership of the record.
+     * Returns NULL when the writer is closed and all records are read.
+     */
+    bcf1_t* read();
+
+    /**
+     * Closes the writing end.
+     */
+    void close_write();
+
+    /**
+     * Closes the reading end, records written subsequently are discarded.
+     */
+    void close_read();
+
+    private:
+
+    //registry of pipes
+    static std::map<std::string, BCFPipe*> pipes;
+    static pthread_mutex_t pipes_mutex;
+};
+
+#endif
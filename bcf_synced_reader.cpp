@@ -38,11 +38,15 @@ BCFSyncedReader::BCFSyncedReader(std::vector<std::string>& file_names, std::vect
     tbxs.resize(nfiles, 0);
     itrs.resize(nfiles, 0);
     ftypes.resize(nfiles);
+    pipes.resize(nfiles, 0);
 
     current_interval = "";
     current_pos1 = 0;
 
     buffer.resize(nfiles);
+    pending.resize(nfiles);
+    no_pending = 0;
+    tree = new LoserTree(nfiles, file_less, this);
     s = {0, 0, 0};
 
     random_access = (intervals.size()!=0);
@@ -74,28 +78,45 @@ BCFSyncedReader::BCFSyncedReader(std::vector<std::string>& file_names, std::vect
             exit(1);
         }
 
-        files[i] = hts_open(file_names[i].c_str(), "r");
-        if (files[i]==NULL)
+        if ((pipes[i] = BCFPipe::get_pipe(file_names[i])))
+        {
+            if (random_access)
+            {
+                fprintf(stderr, "[E:%s:%d %s] index cannot be loaded for %s for random access\n", __FILE__, __LINE__, __FUNCTION__, file_names[i].c_str());
+                exit(1);
+            }
+            ftypes[i].format = bcf;
+            ftypes[i].compression = no_compression;
+            if (!(hdrs[i] = pipes[i]->read_hdr()))
+            {
+                fprintf(stderr, "[E:%s:%d %s] header cannot be read for %s\n", __FILE__, __LINE__, __FUNCTION__, file_names[i].c_str());
+                exit(1);
+            }
+        }
+        else if (!(files[i] = hts_open(file_names[i].c_str(), "r")))
         {
             fprintf(stderr, "[%s:%d %s] Cannot open %s\n", __FILE__, __LINE__, __FUNCTION__, file_names[i].c_str());
             exit(1);
 //            toexit = true;        
         }
-        ftypes[i] = files[i]->format;
-
-        //check format
-        if (ftypes[i].format!=vcf && ftypes[i].format!=bcf)
+        else
         {
-            fprintf(stderr, "[E:%s:%d %s] %s not a VCF or BCF file\n", __FILE__, __LINE__, __FUNCTION__, file_names[i].c_str());
-            exit(1);
-        }
+            ftypes[i] = files[i]->format;
 
-        //read header
-        hdrs[i] = bcf_alt_hdr_read(files[i]);
-        if (!hdrs[i])
-        {
-            fprintf(stderr, "[E:%s:%d %s] header cannot be read for %s\n", __FILE__, __LINE__, __FUNCTION__, file_names[i].c_str());
-            exit(1);
+            //check format
+            if (ftypes[i].format!=vcf && ftypes[i].format!=bcf)
+            {
+                fprintf(stderr, "[E:%s:%d %s] %s not a VCF or BCF file\n", __FILE__, __LINE__, __FUNCTION__, file_names[i].c_str());
+                exit(1);
+            }
+
+            //read header
+            hdrs[i] = bcf_alt_hdr_read(files[i]);
+            if (!hdrs[i])
+            {
+                fprintf(stderr, "[E:%s:%d %s] header cannot be read for %s\n", __FILE__, __LINE__, __FUNCTION__, file_names[i].c_str());
+                exit(1);
+            }
         }
 
         //load index if intervals are specified
@@ -282,7 +303,15 @@ void BCFSyncedReader::close()
 {
     for (size_t i=0; i<nfiles; ++i)
     {
-        bcf_close(files[i]);
+        if (pipes[i])
+        {
+            pipes[i]->close_read();
+            pipes[i] = NULL;
+        }
+        else
+        {
+            bcf_close(files[i]);
+        }
         bcf_hdr_destroy(hdrs[i]);
         if (idxs[i]) hts_idx_destroy(idxs[i]);
         if (tbxs[i]) tbx_destroy(tbxs[i]);
@@ -294,14 +323,59 @@ void BCFSyncedReader::close()
         bcf_destroy(pool.front());
         pool.pop_front();
     }
+
+    for (size_t i=0; i<bcfptr_pool.size(); ++i)
+    {
+        delete bcfptr_pool[i];
+    }
+    bcfptr_pool.clear();
+
+    delete tree;
+    tree = NULL;
 }
 
 /**
- * Inserts a record into pq.
+ * Inserts a record into the pending records of file i.
+ * Records with equal keys are kept in file order.
  */
-void BCFSyncedReader::insert_into_pq(int32_t i, bcf1_t *v)
+void BCFSyncedReader::insert_into_pending(int32_t i, bcf1_t *v)
 {
-    pq.push(new bcfptr(i, bcf_get_rid(v), bcf_get_pos1(v), hdrs[i], v, sync_by_pos));
+    bcfptr *b;
+    if (bcfptr_pool.empty())
+    {
+        b = new bcfptr(i, bcf_get_rid(v), bcf_get_pos1(v), hdrs[i], v, sync_by_pos);
+    }
+    else
+    {
+        b = bcfptr_pool.back();
+        bcfptr_pool.pop_back();
+        b->set(i, bcf_get_rid(v), bcf_get_pos1(v), hdrs[i], v, sync_by_pos);
+    }
+
+    std::list<bcfptr *>::iterator j = pending[i].end();
+    while (j!=pending[i].begin())
+    {
+        std::list<bcfptr *>::iterator k = j;
+        if (bcfptr_key_cmp(*(--k), b)<=0) break;
+        j = k;
+    }
+    pending[i].insert(j, b);
+    ++no_pending;
+}
+
+/**
+ * Orders files by their next pending record, files with no pending records are last.
+ */
+bool BCFSyncedReader::file_less(void *arg, int32_t i, int32_t j)
+{
+    BCFSyncedReader *sr = (BCFSyncedReader *) arg;
+
+    if (sr->pending[i].empty()) return false;
+    if (sr->pending[j].empty()) return true;
+
+    int32_t d = bcfptr_key_cmp(sr->pending[i].front(), sr->pending[j].front());
+
+    return d ? d<0 : i<j;
 }
 
 /**
@@ -334,49 +408,33 @@ void BCFSyncedReader::store_bcf1_into_pool(bcf1_t* v)
 }
 
 /**
- * Compares records based on type of comparison.
+ * Reads the next record of file i, returns false at the end of the file.
  */
-int32_t BCFSyncedReader::bcfptr_cmp(bcfptr *a, bcfptr *b)
+bool BCFSyncedReader::read(int32_t i, bcf1_t *v)
 {
-    if (random_access)
+    if (pipes[i])
     {
-        if (a->pos1 == b->pos1)
-        {
-            if (a->alleles.l!=0 && b->alleles.l!=0)
-            {
-                int32_t d = strcmp(a->alleles.s, b->alleles.s);
-                return d;
-            }
-            else
-            {
-                return 0;
-            }
-        }
+        bcf1_t *u = pipes[i]->read();
+        if (!u) return false;
 
-        return a->pos1 >= b->pos1 ? 1 : -1;
+        //swap contents with the record from the pipe
+        bcf1_t t = *v;
+        *v = *u;
+        *u = t;
+        bcf_destroy(u);
+
+        return true;
     }
-    else
-    {
-        if (a->rid == b->rid)
-        {
-            if (a->pos1 == b->pos1)
-            {
-                if (a->alleles.l!=0 && b->alleles.l!=0)
-                {
-                    int32_t d = strcmp(a->alleles.s, b->alleles.s);
-                    return d;
-                }
-                else
-                {
-                    return 0;
-                }
-            }
 
-            return a->pos1 >= b->pos1 ? 1 : -1;
-        }
+    return bcf_read(files[i], hdrs[i], v)>=0;
+}
 
-        return a->rid >= b->rid ? 1 : -1;
-    }
+/**
+ * Compares records based on type of comparison.
+ */
+int32_t BCFSyncedReader::bcfptr_cmp(bcfptr *a, bcfptr *b)
+{
+    return bcfptr_key_cmp(a, b);
 }
 
 /**
@@ -391,36 +449,29 @@ bool BCFSyncedReader::read_next_position(std::vector<bcfptr*>& current_recs)
     for (size_t i=0; i<current_recs.size(); ++i)
     {
         store_bcf1_into_pool(current_recs[i]->v);
-        delete current_recs[i];
+        bcfptr_pool.push_back(current_recs[i]);
     }
     current_recs.clear();
 
-    //process records in priority queue or initialize next interval if pq is empty
-    //initialize_next_interval tops up the pq
+    //process pending records or initialize next interval if there are none
+    //initialize_next_interval tops up the pending records
     //initialize_next_interval will never be invoked until the end for non indexed reading
-    if (pq.size()!=0 || initialize_next_interval())
+    if (no_pending!=0 || initialize_next_interval())
     {
-        //dequeue pqueue most recent position and return it
-        bcfptr* variant = pq.top();
-        bcfptr* cvariant = variant;
+        //take the records equal to the first pending record
+        bcfptr* variant = pending[tree->top()].front();
 
-        while (bcfptr_cmp(cvariant, variant)==0)
+        while (no_pending!=0 && bcfptr_cmp(pending[tree->top()].front(), variant)==0)
         {
-            bcfptr *b = pq.top();
+            int32_t i = tree->top();
+            bcfptr *b = pending[i].front();
             current_recs.push_back(b);
 
-            buffer[b->file_index].remove(b->v);
-            fill_buffer(b->file_index);
-            pq.pop();
-
-            if (pq.size()==0)
-            {
-                break;
-            }
-            else
-            {
-                cvariant = pq.top();
-            }
+            pending[i].pop_front();
+            --no_pending;
+            buffer[i].remove(b->v);
+            fill_buffer(i);
+            tree->update();
         }
 
         return true;
@@ -463,11 +514,12 @@ bool BCFSyncedReader::initialize_next_interval()
                 fill_buffer(i);
             }
 
-            //make sure pq is not empty
-            //it is possible for the pq to be empty as iterators may be returned
+            //make sure there are pending records
+            //it is possible for there to be none as iterators may be returned
             //as the sequence might be a valid sequence stated in the header
-            if (pq.size()!=0)
+            if (no_pending!=0)
             {
+                tree->build();
                 return true;
             }
         }
@@ -481,8 +533,9 @@ bool BCFSyncedReader::initialize_next_interval()
             fill_buffer(i);
         }
 
-        if (pq.size()!=0)
+        if (no_pending!=0)
         {
+            tree->build();
             return true;
         }
 
@@ -525,7 +578,7 @@ void BCFSyncedReader::fill_buffer(int32_t i)
                 }
                 
                 buffer[i].push_back(v);
-                insert_into_pq(i, v);
+                insert_into_pending(i, v);
 
                 if (pos1==0)
                 {
@@ -564,7 +617,7 @@ void BCFSyncedReader::fill_buffer(int32_t i)
                 }
                 
                 buffer[i].push_back(v);
-                insert_into_pq(i, v);
+                insert_into_pending(i, v);
 
                 if (pos1==0)
                 {
@@ -586,7 +639,7 @@ void BCFSyncedReader::fill_buffer(int32_t i)
         bcf1_t *v = get_bcf1_from_pool();
         bool populated = false;
 
-        while (bcf_read(files[i], hdrs[i], v)>=0)
+        while (read(i, v))
         {
             populated = true;
             bcf_unpack(v, BCF_UN_STR);
@@ -602,7 +655,7 @@ void BCFSyncedReader::fill_buffer(int32_t i)
             }
             
             buffer[i].push_back(v);
-            insert_into_pq(i, v);
+            insert_into_pending(i, v);
 
             if (rid==-1)
             {
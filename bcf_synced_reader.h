@@ -27,6 +27,8 @@
 #include "hts_utils.h"
 #include "utils.h"
 #include "genome_interval.h"
+#include "loser_tree.h"
+#include "bcf_pipe.h"
 
 #define SYNC_BY_POS true
 #define SYNC_BY_VAR false
@@ -34,6 +36,11 @@
 /**
  * Wrapper class for the bcf object.
  * Stores the alleles in lexical order.
+ *
+ * Records are compared with a compact key, pos_key holds the rid and
+ * position and allele_key holds the leading bytes of the sorted alleles
+ * so that comparing the keys agrees with comparing the allele strings.
+ * The allele strings are only compared when the keys are equal.
  */
 class bcfptr
 {
@@ -44,6 +51,8 @@ class bcfptr
     bcf_hdr_t *h;
     bcf1_t *v;
     kstring_t alleles;
+    uint64_t pos_key;
+    uint64_t allele_key;
 
     bcfptr()
     {
@@ -52,20 +61,36 @@ class bcfptr
         pos1 = -1;
         v = NULL;
         alleles = {0,0,0};
+        pos_key = 0;
+        allele_key = 0;
     };
 
     bcfptr(int32_t file_index, int32_t rid, int32_t pos1, bcf_hdr_t *h, bcf1_t *v, bool sync_by_pos)
+    {
+        alleles = {0,0,0};
+        set(file_index, rid, pos1, h, v, sync_by_pos);
+    };
+
+    /**
+     * Sets the record wrapped, the allele string is reused.
+     */
+    void set(int32_t file_index, int32_t rid, int32_t pos1, bcf_hdr_t *h, bcf1_t *v, bool sync_by_pos)
     {
         this->file_index = file_index;
         this->rid = rid;
         this->pos1 = pos1;
         this->h = h;
         this->v = v;
-        alleles = {0,0,0};
+        pos_key = ((uint64_t)(uint32_t)rid<<32) | (uint32_t)pos1;
+        allele_key = 0;
+        alleles.l = 0;
         if (!sync_by_pos)
         {
-            //bcf_alleles2string(h, v, &alleles);
             bcf_alleles2string_sorted(h, v, &alleles);
+            for (size_t i=0; i<8; ++i)
+            {
+                allele_key = (allele_key<<8) | (i<alleles.l ? (uint8_t)alleles.s[i] : 0);
+            }
         }
     };
 
@@ -80,42 +105,27 @@ class bcfptr
 };
 
 /**
- * Comparator for BCFPtr class.  Used in priority_queue; ensures that
- * records are ordered according to file order.
+ * Compares records by position and, when syncing by variant, by alleles.
  */
-class CompareBCFPtr
+inline int32_t bcfptr_key_cmp(bcfptr *a, bcfptr *b)
 {
-    public:
-    bool operator()(bcfptr *a, bcfptr *b)
+    if (a->pos_key!=b->pos_key)
     {
-        if (a->rid == b->rid)
-        {
-            if (a->pos1 == b->pos1)
-            {
-                if (a->alleles.l!=0 && b->alleles.l!=0)
-                {
-                    int32_t d = strcmp(a->alleles.s, b->alleles.s);
-                    
-                    if (d==0)
-                    {
-                        return a->file_index>b->file_index;
-                    }   
-                     
-                    return d>0;
-                }
-                else //this should result in an error
-                {
-                    fprintf(stderr, "[E:%s:%d %s] alleles not defined in VCF record.\n", __FILE__, __LINE__, __FUNCTION__);
-                    exit(1);
-                }
-            }
+        return a->pos_key<b->pos_key ? -1 : 1;
+    }
 
-            return a->pos1 > b->pos1;
-        }
-                    
-        return a->rid > b->rid;
+    if (a->alleles.l==0 || b->alleles.l==0)
+    {
+        return 0;
+    }
+
+    if (a->allele_key!=b->allele_key)
+    {
+        return a->allele_key<b->allele_key ? -1 : 1;
     }
-};
+
+    return strcmp(a->alleles.s, b->alleles.s);
+}
 
 /**
  * A class for reading files in a synced fashion.
@@ -136,6 +146,7 @@ class CompareBCFPtr
  *
  *    When no intervals are specified, indices are not loaded.
  *    Headers are checked to ensure that the contigs listed.
+ *    A file may also be a pipe, see BCFPipe.
  *
  *
  * Modes of synchronizing
@@ -158,6 +169,7 @@ class BCFSyncedReader
     std::vector<tbx_t *> tbxs; // for tabix
     std::vector<hts_itr_t *> itrs; //iterators
     std::vector<htsFormat> ftypes; //file types
+    std::vector<BCFPipe *> pipes; //pipes, for files read from a pipe
     int32_t nfiles; //number of files
     int32_t neofs; //number of files read till eof
 
@@ -182,8 +194,14 @@ class BCFSyncedReader
     std::vector<std::list<bcf1_t *> > buffer;
     //empty records that can be reused
     std::list<bcf1_t *> pool;
-    //contains the most recent position to process
-    std::priority_queue<bcfptr *, std::vector<bcfptr *>, CompareBCFPtr> pq;
+    //records not yet returned for each file in key order
+    std::vector<std::list<bcfptr *> > pending;
+    //number of records in pending
+    uint32_t no_pending;
+    //selects the file with the next record to process
+    LoserTree *tree;
+    //wrappers that can be reused
+    std::vector<bcfptr *> bcfptr_pool;
 
     //useful stuff
 
@@ -250,9 +268,14 @@ class BCFSyncedReader
     void print_buffer();
 
     /**
-     * Inserts a record into pq.
+     * Inserts a record into the pending records of file i.
+     */
+    void insert_into_pending(int32_t i, bcf1_t *v);
+
+    /**
+     * Orders files by their next pending record, files with no pending records are last.
      */
-    void insert_into_pq(int32_t i, bcf1_t *v);
+    static bool file_less(void *arg, int32_t i, int32_t j);
 
     /**
      * Gets records for the most recent position and fills up the buffer for file i.
@@ -279,6 +302,11 @@ class BCFSyncedReader
      */
     void store_bcf1_into_pool(bcf1_t* v);
 
+    /**
+     * Reads the next record of file i, returns false at the end of the file.
+     */
+    bool read(int32_t i, bcf1_t *v);
+
     /**
      * Gets records for the most recent position and fills up the buffer from file i.
      * returns true if buffer is filled or it is not necessary to fill buffer.
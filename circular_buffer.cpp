@@ -84,8 +84,8 @@ void CircularBuffer::set_reference(std::string& ref_fasta_file)
 {
     if (ref_fasta_file!="")
     {
-        fai = fai_load(ref_fasta_file.c_str());
-        if (fai==NULL)
+        ref_index = ReferenceIndex::load(ref_fasta_file);
+        if (ref_index==NULL)
         {
             fprintf(stderr, "[%s:%d %s] cannot load genome index: %s\n", __FILE__, __LINE__, __FUNCTION__, ref_fasta_file.c_str());
             exit(1);
@@ -272,7 +272,7 @@ uint32_t CircularBuffer::inc(uint32_t i, uint32_t j)
 char CircularBuffer::fetch_base(std::string& chrom, uint32_t& pos1)
 {
     int ref_len = 0;
-    char *refseq = faidx_fetch_uc_seq(fai, chrom.c_str(), pos1-1, pos1-1, &ref_len);
+    char *refseq = ref_index->fetch_uc_seq(chrom.c_str(), pos1-1, pos1-1, &ref_len);
     if (!refseq)
     {
         fprintf(stderr, "[%s:%d %s] failure to extrac base from fasta file: %s:%d: >\n", __FILE__, __LINE__, __FUNCTION__, chrom.c_str(), pos1-1);
@@ -290,7 +290,7 @@ char CircularBuffer::fetch_base(std::string& chrom, uint32_t& pos1)
 //char* CircularBuffer::get_sequence(std::string& chrom, uint32_t pos1, uint32_t len)
 //{
 //    int ref_len = 0;
-//    char* seq = faidx_fetch_uc_seq(fai, chrom.c_str(), pos1-1, pos1+len-2, &ref_len);
+//    char* seq = ref_index->fetch_uc_seq(chrom.c_str(), pos1-1, pos1+len-2, &ref_len);
 //    if (!seq || ref_len!=len)
 //    {
 //        fprintf(stderr, "[%s:%d %s] failure to extract sequence from fasta file: %s:%d: >\n", __FILE__, __LINE__, __FUNCTION__, chrom.c_str(), pos1-1);
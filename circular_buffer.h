@@ -29,7 +29,7 @@
 #include "variant_manip.h"
 
 /**
- * A Reference Sequence object wrapping htslib's faidx.
+ * A Reference Sequence object wrapping a packed reference or htslib's faidx.
  * This allows for buffered reading of seqeunces.
  */
 class CircularBuffer
@@ -73,7 +73,7 @@ class CircularBuffer
 
     int32_t debug;
 
-    faidx_t *fai;
+    ReferenceIndex *ref_index;
 
     public:
 
@@ -528,8 +528,8 @@ void ComplexGenotypingRecord::process_read(AugmentedBAMRecord& as, int32_t sampl
             uint32_t cycle = 10;
 
             std::vector<uint32_t>& aug_cigar = as.aug_cigar;
-            std::vector<std::string>& aug_ref = as.aug_ref;
-            std::vector<std::string>& aug_alt = as.aug_alt;
+            std::vector<AugmentedSeq>& aug_ref = as.aug_ref;
+            std::vector<AugmentedSeq>& aug_alt = as.aug_alt;
 
             int32_t vpos1 = pos1;
 
@@ -653,8 +653,8 @@ void ComplexGenotypingRecord::process_read(AugmentedBAMRecord& as, int32_t sampl
             uint32_t cycle = 10;
 
             std::vector<uint32_t>& aug_cigar = as.aug_cigar;
-            std::vector<std::string>& aug_ref = as.aug_ref;
-            std::vector<std::string>& aug_alt = as.aug_alt;
+            std::vector<AugmentedSeq>& aug_ref = as.aug_ref;
+            std::vector<AugmentedSeq>& aug_alt = as.aug_alt;
 
             int32_t vpos1 = pos1;
 
@@ -39,6 +39,7 @@ class Igor : Program
     std::string ref_fasta_file;
     bool smart;
     bool debug;
+    int32_t nthreads;
 
     ///////
     //i/o//
@@ -101,6 +102,7 @@ class Igor : Program
             smart = arg_smart.getValue();
             debug = arg_debug.getValue();
             parse_intervals(intervals, arg_interval_list.getValue(), arg_intervals.getValue());
+            nthreads = hts_get_shared_thread_pool_size();
         }
         catch (TCLAP::ArgException &e)
         {
@@ -109,6 +111,22 @@ class Igor : Program
         }
     };
 
+    /**
+     * Constructs a worker that decomposes the records of a shard with the options of igor.
+     */
+    Igor(Igor& igor, RegionShard *shard)
+    {
+        version = igor.version;
+        input_vcf_file = igor.input_vcf_file;
+        output_vcf_file = shard->output_vcf_file;
+        intervals = shard->intervals;
+        ref_fasta_file = igor.ref_fasta_file;
+        smart = igor.smart;
+        debug = igor.debug;
+        nthreads = 1;
+        fexp = igor.fexp;
+    };
+
     void initialize()
     {
         //////////////////////
@@ -187,6 +205,12 @@ class Igor : Program
 
     void decompose()
     {
+        if (nthreads>1 && odr->is_index_loaded())
+        {
+            decompose_shards();
+            return;
+        }
+
         bcf_hdr_t* h = odr->hdr;
         bcf1_t* v = bcf_init();
         Variant variant;
@@ -198,8 +222,7 @@ class Igor : Program
 
             if (filter_exists)
             {
-                vm->classify_variant(h, v, variant);
-                if (!filter.apply(h, v, &variant, false))
+                if (!filter.apply(h, v, &variant, vm, false))
                 {
                     continue;
                 }
@@ -969,6 +992,47 @@ class Igor : Program
         odw->close();
     };
 
+    /**
+     * Decomposes shards of the input in parallel and stitches the results.
+     */
+    void decompose_shards()
+    {
+        RegionSharder sharder(odr, intervals, nthreads);
+        sharder.run(decompose_shard, this);
+
+        for (size_t i=0; i<sharder.shards.size(); ++i)
+        {
+            Igor *worker = (Igor*) sharder.shards[i].data;
+
+            no_variants += worker->no_variants;
+            no_biallelic += worker->no_biallelic;
+            no_multiallelic += worker->no_multiallelic;
+            no_additional_biallelic += worker->no_additional_biallelic;
+
+            delete worker->odr;
+            delete worker->odw;
+            delete worker->vm;
+            delete worker;
+        }
+
+        sharder.stitch(odw);
+
+        odw->close();
+        odr->close();
+    }
+
+    /**
+     * Decomposes the records of a shard, called by the worker threads of RegionSharder.
+     */
+    static void decompose_shard(void *arg, RegionShard *shard)
+    {
+        Igor *worker = new Igor(*((Igor*) arg), shard);
+        worker->initialize();
+        worker->odr->set_interval_start_only(shard->interval_start_only);
+        worker->decompose();
+        shard->data = worker;
+    }
+
     void print_options()
     {
         std::clog << "decompose v" << version << "\n";
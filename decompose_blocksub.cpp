@@ -56,6 +56,7 @@ class Igor : Program
     std::string output_vcf_file;
     std::vector<GenomeInterval> intervals;
     std::string ref_fasta_file;
+    int32_t nthreads;
 
     ///////
     //i/o//
@@ -113,6 +114,7 @@ class Igor : Program
             max_mnv_dist = arg_max_mnv_dist.getValue();
             output_phased_genotypes = arg_output_phased_genotypes.getValue();
             parse_intervals(intervals, arg_interval_list.getValue(), arg_intervals.getValue());
+            nthreads = hts_get_shared_thread_pool_size();
         }
         catch (TCLAP::ArgException &e)
         {
@@ -121,6 +123,22 @@ class Igor : Program
         }
     };
 
+    /**
+     * Constructs a worker that decomposes the records of a shard with the options of igor.
+     */
+    Igor(Igor& igor, RegionShard *shard)
+    {
+        version = igor.version;
+        input_vcf_file = igor.input_vcf_file;
+        output_vcf_file = shard->output_vcf_file;
+        intervals = shard->intervals;
+        aggressive_mode = igor.aggressive_mode;
+        keep_mnv = igor.keep_mnv;
+        max_mnv_dist = igor.max_mnv_dist;
+        output_phased_genotypes = igor.output_phased_genotypes;
+        nthreads = 1;
+    };
+
     void initialize()
     {
         //////////////////////
@@ -176,6 +194,12 @@ class Igor : Program
 
     void decompose_blocksub()
     {
+        if (nthreads>1 && odr->is_index_loaded())
+        {
+            decompose_blocksub_shards();
+            return;
+        }
+
         v = odw->get_bcf1_from_pool();
         Variant variant;
 
@@ -430,6 +454,46 @@ class Igor : Program
         odr->close();
     };
 
+    /**
+     * Decomposes shards of the input in parallel and stitches the results.
+     */
+    void decompose_blocksub_shards()
+    {
+        RegionSharder sharder(odr, intervals, nthreads);
+        sharder.run(decompose_blocksub_shard, this);
+
+        for (size_t i=0; i<sharder.shards.size(); ++i)
+        {
+            Igor *worker = (Igor*) sharder.shards[i].data;
+
+            no_additional_snps += worker->no_additional_snps;
+            no_biallelic_blocksub += worker->no_biallelic_blocksub;
+            new_no_variants += worker->new_no_variants;
+            no_variants += worker->no_variants;
+
+            delete worker->odr;
+            delete worker->odw;
+            delete worker;
+        }
+
+        sharder.stitch(odw);
+
+        odw->close();
+        odr->close();
+    }
+
+    /**
+     * Decomposes the records of a shard, called by the worker threads of RegionSharder.
+     */
+    static void decompose_blocksub_shard(void *arg, RegionShard *shard)
+    {
+        Igor *worker = new Igor(*((Igor*) arg), shard);
+        worker->initialize();
+        worker->odr->set_interval_start_only(shard->interval_start_only);
+        worker->decompose_blocksub();
+        shard->data = worker;
+    }
+
     void print_options()
     {
         std::clog << "decompose_blocksub v" << version << "\n";
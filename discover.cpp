@@ -36,6 +36,9 @@ typedef struct
 
 KHASH_MAP_INIT_STR(rdict, interval_t)
 
+//bases read on each side of a shard so that the pileup of its first and last positions is complete
+#define DISCOVER_SHARD_PADDING 1000
+
 class Igor : Program
 {
     public:
@@ -50,6 +53,13 @@ class Igor : Program
     std::string sample_id;
     bool ignore_md;
     int32_t debug;
+    int32_t nthreads;
+
+    //intervals owned by a worker, candidates and reads in the padding belong to the neighbouring shards
+    std::vector<GenomeInterval> shard_intervals;
+    int32_t shard_tid;
+    int32_t shard_beg1;
+    int32_t shard_end1;
 
     //options for selecting reads
     khash_t(rdict) *reads;
@@ -178,6 +188,7 @@ class Igor : Program
             read_mapq_cutoff = arg_read_mapq_cutoff.getValue();
             ignore_overlapping_read = arg_ignore_overlapping_read.getValue();
             read_exclude_flag = arg_read_exclude_flag.getValue();
+            nthreads = hts_get_shared_thread_pool_size();
 
             vf.set_reference_bias(arg_reference_bias.getValue());
             vf.set_lr_cutoff(arg_lr_cutoff.getValue());
@@ -210,6 +221,40 @@ class Igor : Program
         }
     };
 
+    /**
+     * Constructs a worker that discovers variants in a shard with the options of igor.
+     *
+     * Shards cut from contigs are read with padding and only candidates
+     * within the shard are written out.
+     */
+    Igor(Igor& igor, RegionShard *shard)
+    {
+        version = igor.version;
+        input_bam_file = igor.input_bam_file;
+        output_vcf_file = shard->output_vcf_file;
+        ref_fasta_file = igor.ref_fasta_file;
+        sample_id = igor.sample_id;
+        ignore_md = igor.ignore_md;
+        debug = igor.debug;
+        nthreads = 1;
+        ploidy = igor.ploidy;
+        read_mapq_cutoff = igor.read_mapq_cutoff;
+        read_exclude_flag = igor.read_exclude_flag;
+        ignore_overlapping_read = igor.ignore_overlapping_read;
+        vf = igor.vf;
+
+        intervals = shard->intervals;
+        if (shard->interval_start_only)
+        {
+            shard_intervals = shard->intervals;
+            for (size_t i=0; i<intervals.size(); ++i)
+            {
+                intervals[i].start1 = std::max(1, intervals[i].start1-DISCOVER_SHARD_PADDING);
+                intervals[i].end1 = std::min((1<<29)-1, intervals[i].end1+DISCOVER_SHARD_PADDING);
+            }
+        }
+    };
+
     void initialize()
     {
         //////////////////////
@@ -272,6 +317,9 @@ class Igor : Program
         chrom = "";
         tid = -1;
         rid = -1;
+        shard_tid = -1;
+        shard_beg1 = 1;
+        shard_end1 = 0;
 
         ////////////////////////
         //tools initialization//
@@ -505,7 +553,7 @@ class Igor : Program
     /**
      * Compute -10 * log10 likelihood ratio P(Non Variant)/P(Variant) for an alternative SNP allele.
      */
-    float compute_snp_variant_score(std::vector<uint32_t>& REF_Q, std::vector<uint32_t>& ALT_Q)
+    float compute_snp_variant_score(BaseQualityHistogram& REF_Q, BaseQualityHistogram& ALT_Q)
     {
         float lg_theta = -3; // theta = 0.001;
         float lg_one_minus_theta = -0.0004345118; // 1-theta = 0.999;
@@ -514,21 +562,24 @@ class Igor : Program
         float lg_two_thirds = -0.1760913;
 
         float lg_pRR = 0;
-        float lg_pRA = 0;
+        float lg_pRA = (REF_Q.n+ALT_Q.n)*lg_0_5;
         float lg_pAA = 0;
 
-        for (uint32_t i=0; i<REF_Q.size(); ++i)
+        for (uint32_t q=0; q<=PILEUP_MAX_BASEQ; ++q)
         {
-            lg_pRR += lt.pl2pl_one_minus_p(REF_Q[i])/-10.0;
-            lg_pRA += lg_0_5;
-            lg_pAA += REF_Q[i]/-10.0;
-        }
+            if (REF_Q.counts[q])
+            {
+                uint32_t n = REF_Q.counts[q];
+                lg_pRR += n*(lt.pl2pl_one_minus_p(q)/-10.0);
+                lg_pAA += n*(q/-10.0);
+            }
 
-        for (uint32_t i=0; i<ALT_Q.size(); ++i)
-        {
-            lg_pRR += ALT_Q[i]/-10.0;
-            lg_pRA += lg_0_5;
-            lg_pAA += lt.pl2pl_one_minus_p(ALT_Q[i])/-10.0;
+            if (ALT_Q.counts[q])
+            {
+                uint32_t n = ALT_Q.counts[q];
+                lg_pRR += n*(q/-10.0);
+                lg_pAA += n*(lt.pl2pl_one_minus_p(q)/-10.0);
+            }
         }
 
         float lg_lr = lg_one_minus_theta + lg_pRR;
@@ -607,6 +658,11 @@ class Igor : Program
             return;
         }
 
+        if (shard_intervals.size() && !in_shard(tid, gpos1))
+        {
+            return;
+        }
+
         if (debug>=3 &&
             (p.X[1]+p.X[2]+p.X[4]+p.X[8]+p.X[15]>p.E+p.N ||
              p.D.size()+p.I.size()>p.N))
@@ -772,12 +828,12 @@ class Igor : Program
 
         if (p.D.size()!=0)
         {
-            for (std::map<std::string, uint32_t>::iterator i = p.D.begin(); i!=p.D.end(); ++i)
+            for (size_t i=0; i<p.D.size(); ++i)
             {
-                std::string del = i->first;
+                std::string del = p.alleles->get(p.D[i].id);
                 if (!contains_non_acgt_bases(del))
                 {
-                    E = i->second;
+                    E = p.D[i].count;
                     N = p.N;
 
                     if (vf.filter_del(E, N))
@@ -806,12 +862,12 @@ class Igor : Program
 
         if (p.I.size()!=0)
         {
-            for (std::map<std::string, uint32_t>::iterator i = p.I.begin(); i!=p.I.end(); ++i)
+            for (size_t i=0; i<p.I.size(); ++i)
             {
-                std::string ins = i->first;
+                std::string ins = p.alleles->get(p.I[i].id);
                 if (!contains_non_acgt_bases(ins))
                 {
-                    E = i->second;
+                    E = p.I[i].count;
                     N = p.N;
 
                     if (vf.filter_ins(E, N))
@@ -842,8 +898,9 @@ class Igor : Program
         {
             if (false && p.J.size()>=vf.get_sclip_u_cutoff())
             {
-                for (std::map<std::string, SoftClipInfo>::iterator i = p.J.begin(); i!=p.J.end(); ++i)
+                for (size_t i=0; i<p.J.size(); ++i)
                 {
+                    const char* seq = p.alleles->get(p.J[i].id);
                     bcf_clear(v);
                     bcf_set_rid(v, rid);
                     bcf_set_pos1(v, gpos1);
@@ -853,14 +910,14 @@ class Igor : Program
                     kputc(p.R, &new_alleles);
                     kputc(',', &new_alleles);
                     kputs("<LSC:", &new_alleles);
-                    kputw(i->first.size(), &new_alleles);
+                    kputw(strlen(seq), &new_alleles);
                     kputc('>', &new_alleles);
                     bcf_update_alleles_str(odw->hdr, v, new_alleles.s);
 
-                    bcf_update_info_string(odw->hdr, v, "SEQ", i->first.c_str());
+                    bcf_update_info_string(odw->hdr, v, "SEQ", seq);
 
                     bcf_update_genotypes(odw->hdr, v, &gts, ploidy);
-                    SoftClipInfo& info = i->second;
+                    SoftClipInfo& info = p.J[i];
                     uint32_t no = info.no;
                     E = no;
                     bcf_update_format_int32(odw->hdr, v, "E", &E, 1);
@@ -879,8 +936,9 @@ class Igor : Program
         {
             if (false && p.K.size()>=vf.get_sclip_u_cutoff())
             {
-                for (std::map<std::string, SoftClipInfo>::iterator i = p.K.begin(); i!=p.K.end(); ++i)
+                for (size_t i=0; i<p.K.size(); ++i)
                 {
+                    const char* seq = p.alleles->get(p.K[i].id);
                     bcf_clear(v);
                     bcf_set_rid(v, rid);
                     bcf_set_pos1(v, gpos1);
@@ -890,14 +948,14 @@ class Igor : Program
                     kputc(p.R, &new_alleles);
                     kputc(',', &new_alleles);
                     kputs("<RSC:", &new_alleles);
-                    kputw(i->first.size(), &new_alleles);
+                    kputw(strlen(seq), &new_alleles);
                     kputc('>', &new_alleles);
                     bcf_update_alleles_str(odw->hdr, v, new_alleles.s);
 
-                    bcf_update_info_string(odw->hdr, v, "SEQ", i->first.c_str());
+                    bcf_update_info_string(odw->hdr, v, "SEQ", seq);
 
                     bcf_update_genotypes(odw->hdr, v, &gts, ploidy);
-                    SoftClipInfo& info = i->second;
+                    SoftClipInfo& info = p.K[i];
                     uint32_t no = info.no;
                     E = no;
                     bcf_update_format_int32(odw->hdr, v, "E", &E, 1);
@@ -1395,13 +1453,7 @@ class Igor : Program
                     }
                     else if (opchar=='D')
                     {
-                        std::string del = "";
-                        for (size_t i=0; i<oplen ; ++i)
-                        {
-                            del += bam_base2char(bam_seqi(seq, spos0+i));
-                        }
-
-                        if (debug) std::cerr << "\t\t\tadding DEL: " << (cpos1-1) << " " << del << "\n";
+                        if (debug) std::cerr << "\t\t\tadding DEL: " << (cpos1-1) << " (" << oplen << ")\n";
                         pileup.add_D((cpos1-1), oplen);
 
                         cpos1 += oplen;
@@ -1473,8 +1525,21 @@ class Igor : Program
     void discover()
     {
         odw->write_hdr();
+
+        if (nthreads>1 && odr->index_loaded)
+        {
+            discover_shards();
+            return;
+        }
+
         while (odr->read(s))
         {
+            if (shard_intervals.size() && !in_shard(bam_get_tid(s), bam_get_pos1(s)))
+            {
+                process_padding_read(s);
+                continue;
+            }
+
             ++no_reads;
 
             if (!filter_read(s))
@@ -1497,6 +1562,150 @@ class Igor : Program
         odw->close();
     };
 
+    /**
+     * Discovers variants in shards of the input in parallel and stitches the results.
+     */
+    void discover_shards()
+    {
+        //the quality tables of LogTool are filled on first use and shared by the workers
+        lt.pl2pl_one_minus_p(PILEUP_MAX_BASEQ);
+
+        RegionSharder sharder(odr, intervals, nthreads);
+        sharder.run(discover_shard, this);
+
+        for (size_t i=0; i<sharder.shards.size(); ++i)
+        {
+            Igor *worker = (Igor*) sharder.shards[i].data;
+
+            no_reads += worker->no_reads;
+            no_overlapping_reads += worker->no_overlapping_reads;
+            no_passed_reads += worker->no_passed_reads;
+            no_exclude_flag_reads += worker->no_exclude_flag_reads;
+            no_low_mapq_reads += worker->no_low_mapq_reads;
+            no_unaligned_cigars += worker->no_unaligned_cigars;
+            no_malformed_del_cigars += worker->no_malformed_del_cigars;
+            no_malformed_ins_cigars += worker->no_malformed_ins_cigars;
+            no_salvageable_ins_cigars += worker->no_salvageable_ins_cigars;
+
+            no_snps += worker->no_snps;
+            no_ts += worker->no_ts;
+            no_tv += worker->no_tv;
+            no_insertions += worker->no_insertions;
+            no_deletions += worker->no_deletions;
+            no_left_soft_clips += worker->no_left_soft_clips;
+            no_right_soft_clips += worker->no_right_soft_clips;
+
+            worker->odr->close();
+            delete worker->odr;
+            delete worker->odw;
+            bam_destroy1(worker->s);
+            bcf_destroy(worker->v);
+            delete worker;
+        }
+
+        //reads without coordinates belong to no shard and are read last in a single pass
+        if (!intervals.size())
+        {
+            count_unplaced_reads();
+        }
+
+        sharder.stitch(odw);
+
+        odw->close();
+        odr->close();
+    }
+
+    /**
+     * Counts the reads at the end of the file that are not placed on any
+     * contig, they have no alignments and are only filtered.
+     */
+    void count_unplaced_reads()
+    {
+        hts_itr_t *itr = sam_itr_queryi(odr->idx, HTS_IDX_NOCOOR, 0, 0);
+        if (!itr)
+        {
+            return;
+        }
+
+        while (sam_itr_next(odr->file, itr, s)>=0)
+        {
+            ++no_reads;
+
+            if (!filter_read(s))
+            {
+                continue;
+            }
+
+            ++no_passed_reads;
+        }
+
+        hts_itr_destroy(itr);
+    }
+
+    /**
+     * Discovers variants in a shard, called by the worker threads of RegionSharder.
+     */
+    static void discover_shard(void *arg, RegionShard *shard)
+    {
+        Igor *worker = new Igor(*((Igor*) arg), shard);
+        worker->initialize();
+        worker->discover();
+        shard->data = worker;
+    }
+
+    /**
+     * Checks if a position belongs to the shard of a worker.
+     */
+    bool in_shard(int32_t tid, int32_t pos1)
+    {
+        if (tid<0)
+        {
+            return false;
+        }
+
+        if (tid!=shard_tid)
+        {
+            shard_tid = tid;
+            shard_beg1 = 1;
+            shard_end1 = 0;
+            for (size_t i=0; i<shard_intervals.size(); ++i)
+            {
+                if (shard_intervals[i].seq==odr->hdr->target_name[tid])
+                {
+                    shard_beg1 = shard_intervals[i].start1;
+                    shard_end1 = shard_intervals[i].end1;
+                    break;
+                }
+            }
+        }
+
+        return pos1>=shard_beg1 && pos1<=shard_end1;
+    }
+
+    /**
+     * Adds a read from the padding of a shard to the pileup, the read is
+     * counted by the shard that it begins in.
+     */
+    void process_padding_read(bam1_t *s)
+    {
+        uint32_t read_stats[7] = {no_overlapping_reads, no_exclude_flag_reads, no_low_mapq_reads,
+                                  no_unaligned_cigars, no_malformed_del_cigars, no_malformed_ins_cigars,
+                                  no_salvageable_ins_cigars};
+
+        if (filter_read(s))
+        {
+            process_read(s);
+        }
+
+        no_overlapping_reads = read_stats[0];
+        no_exclude_flag_reads = read_stats[1];
+        no_low_mapq_reads = read_stats[2];
+        no_unaligned_cigars = read_stats[3];
+        no_malformed_del_cigars = read_stats[4];
+        no_malformed_ins_cigars = read_stats[5];
+        no_salvageable_ins_cigars = read_stats[6];
+    }
+
     void print_options()
     {
         std::clog << "discover v" << version << "\n\n";
@@ -1575,6 +1784,7 @@ class Igor : Program
                 kh_del(rdict, reads, k);
             }
         }
+        kh_destroy(rdict, reads);
     };
 
     private:
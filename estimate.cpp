@@ -57,6 +57,7 @@ class Igor : Program
     int32_t *imap;
     int32_t nsamples;
     bool print_sites_only;
+    int32_t nthreads;
 
     ///////
     //i/o//
@@ -208,6 +209,7 @@ class Igor : Program
             print_sites_only = arg_print_sites_only.getValue();
             fexp = arg_fexp.getValue();
             parse_estimators(compute_estimate, arg_estimates.getValue());
+            nthreads = hts_get_shared_thread_pool_size();
         }
         catch (TCLAP::ArgException &e)
         {
@@ -216,6 +218,25 @@ class Igor : Program
         }
     };
 
+    /**
+     * Constructs a worker that computes the estimates for the records of a shard with the options of igor.
+     */
+    Igor(Igor& igor, RegionShard *shard)
+    {
+        version = igor.version;
+        input_vcf_file = igor.input_vcf_file;
+        output_vcf_file = shard->output_vcf_file;
+        intervals = shard->intervals;
+        print_sites_only = igor.print_sites_only;
+        fexp = igor.fexp;
+        estimates = igor.estimates;
+        for (size_t i=0; i<NO_EST; ++i)
+        {
+            compute_estimate[i] = igor.compute_estimate[i];
+        }
+        nthreads = 1;
+    };
+
     void initialize()
     {
         //////////////////////
@@ -306,6 +327,12 @@ class Igor : Program
 
     void estimate()
     {
+        if (nthreads>1 && odr->is_index_loaded())
+        {
+            estimate_shards();
+            return;
+        }
+
         bcf1_t *v = odw->get_bcf1_from_pool();
         bcf_hdr_t *h = odr->hdr;
         Variant variant;
@@ -548,6 +575,52 @@ class Igor : Program
         odw->close();
     };
 
+    /**
+     * Computes the estimates for shards of the input in parallel and stitches the results.
+     */
+    void estimate_shards()
+    {
+        //the probability table of LogTool is filled on first use and shared by the workers
+        LogTool::pl2prob(3236);
+
+        odw->write_hdr();
+
+        RegionSharder sharder(odr, intervals, nthreads);
+        sharder.run(estimate_shard, this);
+
+        for (size_t i=0; i<sharder.shards.size(); ++i)
+        {
+            Igor *worker = (Igor*) sharder.shards[i].data;
+
+            no_variants += worker->no_variants;
+            no_variants_not_computed += worker->no_variants_not_computed;
+            no_variants_computed += worker->no_variants_computed;
+            no_variants_missing_dependencies += worker->no_variants_missing_dependencies;
+            no_reference += worker->no_reference;
+
+            delete worker->odr;
+            delete worker->odw;
+            delete worker->vm;
+            delete worker;
+        }
+
+        sharder.stitch(odw);
+
+        odw->close();
+    }
+
+    /**
+     * Computes the estimates for the records of a shard, called by the worker threads of RegionSharder.
+     */
+    static void estimate_shard(void *arg, RegionShard *shard)
+    {
+        Igor *worker = new Igor(*((Igor*) arg), shard);
+        worker->initialize();
+        worker->odr->set_interval_start_only(shard->interval_start_only);
+        worker->estimate();
+        shard->data = worker;
+    }
+
     void print_options()
     {
         std::clog << "estimate v" << version << "\n";
@@ -34,6 +34,13 @@ Node::Node()
     tag = {0,0,0};
     s = {0,0,0};
     regex_set = false;
+    id = -1;
+    id_exists = false;
+    unpack = 0;
+    classify = false;
+    cost = 0;
+    definite = true;
+    per_sample = false;
 };
 
 /**
@@ -47,9 +54,443 @@ Node::Node(int32_t type)
     tag = {0,0,0};
     s = {0,0,0};
     regex_set = false;
+    id = -1;
+    id_exists = false;
+    unpack = 0;
+    classify = false;
+    cost = 0;
+    definite = true;
+    per_sample = false;
     this->type = type;
 };
 
+/**
+ * Computes the unpack level, cost and definiteness of this node
+ * from its type and its operands.
+ */
+void Node::update_properties()
+{
+    unpack = 0;
+    classify = false;
+    cost = 0;
+    definite = true;
+    per_sample = false;
+
+    //costs follow the order in which fields are unpacked,
+    //QUAL and N_ALLELE are available without unpacking
+    if (type&VT_BCF_OP)
+    {
+        int32_t op = type&63;
+        if (op==(VT_REF_COL&63) || op==(VT_ALT&63))
+        {
+            unpack = BCF_UN_STR;
+            cost = 1;
+        }
+        else if (op==(VT_FILTER&63) || op==(VT_N_FILTER&63))
+        {
+            unpack = BCF_UN_FLT;
+            cost = 2;
+        }
+        else if (op==(VT_INFO&63))
+        {
+            unpack = BCF_UN_INFO;
+            cost = 3;
+            definite = false;
+        }
+        else if (op==(VT_QUAL&63))
+        {
+            definite = false;
+        }
+        else if (op==(VT_FORMAT&63))
+        {
+            unpack = BCF_UN_FMT;
+            cost = 5;
+            per_sample = true;
+        }
+        else if (op==(VT_VARIANT_TYPE&63) ||
+                 op==(VT_VARIANT_DLEN&63) ||
+                 op==(VT_VARIANT_LEN&63) ||
+                 op==(VT_VARIANT_CONTAINS_N&63))
+        {
+            classify = true;
+            cost = 4;
+        }
+    }
+
+    if (left)
+    {
+        unpack |= left->unpack;
+        classify = classify || left->classify;
+        cost = std::max(cost, left->cost);
+        per_sample = per_sample || left->per_sample;
+    }
+
+    if (right)
+    {
+        unpack |= right->unpack;
+        classify = classify || right->classify;
+        cost = std::max(cost, right->cost);
+        per_sample = per_sample || right->per_sample;
+    }
+
+    if (type&VT_SAMPLE_OP)
+    {
+        if (!left->per_sample)
+        {
+            fprintf(stderr, "[%s:%d %s] COUNT, ANY, ALL and MEAN are applied to expressions on FORMAT fields\n", __FILE__, __LINE__, __FUNCTION__);
+            exit(1);
+        }
+
+        if (type==VT_MEAN && (left->type&VT_BOOL))
+        {
+            fprintf(stderr, "[%s:%d %s] MEAN is applied to a numeric expression on FORMAT fields\n", __FILE__, __LINE__, __FUNCTION__);
+            exit(1);
+        }
+        else if (type!=VT_MEAN && !(left->type&VT_BOOL))
+        {
+            fprintf(stderr, "[%s:%d %s] COUNT, ANY and ALL are applied to a boolean expression on FORMAT fields\n", __FILE__, __LINE__, __FUNCTION__);
+            exit(1);
+        }
+
+        //the samples are reduced to a single value
+        per_sample = false;
+        definite = type!=VT_MEAN;
+        return;
+    }
+
+    //missing per sample values are handled sample by sample
+    if (per_sample)
+    {
+        if ((type&VT_LOGIC_OP) &&
+            ((left->per_sample && !(left->type&VT_BOOL)) || (right && right->per_sample && !(right->type&VT_BOOL))))
+        {
+            fprintf(stderr, "[%s:%d %s] logical operations on FORMAT fields require boolean operands\n", __FILE__, __LINE__, __FUNCTION__);
+            exit(1);
+        }
+
+        definite = true;
+        return;
+    }
+
+    //a value does not exist only when all the operands involved do not exist
+    if (type==VT_NOT)
+    {
+        definite = true;
+    }
+    else if (type==VT_AND || type==VT_OR)
+    {
+        definite = left->definite && right->definite;
+    }
+    else if (type&(VT_MATH_CMP|VT_MATH_OP))
+    {
+        definite = left->definite || right->definite;
+    }
+}
+
+/**
+ * Binds this node to a header, header IDs and types of INFO and FILTER
+ * tags are resolved here so that they are not looked up for every record.
+ */
+void Node::compile(bcf_hdr_t *h)
+{
+    if ((type&63)==(VT_INFO&63))
+    {
+        id = bcf_hdr_id2int(h, BCF_DT_ID, tag.s);
+        if (!bcf_hdr_idinfo_exists(h, BCF_HL_INFO, id))
+        {
+            fprintf(stderr, "[%s:%d %s] INFO tag %s does not exist in header of VCF file.\n", __FILE__, __LINE__, __FUNCTION__, tag.s);
+            exit(1);
+        }
+
+        var_length = bcf_hdr_id2length(h, BCF_HL_INFO, id);
+        number = bcf_hdr_id2number(h, BCF_HL_INFO, id);
+
+        int32_t info_type = bcf_hdr_id2type(h, BCF_HL_INFO, id);
+        if (info_type==BCF_HT_FLAG)
+        {
+            type = VT_INFO|VT_FLG;
+        }
+        else if (info_type==BCF_HT_INT)
+        {
+            type = VT_INFO|VT_INT;
+        }
+        else if (info_type==BCF_HT_REAL)
+        {
+            type = VT_INFO|VT_FLT;
+        }
+        else
+        {
+            type = VT_INFO|VT_STR;
+        }
+    }
+    else if ((type&63)==(VT_FORMAT&63))
+    {
+        id = bcf_hdr_id2int(h, BCF_DT_ID, tag.s);
+        if (!bcf_hdr_idinfo_exists(h, BCF_HL_FMT, id))
+        {
+            fprintf(stderr, "[%s:%d %s] FORMAT tag %s does not exist in header of VCF file.\n", __FILE__, __LINE__, __FUNCTION__, tag.s);
+            exit(1);
+        }
+
+        int32_t format_type = bcf_hdr_id2type(h, BCF_HL_FMT, id);
+        if (format_type==BCF_HT_INT)
+        {
+            type = VT_FORMAT|VT_INT;
+        }
+        else if (format_type==BCF_HT_REAL)
+        {
+            type = VT_FORMAT|VT_FLT;
+        }
+        else
+        {
+            fprintf(stderr, "[%s:%d %s] FORMAT tag %s is not an Integer or Float field.\n", __FILE__, __LINE__, __FUNCTION__, tag.s);
+            exit(1);
+        }
+    }
+    else if (type==VT_FILTER)
+    {
+        id = bcf_hdr_id2int(h, BCF_DT_ID, tag.s);
+        id_exists = bcf_hdr_idinfo_exists(h, BCF_HL_FLT, id);
+    }
+    else if ((type==VT_MATCH || type==VT_NO_MATCH) && right->type==VT_STR)
+    {
+        //regular expression literals are compiled once
+        pregex.set(right->s.s);
+        regex_set = true;
+    }
+}
+
+/**
+ * Reads the value of a compiled INFO node at position k.
+ * Returns false if the value does not exist.
+ */
+bool Node::read_info_value(bcf1_t *v, int32_t k)
+{
+    bcf_info_t *info = bcf_get_info_id(v, id);
+    if (!info || !info->vptr || k>=info->len)
+    {
+        return false;
+    }
+
+    //values are read from the record directly, vector end markers
+    //indicate that there are less values than the length of the field
+    switch (info->type)
+    {
+        case BCF_BT_INT8:
+        {
+            int8_t x = ((int8_t*)info->vptr)[k];
+            if (x==bcf_int8_vector_end) return false;
+            i = x==bcf_int8_missing ? bcf_int32_missing : x;
+            break;
+        }
+        case BCF_BT_INT16:
+        {
+            int16_t x = le_to_i16(info->vptr + k*sizeof(int16_t));
+            if (x==bcf_int16_vector_end) return false;
+            i = x==bcf_int16_missing ? bcf_int32_missing : x;
+            break;
+        }
+        case BCF_BT_INT32:
+        {
+            int32_t x = le_to_i32(info->vptr + k*sizeof(int32_t));
+            if (x==bcf_int32_vector_end) return false;
+            i = x;
+            break;
+        }
+        case BCF_BT_FLOAT:
+        {
+            uint32_t x = le_to_u32(info->vptr + k*sizeof(float));
+            if (x==bcf_float_vector_end) return false;
+            memcpy(&f, &x, sizeof(float));
+            i = (int32_t) f;
+            return true;
+        }
+        default:
+            return false;
+    }
+
+    f = (float) i;
+    return true;
+}
+
+/**
+ * Reads the values of a compiled FORMAT node for all samples.
+ */
+void Node::read_format_values(bcf1_t *v)
+{
+    int32_t n = v->n_sample;
+    sample_values.resize(n);
+    float* x = sample_values.data();
+
+    bcf_fmt_t *fmt = bcf_get_fmt_id(v, id);
+    int32_t k = index ? index-1 : 0;
+    if (!fmt || !fmt->p || k>=fmt->n)
+    {
+        std::fill(sample_values.begin(), sample_values.end(), NAN);
+        return;
+    }
+
+    //the values of a sample are fmt->size bytes apart,
+    //missing values and vector end markers are read as NaN
+    const uint8_t* p = fmt->p + k*(fmt->size/fmt->n);
+    int32_t size = fmt->size;
+    switch (fmt->type)
+    {
+        case BCF_BT_INT8:
+            for (int32_t j=0; j<n; ++j)
+            {
+                int8_t y = (int8_t) p[j*size];
+                x[j] = (y==bcf_int8_missing || y==bcf_int8_vector_end) ? NAN : y;
+            }
+            break;
+        case BCF_BT_INT16:
+            for (int32_t j=0; j<n; ++j)
+            {
+                int16_t y = le_to_i16(p+j*size);
+                x[j] = (y==bcf_int16_missing || y==bcf_int16_vector_end) ? NAN : y;
+            }
+            break;
+        case BCF_BT_INT32:
+            for (int32_t j=0; j<n; ++j)
+            {
+                int32_t y = le_to_i32(p+j*size);
+                x[j] = (y==bcf_int32_missing || y==bcf_int32_vector_end) ? NAN : y;
+            }
+            break;
+        case BCF_BT_FLOAT:
+            for (int32_t j=0; j<n; ++j)
+            {
+                uint32_t y = le_to_u32(p+j*size);
+                memcpy(&x[j], &y, sizeof(float));
+                x[j] = (y==bcf_float_missing || y==bcf_float_vector_end) ? NAN : x[j];
+            }
+            break;
+        default:
+            std::fill(sample_values.begin(), sample_values.end(), NAN);
+    }
+}
+
+/**
+ * Gets the per sample values of an operand, a value that is not per sample
+ * is repeated for each sample.
+ */
+const float* Node::get_sample_values(Node* operand, int32_t n)
+{
+    if (operand->per_sample)
+    {
+        if ((int32_t)operand->sample_values.size()!=n)
+        {
+            fprintf(stderr, "[%s:%d %s] evaluation not supported : %s on boolean values of samples\n", __FILE__, __LINE__, __FUNCTION__, type2string(type).c_str());
+            exit(1);
+        }
+
+        return operand->sample_values.data();
+    }
+
+    float x = NAN;
+    if (operand->value_exists)
+    {
+        x = (operand->type&VT_FLT) ? operand->f : operand->i;
+    }
+    sample_values_buffer.assign(n, x);
+
+    return sample_values_buffer.data();
+}
+
+/**
+ * Gets the per sample booleans of an operand, a value that is not per sample
+ * is repeated for each sample.
+ */
+const uint8_t* Node::get_sample_mask(Node* operand, int32_t n)
+{
+    if (operand->per_sample)
+    {
+        return operand->sample_mask.data();
+    }
+
+    sample_mask_buffer.assign(n, operand->value_exists && operand->b);
+
+    return sample_mask_buffer.data();
+}
+
+/**
+ * Evaluates the actions for this node for all samples.
+ */
+void Node::evaluate_samples(bcf_hdr_t *h, bcf1_t *v, bool debug)
+{
+    int32_t n = v->n_sample;
+
+    if (type&VT_BCF_OP)
+    {
+        read_format_values(v);
+    }
+    else if (type&VT_LOGIC_OP)
+    {
+        sample_mask.resize(n);
+        uint8_t* y = sample_mask.data();
+        const uint8_t* a = get_sample_mask(left, n);
+
+        if (type==VT_NOT)
+        {
+            for (int32_t j=0; j<n; ++j) y[j] = !a[j];
+            return;
+        }
+
+        const uint8_t* c = get_sample_mask(right, n);
+        if (type==VT_AND)
+        {
+            for (int32_t j=0; j<n; ++j) y[j] = a[j] & c[j];
+        }
+        else
+        {
+            for (int32_t j=0; j<n; ++j) y[j] = a[j] | c[j];
+        }
+    }
+    else if (type&VT_MATH_CMP)
+    {
+        sample_mask.resize(n);
+        uint8_t* y = sample_mask.data();
+        const float* a = get_sample_values(left, n);
+        const float* c = get_sample_values(right, n);
+
+        //comparisons with NaN are false, != is the exception and is guarded
+        switch (type)
+        {
+            case VT_EQ: for (int32_t j=0; j<n; ++j) y[j] = a[j]==c[j]; break;
+            case VT_NE: for (int32_t j=0; j<n; ++j) y[j] = a[j]!=c[j] && a[j]==a[j] && c[j]==c[j]; break;
+            case VT_LT: for (int32_t j=0; j<n; ++j) y[j] = a[j]<c[j]; break;
+            case VT_LE: for (int32_t j=0; j<n; ++j) y[j] = a[j]<=c[j]; break;
+            case VT_GT: for (int32_t j=0; j<n; ++j) y[j] = a[j]>c[j]; break;
+            case VT_GE: for (int32_t j=0; j<n; ++j) y[j] = a[j]>=c[j]; break;
+            default:
+                fprintf(stderr, "[%s:%d %s] evaluation not supported for FORMAT fields : %s\n", __FILE__, __LINE__, __FUNCTION__, type2string(type).c_str());
+                exit(1);
+        }
+
+        if (debug)
+            std::cerr << "\tVT_MATH_CMP over " << n << " samples\n";
+    }
+    else if (type&VT_MATH_OP)
+    {
+        //NaN is propagated for missing values
+        const float* a = get_sample_values(left, n);
+        const float* c = get_sample_values(right, n);
+        sample_values.resize(n);
+        float* y = sample_values.data();
+
+        switch (type)
+        {
+            case VT_ADD: for (int32_t j=0; j<n; ++j) y[j] = a[j]+c[j]; break;
+            case VT_SUB: for (int32_t j=0; j<n; ++j) y[j] = a[j]-c[j]; break;
+            case VT_MUL: for (int32_t j=0; j<n; ++j) y[j] = a[j]*c[j]; break;
+            case VT_DIV: for (int32_t j=0; j<n; ++j) y[j] = a[j]/c[j]; break;
+            default:
+                fprintf(stderr, "[%s:%d %s] evaluation not supported for FORMAT fields : %s\n", __FILE__, __LINE__, __FUNCTION__, type2string(type).c_str());
+                exit(1);
+        }
+    }
+}
+
 /**
  * Evaluates the actions for this node.
  */
@@ -61,6 +502,61 @@ void Node::evaluate(bcf_hdr_t *h, bcf1_t *v, Variant *variant, bool debug)
     //by default
     value_exists = true;
 
+    if (per_sample)
+    {
+        evaluate_samples(h, v, debug);
+        return;
+    }
+
+    if (type&VT_SAMPLE_OP)
+    {
+        int32_t n = v->n_sample;
+
+        if (type==VT_MEAN)
+        {
+            const float* x = left->sample_values.data();
+            double sum = 0;
+            int32_t m = 0;
+            for (int32_t j=0; j<n; ++j)
+            {
+                //NaN denotes a missing value
+                bool exists = x[j]==x[j];
+                sum += exists ? x[j] : 0;
+                m += exists;
+            }
+
+            if (debug)
+                std::cerr << "\tVT_MEAN "   <<  sum << "/" << m << " \n";
+
+            if (m==0)
+            {
+                value_exists = false;
+                return;
+            }
+
+            f = sum/m;
+            i = (int32_t) f;
+        }
+        else
+        {
+            const uint8_t* x = left->sample_mask.data();
+            int32_t count = 0;
+            for (int32_t j=0; j<n; ++j)
+            {
+                count += x[j];
+            }
+
+            if (debug)
+                std::cerr << "\tVT_COUNT "   <<  count << "/" << n << " \n";
+
+            i = count;
+            f = (float) count;
+            b = type==VT_ALL ? count==n : count!=0;
+        }
+
+        return;
+    }
+
     if (type&VT_LOGIC_OP)
     {
         if (!left->value_exists && type==VT_NOT)
@@ -187,10 +683,10 @@ void Node::evaluate(bcf_hdr_t *h, bcf1_t *v, Variant *variant, bool debug)
                 if (debug)
                     std::cerr << "\tVT_MATCH "   <<  left->s.s << "&" << right->s.s    <<  " \n";
 
+                //patterns that are not literals are looked up in the cache of pregex
                 if (!regex_set)
                 {
                     pregex.set(right->s.s);
-                    regex_set = true;
                 }
 
                 b = pregex.match(left->s.s);
@@ -216,10 +712,10 @@ void Node::evaluate(bcf_hdr_t *h, bcf1_t *v, Variant *variant, bool debug)
                 if (debug)
                     std::cerr << "\tVT_NO_MATCH "   <<  left->s.s << "&" << right->s.s    <<  " \n";
 
+                //patterns that are not literals are looked up in the cache of pregex
                 if (!regex_set)
                 {
                     pregex.set(right->s.s);
-                    regex_set = true;
                 }
 
                 b = !pregex.match(left->s.s);
@@ -484,12 +980,14 @@ void Node::evaluate(bcf_hdr_t *h, bcf1_t *v, Variant *variant, bool debug)
 
         if (type==VT_REF_COL)
         {
+            bcf_unpack(v, BCF_UN_STR);
             s.l = 0;
             char* ref = bcf_get_ref(v);
             kputs(ref, &s);
         }
         else if (type==VT_ALT)
         {
+            bcf_unpack(v, BCF_UN_STR);
             int32_t no_allele = bcf_get_n_allele(v);
             if (no_allele)
             {
@@ -522,49 +1020,44 @@ void Node::evaluate(bcf_hdr_t *h, bcf1_t *v, Variant *variant, bool debug)
         else if (type==VT_FILTER)
         {
             bcf_unpack(v, BCF_UN_FLT);
-            if (bcf_get_n_filter(v) && bcf_has_filter(h, v, tag.s))
-            {
-                b = true;
-            }
-            else
+            b = false;
+            if (bcf_get_n_filter(v))
             {
-                b = false;
+                //an undefined FILTER tag is treated as present, as in bcf_has_filter
+                b = !id_exists;
+                for (int32_t j=0; j<bcf_get_n_filter(v) && !b; ++j)
+                {
+                    b = v->d.flt[j]==id;
+                }
             }
         }
         else if (type==VT_N_FILTER)
         {
+            bcf_unpack(v, BCF_UN_FLT);
             i = bcf_get_n_filter(v);
             f = i;
             b = true;
             value_exists = true;
         }
-        //figure out type
-        //this should only be invoked once so that we can short circuit
-        //the type checking in subsequent applications of the filter
-        //expression
-        else if (type==VT_INFO)
+        //INFO types are resolved when the filter is compiled
+        else if ((type&63)==(VT_INFO&63))
         {
-            if (!bcf_hdr_idinfo_exists(h, BCF_HL_INFO, bcf_hdr_id2int(h, BCF_DT_ID, tag.s)))
+            if (type&VT_FLG)
             {
-                fprintf(stderr, "[%s:%d %s] INFO tag %s does not exist in header of VCF file.\n", __FILE__, __LINE__, __FUNCTION__, tag.s);
-                exit(1);
-            }
-
-            int32_t int_id = bcf_hdr_id2int(h, BCF_DT_ID, tag.s);
-            int32_t info_type = bcf_hdr_id2type(h, BCF_HL_INFO, int_id);
-            var_length = bcf_hdr_id2length(h, BCF_HL_INFO, int_id);
-            number = bcf_hdr_id2number(h, BCF_HL_INFO, int_id);
-            bcf_unpack(v, BCF_UN_INFO);
+                b = bcf_get_info_id(v, id)!=NULL;
 
-            if (info_type==BCF_HT_FLAG)
+                if (debug)
+                    std::cerr << "\tVT_INFO|VT_FLG "   << b <<  " \n";
+            }
+            else if (type&VT_STR)
             {
-                type |= VT_FLG;
-                if (bcf_get_info_flag(h, v, tag.s, 0, 0)>0)
+                //todo: how do you handle a vector of strings?
+                bcf_info_t *info = bcf_get_info_id(v, id);
+                if (info && info->vptr)
                 {
-                    i = 1;
-                    f = 1;
+                    s.l = 0;
+                    kputsn((char*)info->vptr, info->len, &s);
                     b = true;
-                    s.l=0;
                 }
                 else
                 {
@@ -572,275 +1065,12 @@ void Node::evaluate(bcf_hdr_t *h, bcf1_t *v, Variant *variant, bool debug)
                     value_exists = false;
                 }
             }
-            else if (info_type==BCF_HT_INT)
-            {
-//                std::cerr << "\tadd INT to VT_INFO type\n";
-
-
-                type |= VT_INT;
-
-                if (var_length==BCF_VL_FIXED)
-                {
-//                    std::cerr << "\tFIXED length\n";
-
-//                    std::cerr << "\tnumber : " << number << "\n";
-                    if (number==1)
-                    {
-                        int32_t ns = 0;
-                        int32_t *is = NULL;
-                        if (bcf_get_info_int32(h, v, tag.s, &is, &ns)>0)
-                        {
-//                            std::cerr << "\tupdating field i\n";
-
-                            i = is[0];
-                            f = (float)is[0];
-                        }
-                        else
-                        {
-                            b = false;
-                            value_exists = false;
-                        }
-
-                        if (ns) free(is);
-                    }
-                    else if (number>1)
-                    {
-//                        std::cerr << "\tnumber > 1 "  << "\n";
-//                        std::cerr << "1) updating initial record\n";
-                        int32_t ns = 0;
-                        int32_t *is = NULL;
-                        if (bcf_get_info_int32(h, v, tag.s, &is, &ns)>0)
-                        {
-                            ivec.resize(0);
-                            fvec.resize(0);
-                            for (int32_t i=0; i<ns; ++i)
-                            {
-                                ivec.push_back(is[i]);
-                                fvec.push_back(is[i]);
-                            }
-                            i = is[index-1];
-                            f = (float)is[index-1];
-                        }
-                        else
-                        {
-                            b = false;
-                            value_exists = false;
-                        }
-
-                        if (ns) free(is);
-                    }
-                    else
-                    {
-                        std::cerr << "\thmmmmmm "  << "\n";
-                        //hmmmmm.....
-                    }
-                }
-                else if (var_length==BCF_VL_R || var_length==BCF_VL_A || var_length==BCF_VL_G)
-                {
-                    int32_t no_alleles = bcf_get_n_allele(v);
-
-                    if (var_length==BCF_VL_R)
-                    {
-//                        std::cerr << "\tR length\n";
-                        number = no_alleles;
-                    }
-                    else if (var_length==BCF_VL_A)
-                    {
-//                        std::cerr << "\tA length\n";
-                        number = no_alleles-1;
-                    }
-                    else if (var_length==BCF_VL_G)
-                    {
-//                        std::cerr << "\tG length\n";
-                        //assume ploidy is too for the time being
-                        //usage is not determinable for info fields because
-                        //ploidy is individual dependent
-                        number = bcf_ap2g(no_alleles, 2);
-                    }
-
-//                    std::cerr << "\tnumber : " << number << "\n";
-                    if (number==1)
-                    {
-                        int32_t ns = 0;
-                        int32_t *is = NULL;
-                        if (bcf_get_info_int32(h, v, tag.s, &is, &ns)>0)
-                        {
-//                            std::cerr << "\tupdating field i\n";
-
-                            i = is[0];
-                            f = (float)is[0];
-                        }
-                        else
-                        {
-                            b = false;
-                            value_exists = false;
-                        }
-
-                        if (ns) free(is);
-                    }
-                    else if (number>1)
-                    {
-                        std::cerr << "\tnumber > 1 "  << "\n";
-//                        std::cerr << "1) updating initial record\n";
-                        int32_t ns = 0;
-                        int32_t *is = NULL;
-                        if (bcf_get_info_int32(h, v, tag.s, &is, &ns)>0)
-                        {
-                            ivec.resize(0);
-                            fvec.resize(0);
-                            for (int32_t i=0; i<ns; ++i)
-                            {
-                                ivec.push_back(is[i]);
-                                fvec.push_back(is[i]);
-                            }
-                            i = is[index-1];
-                            f = (float)is[index-1];
-                        }
-                        else
-                        {
-                            b = false;
-                            value_exists = false;
-                        }
-
-                        if (ns) free(is);
-                    }
-                    else
-                    {
-                        std::cerr << "\thmmmmmm "  << "\n";
-
-                        //hmmmmm.....
-                    }
-                }
-                else if (var_length==BCF_VL_VAR)
-                {
-                    std::cerr << "\tvariable length, should we treat as a blob?\n";
-                }
-            }
-            else if (info_type==BCF_HT_REAL)
-            {
-                type |= VT_FLT;
-
-                if (var_length==BCF_VL_FIXED)
-                {
-                    if (number==1)
-                    {
-                        int32_t ns = 0;
-                        int32_t *fs = NULL;
-                        if (bcf_get_info_float(h, v, tag.s, &fs, &ns)>0)
-                        {
-                            i = (int32_t) fs[0];
-                            f = fs[0];
-                        }
-                        else
-                        {
-                            b = false;
-                            value_exists = false;
-                        }
-
-                        if (ns) free(fs);
-                    }
-                    else if (number>1)
-                    {
-                        int32_t ns = 0;
-                        int32_t *fs = NULL;
-                        if (bcf_get_info_float(h, v, tag.s, &fs, &ns)>0)
-                        {
-                            ivec.resize(0);
-                            fvec.resize(0);
-                            for (int32_t i=0; i<ns; ++i)
-                            {
-                                ivec.push_back(fs[i]);
-                                fvec.push_back(fs[i]);
-                            }
-                            i = (int32_t) fs[index-1];
-                            f = fs[index-1];
-                        }
-                        else
-                        {
-                            b = false;
-                            value_exists = false;
-                        }
-
-                        if (ns) free(fs);
-                    }
-                }
-                else if (var_length==BCF_VL_R || var_length==BCF_VL_A || var_length==BCF_VL_G)
-                {
-                    int32_t no_alleles = bcf_get_n_allele(v);
-
-                    if (var_length==BCF_VL_R)
-                    {
-                        number = no_alleles;
-                    }
-                    else if (var_length==BCF_VL_A)
-                    {
-                        number = no_alleles-1;
-                    }
-                    else if (var_length==BCF_VL_G)
-                    {
-                        //assume ploidy is too for the time being
-                        //usage is not determinable for info fields because
-                        //ploidy is individual dependent
-                        number = bcf_ap2g(no_alleles, 2);
-                    }
-
-                    if (number==1)
-                    {
-                        int32_t ns = 0;
-                        int32_t *fs = NULL;
-                        if (bcf_get_info_float(h, v, tag.s, &fs, &ns)>0)
-                        {
-                            i = (int32_t)fs[0];
-                            f = fs[0];
-                        }
-                        else
-                        {
-                            b = false;
-                            value_exists = false;
-                        }
-
-                        if (ns) free(fs);
-                    }
-                    else if (number>1)
-                    {
-                        int32_t ns = 0;
-                        int32_t *fs = NULL;
-                        if (bcf_get_info_float(h, v, tag.s, &fs, &ns)>0)
-                        {
-                            ivec.resize(0);
-                            fvec.resize(0);
-                            for (int32_t i=0; i<ns; ++i)
-                            {
-                                ivec.push_back(fs[i]);
-                                fvec.push_back(fs[i]);
-                            }
-                            i = (int32_t)fs[index-1];
-                            f = fs[index-1];
-                        }
-                        else
-                        {
-                            b = false;
-                            value_exists = false;
-                        }
-
-                        if (ns) free(fs);
-                    }
-                }
-                else if (var_length==BCF_VL_VAR)
-                {
-                    //variable length, should we treat as a blob?
-                }
-            }
-            else if (info_type==BCF_HT_STR)
+            else
             {
-                type |= VT_STR;
-                //todo: how do you handle a vector of strings?
-
-                int32_t n = s.m;
-                if (bcf_get_info_string(h, v, tag.s, &s.s, &n)>0)
+                //index access e.g. AC[1], the first value otherwise
+                if (read_info_value(v, index ? index-1 : 0))
                 {
                     b = true;
-                    s.m = n;
                 }
                 else
                 {
@@ -849,283 +1079,6 @@ void Node::evaluate(bcf_hdr_t *h, bcf1_t *v, Variant *variant, bool debug)
                 }
             }
         }
-        //fast lane for INFO-TYPEs
-        else if (type==(VT_INFO|VT_INT))
-        {
-            if (var_length==BCF_VL_FIXED)
-            {
-                if (number==1)
-                {
-                    int32_t n = 0;
-                    int32_t *data = NULL;
-                    if (bcf_get_info_int32(h, v, tag.s, &data, &n)>0)
-                    {
-                        b = true;
-                        i = data[0];
-                        f = (float)data[0];
-                    }
-                    else
-                    {
-                        b = false;
-                        value_exists = false;
-                    }
-
-                    if (data) free(data);
-                }
-                else if (number>1)
-                {
-                    int32_t n = 0;
-                    int32_t *data = NULL;
-                    if (bcf_get_info_int32(h, v, tag.s, &data, &n)>0)
-                    {
-                        ivec.resize(0);
-                        fvec.resize(0);
-                        for (int32_t i=0; i<n; ++i)
-                        {
-                            ivec.push_back(data[i]);
-                            fvec.push_back(data[i]);
-                        }
-                        b = true;
-                        i = data[index-1];
-                        f = (float)data[index-1];
-                    }
-                    else
-                    {
-                        b = false;
-                        value_exists = false;
-                    }
-
-                    if (n) free(data);
-                }
-                else
-                {
-                    //hmmmmm.....
-                }
-            }
-            else if (var_length==BCF_VL_R || var_length==BCF_VL_A || var_length==BCF_VL_G)
-            {
-                int32_t no_alleles = bcf_get_n_allele(v);
-
-                if (var_length==BCF_VL_R)
-                {
-                    number = no_alleles;
-                }
-                else if (var_length==BCF_VL_A)
-                {
-                    number = no_alleles-1;
-                }
-                else if (var_length==BCF_VL_G)
-                {
-                    //assume ploidy is too for the time being
-                    //usage is not determinable for info fields because
-                    //ploidy is individual dependent
-                    number = bcf_ap2g(no_alleles, 2);
-                }
-
-                if (number==1)
-                {
-                    int32_t ns = 0;
-                    int32_t *is = NULL;
-                    if (bcf_get_info_int32(h, v, tag.s, &is, &ns)>0)
-                    {
-                        i = is[0];
-                        f = (float)is[0];
-                    }
-                    else
-                    {
-                        b = false;
-                        value_exists = false;
-                    }
-
-                    if (ns) free(is);
-                }
-                else if (number>1)
-                {
-                    int32_t ns = 0;
-                    int32_t *is = NULL;
-                    if (bcf_get_info_int32(h, v, tag.s, &is, &ns)>0)
-                    {
-                        ivec.resize(0);
-                        fvec.resize(0);
-                        for (int32_t i=0; i<ns; ++i)
-                        {
-                            ivec.push_back(is[i]);
-                            fvec.push_back(is[i]);
-                        }
-                        i = is[index-1];
-                        f = (float)is[index-1];
-                    }
-                    else
-                    {
-                        b = false;
-                        value_exists = false;
-                    }
-
-                    if (ns) free(is);
-                }
-            }
-        }
-        else if (type==(VT_INFO|VT_FLT))
-        {
-            float *data = NULL;
-            int32_t n = 0;
-
-            if (bcf_get_info_float(h, v, tag.s, &data, &n)>0)
-            {
-                b = true;
-                i = (int32_t) data[0];
-                f = data[0];
-            }
-            else
-            {
-                b = false;
-                value_exists = false;
-            }
-
-            if (n) free(data);
-        }
-        else if (type==(VT_INFO|VT_FLT))
-        {
-            if (var_length==BCF_VL_FIXED)
-            {
-                if (number==1)
-                {
-                    int32_t ns = 0;
-                    int32_t *fs = NULL;
-                    if (bcf_get_info_float(h, v, tag.s, &fs, &ns)>0)
-                    {
-                        i = (int32_t) fs[0];
-                        f = fs[0];
-                    }
-                    else
-                    {
-                        b = false;
-                        value_exists = false;
-                    }
-
-                    if (ns) free(fs);
-                }
-                else if (number>1)
-                {
-                    int32_t ns = 0;
-                    int32_t *fs = NULL;
-                    if (bcf_get_info_float(h, v, tag.s, &fs, &ns)>0)
-                    {
-                        ivec.resize(0);
-                        fvec.resize(0);
-                        for (int32_t i=0; i<ns; ++i)
-                        {
-                            ivec.push_back(fs[i]);
-                            fvec.push_back(fs[i]);
-                        }
-                        i = (int32_t) fs[index-1];
-                        f = fs[index-1];
-                    }
-                    else
-                    {
-                        b = false;
-                        value_exists = false;
-                    }
-
-                    if (ns) free(fs);
-                }
-            }
-            else if (var_length==BCF_VL_R || var_length==BCF_VL_A || var_length==BCF_VL_G)
-            {
-                int32_t no_alleles = bcf_get_n_allele(v);
-
-                if (var_length==BCF_VL_R)
-                {
-                    number = no_alleles;
-                }
-                else if (var_length==BCF_VL_A)
-                {
-                    number = no_alleles-1;
-                }
-                else if (var_length==BCF_VL_G)
-                {
-                    //assume ploidy is too for the time being
-                    //usage is not determinable for info fields because
-                    //ploidy is individual dependent
-                    number = bcf_ap2g(no_alleles, 2);
-                }
-
-                if (number==1)
-                {
-                    int32_t ns = 0;
-                    int32_t *fs = NULL;
-                    if (bcf_get_info_float(h, v, tag.s, &fs, &ns)>0)
-                    {
-                        i = (int32_t)fs[0];
-                        f = fs[0];
-                    }
-                    else
-                    {
-                        b = false;
-                        value_exists = false;
-                    }
-
-                    if (ns) free(fs);
-                }
-                else if (number>1)
-                {
-                    int32_t ns = 0;
-                    int32_t *fs = NULL;
-                    if (bcf_get_info_float(h, v, tag.s, &fs, &ns)>0)
-                    {
-                        ivec.resize(0);
-                        fvec.resize(0);
-                        for (int32_t i=0; i<ns; ++i)
-                        {
-                            ivec.push_back(fs[i]);
-                            fvec.push_back(fs[i]);
-                        }
-                        i = (int32_t)fs[index-1];
-                        f = fs[index-1];
-                    }
-                    else
-                    {
-                        b = false;
-                        value_exists = false;
-                    }
-
-                    if (ns) free(fs);
-                }
-            }
-            else if (var_length==BCF_VL_VAR)
-            {
-                std::cerr << "\tvariable length, should we treat as a blob?\n";
-            }
-        }
-        else if (type==(VT_INFO|VT_STR))
-        {
-            int32_t n = s.m;
-
-            if (bcf_get_info_string(h, v, tag.s, &s.s, &n)>0)
-            {
-                b = true;
-                s.m = n;
-            }
-            else
-            {
-                b = false;
-                value_exists = false;
-            }
-        }
-        else if (type==(VT_INFO|VT_FLG))
-        {
-            if (bcf_get_info_flag(h, v, tag.s, 0, 0)>0)
-            {
-                b = true;
-            }
-            else
-            {
-                b = false;
-            }
-
-            if (debug)
-                std::cerr << "\tVT_INFO|VT_FLG "   << i << " " << f << " " << b << " " << s.s <<  " \n";
-        }
         else if (type==VT_VARIANT_TYPE)
         {
             if (debug)
@@ -1410,6 +1363,12 @@ std::string Node::type2string(int32_t type)
         s += "BCF_OP";
     }
 
+    if (type&VT_SAMPLE_OP)
+    {
+        s += (s==""? "" : "|");
+        s += "SAMPLE_OP";
+    }
+
     if (type==VT_QUAL)
     {
         s += (s==""? "" : "|");
@@ -1434,6 +1393,36 @@ std::string Node::type2string(int32_t type)
         s += "INFO";
     }
 
+    if ((type&~(VT_INT|VT_FLT))==VT_FORMAT)
+    {
+        s += (s==""? "" : "|");
+        s += "FORMAT";
+    }
+
+    if (type==VT_COUNT)
+    {
+        s += (s==""? "" : "|");
+        s += "COUNT";
+    }
+
+    if (type==VT_ANY)
+    {
+        s += (s==""? "" : "|");
+        s += "ANY";
+    }
+
+    if (type==VT_ALL)
+    {
+        s += (s==""? "" : "|");
+        s += "ALL";
+    }
+
+    if (type==VT_MEAN)
+    {
+        s += (s==""? "" : "|");
+        s += "MEAN";
+    }
+
     if (type==VT_N_ALLELE)
     {
         s += (s==""? "" : "|");
@@ -1467,6 +1456,7 @@ std::string Node::type2string(int32_t type)
 Filter::Filter()
 {
     this->tree = NULL;
+    compiled_hdr = NULL;
 };
 
 /**
@@ -1475,6 +1465,7 @@ Filter::Filter()
 Filter::Filter(std::string exp)
 {
     this->tree = NULL;
+    compiled_hdr = NULL;
     parse(exp.c_str(), false);
 };
 
@@ -1498,12 +1489,19 @@ void Filter::parse(const char* exp, bool debug)
         reset();
         tree = new Node();
         parse(exp_no_space.c_str(), exp_no_space.size(), tree, debug);
+        order(tree);
 
         if (!(tree->type&VT_BOOL))
         {
             fprintf(stderr, "[%s:%d %s] filter expression not boolean %s\n", __FILE__, __LINE__, __FUNCTION__, exp);
             exit(1);
         }
+
+        if (tree->per_sample)
+        {
+            fprintf(stderr, "[%s:%d %s] FORMAT fields have to be aggregated over samples with COUNT, ANY, ALL or MEAN %s\n", __FILE__, __LINE__, __FUNCTION__, exp);
+            exit(1);
+        }
     }
     else
     {
@@ -1511,22 +1509,88 @@ void Filter::parse(const char* exp, bool debug)
     }
 }
 
+/**
+ * Compiles the filter expression against a header.  This is invoked
+ * by apply when the header changes.
+ */
+void Filter::compile(bcf_hdr_t *h)
+{
+    program.clear();
+    compiled_hdr = h;
+
+    if (tree==NULL)
+    {
+        return;
+    }
+
+    this->h = h;
+    compile(tree);
+}
+
 /**
  * Applies filter to vcf record.
  */
-bool Filter::apply(bcf_hdr_t *h, bcf1_t *v, Variant *variant, bool debug) //recursive
+bool Filter::apply(bcf_hdr_t *h, bcf1_t *v, Variant *variant, bool debug)
+{
+    return apply(h, v, variant, NULL, debug);
+}
+
+/**
+ * Applies filter to vcf record, the variant is classified with vm only
+ * when the result is not decided by the cheaper parts of the expression.
+ */
+bool Filter::apply(bcf_hdr_t *h, bcf1_t *v, Variant *variant, VariantManip *vm, bool debug)
 {
     if (tree==NULL)
     {
         return true;
     }
 
+    if (h!=compiled_hdr)
+    {
+        compile(h);
+    }
+
     this->h = h;
     this->v = v;
     this->variant = variant;
+    this->vm = vm;
+
+    bool classified = (vm==NULL);
 
     if (debug) std::cerr << "==========\n";
-    apply(tree, debug);
+    int32_t n = program.size();
+    int32_t pc = 0;
+    while (pc<n)
+    {
+        FilterInstruction& instruction = program[pc];
+        Node* node = instruction.node;
+
+        if (instruction.classify && !classified)
+        {
+            vm->classify_variant(h, v, *variant);
+            classified = true;
+        }
+
+        //lazy evaluation for && and ||
+        if (instruction.jump!=-1)
+        {
+            if (node->left->value_exists && node->left->b==(node->type==VT_OR))
+            {
+                node->b = node->left->b;
+                node->value_exists = true;
+                pc = instruction.jump;
+            }
+            else
+            {
+                ++pc;
+            }
+            continue;
+        }
+
+        node->evaluate(h, v, variant, debug);
+        ++pc;
+    }
     if (debug) std::cerr << "==========\n";
 
     if (tree->value_exists)
@@ -1539,6 +1603,15 @@ bool Filter::apply(bcf_hdr_t *h, bcf1_t *v, Variant *variant, bool debug) //recu
     }
 }
 
+/**
+ * Returns the bcf_unpack level required to apply the filter, this
+ * excludes the fields required for classification of the variant.
+ */
+int32_t Filter::get_unpack_level()
+{
+    return tree ? tree->unpack : 0;
+}
+
 /**
  * Attempts to simplify the expression tree by collapsing nodes that can be precomputed.
  */
@@ -1556,6 +1629,8 @@ void Filter::reset()
         delete tree;
         tree = NULL;
     }
+    program.clear();
+    compiled_hdr = NULL;
 }
 
 /**
@@ -1578,8 +1653,19 @@ void Filter::parse(const char* exp, int32_t len, Node *node, bool debug)
     while (exp[len-1]==' ') --len;
     trim_brackets(exp, len, debug);
 
+    int32_t name_len = 0;
+    int32_t aggregate_type = is_aggregate(exp, len, name_len, debug);
+
+    //aggregate over samples
+    if (aggregate_type!=VT_UNKNOWN)
+    {
+        node->type = aggregate_type;
+
+        node->left = new Node();
+        parse(exp+name_len, len-name_len, node->left, debug);
+    }
     //this is a literal
-    if (is_literal(exp, len, debug))
+    else if (is_literal(exp, len, debug))
     {
         //will not recurse any further
         return parse_literal(exp, len, node, debug);
@@ -1660,7 +1746,10 @@ bool Filter::is_unary_op(const char* exp, int32_t len, bool debug)
     //NOT operator
     if (exp[0]=='~')
     {
-        if (is_literal(exp+1, len-1, debug)||is_bracketed_expression(exp+1, len-1, debug))
+        int32_t name_len = 0;
+        if (is_literal(exp+1, len-1, debug)||
+            is_bracketed_expression(exp+1, len-1, debug)||
+            is_aggregate(exp+1, len-1, name_len, debug)!=VT_UNKNOWN)
         {
             if (debug) std::cerr << "\tis unary op\n";
             return true;
@@ -1671,6 +1760,45 @@ bool Filter::is_unary_op(const char* exp, int32_t len, bool debug)
     return false;
 }
 
+/**
+ * Checks if exp is an aggregate over samples e.g. COUNT(FORMAT.DP>10).
+ * Returns the type of the aggregate and the length of its name, VT_UNKNOWN if it is not.
+ */
+int32_t Filter::is_aggregate(const char* exp, int32_t len, int32_t &name_len, bool debug)
+{
+    int32_t type = VT_UNKNOWN;
+
+    if (len>6 && strncmp(exp, "COUNT(", 6)==0)
+    {
+        type = VT_COUNT;
+        name_len = 5;
+    }
+    else if (len>4 && strncmp(exp, "ANY(", 4)==0)
+    {
+        type = VT_ANY;
+        name_len = 3;
+    }
+    else if (len>4 && strncmp(exp, "ALL(", 4)==0)
+    {
+        type = VT_ALL;
+        name_len = 3;
+    }
+    else if (len>5 && strncmp(exp, "MEAN(", 5)==0)
+    {
+        type = VT_MEAN;
+        name_len = 4;
+    }
+
+    //the bracket after the name has to enclose the rest of the expression
+    if (type==VT_UNKNOWN || !is_bracketed_expression(exp+name_len, len-name_len, debug))
+    {
+        return VT_UNKNOWN;
+    }
+
+    if (debug) std::cerr << "\tis aggregate\n";
+    return type;
+}
+
 /**
  * Checks is expression is bracketed.
  */
@@ -1710,6 +1838,12 @@ bool Filter::is_bracketed_expression(const char* exp, int32_t len, bool debug)
                --opened_brackets;
             }
 
+            //the first bracket is closed before the end e.g. (a)&&(b)
+            if (opened_brackets==0)
+            {
+                nested = false;
+                break;
+            }
             ++j;
         }
 
@@ -1869,6 +2003,16 @@ void Filter::parse_literal(const char* exp, int32_t len, Node * node, bool debug
         if (debug) std::cerr << "\tis info_op\n";
         return;
     }
+    else if (strncmp(exp, "FORMAT.", 7)==0)
+    {
+        node->type = VT_FORMAT;
+        exp += 7;
+        //detect index access e.g. AD[2]
+        int32_t index_width = get_index_width(exp, len-7, &node->index);
+        kputsn(exp, len-7-index_width, &node->tag);
+        if (debug) std::cerr << "\tis format_op\n";
+        return;
+    }
     else if (strncmp(exp, "VTYPE", 5)==0)
     {
         node->type = VT_VARIANT_TYPE;
@@ -2050,6 +2194,13 @@ void Filter::print_filter_help()
     fprintf(stderr, "  Passed Common biallelic SNPs only           : PASS&&VTYPE==SNP&&N_ALLELE==2&&INFO.AF>0.005\n");
     fprintf(stderr, "  Passed Common biallelic SNPs or rare indels : (PASS&&VTYPE==SNP&&N_ALLELE==2&&INFO.AF>0.005)||(VTYPE&INDEL&&INFO.AF<=0.005)\n");
     fprintf(stderr, "\n");
+    fprintf(stderr, "  FORMAT fields aggregated over samples\n");
+    fprintf(stderr, "    COUNT(<exp>), ANY(<exp>), ALL(<exp>), MEAN(<exp>)\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  At least 10 samples with GQ>=20 and DP>=8 : COUNT(FORMAT.GQ>=20&&FORMAT.DP>=8)>=10\n");
+    fprintf(stderr, "  Mean depth of samples above 20            : MEAN(FORMAT.DP)>20\n");
+    fprintf(stderr, "  No sample with alt allele fraction > 0.2  : ~ANY(FORMAT.AD[2]/FORMAT.DP>0.2)\n");
+    fprintf(stderr, "\n");
     fprintf(stderr, "  Regular expressions for string fields using pcre2\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "  Passed variants in intergenic regions or UTR : PASS&&INFO.ANNO=~'Intergenic|UTR'\n");
@@ -2305,55 +2456,110 @@ int32_t Filter::peek_op(const char* &r, int32_t len, int32_t &oplen, bool debug)
 }
 
 /**
- * Recursive call for apply.
+ * Recursive call for compile.
  */
-void Filter::apply(Node* node, bool debug)
+void Filter::compile(Node* node)
 {
-    node->value_exists = false;
-
-    //evaluate downstream
     if (node->left!=NULL)
     {
-        apply(node->left, debug);
+        compile(node->left);
+    }
+
+    //per sample values are combined for all samples and are not short circuited
+    if ((node->type==VT_AND || node->type==VT_OR) && !node->per_sample)
+    {
+        int32_t k = program.size();
+        program.push_back(FilterInstruction(node, -1));
+        compile(node->right);
+        //skips the right operand and this node
+        program[k].jump = program.size()+1;
+    }
+    else if (node->right!=NULL)
+    {
+        compile(node->right);
+    }
+
+    node->compile(h);
+
+    if (node->type&(VT_LOGIC_OP|VT_MATH_CMP|VT_MATH_OP|VT_BCF_OP|VT_SAMPLE_OP))
+    {
+        program.push_back(FilterInstruction(node, -1));
+        program.back().classify = (node->type&VT_BCF_OP) && node->classify;
     }
+    else
+    {
+        //literals are evaluated once
+        node->value_exists = true;
+    }
+}
 
-    //can do some lazy evaluation here for && and || types.
-    if (node->type&VT_LOGIC_OP)
+/**
+ * Computes the properties of the nodes and orders the operands of
+ * chains of && and || so that cheaper operands are evaluated first.
+ */
+void Filter::order(Node* node)
+{
+    if (node->type==VT_AND || node->type==VT_OR)
     {
-        if (node->type==VT_AND)
+        std::vector<Node*> operands;
+        std::vector<Node*> ops;
+        collect_operands(node, node->type, operands, ops);
+
+        bool definite = true;
+        for (uint32_t i=0; i<operands.size(); ++i)
         {
-            if (node->left->value_exists && !node->left->b)
-            {
-                node->b = false;
-                node->value_exists = true;
-                return;
-            }
-            else
-            {
-                 apply(node->right, debug);
-            }
+            order(operands[i]);
+            definite = definite && operands[i]->definite;
         }
-        else if (node->type==VT_OR)
+
+        //operands with missing values do not commute, these are left as is
+        if (definite)
         {
-            if (node->left->value_exists && node->left->b)
-            {
-                node->b = true;
-                node->value_exists = true;
-                return;
-            }
-            else
+            std::stable_sort(operands.begin(), operands.end(), CompareNodeCost());
+
+            for (uint32_t i=0; i<ops.size(); ++i)
             {
-                 apply(node->right, debug);
+                ops[i]->left = operands[i];
+                ops[i]->right = i+1<ops.size() ? ops[i+1] : operands[i+1];
+                ops[i]->left->parent = ops[i];
+                ops[i]->right->parent = ops[i];
             }
         }
-    }
-    else
-    {
-        if (node->right!=NULL)
+
+        for (int32_t i=ops.size()-1; i>=0; --i)
         {
-            apply(node->right, debug);
+            ops[i]->update_properties();
         }
+
+        return;
     }
 
-    node->evaluate(h, v, variant, debug);
-};
\ No newline at end of file
+    if (node->left!=NULL)
+    {
+        order(node->left);
+    }
+
+    if (node->right!=NULL)
+    {
+        order(node->right);
+    }
+
+    node->update_properties();
+}
+
+/**
+ * Collects the operands of a chain of the same logical operator.
+ */
+void Filter::collect_operands(Node* node, int32_t op, std::vector<Node*>& operands, std::vector<Node*>& ops)
+{
+    if (node->type==op)
+    {
+        ops.push_back(node);
+        collect_operands(node->left, op, operands, ops);
+        collect_operands(node->right, op, operands, ops);
+    }
+    else
+    {
+        operands.push_back(node);
+    }
+}
@@ -26,8 +26,10 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cmath>
 #include "hts_utils.h"
 #include "variant.h"
+#include "variant_manip.h"
 #include "pregex.h"
 
 //TYPES
@@ -36,6 +38,7 @@
 #define VT_MATH_CMP  4096   //0x2000
 #define VT_MATH_OP   8192   //0x4000
 #define VT_BCF_OP    16384  //0x8000
+#define VT_SAMPLE_OP 32768  //0x10000
 
 #define VT_BOOL     64      //0x0040
 #define VT_INT      128     //0x0080 
@@ -76,6 +79,13 @@
 #define VT_INFO                (41|VT_BCF_OP)
 #define VT_REF_COL             (42|VT_BCF_OP|VT_STR)
 #define VT_ALT                 (43|VT_BCF_OP|VT_STR)
+#define VT_FORMAT              (44|VT_BCF_OP)
+
+//aggregates of per sample values
+#define VT_COUNT               (45|VT_INT|VT_SAMPLE_OP)
+#define VT_ANY                 (46|VT_SAMPLE_OP|VT_BOOL)
+#define VT_ALL                 (47|VT_SAMPLE_OP|VT_BOOL)
+#define VT_MEAN                (48|VT_SAMPLE_OP|VT_FLT)
 
 //problems will arise once you pass 63.
 #define VT_UNKNOWN -1
@@ -95,6 +105,7 @@ class Node
 //VT_MATH_CMP  4096
 //VT_MATH_OP   8192
 //VT_BCF_OP    16384
+//VT_SAMPLE_OP 32768
 //
 //VT_BOOL     64
 //VT_INT      128
@@ -111,6 +122,15 @@ class Node
     int32_t number; //actual length
     kstring_t tag;  //store the INFO tag of a BCF type
     int32_t index;  //store index value of interest
+    int32_t id;     //header ID of the INFO, FORMAT or FILTER tag, resolved when compiled
+    bool id_exists; //if the FILTER tag is defined in the header
+
+    //properties of this node and its operands, computed when parsed
+    int32_t unpack;     //bcf_unpack level required
+    bool classify;      //if classification of the variant is required
+    int32_t cost;       //relative cost of evaluation, used to order operands of && and ||
+    bool definite;      //if a value always exists after evaluation
+    bool per_sample;    //if this node has a value for each sample, these are FORMAT fields and operations on them
 
     bool value_exists; // if value exists
 
@@ -125,6 +145,13 @@ class Node
     std::vector<int32_t> ivec;
     std::vector<float> fvec;
 
+    //per sample values, stored contiguously so that operations on them are simple loops,
+    //missing values are NaN and evaluate to false in comparisons
+    std::vector<float> sample_values;
+    std::vector<uint8_t> sample_mask;
+    std::vector<float> sample_values_buffer;   //for repeating a value over the samples
+    std::vector<uint8_t> sample_mask_buffer;   //for repeating a boolean over the samples
+
     PERLregex pregex;
     bool regex_set;
 
@@ -138,17 +165,93 @@ class Node
      */
     Node(int32_t type);
 
+    /**
+     * Computes the unpack level, cost and definiteness of this node
+     * from its type and its operands.
+     */
+    void update_properties();
+
+    /**
+     * Binds this node to a header, header IDs and types of INFO and FILTER
+     * tags are resolved here so that they are not looked up for every record.
+     */
+    void compile(bcf_hdr_t *h);
+
     /**
      * Evaluates the actions for this node.
      */
     void evaluate(bcf_hdr_t *h, bcf1_t *v, Variant *variant, bool debug=false);
 
+    /**
+     * Evaluates the actions for this node for all samples.
+     */
+    void evaluate_samples(bcf_hdr_t *h, bcf1_t *v, bool debug=false);
+
+    /**
+     * Reads the values of a compiled FORMAT node for all samples.
+     */
+    void read_format_values(bcf1_t *v);
+
+    /**
+     * Gets the per sample values of an operand, a value that is not per sample
+     * is repeated for each sample.
+     */
+    const float* get_sample_values(Node* operand, int32_t n);
+
+    /**
+     * Gets the per sample booleans of an operand, a value that is not per sample
+     * is repeated for each sample.
+     */
+    const uint8_t* get_sample_mask(Node* operand, int32_t n);
+
+    /**
+     * Reads the value of a compiled INFO node at position k.
+     * Returns false if the value does not exist.
+     */
+    bool read_info_value(bcf1_t *v, int32_t k);
+
     /**
      * Converts type to string.
      */
     std::string type2string(int32_t type);
 };
 
+/**
+ * Comparator for ordering nodes by the cost of evaluation.
+ */
+class CompareNodeCost
+{
+    public:
+    bool operator()(const Node* a, const Node* b)
+    {
+        return a->cost < b->cost;
+    }
+};
+
+/**
+ * Instruction of a compiled filter expression.
+ *
+ * The expression tree is flattened in post order, a node is evaluated after
+ * its operands.  For && and ||, an additional instruction is placed after
+ * the left operand that skips the right operand when the left operand
+ * decides the result.
+ */
+class FilterInstruction
+{
+    public:
+
+    Node* node;
+    int32_t jump;  //instruction to continue from when short circuited, -1 if this is not a short circuit
+    bool classify; //if the variant has to be classified before this node is evaluated
+
+    FilterInstruction(Node* node, int32_t jump)
+    {
+        this->node = node;
+        this->jump = jump;
+        classify = false;
+    };
+};
+
 /**
  * Filter for VCF records.
  */
@@ -159,10 +262,15 @@ class Filter
     //filter expression
     Node* tree;
 
+    //compiled filter expression
+    std::vector<FilterInstruction> program;
+    bcf_hdr_t *compiled_hdr;
+
     //useful pointers for applying the filter to a vcf record
     bcf_hdr_t *h;
     bcf1_t *v;
     Variant *variant;
+    VariantManip *vm;
 
     /**
      * Constructor.
@@ -179,11 +287,29 @@ class Filter
      */
     void parse(const char* exp, bool debug=false);
 
+    /**
+     * Compiles the filter expression against a header.  This is invoked
+     * by apply when the header changes.
+     */
+    void compile(bcf_hdr_t *h);
+
     /**
      * Applies filter to vcf record.
      */
     bool apply(bcf_hdr_t *h, bcf1_t *v, Variant *variant, bool debug=false);
 
+    /**
+     * Applies filter to vcf record, the variant is classified with vm only
+     * when the result is not decided by the cheaper parts of the expression.
+     */
+    bool apply(bcf_hdr_t *h, bcf1_t *v, Variant *variant, VariantManip *vm, bool debug=false);
+
+    /**
+     * Returns the bcf_unpack level required to apply the filter, this
+     * excludes the fields required for classification of the variant.
+     */
+    int32_t get_unpack_level();
+
     /**
      * Attempts to simplify the expression tree by collapsing nodes that can be precomputed.
      */
@@ -211,6 +337,12 @@ class Filter
      */
     bool is_unary_op(const char* exp, int32_t len, bool debug=false);
 
+    /**
+     * Checks if exp is an aggregate over samples e.g. COUNT(FORMAT.DP>10).
+     * Returns the type of the aggregate and the length of its name, VT_UNKNOWN if it is not.
+     */
+    int32_t is_aggregate(const char* exp, int32_t len, int32_t &name_len, bool debug=false);
+
     /**
      * Checks is expression is bracketed.
      */
@@ -247,9 +379,20 @@ class Filter
     int32_t peek_op(const char* &r, int32_t len, int32_t &oplen, bool debug);
 
     /**
-     * Recursive call for apply.
+     * Recursive call for compile.
+     */
+    void compile(Node* node);
+
+    /**
+     * Computes the properties of the nodes and orders the operands of
+     * chains of && and || so that cheaper operands are evaluated first.
+     */
+    void order(Node* node);
+
+    /**
+     * Collects the operands of a chain of the same logical operator.
      */
-    void apply(Node* node, bool debug=false);
+    void collect_operands(Node* node, int32_t op, std::vector<Node*>& operands, std::vector<Node*>& ops);
 
     /**
      * Help message on filter expressions.
@@ -103,8 +103,8 @@ void GENCODERecord::feature2string(int32_t feature, kstring_t *s)
  */
 GENCODE::GENCODE(std::string& gencode_gtf_file, std::string& ref_fasta_file, std::vector<GenomeInterval>& intervals)
 {
-    fai = fai_load(ref_fasta_file.c_str());
-    if (fai==NULL) 
+    ref_index = ReferenceIndex::load(ref_fasta_file);
+    if (ref_index==NULL) 
     {
         fprintf(stderr, "[%s:%d %s] Cannot load genome index: %s\n", __FILE__, __LINE__, __FUNCTION__, ref_fasta_file.c_str());
         exit(1);
@@ -273,8 +273,8 @@ GENCODE::GENCODE(std::string& gencode_gtf_file, std::string& ref_fasta_file, std
  */
 GENCODE::GENCODE(std::string& gencode_gtf_file, std::string& ref_fasta_file)
 {
-    fai = fai_load(ref_fasta_file.c_str());
-    if (fai==NULL) 
+    ref_index = ReferenceIndex::load(ref_fasta_file);
+    if (ref_index==NULL) 
     {
         fprintf(stderr, "[%s:%d %s] Cannot load genome index: %s\n", __FILE__, __LINE__, __FUNCTION__, ref_fasta_file.c_str());
         exit(1);
@@ -291,7 +291,7 @@ void GENCODE::fill_synonymous(GENCODERecord *g)
     {
         //extract sequence
         int32_t ref_len;
-//        char* seq = faidx_fetch_seq(fai, g->chrom.c_str(), g->start, g->end, &ref_len);
+//        char* seq = ref_index->fetch_seq(g->chrom.c_str(), g->start, g->end, &ref_len);
         
 //        g->syn = new int32_t[ref_len];
 //        kstring_t s = {0,0,0}; 
@@ -425,8 +425,8 @@ void GENCODE::initialize(std::vector<GenomeInterval>& intervals)
             int32_t ref_len1 = 0;
             int32_t ref_len2 = 0;
 
-            char *dnc1 = faidx_fetch_seq(fai, chrom.c_str(), start1-3, start1-2, &ref_len1);
-            char *dnc2 = faidx_fetch_seq(fai, chrom.c_str(), end1, end1+1, &ref_len2);
+            char *dnc1 = ref_index->fetch_seq(chrom.c_str(), start1-3, start1-2, &ref_len1);
+            char *dnc2 = ref_index->fetch_seq(chrom.c_str(), end1, end1+1, &ref_len2);
 
             if(strand=='+')
             {
@@ -124,7 +124,7 @@ class GENCODE
     public:
     std::string gencode_gtf_file;
     std::string ref_fasta_file;
-    faidx_t *fai;
+    ReferenceIndex *ref_index;
     std::map<std::string, IntervalTree*> CHROM;
     std::stringstream token;
     khash_t(aadict) *codon2syn;
@@ -225,8 +225,8 @@ class GENCODE
 //            int32_t ref_len1 = 0;
 //            int32_t ref_len2 = 0;
 //
-//            char *dnc1 = faidx_fetch_seq(fai, chrom.c_str(), start1-3, start1-2, &ref_len1);
-//            char *dnc2 = faidx_fetch_seq(fai, chrom.c_str(), end1, end1+1, &ref_len2);
+//            char *dnc1 = ref_index->fetch_seq(chrom.c_str(), start1-3, start1-2, &ref_len1);
+//            char *dnc2 = ref_index->fetch_seq(chrom.c_str(), end1, end1+1, &ref_len2);
 //
 //            if(strand=='+')
 //            {
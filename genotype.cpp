@@ -23,6 +23,9 @@
 
 #include "genotype.h"
 
+//sites closer than this are genotyped from a single region of the BAM file in sparse mode
+#define SPARSE_REGION_GAP 1000
+
 namespace
 {
 
@@ -48,6 +51,7 @@ class Igor : Program
     std::string sample_id;
     std::string input_vcf_file;
     std::string input_sam_file;
+    std::string input_sam_file_list;
     std::string output_vcf_file;
     std::string ref_fasta_file;
     std::string mode;
@@ -59,6 +63,11 @@ class Igor : Program
     int32_t tid; // current sequence id in bam
     int32_t rid; // current sequence id in bcf
 
+    //samples genotyped jointly from a list of BAM files
+    std::vector<std::string> input_sam_files;
+    std::vector<std::string> sample_ids;
+    std::vector<double> contams;
+
     //read filters
     uint32_t read_mapq_cutoff;
     uint16_t read_exclude_flag;
@@ -67,14 +76,17 @@ class Igor : Program
     ///////
     //i/o//
     ///////
-    BAMOrderedReader *odr;
+    BAMSyncedReader *sr;
     BCFGenotypingBufferedReader *gbr;
     BCFOrderedWriter *odw;
 
     std::vector<GenomeInterval> intervals;
 
-    //options for selecting reads
-    khash_t(rdict) *reads;
+    //regions of the BAM file around the sites for sparse genotyping
+    std::vector<GenomeInterval> site_regions;
+
+    //options for selecting reads, for each sample
+    std::vector<khash_t(rdict)*> reads;
 
     /////////
     //stats//
@@ -118,9 +130,11 @@ class Igor : Program
 
             TCLAP::ValueArg<std::string> arg_intervals("i", "i", "intervals []", false, "", "str", cmd);
             TCLAP::ValueArg<std::string> arg_interval_list("I", "I", "file containing list of intervals []", false, "", "file", cmd);
-            TCLAP::ValueArg<std::string> arg_input_sam_file("b", "b", "input SAM/BAM/CRAM file []", true, "", "string", cmd);
+            TCLAP::ValueArg<std::string> arg_input_sam_file("b", "b", "input SAM/BAM/CRAM file []", false, "", "string", cmd);
+            TCLAP::ValueArg<std::string> arg_input_sam_file_list("L", "L", "file containing list of SAM/BAM/CRAM files to be genotyped jointly,\n"
+                 "              one per line with optional columns for the sample ID and contamination fraction []", false, "", "file", cmd);
             TCLAP::ValueArg<std::string> arg_output_vcf_file("o", "o", "output VCF file", false, "-", "string", cmd);
-            TCLAP::ValueArg<std::string> arg_sample_id("s", "s", "sample ID []", true, "", "string", cmd);
+            TCLAP::ValueArg<std::string> arg_sample_id("s", "s", "sample ID []", false, "", "string", cmd);
             TCLAP::ValueArg<std::string> arg_mode("m", "m", "mode [d]\n"
                  "              d : iterate by read for dense genotyping.\n"
                  "                 (e.g. 50m variants close to one another).\n"
@@ -136,6 +150,7 @@ class Igor : Program
             mode = arg_mode.getValue();
             input_vcf_file = arg_input_vcf_file.getValue();
             input_sam_file = arg_input_sam_file.getValue();
+            input_sam_file_list = arg_input_sam_file_list.getValue();
             output_vcf_file = arg_output_vcf_file.getValue();
             sample_id = arg_sample_id.getValue();
             parse_intervals(intervals, arg_interval_list.getValue(), arg_intervals.getValue());
@@ -165,15 +180,74 @@ class Igor : Program
         //read_exclude_flag = 0x0704;
 
         //input sam
-        odr = new BAMOrderedReader(input_sam_file, intervals);
+        sr = NULL;
+        if (input_sam_file_list!="")
+        {
+            if (input_sam_file!="")
+            {
+                fprintf(stderr, "[E:%s:%d %s] specify either a SAM/BAM/CRAM file or a list of files\n", __FILE__, __LINE__, __FUNCTION__);
+                exit(1);
+            }
+
+            if (sample_id!="")
+            {
+                fprintf(stderr, "[E:%s:%d %s] sample IDs are given in the second column of the list of files, -s cannot be used with -L\n", __FILE__, __LINE__, __FUNCTION__);
+                exit(1);
+            }
+
+            parse_sam_file_list();
+        }
+        else if (input_sam_file=="" || sample_id=="")
+        {
+            fprintf(stderr, "[E:%s:%d %s] a SAM/BAM/CRAM file with a sample ID or a list of files is required\n", __FILE__, __LINE__, __FUNCTION__);
+            exit(1);
+        }
+        else
+        {
+            //a single sample is genotyped as a joint call of one uncontaminated sample
+            input_sam_files.push_back(input_sam_file);
+            sample_ids.push_back(sample_id);
+            contams.push_back(0);
+        }
+
+        if (mode=="s")
+        {
+            collect_site_regions();
+            sr = new BAMSyncedReader(input_sam_files, site_regions, ref_fasta_file);
+
+            if (input_sam_file!="" && !sr->odrs[0]->index_loaded)
+            {
+                fprintf(stderr, "[W:%s:%d %s] %s is not indexed, genotyping in dense mode\n", __FILE__, __LINE__, __FUNCTION__, input_sam_file.c_str());
+                sr->close();
+                delete sr;
+                sr = new BAMSyncedReader(input_sam_files, intervals, ref_fasta_file);
+                mode = "d";
+            }
+        }
+        else if (mode=="d")
+        {
+            sr = new BAMSyncedReader(input_sam_files, intervals, ref_fasta_file);
+        }
+        else
+        {
+            fprintf(stderr, "[E:%s:%d %s] mode not recognized: %s\n", __FILE__, __LINE__, __FUNCTION__, mode.c_str());
+            exit(1);
+        }
 
         //input vcf
-        gbr = new BCFGenotypingBufferedReader(input_vcf_file, intervals, ref_fasta_file);
+        gbr = new BCFGenotypingBufferedReader(input_vcf_file, intervals, ref_fasta_file, contams);
 
         //output vcf
         odw = new BCFOrderedWriter(output_vcf_file);
         bcf_hdr_transfer_contigs(gbr->odr->hdr, odw->hdr);
-        bcf_hdr_add_sample(odw->hdr, strdup(sample_id.c_str()));
+        for (size_t i=0; i<sample_ids.size(); ++i)
+        {
+            if (bcf_hdr_add_sample(odw->hdr, sample_ids[i].c_str()))
+            {
+                fprintf(stderr, "[E:%s:%d %s] cannot add sample %s, sample IDs should be unique\n", __FILE__, __LINE__, __FUNCTION__, sample_ids[i].c_str());
+                exit(1);
+            }
+        }
         bcf_hdr_add_sample(odw->hdr, NULL);
 
         //INFO fields
@@ -234,6 +308,29 @@ class Igor : Program
         bcf_hdr_append(odw->hdr, "##FORMAT=<ID=DPF,Number=1,Type=Integer,Description=\"Depth of forward reference alleles\">");
         bcf_hdr_append(odw->hdr, "##FORMAT=<ID=DPR,Number=1,Type=Integer,Description=\"Depth of reverse reference alleles\">");
 
+        //JOINT GENOTYPING
+        bcf_hdr_append(odw->hdr, "##FORMAT=<ID=GQ,Number=1,Type=Integer,Description=\"Genotype Quality\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=AVGDP,Number=1,Type=Float,Description=\"Average Depth per Sample\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=AC,Number=A,Type=Integer,Description=\"Alternate Allele Counts\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=AN,Number=1,Type=Integer,Description=\"Total Number Allele Counts\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=AF,Number=A,Type=Float,Description=\"Alternate Allele Frequency from Best-guess Genotypes\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=GC,Number=G,Type=Integer,Description=\"Genotype Counts\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=GN,Number=1,Type=Integer,Description=\"Total Number of Genotypes\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=HWEAF,Number=A,Type=Float,Description=\"Genotype likelihood based Allele Frequency assuming HWE\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=HWDGF,Number=G,Type=Float,Description=\"Genotype likelihood based Genotype Frequency ignoring HWE\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=IBC,Number=1,Type=Float,Description=\"Inbreeding Coefficients calculated from genotype likelihoods\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=HWE_SLP,Number=1,Type=Float,Description=\"Signed log p-values testing  statistics based Hardy Weinberg ln(Likelihood Ratio)\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=ABE,Number=1,Type=Float,Description=\"Expected allele Balance towards Reference Allele on Heterozygous Sites\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=ABZ,Number=1,Type=Float,Description=\"Average Z-scores of Allele Balance towards Reference Allele on Heterozygous Sites\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=BQZ,Number=1,Type=Float,Description=\"Correlation between base quality and alleles\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=MQZ,Number=1,Type=Float,Description=\"Correlation between mapping quality and alleles\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=CYZ,Number=1,Type=Float,Description=\"Correlation between cycle and alleles\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=STZ,Number=1,Type=Float,Description=\"Correlation between strand and alleles\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=NMZ,Number=1,Type=Float,Description=\"Correlation between mismatch counts per read and alleles\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=IOR,Number=1,Type=Float,Description=\"Inflated rate of observing of other alleles in log10 scale\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=NM0,Number=1,Type=Float,Description=\"Average number of mismatches in the reads with ref alleles\">");
+        bcf_hdr_append(odw->hdr, "##INFO=<ID=NM1,Number=1,Type=Float,Description=\"Average number of mismatches in the reads with non-ref alleles\">");
+
         odw->write_hdr();
 
 
@@ -255,7 +352,10 @@ class Igor : Program
         no_vntrs_genotyped = 0;
 
         //for tracking overlapping reads
-        reads = kh_init(rdict);
+        for (size_t i=0; i<sample_ids.size(); ++i)
+        {
+            reads.push_back(kh_init(rdict));
+        }
 
         //////////////////////////////////////
         //discovery variables initialization//
@@ -276,7 +376,7 @@ class Igor : Program
      *
      * Returns true if read is failed.
      */
-    bool filter_read(bam1_t *s)
+    bool filter_read(bam_hdr_t *h, bam1_t *s, int32_t sample_index)
     {
         khiter_t k;
         int32_t ret;
@@ -295,24 +395,24 @@ class Igor : Program
                         //add read that has overlapping
                         //duplicate the record and perform the stitching later
                         char* qname = strdup(bam_get_qname(s));
-                        k = kh_put(rdict, reads, qname, &ret);
+                        k = kh_put(rdict, reads[sample_index], qname, &ret);
                         if (!ret)
                         {
                             //already present
                             free(qname);
                         }
-                        kh_val(reads, k) = {bam_get_pos1(s), bam_get_pos1(s)+bam_get_l_qseq(s)-1};
+                        kh_val(reads[sample_index], k) = {bam_get_pos1(s), bam_get_pos1(s)+bam_get_l_qseq(s)-1};
                     }
                 }
                 else
                 {
                     //check overlap
-                    if((k = kh_get(rdict, reads, bam_get_qname(s)))!=kh_end(reads))
+                    if((k = kh_get(rdict, reads[sample_index], bam_get_qname(s)))!=kh_end(reads[sample_index]))
                     {
-                        if (kh_exist(reads, k))
+                        if (kh_exist(reads[sample_index], k))
                         {
-                            free((char*)kh_key(reads, k));
-                            kh_del(rdict, reads, k);
+                            free((char*)kh_key(reads[sample_index], k));
+                            kh_del(rdict, reads[sample_index], k);
                             ++no_overlapping_reads;
                         }
                         //set this on to remove overlapping reads.
@@ -361,7 +461,7 @@ class Igor : Program
                     if (i!=0 && i!=n_cigar_op-1)
                     {
                         std::cerr << "S issue\n";
-                        bam_print_key_values(odr->hdr, s);
+                        bam_print_key_values(h, s);
                         //++malformed_cigar;
                     }
                 }
@@ -375,7 +475,7 @@ class Igor : Program
                     {
                         std::cerr << "D issue\n";
                         ++no_malformed_del_cigars;
-                        bam_print_key_values(odr->hdr, s);
+                        bam_print_key_values(h, s);
                     }
                 }
                 else if (opchr=='I')
@@ -387,7 +487,7 @@ class Igor : Program
                             if (last_opchr!='^' && last_opchr!='S')
                             {
                                 std::cerr << "leading I issue\n";
-                                bam_print_key_values(odr->hdr, s);
+                                bam_print_key_values(h, s);
                                 ++no_malformed_ins_cigars;
                             }
                             else
@@ -407,7 +507,7 @@ class Igor : Program
                         else
                         {
                             std::cerr << "trailing I issue\n";
-                            bam_print_key_values(odr->hdr, s);
+                            bam_print_key_values(h, s);
                             ++no_malformed_ins_cigars;
                         }
                     }
@@ -419,7 +519,7 @@ class Igor : Program
             if (!seenM)
             {
                 std::cerr << "NO! M issue\n";
-                bam_print_key_values(odr->hdr, s);
+                bam_print_key_values(h, s);
                 ++no_unaligned_cigars;
             }
         }
@@ -429,12 +529,15 @@ class Igor : Program
         //can be retained in the hash
         if (bam_get_tid(s)!=tid)
         {
-            for (k = kh_begin(reads); k != kh_end(reads); ++k)
+            for (size_t i=0; i<reads.size(); ++i)
             {
-                if (kh_exist(reads, k))
+                for (k = kh_begin(reads[i]); k != kh_end(reads[i]); ++k)
                 {
-                    free((char*)kh_key(reads, k));
-                    kh_del(rdict, reads, k);
+                    if (kh_exist(reads[i], k))
+                    {
+                        free((char*)kh_key(reads[i], k));
+                        kh_del(rdict, reads[i], k);
+                    }
                 }
             }
 
@@ -444,45 +547,131 @@ class Igor : Program
         return true;
     }
 
-    void genotype()
+    /**
+     * Reads the list of SAM/BAM/CRAM files, each line has a file name optionally
+     * followed by the sample ID and the contamination fraction of the sample.
+     * Sample IDs that are not given are read from the headers of the files.
+     */
+    void parse_sam_file_list()
     {
-        if (mode=="d")
+        std::vector<std::string> lines;
+        std::vector<std::string> no_files;
+        parse_files(lines, no_files, input_sam_file_list);
+
+        std::vector<std::string> fields;
+        for (size_t i=0; i<lines.size(); ++i)
         {
-            //iterate sam
-            bam_hdr_t *h = odr->hdr;
-            bam1_t * s = bam_init1();
-            while (odr->read(s))
+            split(fields, " \t", lines[i]);
+            if (fields.empty())
             {
-                ++no_reads;
+                continue;
+            }
 
-                if (!filter_read(s))
-                {
-                    continue;
-                }
+            input_sam_files.push_back(fields[0]);
+            sample_ids.push_back(fields.size()>1 ? fields[1] : "");
+            contams.push_back(fields.size()>2 ? atof(fields[2].c_str()) : 0);
+
+            if (contams.back()<0 || contams.back()>=1)
+            {
+                fprintf(stderr, "[E:%s:%d %s] contamination fraction of %s not in [0,1): %s\n", __FILE__, __LINE__, __FUNCTION__, fields[0].c_str(), fields[2].c_str());
+                exit(1);
+            }
+        }
 
-                gbr->flush(odw, h, s);
-                gbr->process_read(h, s);
+        if (input_sam_files.empty())
+        {
+            fprintf(stderr, "[E:%s:%d %s] no files in %s\n", __FILE__, __LINE__, __FUNCTION__, input_sam_file_list.c_str());
+            exit(1);
+        }
 
-                ++no_passed_reads;
-                if ((no_reads & 0x0000FFFF) == 0)
+        for (size_t i=0; i<input_sam_files.size(); ++i)
+        {
+            if (sample_ids[i]=="")
+            {
+                samFile *file = sam_open(input_sam_files[i].c_str(), "r");
+                if (!file)
                 {
-                    std::cerr << bam_get_chrom(h,s) << ":" << bam_get_pos1(s) << " ("  << gbr->buffer.size() << ")\n";
+                    fprintf(stderr, "[E:%s:%d %s] cannot open %s\n", __FILE__, __LINE__, __FUNCTION__, input_sam_files[i].c_str());
+                    exit(1);
                 }
+                bam_hdr_t *h = sam_hdr_read(file);
+                sample_ids[i] = bam_hdr_get_sample_name(h);
+                bam_hdr_destroy(h);
+                sam_close(file);
             }
+        }
+    }
 
-            gbr->flush(odw, h, s, true);
-            
-            no_snps_genotyped = gbr->no_snps_genotyped;
-            no_indels_genotyped = gbr->no_indels_genotyped;
-            no_vntrs_genotyped = gbr->no_vntrs_genotyped;
+    /**
+     * Collects the regions spanned by the sites for sparse genotyping.
+     * Sites that are close to one another are coalesced into a single region
+     * so that the BAM file is accessed once for them.
+     */
+    void collect_site_regions()
+    {
+        BCFOrderedReader *sites_odr = new BCFOrderedReader(input_vcf_file, intervals);
+        bcf1_t *v = bcf_init();
 
-            odw->close();
+        while (sites_odr->read(v))
+        {
+            std::string seq = bcf_get_chrom(sites_odr->hdr, v);
+            //includes the flanking bases of indels
+            int32_t start1 = std::max(bcf_get_pos1(v)-1, 1);
+            int32_t end1 = bcf_get_pos1(v) + v->rlen;
+
+            if (site_regions.size() &&
+                site_regions.back().seq==seq &&
+                start1 <= site_regions.back().end1 + SPARSE_REGION_GAP)
+            {
+                site_regions.back().end1 = std::max(site_regions.back().end1, end1);
+            }
+            else
+            {
+                site_regions.push_back(GenomeInterval(seq, start1, end1));
+            }
         }
-        else if (mode=="s")
+
+        bcf_destroy(v);
+        sites_odr->close();
+        delete sites_odr;
+    }
+
+    void genotype()
+    {
+        //iterate sam, in sparse mode only the reads from the regions
+        //around the sites are read with the index of the BAM file,
+        //reads from multiple files are merged by position
+        bam_hdr_t *h = sr->hdr;
+        bam1_t *s = NULL;
+        int32_t i = 0;
+
+        while ((mode!="s" || site_regions.size()) && sr->read(s, i))
         {
-            //iterate VCF file
-                //random access per site
+            ++no_reads;
+
+            if (!filter_read(h, s, i))
+            {
+                continue;
+            }
+
+            gbr->flush(odw, h, s);
+            gbr->process_read(h, s, i);
+
+            ++no_passed_reads;
+            if ((no_reads & 0x0000FFFF) == 0)
+            {
+                std::cerr << bam_get_chrom(h,s) << ":" << bam_get_pos1(s) << " ("  << gbr->buffer.size() << ")\n";
+            }
         }
+
+        gbr->flush(odw, h, s, true);
+
+        no_snps_genotyped = gbr->no_snps_genotyped;
+        no_indels_genotyped = gbr->no_indels_genotyped;
+        no_vntrs_genotyped = gbr->no_vntrs_genotyped;
+
+        sr->close();
+        odw->close();
     }
 
     /**
@@ -532,9 +721,19 @@ class Igor : Program
         std::clog << "genotype v" << version << "\n\n";
 
         std::clog << "options:     input VCF File                       " << input_vcf_file << "\n";
-        std::clog << "         [b] input BAM File                       " << input_sam_file << "\n";
+        if (input_sam_file_list!="")
+        {
+            print_ifiles("         [L] input BAM Files                      ", input_sam_files);
+        }
+        else
+        {
+            std::clog << "         [b] input BAM File                       " << input_sam_file << "\n";
+        }
         std::clog << "         [o] output VCF File                      " << output_vcf_file << "\n";
-        std::clog << "         [s] sample ID                            " << sample_id << "\n";
+        if (input_sam_file_list=="")
+        {
+            std::clog << "         [s] sample ID                            " << sample_id << "\n";
+        }
         std::clog << "         [r] reference FASTA File                 " << ref_fasta_file << "\n";
         std::clog << "         [z] ignore MD tags                       " << (ignore_md ? "true": "false") << "\n";
         std::clog << "         [m] mode of genotyping                   " << mode << "\n";
@@ -555,6 +754,14 @@ class Igor : Program
         std::clog << "       no. overlapping reads        : " << no_overlapping_reads << "\n";
         std::clog << "       no. low mapq reads           : " << no_low_mapq_reads << "\n";
         std::clog << "       no. passed reads             : " << no_passed_reads << "\n";
+        if (input_sam_file_list!="")
+        {
+            std::clog << "       no. samples                  : " << sample_ids.size() << "\n";
+        }
+        if (mode=="s")
+        {
+            std::clog << "       no. site regions             : " << site_regions.size() << "\n";
+        }
         std::clog << "       no. exclude flag reads       : " << no_exclude_flag_reads << "\n";
         std::clog << "\n";
         std::clog << "       no. unaligned cigars         : " << no_unaligned_cigars << "\n";
@@ -570,7 +777,10 @@ class Igor : Program
 
     ~Igor()
     {
-        kh_destroy(rdict, reads);
+        for (size_t i=0; i<reads.size(); ++i)
+        {
+            kh_destroy(rdict, reads[i]);
+        }
     };
 
     private:
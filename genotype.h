@@ -25,6 +25,7 @@
 #define GENOTYPE_H
 
 #include "bam_ordered_reader.h"
+#include "bam_synced_reader.h"
 #include "bcf_ordered_reader.h"
 #include "bcf_ordered_writer.h"
 #include "bcf_synced_reader.h"
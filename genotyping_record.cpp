@@ -21,4 +21,31 @@
    THE SOFTWARE.
 */
 
-#include "genotyping_record.h"
\ No newline at end of file
+#include "genotyping_record.h"
+
+/**
+ * Keeps an allele observed in a read for a sample.
+ */
+void GenotypingRecord::observe_allele(int32_t sampleIndex, int32_t allele, uint8_t mapq, bool fwd, uint32_t q, int32_t cycle, uint32_t nm)
+{
+    allele_obs_t o = {allele, q, cycle, nm, mapq, fwd};
+    obs[sampleIndex].push_back(o);
+}
+
+/**
+ * Flushes all samples, the alleles observed for each sample are added before it is flushed.
+ */
+void GenotypingRecord::flush_samples(std::vector<double>& contams)
+{
+    for (size_t i=0; i<obs.size(); ++i)
+    {
+        for (size_t j=0; j<obs[i].size(); ++j)
+        {
+            allele_obs_t& o = obs[i][j];
+            add_allele(contams[i], o.allele, o.mapq, o.fwd, o.q, o.cycle, o.nm);
+        }
+        flush_sample(i);
+
+        std::vector<allele_obs_t>().swap(obs[i]);
+    }
+}
@@ -36,6 +36,19 @@
 #define FILTER_MASK_OVERLAP_INDEL 0x0002
 #define FILTER_MASK_OVERLAP_VNTR  0x0004
 
+/**
+ * An allele observed in a read of a sample.
+ */
+typedef struct
+{
+    int32_t allele;
+    uint32_t q;
+    int32_t cycle;
+    uint32_t nm;
+    uint8_t mapq;
+    bool fwd;
+} allele_obs_t;
+
 /**
  * A generic record that holds information for genotyping a
  * variant across multiple samples.
@@ -105,6 +118,10 @@ class GenotypingRecord
     uint8_t* pls;
     uint8_t* ads;
 
+    //alleles observed for each sample, added when the samples are flushed
+    //so that the reads of the samples may be processed in any order
+    std::vector<std::vector<allele_obs_t> > obs;
+
     // sufficient statistics for computing INFO field
     float bqr_num, bqr_den;
     float mqr_num, mqr_den;
@@ -154,6 +171,11 @@ class GenotypingRecord
      * Destructor.
      */
     virtual ~GenotypingRecord() {};
+
+    /**
+     * Sets this record to genotype a VCF record so that records may be reused.
+     */
+    virtual void initialize(bcf_hdr_t *h, bcf1_t *v, int32_t nsamples, int32_t ploidy) {};
     
     /**
      * Clears this record.
@@ -185,6 +207,18 @@ class GenotypingRecord
      * Clears this record.
      */
     virtual void process_read(AugmentedBAMRecord& as, int32_t sampleIndex, double contam) {};
+
+    /**
+     * Keeps an allele observed in a read for a sample.
+     */
+    void observe_allele(int32_t sampleIndex, int32_t allele, uint8_t mapq, bool fwd, uint32_t q, int32_t cycle, uint32_t nm);
+
+    /**
+     * Flushes all samples, the alleles observed for each sample are added before it is flushed.
+     *
+     * @contams - contamination fraction of each sample.
+     */
+    void flush_samples(std::vector<double>& contams);
 };
 
 #endif
@@ -44,6 +44,7 @@ class Igor : Program
     std::string filter_tag;
     std::string filter_tag_desc;
     bool clear_filter;
+    int32_t nthreads;
 
     ///////
     //i/o//
@@ -100,6 +101,7 @@ class Igor : Program
             clear_filter = arg_clear_filter.getValue();
             filter_tag = arg_filter_tag.getValue();
             filter_tag_desc = arg_filter_tag_desc.getValue();
+            nthreads = hts_get_shared_thread_pool_size();
         }
         catch (TCLAP::ArgException &e)
         {
@@ -108,6 +110,22 @@ class Igor : Program
         }
     };
 
+    /**
+     * Constructs a worker that filters the records of a shard with the options of igor.
+     */
+    Igor(Igor& igor, RegionShard *shard)
+    {
+        version = igor.version;
+        input_vcf_file = igor.input_vcf_file;
+        output_vcf_file = shard->output_vcf_file;
+        intervals = shard->intervals;
+        fexp = igor.fexp;
+        clear_filter = igor.clear_filter;
+        filter_tag = igor.filter_tag;
+        filter_tag_desc = igor.filter_tag_desc;
+        nthreads = 1;
+    };
+
     ~Igor() {};
 
     void initialize()
@@ -164,6 +182,12 @@ class Igor : Program
     {
         odw->write_hdr();
 
+        if (nthreads>1 && odr->is_index_loaded())
+        {
+            hfilter_shards();
+            return;
+        }
+
         bcf1_t *v = odw->get_bcf1_from_pool();
         bcf_hdr_t *h = odr->hdr;
         Variant variant;
@@ -193,6 +217,44 @@ class Igor : Program
         odw->close();
     };
 
+    /**
+     * Filters shards of the input in parallel and stitches the results.
+     */
+    void hfilter_shards()
+    {
+        RegionSharder sharder(odr, intervals, nthreads);
+        sharder.run(hfilter_shard, this);
+
+        for (size_t i=0; i<sharder.shards.size(); ++i)
+        {
+            Igor *worker = (Igor*) sharder.shards[i].data;
+
+            no_variants_filtered += worker->no_variants_filtered;
+            no_variants += worker->no_variants;
+
+            delete worker->odr;
+            delete worker->odw;
+            delete worker->vm;
+            delete worker;
+        }
+
+        sharder.stitch(odw);
+
+        odw->close();
+    }
+
+    /**
+     * Filters the records of a shard, called by the worker threads of RegionSharder.
+     */
+    static void hfilter_shard(void *arg, RegionShard *shard)
+    {
+        Igor *worker = new Igor(*((Igor*) arg), shard);
+        worker->initialize();
+        worker->odr->set_interval_start_only(shard->interval_start_only);
+        worker->hfilter();
+        shard->data = worker;
+    }
+
     private:
 };
 }
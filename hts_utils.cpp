@@ -94,6 +94,166 @@ int32_t hts_filename_type(std::string const& value)
     }
 }
 
+/******************
+ *THREAD POOL UTILS
+ ******************/
+
+static htsThreadPool shared_thread_pool = {NULL, 0};
+static int32_t shared_thread_pool_size = 0;
+
+/**
+ * Creates the htslib thread pool that is shared by all readers
+ * and writers in vt. No pool is created if nthreads is less than 1.
+ */
+void hts_create_shared_thread_pool(int32_t nthreads)
+{
+    if (nthreads<1 || shared_thread_pool.pool) return;
+
+    if (!(shared_thread_pool.pool = hts_tpool_init(nthreads)))
+    {
+        fprintf(stderr, "[%s:%d %s] Cannot create thread pool with %d threads\n", __FILE__, __LINE__, __FUNCTION__, nthreads);
+        exit(1);
+    }
+    shared_thread_pool.qsize = 0;
+    shared_thread_pool_size = nthreads;
+}
+
+/**
+ * Gets the shared thread pool, NULL if none was created.
+ */
+htsThreadPool* hts_get_shared_thread_pool()
+{
+    return shared_thread_pool.pool ? &shared_thread_pool : NULL;
+}
+
+/**
+ * Gets the number of threads in the shared thread pool, 0 if none was created.
+ */
+int32_t hts_get_shared_thread_pool_size()
+{
+    return shared_thread_pool_size;
+}
+
+/**
+ * Attaches the shared thread pool to a file for BGZF/CRAM compression
+ * and decompression.  Does nothing if there is no shared thread pool.
+ */
+void hts_attach_shared_thread_pool(htsFile *fp)
+{
+    if (fp && shared_thread_pool.pool)
+    {
+        if (hts_set_thread_pool(fp, &shared_thread_pool))
+        {
+            fprintf(stderr, "[%s:%d %s] Cannot attach thread pool to %s\n", __FILE__, __LINE__, __FUNCTION__, fp->fn);
+        }
+    }
+}
+
+/**
+ * Destroys the shared thread pool.  Files that the pool
+ * is attached to should be closed before this is called.
+ */
+void hts_destroy_shared_thread_pool()
+{
+    if (shared_thread_pool.pool)
+    {
+        hts_tpool_destroy(shared_thread_pool.pool);
+        shared_thread_pool.pool = NULL;
+        shared_thread_pool_size = 0;
+    }
+}
+
+/*********************
+ *CRAM REFERENCE UTILS
+ *********************/
+
+typedef struct
+{
+    std::string fai_file;
+    std::string dict;
+    refs_t *refs;
+    int32_t nfiles;
+} shared_cram_reference_t;
+
+static std::vector<shared_cram_reference_t> shared_cram_references;
+static pthread_mutex_t shared_cram_references_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Sets the reference of a CRAM file opened for reading.
+ *
+ * CRAM files with the same reference and sequence dictionary share the
+ * loaded reference, a contig is loaded once in full for all of them and
+ * is released when none of them decodes it, so at most the contigs in
+ * use and the last contig used are held in memory.
+ */
+void hts_set_shared_cram_reference(htsFile *fp, bam_hdr_t *h, const char* fai_file)
+{
+    //the reference is indexed by the sequence IDs of the header
+    std::string dict;
+    for (int32_t i=0; i<h->n_targets; ++i)
+    {
+        dict.append(h->target_name[i]);
+        dict.append(1, ':');
+        dict.append(std::to_string(h->target_len[i]));
+        dict.append(1, '\n');
+    }
+
+    pthread_mutex_lock(&shared_cram_references_lock);
+
+    for (size_t i=0; i<shared_cram_references.size(); ++i)
+    {
+        shared_cram_reference_t& r = shared_cram_references[i];
+        if (r.fai_file==fai_file && r.dict==dict)
+        {
+            hts_set_opt(fp, CRAM_OPT_SHARED_REF, r.refs);
+            ++r.nfiles;
+            pthread_mutex_unlock(&shared_cram_references_lock);
+            return;
+        }
+    }
+
+    hts_set_fai_filename(fp, fai_file);
+
+    //loads whole contigs even when the file is decoded without a thread pool,
+    //instead of fetching a slice of the reference for every container
+    refs_t *refs = cram_get_refs(fp);
+    if (refs)
+    {
+        hts_set_opt(fp, CRAM_OPT_SHARED_REF, refs);
+
+        shared_cram_reference_t r = {fai_file, dict, refs, 1};
+        shared_cram_references.push_back(r);
+    }
+
+    pthread_mutex_unlock(&shared_cram_references_lock);
+}
+
+/**
+ * Stops sharing the reference of a CRAM file, to be called before it is closed.
+ */
+void hts_release_shared_cram_reference(htsFile *fp)
+{
+    refs_t *refs = cram_get_refs(fp);
+    if (!refs) return;
+
+    pthread_mutex_lock(&shared_cram_references_lock);
+
+    for (size_t i=0; i<shared_cram_references.size(); ++i)
+    {
+        if (shared_cram_references[i].refs==refs)
+        {
+            //the reference is freed by htslib with the last file that uses it
+            if (--shared_cram_references[i].nfiles==0)
+            {
+                shared_cram_references.erase(shared_cram_references.begin()+i);
+            }
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&shared_cram_references_lock);
+}
+
 /**************
  *BAM HDR UTILS
  **************/
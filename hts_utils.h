@@ -34,6 +34,8 @@
 #include "htslib/faidx.h"
 #include "htslib/tbx.h"
 #include "htslib/hfile.h"
+#include "htslib/thread_pool.h"
+#include "htslib/cram.h"
 #include "utils.h"
 
 /**********
@@ -66,6 +68,57 @@ bool str_ends_with(std::string const & value, std::string const & ending);
  */
 int32_t hts_filename_type(std::string const& value);
 
+/******************
+ *THREAD POOL UTILS
+ ******************/
+
+/**
+ * Creates the htslib thread pool that is shared by all readers
+ * and writers in vt. No pool is created if nthreads is less than 1.
+ */
+void hts_create_shared_thread_pool(int32_t nthreads);
+
+/**
+ * Gets the shared thread pool, NULL if none was created.
+ */
+htsThreadPool* hts_get_shared_thread_pool();
+
+/**
+ * Gets the number of threads in the shared thread pool, 0 if none was created.
+ */
+int32_t hts_get_shared_thread_pool_size();
+
+/**
+ * Attaches the shared thread pool to a file for BGZF/CRAM compression
+ * and decompression.  Does nothing if there is no shared thread pool.
+ */
+void hts_attach_shared_thread_pool(htsFile *fp);
+
+/**
+ * Destroys the shared thread pool.  Files that the pool
+ * is attached to should be closed before this is called.
+ */
+void hts_destroy_shared_thread_pool();
+
+/*********************
+ *CRAM REFERENCE UTILS
+ *********************/
+
+/**
+ * Sets the reference of a CRAM file opened for reading.
+ *
+ * CRAM files with the same reference and sequence dictionary share the
+ * loaded reference, a contig is loaded once in full for all of them and
+ * is released when none of them decodes it, so at most the contigs in
+ * use and the last contig used are held in memory.
+ */
+void hts_set_shared_cram_reference(htsFile *fp, bam_hdr_t *h, const char* fai_file);
+
+/**
+ * Stops sharing the reference of a CRAM file, to be called before it is closed.
+ */
+void hts_release_shared_cram_reference(htsFile *fp);
+
 /**************
  *BAM HDR UTILS
  **************/
@@ -28,6 +28,17 @@
  * @v - VCF record.
  */
 IndelGenotypingRecord::IndelGenotypingRecord(bcf_hdr_t *h, bcf1_t *v, int32_t nsamples, int32_t ploidy)
+{
+    pls = ads = NULL;
+    alleles = {0,0,0};
+
+    initialize(h, v, nsamples, ploidy);
+}
+
+/**
+ * Sets this record to genotype a VCF record, the buffers of the record are reused.
+ */
+void IndelGenotypingRecord::initialize(bcf_hdr_t *h, bcf1_t *v, int32_t nsamples, int32_t ploidy)
 {
     clear();
 
@@ -36,7 +47,8 @@ IndelGenotypingRecord::IndelGenotypingRecord(bcf_hdr_t *h, bcf1_t *v, int32_t ns
     this->pos1 = bcf_get_pos1(v);
     this->nsamples = nsamples;
 
-    this->alleles = {0,0,0};
+    this->alleles.l = 0;
+    v_alleles.clear();
     char** tmp_alleles = bcf_get_allele(v);
     for (size_t i=0; i< bcf_get_n_allele(v); ++i) 
     {
@@ -46,6 +58,7 @@ IndelGenotypingRecord::IndelGenotypingRecord(bcf_hdr_t *h, bcf1_t *v, int32_t ns
     }
 
     n_filter = 0;
+    vtype = VT_INDEL;
 
     //rid = bcf_get_rid(v);
     dlen = strlen(tmp_alleles[1])-strlen(tmp_alleles[0]);
@@ -66,6 +79,7 @@ IndelGenotypingRecord::IndelGenotypingRecord(bcf_hdr_t *h, bcf1_t *v, int32_t ns
         this->end1 = bcf_get_end1(v) + 3;
     }
 
+    indel.clear();
     if (dlen>0) 
     {
         indel.append(&tmp_alleles[1][1]);
@@ -85,8 +99,11 @@ IndelGenotypingRecord::IndelGenotypingRecord(bcf_hdr_t *h, bcf1_t *v, int32_t ns
         n_filter |= FILTER_MASK_OVERLAP_VNTR;
 
     
-    pls = (uint8_t*)calloc( nsamples*3, sizeof(uint8_t) );
-    ads = (uint8_t*)calloc( nsamples*3, sizeof(uint8_t) );
+    pls = (uint8_t*)realloc(pls, nsamples*3*sizeof(uint8_t));
+    ads = (uint8_t*)realloc(ads, nsamples*3*sizeof(uint8_t));
+    memset(pls, 0, nsamples*3*sizeof(uint8_t));
+    memset(ads, 0, nsamples*3*sizeof(uint8_t));
+    obs.resize(nsamples);
 }
 
 /**
@@ -111,8 +128,6 @@ void IndelGenotypingRecord::clear()
 {
     vtype = -1;
 
-    pls = ads = NULL;
-
     bqr_num = bqr_den = 0;
     mqr_num = mqr_den = 0;
     cyr_num = cyr_den = 0;
@@ -135,7 +150,7 @@ IndelGenotypingRecord::~IndelGenotypingRecord()
   //if (v) bcf_destroy(v);
     if ( pls ) free(pls);
     if ( ads ) free(ads);
-    if ( alleles.l > 0 ) free(alleles.s);
+    if ( alleles.m ) free(alleles.s);
 }
 
 /**
@@ -326,11 +341,6 @@ bcf1_t* IndelGenotypingRecord::flush_variant(bcf_hdr_t* hdr)
     free(ad);
     free(td);
 
-    free(pls); pls = NULL;
-    free(ads); ads = NULL;
-
-    free(alleles.s);
-
     return nv;
 }
 
@@ -492,8 +502,8 @@ void IndelGenotypingRecord::process_read(AugmentedBAMRecord& as, int32_t sampleI
             uint32_t cycle = 10;
 
             std::vector<uint32_t>& aug_cigar = as.aug_cigar;
-            std::vector<std::string>& aug_ref = as.aug_ref;
-            std::vector<std::string>& aug_alt = as.aug_alt;
+            std::vector<AugmentedSeq>& aug_ref = as.aug_ref;
+            std::vector<AugmentedSeq>& aug_alt = as.aug_alt;
 
             int32_t vpos1 = pos1;
 
@@ -589,14 +599,14 @@ void IndelGenotypingRecord::process_read(AugmentedBAMRecord& as, int32_t sampleI
                 }
             }
 
-            add_allele( contam, allele, mapq, strand == 'F', q, rand() % 75, as.no_mismatches );
+            observe_allele(sampleIndex, allele, mapq, strand == 'F', q, rand() % 75, as.no_mismatches);
         }
         else
         {
             bam1_t *s = as.s;
             uint8_t mapq = bam_get_mapq(s);
 
-            add_allele( contam, -1, mapq, bam_is_rev(as.s) ? false : true, 20, rand() % 75, as.no_mismatches );
+            observe_allele(sampleIndex, -1, mapq, bam_is_rev(as.s) ? false : true, 20, rand() % 75, as.no_mismatches);
         }
     }
     else //multiallelic
@@ -617,8 +627,8 @@ void IndelGenotypingRecord::process_read(AugmentedBAMRecord& as, int32_t sampleI
             uint32_t cycle = 10;
 
             std::vector<uint32_t>& aug_cigar = as.aug_cigar;
-            std::vector<std::string>& aug_ref = as.aug_ref;
-            std::vector<std::string>& aug_alt = as.aug_alt;
+            std::vector<AugmentedSeq>& aug_ref = as.aug_ref;
+            std::vector<AugmentedSeq>& aug_alt = as.aug_alt;
 
             int32_t vpos1 = pos1;
 
@@ -714,14 +724,14 @@ void IndelGenotypingRecord::process_read(AugmentedBAMRecord& as, int32_t sampleI
                 }
             }
 
-            add_allele( contam, allele, mapq, strand == 'F', q, rand() % 75, as.no_mismatches );
+            observe_allele(sampleIndex, allele, mapq, strand == 'F', q, rand() % 75, as.no_mismatches);
         }
         else
         {
             bam1_t *s = as.s;
             uint8_t mapq = bam_get_mapq(s);
 
-            add_allele( contam, -1, mapq, bam_is_rev(as.s) ? false : true, 20, rand() % 75, as.no_mismatches );
+            observe_allele(sampleIndex, -1, mapq, bam_is_rev(as.s) ? false : true, 20, rand() % 75, as.no_mismatches);
         }
     }
 }
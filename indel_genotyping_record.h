@@ -125,10 +125,15 @@ class IndelGenotypingRecord : public GenotypingRecord
     void add_allele( double contam, int32_t allele, uint8_t mapq, bool fwd, uint32_t q, int32_t cycle, uint32_t nm );
     
     /**
-     * Clears this record.
+     * Observes the allele in a read for a sample, the allele is added when the samples are flushed.
      */
     void process_read(AugmentedBAMRecord& as, int32_t sampleIndex, double contam);
 
+    /**
+     * Sets this record to genotype a VCF record, the buffers of the record are reused.
+     */
+    void initialize(bcf_hdr_t *h, bcf1_t *v, int32_t nsamples, int32_t ploidy);
+
     /**
      * Destructor.
      */
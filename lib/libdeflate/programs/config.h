@@ -0,0 +1,23 @@
+/* THIS FILE WAS AUTOMATICALLY GENERATED.  DO NOT EDIT. */
+#ifndef CONFIG_H
+#define CONFIG_H
+
+/* Is the clock_gettime() function available? */
+#define HAVE_CLOCK_GETTIME 1
+
+/* Is the futimens() function available? */
+#define HAVE_FUTIMENS 1
+
+/* Is the futimes() function available? */
+#define HAVE_FUTIMES 1
+
+/* Is the posix_fadvise() function available? */
+#define HAVE_POSIX_FADVISE 1
+
+/* Is the posix_madvise() function available? */
+#define HAVE_POSIX_MADVISE 1
+
+/* Does stat() provide nanosecond-precision timestamps? */
+#define HAVE_STAT_NANOSECOND_PRECISION 1
+
+#endif /* CONFIG_H */
@@ -0,0 +1,85 @@
+/* The MIT License
+
+   Copyright (c) 2018 Adrian Tan <atks@umich.edu>
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+
+#include "loser_tree.h"
+
+/**
+ * Constructor.
+ */
+LoserTree::LoserTree(int32_t k, bool (*less)(void *arg, int32_t i, int32_t j), void *arg)
+{
+    this->k = k;
+    this->less = less;
+    this->arg = arg;
+    //the winner is kept in tree[0] even when there are no sources
+    tree.resize(std::max(k, 1), 0);
+};
+
+/**
+ * Plays the tournament from scratch, sources should have their first item loaded.
+ */
+void LoserTree::build()
+{
+    tree[0] = k ? play(1) : -1;
+};
+
+/**
+ * Replays the tournament after the winning source has advanced.
+ */
+void LoserTree::update()
+{
+    int32_t winner = tree[0];
+    for (int32_t node=(winner+k)>>1; node>=1; node>>=1)
+    {
+        if (less(arg, tree[node], winner))
+        {
+            std::swap(tree[node], winner);
+        }
+    }
+    tree[0] = winner;
+};
+
+/**
+ * Plays the subtree at node, returns the winner.
+ */
+int32_t LoserTree::play(int32_t node)
+{
+    if (node>=k)
+    {
+        return node-k;
+    }
+
+    int32_t left = play(node<<1);
+    int32_t right = play((node<<1)+1);
+    if (less(arg, right, left))
+    {
+        tree[node] = left;
+        return right;
+    }
+    else
+    {
+        tree[node] = right;
+        return left;
+    }
+};
@@ -0,0 +1,87 @@
+/* The MIT License
+
+   Copyright (c) 2018 Adrian Tan <atks@umich.edu>
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+
+#ifndef LOSER_TREE_H
+#define LOSER_TREE_H
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+/**
+ * A tournament tree of losers for merging k sorted sources.
+ *
+ * The sources are identified by their index and compared with a
+ * caller supplied function that should rank exhausted sources last
+ * and break ties by index for a stable merge.  After the winner is
+ * advanced, the tree is replayed from its leaf with log2(k) comparisons
+ * against the losers stored along the path to the root.
+ */
+class LoserTree
+{
+    public:
+
+    int32_t k;
+
+    //tree[0] is the winner, tree[1..k-1] are the losers of the internal nodes,
+    //leaf i is at node k+i
+    std::vector<int32_t> tree;
+
+    //returns true when source i ranks before source j
+    bool (*less)(void *arg, int32_t i, int32_t j);
+    void *arg;
+
+    /**
+     * Constructor.
+     *
+     * @k    - number of sources
+     * @less - comparison of sources
+     * @arg  - passed to less
+     */
+    LoserTree(int32_t k, bool (*less)(void *arg, int32_t i, int32_t j), void *arg);
+
+    /**
+     * Plays the tournament from scratch, sources should have their first item loaded.
+     */
+    void build();
+
+    /**
+     * Returns the index of the source that ranks first.
+     */
+    int32_t top() { return tree[0]; };
+
+    /**
+     * Replays the tournament after the winning source has advanced.
+     */
+    void update();
+
+    private:
+
+    /**
+     * Plays the subtree at node, returns the winner.
+     */
+    int32_t play(int32_t node);
+};
+
+#endif
@@ -56,11 +56,13 @@
 #include "merge.h"
 #include "multi_partition.h"
 #include "normalize.h"
+#include "pack_reference.h"
 #include "partition.h"
 #include "paste.h"
 #include "paste_genotypes.h"
 #include "paste_and_compute_features_sequential.h"
 #include "peek.h"
+#include "pipe.h"
 #include "profile_afs.h"
 #include "profile_chm1.h"
 #include "profile_chrom.h"
@@ -124,6 +126,8 @@ void help()
     std::clog << "paste                     paste VCF files\n";
     std::clog << "sort                      sort VCF files\n";
     std::clog << "subset                    subset VCF file to variants polymorphic in a sample\n";
+    std::clog << "pipe                      run a series of vt programs in a single process\n";
+    std::clog << "pack_reference            pack a reference FASTA file for memory mapping\n";
     std::clog << "\n";
     std::clog << "peek                      summary of variants in the vcf file\n";
     std::clog << "partition                 partition variants\n";
@@ -138,6 +142,10 @@ void help()
     std::clog << "discover                  discover variants\n";
     std::clog << "genotype                  genotype variants\n";
     std::clog << "\n";
+    std::clog << "Global options:\n";
+    std::clog << "-@, --threads <int>       number of threads for BGZF/CRAM compression and decompression\n";
+    std::clog << "                          and for processing indexed files by region in parallel [0]\n";
+    std::clog << "\n";
 }
 
 int main(int argc, char ** argv)
@@ -152,6 +160,14 @@ int main(int argc, char ** argv)
         exit(0);
     }
 
+    Program::parse_threads(argc, argv);
+
+    if (argc==1)
+    {
+        help();
+        exit(0);
+    }
+
     std::string cmd(argv[1]);
 
     //primitive programs that do not require help pages and summary statistics by default
@@ -234,6 +250,14 @@ int main(int argc, char ** argv)
     {
         print = rminfo(argc-1, ++argv);
     }
+    else if (argc>1 && cmd=="pipe")
+    {
+        print = pipe(argc-1, ++argv);
+    }
+    else if (argc>1 && cmd=="pack_reference")
+    {
+        print = pack_reference(argc-1, ++argv);
+    }
     else if (argc>1 && cmd=="sort")
     {
         print = sort(argc-1, ++argv);
@@ -432,5 +456,7 @@ int main(int argc, char ** argv)
         print_time((float)(t1-t0)/CLOCKS_PER_SEC);
     }
 
+    hts_destroy_shared_thread_pool();
+
     return 0;
 }
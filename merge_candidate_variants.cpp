@@ -26,6 +26,11 @@
 #define SINGLE     0
 #define AGGREGATED 1
 
+//descriptors kept free when determining the number of files merged at once
+#define RESERVED_FILE_DESCRIPTORS 32
+//estimated memory used by an open input file
+#define MEMORY_PER_INPUT_FILE (1<<20)
+
 namespace
 {
 
@@ -45,6 +50,8 @@ class Igor : Program
     std::string interval_list;
     float snp_variant_score_cutoff;
     float indel_variant_score_cutoff;
+    int32_t max_merge_files;
+    int32_t nthreads;
 
     ///////
     //i/o//
@@ -59,6 +66,14 @@ class Igor : Program
     std::vector<int32_t> file_types;
     kstring_t variant;
 
+    //groups of files merged into intermediate files by worker threads
+    std::vector<GenomeInterval> *level_intervals;
+    std::vector<std::vector<std::string> > groups;
+    std::vector<std::string> group_output_files;
+    uint32_t next_group;
+    pthread_mutex_t mutex;
+    int32_t no_levels;
+
     /////////
     //stats//
     /////////
@@ -91,6 +106,9 @@ Each VCF file is required to have the FORMAT flags E and N and should have exact
             TCLAP::ValueArg<std::string> arg_input_vcf_file_list("L", "L", "file containing list of input VCF files", false, "", "str", cmd);
             TCLAP::ValueArg<float> arg_snp_variant_score_cutoff("c", "c", "SNP variant score cutoff [30]", false, 30, "float", cmd);
             TCLAP::ValueArg<float> arg_indel_variant_score_cutoff("d", "d", "Indel variant score cutoff [30]", false, 30, "float", cmd);
+            TCLAP::ValueArg<int32_t> arg_max_merge_files("m", "m", "maximum number of files merged at once, when there are more input files,\n"
+                 "              groups of files are merged into intermediate files which are then merged.\n"
+                 "              If 0, this is determined from the open file limit and memory available [0]", false, 0, "int", cmd);
             TCLAP::UnlabeledMultiArg<std::string> arg_input_vcf_files("<in1.vcf>...", "Multiple VCF files",false, "files", cmd);
 
             cmd.parse(argc, argv);
@@ -100,6 +118,9 @@ Each VCF file is required to have the FORMAT flags E and N and should have exact
             snp_variant_score_cutoff = arg_snp_variant_score_cutoff.getValue();
             indel_variant_score_cutoff = arg_indel_variant_score_cutoff.getValue();
             parse_intervals(intervals, arg_interval_list.getValue(), arg_intervals.getValue());
+            max_merge_files = arg_max_merge_files.getValue();
+            nthreads = std::max(hts_get_shared_thread_pool_size(), 1);
+            set_max_merge_files();
         }
         catch (TCLAP::ArgException &e)
         {
@@ -108,6 +129,164 @@ Each VCF file is required to have the FORMAT flags E and N and should have exact
         }
     };
 
+    /**
+     * Constructs a worker that merges a group of files with the options of igor.
+     */
+    Igor(Igor& igor, std::vector<std::string>& input_vcf_files, std::string& output_vcf_file, std::vector<GenomeInterval>& intervals)
+    {
+        version = igor.version;
+        this->input_vcf_files = input_vcf_files;
+        this->output_vcf_file = output_vcf_file;
+        this->intervals = intervals;
+        snp_variant_score_cutoff = igor.snp_variant_score_cutoff;
+        indel_variant_score_cutoff = igor.indel_variant_score_cutoff;
+        max_merge_files = igor.max_merge_files;
+        nthreads = 1;
+    };
+
+    /**
+     * Determines the number of files merged at once from the open file
+     * limit and the physical memory when it is not specified, this is
+     * shared by the worker threads.
+     */
+    void set_max_merge_files()
+    {
+        if (max_merge_files)
+        {
+            max_merge_files = std::max(max_merge_files, 2);
+            return;
+        }
+
+        int64_t max_files = INT32_MAX;
+        struct rlimit rl;
+        if (getrlimit(RLIMIT_NOFILE, &rl)==0 && rl.rlim_cur!=RLIM_INFINITY)
+        {
+            max_files = ((int64_t) rl.rlim_cur - RESERVED_FILE_DESCRIPTORS)/nthreads;
+        }
+
+        int64_t pages = sysconf(_SC_PHYS_PAGES);
+        int64_t page_size = sysconf(_SC_PAGE_SIZE);
+        if (pages>0 && page_size>0)
+        {
+            //use up to a quarter of the memory for input buffers
+            max_files = std::min(max_files, pages/4*page_size/MEMORY_PER_INPUT_FILE/nthreads);
+        }
+
+        max_merge_files = (int32_t) std::max(max_files, (int64_t) 2);
+    }
+
+    /**
+     * Merges the input files, when there are more than max_merge_files,
+     * consecutive groups of files are merged in parallel into intermediate
+     * uncompressed BCF files level by level until the remaining files can
+     * be merged at once.  Intermediate files are aggregated candidate variant
+     * lists and as groups are consecutive, the result is the same as
+     * merging all files at once.
+     */
+    void merge_levels()
+    {
+        no_levels = 0;
+
+        std::string tmp_prefix = (output_vcf_file=="-" || output_vcf_file=="+") ? "" : output_vcf_file + ".";
+        std::vector<std::string> files = input_vcf_files;
+        std::vector<GenomeInterval> level_intervals = intervals;
+
+        while (files.size()>(size_t)max_merge_files)
+        {
+            groups.clear();
+            group_output_files.clear();
+            for (size_t i=0; i<files.size(); i+=max_merge_files)
+            {
+                size_t j = std::min(i+max_merge_files, files.size());
+                groups.push_back(std::vector<std::string>(files.begin()+i, files.begin()+j));
+
+                kstring_t s = {0,0,0};
+                kputs(tmp_prefix.c_str(), &s);
+                kputs("merge_candidate_variants.", &s);
+                kputw(getpid(), &s);
+                kputc('.', &s);
+                kputw(no_levels+1, &s);
+                kputc('.', &s);
+                kputw(groups.size(), &s);
+                kputs(".ubcf", &s);
+                group_output_files.push_back(std::string(s.s));
+                if (s.m) free(s.s);
+            }
+
+            this->level_intervals = &level_intervals;
+            next_group = 0;
+            pthread_mutex_init(&mutex, NULL);
+            int32_t nworkers = std::min(nthreads, (int32_t) groups.size());
+            std::vector<pthread_t> workers(nworkers);
+            for (int32_t i=0; i<nworkers; ++i)
+            {
+                if (pthread_create(&workers[i], NULL, merge_groups, this))
+                {
+                    fprintf(stderr, "[%s:%d %s] Cannot create worker thread\n", __FILE__, __LINE__, __FUNCTION__);
+                    exit(1);
+                }
+            }
+            for (int32_t i=0; i<nworkers; ++i)
+            {
+                pthread_join(workers[i], NULL);
+            }
+            pthread_mutex_destroy(&mutex);
+
+            //intermediate files of earlier levels are no longer needed
+            if (no_levels)
+            {
+                for (size_t i=0; i<files.size(); ++i)
+                {
+                    std::remove(files[i].c_str());
+                }
+            }
+
+            files = group_output_files;
+            //intervals are applied when reading the input files, intermediate files are not indexed
+            level_intervals.clear();
+            ++no_levels;
+        }
+
+        input_vcf_files = files;
+        intervals = level_intervals;
+        initialize();
+        merge_candidate_variants();
+
+        if (no_levels)
+        {
+            for (size_t i=0; i<files.size(); ++i)
+            {
+                std::remove(files[i].c_str());
+            }
+        }
+    }
+
+    /**
+     * Merges groups of files until none are left, run by each worker thread.
+     */
+    static void* merge_groups(void *arg)
+    {
+        Igor *igor = (Igor*) arg;
+
+        while (true)
+        {
+            pthread_mutex_lock(&igor->mutex);
+            uint32_t i = igor->next_group++;
+            pthread_mutex_unlock(&igor->mutex);
+
+            if (i>=igor->groups.size()) break;
+
+            Igor worker(*igor, igor->groups[i], igor->group_output_files[i], *igor->level_intervals);
+            worker.initialize();
+            worker.merge_candidate_variants();
+            delete worker.vm;
+            delete worker.sr;
+            delete worker.odw;
+        }
+
+        return NULL;
+    }
+
     void initialize()
     {
         //////////////////////
@@ -349,6 +528,7 @@ Each VCF file is required to have the FORMAT flags E and N and should have exact
         std::clog << "         [o] output VCF file             " << output_vcf_file << "\n";
         std::clog << "         [c] SNP variant score cutoff    " << snp_variant_score_cutoff << "\n";
         std::clog << "         [d] Indel variant score cutoff  " << indel_variant_score_cutoff << "\n";
+        print_num_op("         [m] maximum files merged        ", max_merge_files);
         print_int_op("         [i] intervals                   ", intervals);
         std::clog << "\n";
     }
@@ -358,6 +538,10 @@ Each VCF file is required to have the FORMAT flags E and N and should have exact
         std::clog << "\n";
         std::clog << "stats: Total Number of Candidate SNPs                 " << no_candidate_snps << "\n";
         std::clog << "       Total Number of Candidate Indels               " << no_candidate_indels << "\n";
+        if (no_levels)
+        {
+            std::clog << "       Number of intermediate merge levels            " << no_levels << "\n";
+        }
         std::clog << "\n";
     };
 
@@ -374,8 +558,7 @@ void merge_candidate_variants(int argc, char ** argv)
 {
     Igor igor(argc, argv);
     igor.print_options();
-    igor.initialize();
-    igor.merge_candidate_variants();
+    igor.merge_levels();
     igor.print_stats();
 }
 
@@ -24,6 +24,7 @@
 #ifndef MERGE_CANDIDATE_VARIANTS_H
 #define MERGE_CANDIDATE_VARIANTS_H
 
+#include <sys/resource.h>
 #include "program.h"
 #include "log_tool.h"
 
@@ -26,6 +26,9 @@
 #define SINGLE     0
 #define AGGREGATED 1
 
+//file descriptors kept free for purposes other than the input files
+#define RESERVED_FILE_DESCRIPTORS 32
+
 namespace
 {
 
@@ -44,6 +47,7 @@ class Igor : Program
     std::string candidate_sites_vcf_file;
     std::vector<GenomeInterval> intervals;
     std::string interval_list;
+    int32_t nthreads;
 
     ///////
     //i/o//
@@ -51,6 +55,8 @@ class Igor : Program
     BCFSyncedReader *sr;
     BCFOrderedWriter *odw;
     bcf1_t *v;
+    //when true, only records beginning in the current interval are merged
+    bool interval_start_only;
 
     ///////////////
     //general use//
@@ -108,6 +114,8 @@ Extracts only the naive genotypes based on best guess genotypes.";
             output_vcf_file = arg_output_vcf_file.getValue();
             fexp = arg_fexp.getValue();
             parse_intervals(intervals, arg_interval_list.getValue(), arg_intervals.getValue());
+            nthreads = hts_get_shared_thread_pool_size();
+            interval_start_only = false;
         }
         catch (TCLAP::ArgException &e)
         {
@@ -116,6 +124,41 @@ Extracts only the naive genotypes based on best guess genotypes.";
         }
     };
 
+    /**
+     * Constructs a worker that merges the genotypes of a shard with the
+     * options and the output header of igor.
+     */
+    Igor(Igor& igor, RegionShard *shard)
+    {
+        version = igor.version;
+        input_vcf_files = igor.input_vcf_files;
+        input_vcf_file_list = igor.input_vcf_file_list;
+        output_vcf_file = shard->output_vcf_file;
+        candidate_sites_vcf_file = igor.candidate_sites_vcf_file;
+        intervals = shard->intervals;
+        interval_start_only = shard->interval_start_only;
+        nthreads = 1;
+        fexp = igor.fexp;
+
+        filter.parse(fexp.c_str(), false);
+        filter_exists = fexp=="" ? false : true;
+
+        //the candidate sites file is already the first input file
+        sr = new BCFSyncedReader(input_vcf_files, intervals, false);
+        odw = new BCFOrderedWriter(output_vcf_file, 0);
+        odw->set_hdr(igor.odw->hdr);
+        odw->write_hdr();
+
+        variant = {0,0,0};
+        no_samples = igor.no_samples;
+
+        no_snps = 0;
+        no_indels = 0;
+        no_vntrs = 0;
+
+        vm = new VariantManip();
+    };
+
     void initialize()
     {
         /////////////////////////
@@ -241,38 +284,44 @@ Extracts only the naive genotypes based on best guess genotypes.";
 
     void merge_genotypes()
     {
-        int32_t *NSAMPLES = NULL;
-        int32_t no_NSAMPLES = 0;
-        int32_t *GT = NULL;
-        int32_t *PL = NULL;
-        int32_t *AD = NULL;
-        int32_t *ADF = NULL;
-        int32_t *ADR = NULL;
-        int32_t *BQSUM = NULL;
-        int32_t *DP = NULL;
-        float *CG = NULL;
-
-        int32_t no_GT = 0;
-        int32_t no_PL = 0;
-        int32_t no_AD = 0;
-        int32_t no_ADF = 0;
-        int32_t no_ADR = 0;
-        int32_t no_BQSUM = 0;
-        int32_t no_DP = 0;
-        int32_t no_CG = 0;
-
-        std::vector<int32_t> gt;
-        std::vector<int32_t> pl;
-        std::vector<int32_t> ad;
-        std::vector<int32_t> dp;
-        std::vector<float> cg;
+        if (nthreads>1)
+        {
+            BCFOrderedReader *odr = new BCFOrderedReader(candidate_sites_vcf_file, intervals);
+            bool sharded = odr->is_index_loaded() && inputs_indexed() && set_max_threads();
+            if (sharded)
+            {
+                merge_genotypes_shards(odr);
+            }
+            odr->close();
+            delete odr;
+            if (sharded) return;
+        }
+
+        //sample by field matrices of the merged record, the record of
+        //each input file is decoded directly into the column of its sample
+        std::vector<int32_t> gt(no_samples*2);
+        std::vector<int32_t> pl(no_samples*3);
+        std::vector<int32_t> ad(no_samples*2);
+        std::vector<int32_t> dp(no_samples);
+        std::vector<float> cg(no_samples*2);
+        int32_t adf[2];
+        int32_t adr[2];
+        int32_t bqsum[1];
 
         bcf1_t* nv = bcf_init();
         Variant var;
         std::vector<bcfptr*> current_recs;
+        std::vector<bool> file_processed(no_samples+1, false);
 
         while(sr->read_next_position(current_recs))
         {
+            //records overlapping the start of a shard are merged in the preceding shard
+            if (interval_start_only &&
+                bcf_get_pos1(current_recs[0]->v)<sr->intervals[sr->intervals_index-1].start1)
+            {
+                continue;
+            }
+
             if (current_recs.size()!=no_samples+1)
             {
                 std::string variant = bcf_variant2string(current_recs[0]->h, current_recs[0]->v);
@@ -298,12 +347,6 @@ Extracts only the naive genotypes based on best guess genotypes.";
                 }
             }
 
-            gt.resize(0);
-            pl.resize(0);
-            ad.resize(0);
-            dp.resize(0);
-            cg.resize(0);
-
             bcf_clear(nv);
             int32_t vtype;
 
@@ -316,11 +359,8 @@ Extracts only the naive genotypes based on best guess genotypes.";
                 }
             }
 
-            std::vector<bool> file_processed(no_samples+1, false);
-            int32_t files_processed = 0;
-
-//            file_processed.resize(0);
-//            file_processed.resize(no_samples+1, false);
+            std::fill(file_processed.begin(), file_processed.end(), false);
+            uint32_t files_processed = 0;
 
             //for each file
             for (uint32_t i=0; i<current_recs.size(); ++i)
@@ -340,10 +380,6 @@ Extracts only the naive genotypes based on best guess genotypes.";
                     file_processed[file_index] = true;
                 }
 
-//                printf("\tfile index: %d\n", file_index);
-//                bcf_print(h, v);
-
-
                 //candidate sites file, populate info fields
                 if (!file_index)
                 {
@@ -435,125 +471,38 @@ Extracts only the naive genotypes based on best guess genotypes.";
                     continue;
                 }
 
-                if (vtype==VT_SNP)
-                {
-//                    printf("\t\tis a SNP\n");
-
-                    int32_t no_gt = bcf_get_genotypes(h, v, &GT, &no_GT);
-                    int32_t no_pl = bcf_get_format_int32(h, v, "PL", &PL, &no_PL);
-                    int32_t no_dp = bcf_get_format_int32(h, v, "DP", &DP, &no_DP);
-                    int32_t no_adf = bcf_get_format_int32(h, v, "ADF", &ADF, &no_ADF);
-                    int32_t no_adr = bcf_get_format_int32(h, v, "ADR", &ADR, &no_ADR);
-                    int32_t no_bqsum = bcf_get_format_int32(h, v, "BQSUM", &BQSUM, &no_BQSUM);
-
-//                    printf("GT: %d\n", no_gt);
-//                    printf("PL: %d\n", no_pl);
-//                    printf("DP: %d\n", no_dp);
-//                    printf("ADF: %d\n", no_adf);
-//                    printf("ADR: %d\n", no_adr);
-//                    printf("BQSUM: %d\n", no_bqsum);
 
-                    //GT:PL:DP:AD:ADF:ADR:BQ:MQ:CY:ST:AL:NM
-                    if (no_gt > 0 &&
-                        no_pl > 0 &&
-                        no_dp > 0 &&
-                        no_adf > 0 &&
-                        no_adr > 0)
-                    {
-//                        printf("\t\tupdating genotypes for GT,PL\n");
-//                        printf("\t\t\tno_GT %d\n", no_GT);
-//                        printf("\t\t\t%d %d\n", GT[0], GT[1]);
-                          gt.push_back(GT[0]);
-                          gt.push_back(GT[1]);
-                          pl.push_back(PL[0]);
-                          pl.push_back(PL[1]);
-                          pl.push_back(PL[2]);
-                          dp.push_back(DP[0]);
-                          ad.push_back(ADF[0]+ADR[0]);
-                          ad.push_back(ADF[1]+ADR[1]);
-
-//                          printf("GT: %d\n", no_GT);
-//                          printf("PL: %d\n", no_PL);
-//                          printf("DP: %d\n", no_DP);
-//                          printf("ADF: %d\n", no_ADF);
-//                          printf("ADR: %d\n", no_ADR);
+                //column of the sample of this file
+                int32_t j = file_index-1;
 
-                    }
-                    //GT:BQSUM:DP
-                    else if (no_gt > 0 &&
-                             no_bqsum > 0 &&
-                             no_dp > 0)
-                    {
-//                          printf("\t\tupdating genotypes for GT,BQSUM\n");
-//                          printf("\t\t\tno_GT %d\n", no_GT);
-//                          printf("\t\t\t%d %d\n", GT[0], GT[1]);
-                          gt.push_back(GT[0]);
-                          gt.push_back(GT[1]);
-                          pl.push_back(0);
-                          pl.push_back(BQSUM[0]/3);
-                          pl.push_back(BQSUM[0]);
-                          dp.push_back(DP[0]);
-                          ad.push_back(DP[0]);
-                          ad.push_back(0);
-                    }
-                    else
-                    {
-                        fprintf(stderr, "[E:%s:%d %s] cannot get format values GT:PL:DP:ADF:ADR or GT:BQSUM:DP from %s\n", __FILE__, __LINE__, __FUNCTION__, sr->file_names[file_index].c_str());
-                        exit(1);
-                    }
-                }
-                else if (vtype == VT_INDEL)
+                if (vtype==VT_SNP || vtype==VT_INDEL)
                 {
-//                    printf("\t\tis an INDEL\n");
-
-                    int32_t no_gt = bcf_get_genotypes(h, v, &GT, &no_GT);
-                    int32_t no_pl = bcf_get_format_int32(h, v, "PL", &PL, &no_PL);
-                    int32_t no_dp = bcf_get_format_int32(h, v, "DP", &DP, &no_DP);
-                    int32_t no_adf = bcf_get_format_int32(h, v, "ADF", &ADF, &no_ADF);
-                    int32_t no_adr = bcf_get_format_int32(h, v, "ADR", &ADR, &no_ADR);
-                    int32_t no_bqsum = bcf_get_format_int32(h, v, "BQSUM", &BQSUM, &no_BQSUM);
+                    int32_t no_gt = get_format_int32(h, v, "GT", &gt[2*j], 2);
+                    int32_t no_pl = get_format_int32(h, v, "PL", &pl[3*j], 3);
+                    int32_t no_dp = get_format_int32(h, v, "DP", &dp[j], 1);
+                    int32_t no_adf = get_format_int32(h, v, "ADF", adf, 2);
+                    int32_t no_adr = get_format_int32(h, v, "ADR", adr, 2);
 
+                    //GT:PL:DP:AD:ADF:ADR:BQ:MQ:CY:ST:AL:NM
                     if (no_gt > 0 &&
                         no_pl > 0 &&
                         no_dp > 0 &&
                         no_adf > 0 &&
                         no_adr > 0)
                     {
-//                        printf("\t\tupdating genotypes for GT,PL\n");
-//                        printf("\t\t\tno_GT %d\n", no_GT);
-//                        printf("\t\t\t%d %d\n", GT[0], GT[1]);
-                          gt.push_back(GT[0]);
-                          gt.push_back(GT[1]);
-                          pl.push_back(PL[0]);
-                          pl.push_back(PL[1]);
-                          pl.push_back(PL[2]);
-                          dp.push_back(DP[0]);
-                          ad.push_back(ADF[0]+ADR[0]);
-                          ad.push_back(ADF[1]+ADR[1]);
-
-//                          printf("GT: %d\n", no_GT);
-//                          printf("PL: %d\n", no_PL);
-//                          printf("DP: %d\n", no_DP);
-//                          printf("ADF: %d\n", no_ADF);
-//                          printf("ADR: %d\n", no_ADR);
-
+                        ad[2*j] = adf[0]+adr[0];
+                        ad[2*j+1] = adf[1]+adr[1];
                     }
                     //GT:BQSUM:DP
                     else if (no_gt > 0 &&
-                             no_bqsum > 0 &&
-                             no_dp > 0)
+                             no_dp > 0 &&
+                             get_format_int32(h, v, "BQSUM", bqsum, 1) > 0)
                     {
-//                          printf("\t\tupdating genotypes for GT,BQSUM\n");
-//                          printf("\t\t\tno_GT %d\n", no_GT);
-//                          printf("\t\t\t%d %d\n", GT[0], GT[1]);
-                          gt.push_back(GT[0]);
-                          gt.push_back(GT[1]);
-                          pl.push_back(0);
-                          pl.push_back(BQSUM[0]/3);
-                          pl.push_back(BQSUM[0]);
-                          dp.push_back(DP[0]);
-                          ad.push_back(DP[0]);
-                          ad.push_back(0);
+                        pl[3*j] = 0;
+                        pl[3*j+1] = bqsum[0]/3;
+                        pl[3*j+2] = bqsum[0];
+                        ad[2*j] = dp[j];
+                        ad[2*j+1] = 0;
                     }
                     else
                     {
@@ -563,91 +512,208 @@ Extracts only the naive genotypes based on best guess genotypes.";
                 }
                 else if (vtype == VT_VNTR)
                 {
-//                    printf("\t\tis a VNTR\n");
-//                    bcf_print(h, v);
-//
-                    int32_t no_cg = bcf_get_format_float(h, v, "CG", &CG, &no_CG);
-
                     //CG
-                    if (no_cg > 0)
-                    {
-//                          printf("\t\tupdating genotypes for CG\n");
-//                          printf("\t\t\tno_CG %d\n", no_CG);
-//                          printf("\t\t\t%f %f\n", CG[0], CG[1]);
-                          cg.push_back(CG[0]);
-                          cg.push_back(CG[1]);
-                    }
-                    else
+                    if (get_format_float(h, v, "CG", &cg[2*j], 2) <= 0)
                     {
                         fprintf(stderr, "[E:%s:%d %s] cannot get format values CG from %s\n", __FILE__, __LINE__, __FUNCTION__, sr->file_names[file_index].c_str());
+                        bcf_float_set_missing(cg[2*j]);
+                        bcf_float_set_vector_end(cg[2*j+1]);
                     }
                 }
 
             }//end processing each file
 
-            //write to merged record
-            if (vtype==VT_SNP)
+            //check to make sure correct number of records are processed.
+            if (files_processed!=file_processed.size())
             {
-//                printf("\tupdating genotypes %zd\n", gt.size());
-//                printf("\tn_samples %zd\n", nv->n_sample);
-                bcf_update_genotypes(odw->hdr, nv, &gt[0], gt.size());
-                bcf_update_format_int32(odw->hdr, nv, "PL", &pl[0], pl.size());
-                bcf_update_format_int32(odw->hdr, nv, "DP", &dp[0], dp.size());
-                bcf_update_format_int32(odw->hdr, nv, "AD", &ad[0], ad.size());
-
-                ++no_snps;
+                fprintf(stderr, "[I:%s:%d %s] Lesser than expected number of files processed : %u\n", __FILE__, __LINE__, __FUNCTION__, files_processed);
+                exit(1);
             }
-            else if (vtype==VT_INDEL)
+
+            //write to merged record
+            if (vtype==VT_SNP || vtype==VT_INDEL)
             {
-//                printf("\tupdating genotypes %zd\n", gt.size());
-//                printf("\tn_samples %zd\n", nv->n_sample);
                 bcf_update_genotypes(odw->hdr, nv, &gt[0], gt.size());
                 bcf_update_format_int32(odw->hdr, nv, "PL", &pl[0], pl.size());
                 bcf_update_format_int32(odw->hdr, nv, "DP", &dp[0], dp.size());
                 bcf_update_format_int32(odw->hdr, nv, "AD", &ad[0], ad.size());
 
-                ++no_indels;
+                if (vtype==VT_SNP)
+                {
+                    ++no_snps;
+                }
+                else
+                {
+                    ++no_indels;
+                }
             }
             else if (vtype==VT_VNTR)
             {
-//                printf("\tupdating genotypes %zd\n", gt.size());
-//                printf("\tn_samples %zd\n", nv->n_sample);
                 bcf_update_format_float(odw->hdr, nv, "CG", &cg[0], cg.size());
 
                 ++no_vntrs;
-
-//                bcf_print(odw->hdr, nv);
-            }
-
-            //check to make sure correct number of records are processed.
-            if (files_processed!=file_processed.size())
-            {
-                fprintf(stderr, "[I:%s:%d %s] Lesser than expected number of files processed : %d\n", __FILE__, __LINE__, __FUNCTION__, files_processed);
-                exit(1);
             }
 
             odw->write(nv);
-//            bcf_print(odw->hdr, nv);
 
             //this acts as a flag to initialize a newly merged record
             vtype = VT_UNDEFINED;
 
             int32_t no_variants = no_snps+no_indels+no_vntrs;
-//            if ((no_variants&0x0FFF)==0x0600)
             if ((no_variants%100)==0)
             {
                 fprintf(stderr, "[I:%s:%d %s] Merged %d rows\n", __FILE__, __LINE__, __FUNCTION__, no_variants);
             }
-
         }
 
+        bcf_destroy(nv);
         odw->close();
-        fprintf(stderr, "[I:%s:%d %s] Synced reader closing ...", __FILE__, __LINE__, __FUNCTION__);    
+        fprintf(stderr, "[I:%s:%d %s] Synced reader closing ...", __FILE__, __LINE__, __FUNCTION__);
         sr->close();
-        fprintf(stderr, " closed\n");    
-        
+        fprintf(stderr, " closed\n");
     };
 
+    /**
+     * Checks that the input files are indexed so that the shards can be read by random access.
+     */
+    bool inputs_indexed()
+    {
+        for (size_t i=1; i<input_vcf_files.size(); ++i)
+        {
+            std::string& file = input_vcf_files[i];
+            if (access((file + ".csi").c_str(), F_OK) && access((file + ".tbi").c_str(), F_OK))
+            {
+                fprintf(stderr, "[W:%s:%d %s] %s is not indexed, genotypes are merged with a single thread\n", __FILE__, __LINE__, __FUNCTION__, file.c_str());
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * Limits the number of worker threads as every worker keeps all input files open.
+     * Returns false if there are not enough file descriptors for more than one worker.
+     */
+    bool set_max_threads()
+    {
+        struct rlimit rl;
+        if (getrlimit(RLIMIT_NOFILE, &rl)==0 && rl.rlim_cur!=RLIM_INFINITY)
+        {
+            int64_t max_threads = ((int64_t) rl.rlim_cur - RESERVED_FILE_DESCRIPTORS - sr->nfiles)/sr->nfiles;
+            if (max_threads<nthreads)
+            {
+                fprintf(stderr, "[W:%s:%d %s] open file limit of %d allows only %d threads for %d files\n", __FILE__, __LINE__, __FUNCTION__, (int32_t) rl.rlim_cur, (int32_t) std::max(max_threads, (int64_t) 1), sr->nfiles);
+                nthreads = (int32_t) std::max(max_threads, (int64_t) 1);
+            }
+        }
+
+        return nthreads>1;
+    }
+
+    /**
+     * Merges genotypes of shards of the candidate sites in parallel and stitches the results.
+     */
+    void merge_genotypes_shards(BCFOrderedReader *odr)
+    {
+        RegionSharder sharder(odr, intervals, nthreads);
+        sharder.run(merge_genotypes_shard, this);
+
+        for (size_t i=0; i<sharder.shards.size(); ++i)
+        {
+            Igor *worker = (Igor*) sharder.shards[i].data;
+
+            no_snps += worker->no_snps;
+            no_indels += worker->no_indels;
+            no_vntrs += worker->no_vntrs;
+
+            delete worker->sr;
+            delete worker->odw;
+            delete worker->vm;
+            delete worker;
+        }
+
+        sharder.stitch(odw);
+
+        odw->close();
+        sr->close();
+    }
+
+    /**
+     * Merges the genotypes of a shard, called by the worker threads of RegionSharder.
+     */
+    static void merge_genotypes_shard(void *arg, RegionShard *shard)
+    {
+        Igor *worker = new Igor(*((Igor*) arg), shard);
+        worker->merge_genotypes();
+        shard->data = worker;
+    }
+
+    /**
+     * Decodes up to n values of an integer FORMAT field of the first sample into dst
+     * and pads dst with vector ends.  Returns the number of values of the field.
+     */
+    static int32_t get_format_int32(bcf_hdr_t *h, bcf1_t *v, const char *tag, int32_t *dst, int32_t n)
+    {
+        bcf_fmt_t *fmt = bcf_get_fmt(h, v, tag);
+        if (!fmt) return 0;
+
+        int32_t m = std::min(fmt->n, n);
+        switch (fmt->type)
+        {
+            case BCF_BT_INT8:
+                decode_int32((int8_t*) fmt->p, (int8_t) bcf_int8_missing, (int8_t) bcf_int8_vector_end, dst, m);
+                break;
+            case BCF_BT_INT16:
+                decode_int32((int16_t*) fmt->p, (int16_t) bcf_int16_missing, (int16_t) bcf_int16_vector_end, dst, m);
+                break;
+            case BCF_BT_INT32:
+                decode_int32((int32_t*) fmt->p, bcf_int32_missing, bcf_int32_vector_end, dst, m);
+                break;
+            default:
+                return 0;
+        }
+
+        for (int32_t i=m; i<n; ++i)
+        {
+            dst[i] = bcf_int32_vector_end;
+        }
+
+        return fmt->n;
+    }
+
+    /**
+     * Decodes up to n values of a float FORMAT field of the first sample into dst
+     * and pads dst with vector ends.  Returns the number of values of the field.
+     */
+    static int32_t get_format_float(bcf_hdr_t *h, bcf1_t *v, const char *tag, float *dst, int32_t n)
+    {
+        bcf_fmt_t *fmt = bcf_get_fmt(h, v, tag);
+        if (!fmt || fmt->type!=BCF_BT_FLOAT) return 0;
+
+        int32_t m = std::min(fmt->n, n);
+        memcpy(dst, fmt->p, m*sizeof(float));
+
+        for (int32_t i=m; i<n; ++i)
+        {
+            bcf_float_set_vector_end(dst[i]);
+        }
+
+        return fmt->n;
+    }
+
+    /**
+     * Converts BCF typed integers to 32 bit integers.
+     */
+    template <class T>
+    static void decode_int32(T *p, T missing, T vector_end, int32_t *dst, int32_t n)
+    {
+        for (int32_t i=0; i<n; ++i)
+        {
+            dst[i] = p[i]==missing ? bcf_int32_missing : (p[i]==vector_end ? bcf_int32_vector_end : p[i]);
+        }
+    }
+
     void print_options()
     {
         std::clog << "merge_genotypes v" << version << "\n\n";
@@ -24,6 +24,7 @@
 #ifndef MERGE_GENOTYPES_H
 #define MERGE_GENOTYPES_H
 
+#include <sys/resource.h>
 #include "program.h"
 #include "log_tool.h"
 
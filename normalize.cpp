@@ -38,12 +38,14 @@ class Igor : Program
     std::vector<GenomeInterval> intervals;
     std::string ref_fasta_file;
     int32_t window_size;
+    bool adaptive_window;
     // 0 - do not fail at all
     // 1 - fail on unmasked consistencies
     // 2 - fail on all consistencies
     int32_t strict_level;
     bool print;
     bool debug;
+    int32_t nthreads;
 
     ///////
     //i/o//
@@ -99,6 +101,8 @@ class Igor : Program
             TCLAP::ValueArg<std::string> arg_intervals("i", "i", "intervals []", false, "", "str", cmd);
             TCLAP::ValueArg<std::string> arg_interval_list("I", "I", "file containing list of intervals []", false, "", "file", cmd);
             TCLAP::ValueArg<int32_t> arg_window_size("w", "w", "window size for local sorting of variants [10000]", false, 10000, "integer", cmd);
+            TCLAP::SwitchArg arg_adaptive_window("a", "a", "enlarge window for local sorting of variants when\n"
+                                       "              out of order variants are observed [false]", cmd, false);
             TCLAP::ValueArg<std::string> arg_fexp("f", "f", "filter expression []", false, "", "str", cmd);
             TCLAP::SwitchArg arg_warn_only("n", "n", "warns but does not exit when REF is inconsistent\n"
                                        "              with reference sequence for non SNPs [false]", cmd, false);
@@ -121,7 +125,9 @@ class Igor : Program
             strict_level = arg_warn_for_masked_only.getValue() ? 1 : strict_level;
             debug = arg_debug.getValue();
             window_size = arg_window_size.getValue();
+            adaptive_window = arg_adaptive_window.getValue();
             ref_fasta_file = arg_ref_fasta_file.getValue();
+            nthreads = hts_get_shared_thread_pool_size();
         }
         catch (TCLAP::ArgException &e)
         {
@@ -130,6 +136,25 @@ class Igor : Program
         }
     };
 
+    /**
+     * Constructs a worker that normalizes the records of a shard with the options of igor.
+     */
+    Igor(Igor& igor, RegionShard *shard)
+    {
+        version = igor.version;
+        input_vcf_file = igor.input_vcf_file;
+        output_vcf_file = shard->output_vcf_file;
+        intervals = shard->intervals;
+        ref_fasta_file = igor.ref_fasta_file;
+        window_size = igor.window_size;
+        adaptive_window = igor.adaptive_window;
+        strict_level = igor.strict_level;
+        print = igor.print;
+        debug = igor.debug;
+        nthreads = 1;
+        fexp = igor.fexp;
+    };
+
     void initialize()
     {
         //////////////////////
@@ -137,6 +162,7 @@ class Igor : Program
         //////////////////////
         odr = new BCFOrderedReader(input_vcf_file, intervals);
         odw = new BCFOrderedWriter(output_vcf_file, window_size);
+        odw->set_adaptive_window(adaptive_window);
         odw->link_hdr(odr->hdr);
         bcf_hdr_append(odw->hdr, "##INFO=<ID=OLD_VARIANT,Number=.,Type=String,Description=\"Original chr:pos:ref:alt encoding\">\n");
         odw->write_hdr();
@@ -180,6 +206,18 @@ class Igor : Program
         kstring_t old_alleles = {0,0,0};
         kstring_t new_alleles = {0,0,0};
 
+        if (nthreads>1 && odr->is_index_loaded())
+        {
+            normalize_shards();
+            return;
+        }
+
+        //the header is finalized and synced when it is written
+        if (odr->ftype.format==bcf && hts_get_shared_thread_pool_size())
+        {
+            odr->enable_prefetch();
+        }
+
         v = odw->get_bcf1_from_pool();
         Variant variant;
 
@@ -329,6 +367,57 @@ class Igor : Program
         odr->close();
     };
 
+    /**
+     * Normalizes shards of the input in parallel and stitches the results.
+     */
+    void normalize_shards()
+    {
+        RegionSharder sharder(odr, intervals, nthreads);
+        sharder.run(normalize_shard, this);
+
+        for (size_t i=0; i<sharder.shards.size(); ++i)
+        {
+            Igor *worker = (Igor*) sharder.shards[i].data;
+
+            no_variants += worker->no_variants;
+            no_refs += worker->no_refs;
+
+            no_lt += worker->no_lt;
+            no_rt += worker->no_rt;
+            no_lt_rt += worker->no_lt_rt;
+            no_rt_la += worker->no_rt_la;
+            no_la += worker->no_la;
+
+            no_multi_lt += worker->no_multi_lt;
+            no_multi_rt += worker->no_multi_rt;
+            no_multi_lt_rt += worker->no_multi_lt_rt;
+            no_multi_rt_la += worker->no_multi_rt_la;
+            no_multi_la += worker->no_multi_la;
+
+            delete worker->odr;
+            delete worker->odw;
+            delete worker->vm;
+            delete worker;
+        }
+
+        sharder.stitch(odw);
+
+        odw->close();
+        odr->close();
+    }
+
+    /**
+     * Normalizes the records of a shard, called by the worker threads of RegionSharder.
+     */
+    static void normalize_shard(void *arg, RegionShard *shard)
+    {
+        Igor *worker = new Igor(*((Igor*) arg), shard);
+        worker->initialize();
+        worker->odr->set_interval_start_only(shard->interval_start_only);
+        worker->normalize();
+        shard->data = worker;
+    }
+
     void print_options()
     {
         if (!print) return;
@@ -338,6 +427,7 @@ class Igor : Program
         std::clog << "options:     input VCF file                                  " << input_vcf_file << "\n";
         std::clog << "         [o] output VCF file                                 " << output_vcf_file << "\n";
         std::clog << "         [w] sorting window size                             " << window_size << "\n";
+        if (adaptive_window) std::clog << "         [a] adaptive sorting window                         true\n";
         print_str_op("         [f] filter                                          ", fexp);
         std::clog << "         [m] no fail on masked reference inconsistency       " << (strict_level==1 ? "true" : "false") << "\n";
         std::clog << "         [n] no fail on reference inconsistency              " << (strict_level==0 ? "true" : "false") << "\n";
@@ -0,0 +1,116 @@
+/* The MIT License
+
+   Copyright (c) 2018 Adrian Tan <atks@umich.edu>
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "pack_reference.h"
+#include "packed_reference.h"
+
+namespace
+{
+
+class Igor : Program
+{
+    public:
+
+    ///////////
+    //options//
+    ///////////
+    std::string ref_fasta_file;
+    std::string packed_reference_file;
+    bool print;
+
+    Igor(int argc, char **argv)
+    {
+        version = "0.5";
+
+        //////////////////////////
+        //options initialization//
+        //////////////////////////
+        try
+        {
+            std::string desc = "Packs a reference FASTA file into 2 bits per base for memory mapping.\n"
+                 "              The packed reference is used in place of the FASTA file\n"
+                 "              when it is found as <ref.fa>.pack.";
+
+            TCLAP::CmdLine cmd(desc, ' ', version);
+            VTOutput my;
+            cmd.setOutput(&my);
+            TCLAP::ValueArg<std::string> arg_packed_reference_file("o", "o", "output packed reference file [<ref.fa>.pack]", false, "", "str", cmd);
+            TCLAP::SwitchArg arg_print("p", "p", "print options and summary []", cmd, false);
+            TCLAP::UnlabeledValueArg<std::string> arg_ref_fasta_file("<ref.fa>", "reference FASTA file", true, "","file", cmd);
+
+            cmd.parse(argc, argv);
+
+            ref_fasta_file = arg_ref_fasta_file.getValue();
+            packed_reference_file = arg_packed_reference_file.getValue();
+            if (packed_reference_file=="")
+            {
+                packed_reference_file = ref_fasta_file + PACKED_REFERENCE_EXTENSION;
+            }
+            print = arg_print.getValue();
+        }
+        catch (TCLAP::ArgException &e)
+        {
+            std::cerr << "error: " << e.error() << " for arg " << e.argId() << "\n";
+            abort();
+        }
+    };
+
+    void initialize()
+    {
+    }
+
+    void pack_reference()
+    {
+        PackedReference::build(ref_fasta_file, packed_reference_file);
+    };
+
+    void print_options()
+    {
+        if (!print) return;
+
+        std::clog << "pack_reference v" << version << "\n\n";
+
+        std::clog << "options:     reference FASTA file      " << ref_fasta_file << "\n";
+        std::clog << "             packed reference file     " << packed_reference_file << "\n";
+        std::clog << "\n";
+    }
+
+    void print_stats()
+    {
+    };
+
+    ~Igor() {};
+
+    private:
+};
+}
+
+bool pack_reference(int argc, char ** argv)
+{
+    Igor igor(argc, argv);
+    igor.print_options();
+    igor.initialize();
+    igor.pack_reference();
+    igor.print_stats();
+    return igor.print;
+};
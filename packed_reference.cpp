@@ -0,0 +1,473 @@
+/* The MIT License
+
+   Copyright (c) 2018 Adrian Tan <atks@umich.edu>
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "packed_reference.h"
+
+/**
+ * Constructor, the file is memory mapped.
+ */
+PackedReference::PackedReference(std::string file_name)
+{
+    this->file_name = file_name;
+    last_id = -1;
+
+    fd = open(file_name.c_str(), O_RDONLY);
+    if (fd==-1)
+    {
+        fprintf(stderr, "[%s:%d %s] cannot open packed reference: %s\n", __FILE__, __LINE__, __FUNCTION__, file_name.c_str());
+        exit(1);
+    }
+
+    struct stat st;
+    fstat(fd, &st);
+    map_size = st.st_size;
+
+    map = (uint8_t*) mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map==MAP_FAILED || map_size<16 || memcmp(map, PACKED_REFERENCE_MAGIC, 8))
+    {
+        fprintf(stderr, "[%s:%d %s] not a packed reference: %s\n", __FILE__, __LINE__, __FUNCTION__, file_name.c_str());
+        exit(1);
+    }
+
+    //the index of the sequences is at the end of the file
+    uint64_t offset;
+    memcpy(&offset, map+8, sizeof(uint64_t));
+    const uint8_t* p = map+offset;
+
+    uint32_t n;
+    memcpy(&n, p, sizeof(uint32_t)); p += sizeof(uint32_t);
+    seqs.resize(n);
+    for (uint32_t i=0; i<n; ++i)
+    {
+        PackedSequence& s = seqs[i];
+        uint32_t name_len;
+        uint64_t bases_offset, n_runs_offset, mask_runs_offset, other_pos0_offset, other_bases_offset;
+
+        memcpy(&name_len, p, sizeof(uint32_t)); p += sizeof(uint32_t);
+        s.name.assign((const char*)p, name_len); p += name_len;
+        memcpy(&s.len, p, sizeof(int32_t)); p += sizeof(int32_t);
+        memcpy(&bases_offset, p, sizeof(uint64_t)); p += sizeof(uint64_t);
+        memcpy(&s.no_n_runs, p, sizeof(uint32_t)); p += sizeof(uint32_t);
+        memcpy(&n_runs_offset, p, sizeof(uint64_t)); p += sizeof(uint64_t);
+        memcpy(&s.no_mask_runs, p, sizeof(uint32_t)); p += sizeof(uint32_t);
+        memcpy(&mask_runs_offset, p, sizeof(uint64_t)); p += sizeof(uint64_t);
+        memcpy(&s.no_others, p, sizeof(uint32_t)); p += sizeof(uint32_t);
+        memcpy(&other_pos0_offset, p, sizeof(uint64_t)); p += sizeof(uint64_t);
+        memcpy(&other_bases_offset, p, sizeof(uint64_t)); p += sizeof(uint64_t);
+
+        s.bases = map+bases_offset;
+        s.n_runs = (const uint32_t*) (map+n_runs_offset);
+        s.mask_runs = (const uint32_t*) (map+mask_runs_offset);
+        s.other_pos0 = (const uint32_t*) (map+other_pos0_offset);
+        s.other_bases = (const char*) (map+other_bases_offset);
+
+        name2id[s.name] = i;
+    }
+};
+
+/**
+ * Destructor.
+ */
+PackedReference::~PackedReference()
+{
+    munmap(map, map_size);
+    close(fd);
+};
+
+/**
+ * Checks if file_name is a packed reference.
+ */
+bool PackedReference::is_packed_reference(std::string file_name)
+{
+    FILE* file = fopen(file_name.c_str(), "r");
+    if (!file) return false;
+
+    char magic[8];
+    bool packed = fread(magic, 1, 8, file)==8 && !memcmp(magic, PACKED_REFERENCE_MAGIC, 8);
+    fclose(file);
+
+    return packed;
+};
+
+namespace
+{
+/**
+ * Writes data to a packed reference file, returns the offset it is written at.
+ * Sections are aligned to 8 bytes so that they can be read in place.
+ */
+uint64_t write_section(FILE* file, const void* data, size_t size)
+{
+    uint64_t offset = ftell(file);
+    if (offset&7)
+    {
+        char pad[8] = {0,0,0,0,0,0,0,0};
+        fwrite(pad, 1, 8-(offset&7), file);
+        offset = ftell(file);
+    }
+    if (size) fwrite(data, 1, size, file);
+
+    return offset;
+}
+
+/**
+ * Adds position i to a list of runs stored as pairs.
+ */
+void add_to_runs(std::vector<uint32_t>& runs, uint32_t i)
+{
+    if (runs.size() && runs.back()==i)
+    {
+        ++runs.back();
+    }
+    else
+    {
+        runs.push_back(i);
+        runs.push_back(i+1);
+    }
+}
+}
+
+/**
+ * Builds a packed reference from a FASTA file.
+ */
+void PackedReference::build(std::string ref_fasta_file, std::string packed_reference_file)
+{
+    faidx_t* fai = fai_load(ref_fasta_file.c_str());
+    if (fai==NULL)
+    {
+        fprintf(stderr, "[%s:%d %s] cannot load genome index: %s\n", __FILE__, __LINE__, __FUNCTION__, ref_fasta_file.c_str());
+        exit(1);
+    }
+
+    FILE* file = fopen(packed_reference_file.c_str(), "w");
+    if (file==NULL)
+    {
+        fprintf(stderr, "[%s:%d %s] cannot open packed reference for writing: %s\n", __FILE__, __LINE__, __FUNCTION__, packed_reference_file.c_str());
+        exit(1);
+    }
+
+    uint64_t index_offset = 0;
+    fwrite(PACKED_REFERENCE_MAGIC, 1, 8, file);
+    fwrite(&index_offset, sizeof(uint64_t), 1, file);
+
+    //index entries are written after the sequences
+    kstring_t index = {0,0,0};
+    uint32_t n = faidx_nseq(fai);
+    kputsn((char*)&n, sizeof(uint32_t), &index);
+
+    uint8_t code[256];
+    memset(code, 4, 256);
+    code['A'] = code['a'] = 0;
+    code['C'] = code['c'] = 1;
+    code['G'] = code['g'] = 2;
+    code['T'] = code['t'] = 3;
+
+    std::vector<uint8_t> bases;
+    std::vector<uint32_t> n_runs, mask_runs, other_pos0;
+    std::string other_bases;
+
+    for (uint32_t i=0; i<n; ++i)
+    {
+        const char* name = faidx_iseq(fai, i);
+        int32_t len = 0;
+        char* seq = faidx_fetch_seq(fai, name, 0, INT_MAX, &len);
+        if (seq==NULL || len<0)
+        {
+            fprintf(stderr, "[%s:%d %s] cannot read %s from %s\n", __FILE__, __LINE__, __FUNCTION__, name, ref_fasta_file.c_str());
+            exit(1);
+        }
+
+        bases.assign((len+3)/4, 0);
+        n_runs.clear();
+        mask_runs.clear();
+        other_pos0.clear();
+        other_bases.clear();
+
+        for (int32_t j=0; j<len; ++j)
+        {
+            uint8_t c = seq[j];
+            if (c>='a' && c<='z')
+            {
+                add_to_runs(mask_runs, j);
+                c = toupper(c);
+            }
+
+            if (code[c]<4)
+            {
+                bases[j>>2] |= code[c]<<((j&3)<<1);
+            }
+            else if (c=='N')
+            {
+                add_to_runs(n_runs, j);
+            }
+            else
+            {
+                other_pos0.push_back(j);
+                other_bases.push_back(c);
+            }
+        }
+        free(seq);
+
+        uint64_t bases_offset = write_section(file, bases.data(), bases.size());
+        uint64_t n_runs_offset = write_section(file, n_runs.data(), n_runs.size()*sizeof(uint32_t));
+        uint64_t mask_runs_offset = write_section(file, mask_runs.data(), mask_runs.size()*sizeof(uint32_t));
+        uint64_t other_pos0_offset = write_section(file, other_pos0.data(), other_pos0.size()*sizeof(uint32_t));
+        uint64_t other_bases_offset = write_section(file, other_bases.data(), other_bases.size());
+
+        uint32_t name_len = strlen(name);
+        uint32_t no_n_runs = n_runs.size()/2;
+        uint32_t no_mask_runs = mask_runs.size()/2;
+        uint32_t no_others = other_pos0.size();
+        kputsn((char*)&name_len, sizeof(uint32_t), &index);
+        kputsn(name, name_len, &index);
+        kputsn((char*)&len, sizeof(int32_t), &index);
+        kputsn((char*)&bases_offset, sizeof(uint64_t), &index);
+        kputsn((char*)&no_n_runs, sizeof(uint32_t), &index);
+        kputsn((char*)&n_runs_offset, sizeof(uint64_t), &index);
+        kputsn((char*)&no_mask_runs, sizeof(uint32_t), &index);
+        kputsn((char*)&mask_runs_offset, sizeof(uint64_t), &index);
+        kputsn((char*)&no_others, sizeof(uint32_t), &index);
+        kputsn((char*)&other_pos0_offset, sizeof(uint64_t), &index);
+        kputsn((char*)&other_bases_offset, sizeof(uint64_t), &index);
+    }
+
+    index_offset = write_section(file, index.s, index.l);
+    fseek(file, 8, SEEK_SET);
+    fwrite(&index_offset, sizeof(uint64_t), 1, file);
+
+    if (fclose(file))
+    {
+        fprintf(stderr, "[%s:%d %s] writing of packed reference failed: %s\n", __FILE__, __LINE__, __FUNCTION__, packed_reference_file.c_str());
+        exit(1);
+    }
+
+    if (index.m) free(index.s);
+    fai_destroy(fai);
+};
+
+/**
+ * Gets the ID of a sequence, -1 if it does not exist.
+ */
+int32_t PackedReference::get_id(const char* chrom)
+{
+    if (last_id!=-1 && seqs[last_id].name==chrom)
+    {
+        return last_id;
+    }
+
+    std::map<std::string, int32_t>::iterator i = name2id.find(chrom);
+    if (i==name2id.end())
+    {
+        return -1;
+    }
+
+    last_id = i->second;
+    return last_id;
+};
+
+/**
+ * Copies the bases of sequence id from beg0 to end0 inclusive into seq.
+ */
+void PackedReference::decode(int32_t id, int32_t beg0, int32_t end0, char* seq)
+{
+    static const char bases[4] = {'A','C','G','T'};
+    PackedSequence& s = seqs[id];
+
+    for (int32_t i=beg0; i<=end0; ++i)
+    {
+        seq[i-beg0] = bases[(s.bases[i>>2]>>((i&3)<<1))&3];
+    }
+
+    //first run that ends after beg0
+    uint32_t lo = 0, hi = s.no_n_runs;
+    while (lo<hi)
+    {
+        uint32_t mid = (lo+hi)>>1;
+        if (s.n_runs[mid*2+1]<=(uint32_t)beg0) lo = mid+1; else hi = mid;
+    }
+    for (uint32_t j=lo; j<s.no_n_runs && s.n_runs[j*2]<=(uint32_t)end0; ++j)
+    {
+        uint32_t b = std::max(s.n_runs[j*2], (uint32_t)beg0);
+        uint32_t e = std::min(s.n_runs[j*2+1], (uint32_t)end0+1);
+        memset(seq+b-beg0, 'N', e-b);
+    }
+
+    const uint32_t* other = std::lower_bound(s.other_pos0, s.other_pos0+s.no_others, (uint32_t)beg0);
+    for (; other!=s.other_pos0+s.no_others && *other<=(uint32_t)end0; ++other)
+    {
+        seq[*other-beg0] = s.other_bases[other-s.other_pos0];
+    }
+
+    lo = 0, hi = s.no_mask_runs;
+    while (lo<hi)
+    {
+        uint32_t mid = (lo+hi)>>1;
+        if (s.mask_runs[mid*2+1]<=(uint32_t)beg0) lo = mid+1; else hi = mid;
+    }
+    for (uint32_t j=lo; j<s.no_mask_runs && s.mask_runs[j*2]<=(uint32_t)end0; ++j)
+    {
+        uint32_t b = std::max(s.mask_runs[j*2], (uint32_t)beg0);
+        uint32_t e = std::min(s.mask_runs[j*2+1], (uint32_t)end0+1);
+        for (uint32_t k=b; k<e; ++k)
+        {
+            seq[k-beg0] = tolower(seq[k-beg0]);
+        }
+    }
+};
+
+/**
+ * Constructor.
+ */
+ReferenceIndex::ReferenceIndex()
+{
+    fai = NULL;
+    packed = NULL;
+};
+
+/**
+ * Loads the index of a reference sequence file, returns NULL on failure.
+ */
+ReferenceIndex* ReferenceIndex::load(std::string ref_fasta_file)
+{
+    ReferenceIndex* ref = new ReferenceIndex();
+
+    std::string packed_reference_file = ref_fasta_file + PACKED_REFERENCE_EXTENSION;
+    struct stat fasta_st, packed_st;
+    if (PackedReference::is_packed_reference(ref_fasta_file))
+    {
+        ref->packed = new PackedReference(ref_fasta_file);
+        return ref;
+    }
+    else if (stat(packed_reference_file.c_str(), &packed_st)==0 &&
+             PackedReference::is_packed_reference(packed_reference_file))
+    {
+        if (stat(ref_fasta_file.c_str(), &fasta_st)==0 && fasta_st.st_mtime<=packed_st.st_mtime)
+        {
+            ref->packed = new PackedReference(packed_reference_file);
+            return ref;
+        }
+
+        fprintf(stderr, "[%s:%d %s] packed reference is older than %s and is not used: %s\n", __FILE__, __LINE__, __FUNCTION__, ref_fasta_file.c_str(), packed_reference_file.c_str());
+    }
+
+    ref->fai = fai_load(ref_fasta_file.c_str());
+    if (ref->fai==NULL)
+    {
+        delete ref;
+        return NULL;
+    }
+
+    return ref;
+};
+
+/**
+ * Destructor.
+ */
+ReferenceIndex::~ReferenceIndex()
+{
+    if (fai) fai_destroy(fai);
+    if (packed) delete packed;
+};
+
+/**
+ * Returns the number of sequences.
+ */
+int32_t ReferenceIndex::nseq()
+{
+    return packed ? packed->seqs.size() : faidx_nseq(fai);
+};
+
+/**
+ * Returns the name of the ith sequence.
+ */
+const char* ReferenceIndex::iseq(int32_t i)
+{
+    return packed ? packed->seqs[i].name.c_str() : faidx_iseq(fai, i);
+};
+
+/**
+ * Returns the length of a sequence, -1 if it does not exist.
+ */
+int32_t ReferenceIndex::seq_len(const char* chrom)
+{
+    if (!packed)
+    {
+        return faidx_seq_len(fai, chrom);
+    }
+
+    int32_t id = packed->get_id(chrom);
+    return id==-1 ? -1 : packed->seqs[id].len;
+};
+
+/**
+ * Fetches the sequence chrom:beg0-end0, len is -2 if the sequence does not exist.
+ */
+char* ReferenceIndex::fetch_seq(const char* chrom, int32_t beg0, int32_t end0, int32_t* len)
+{
+    if (!packed)
+    {
+        return faidx_fetch_seq(fai, chrom, beg0, end0, len);
+    }
+
+    int32_t id = packed->get_id(chrom);
+    if (id==-1)
+    {
+        fprintf(stderr, "[%s:%d %s] The sequence \"%s\" was not found\n", __FILE__, __LINE__, __FUNCTION__, chrom);
+        *len = -2;
+        return NULL;
+    }
+
+    //positions are clamped as in faidx
+    int32_t seq_len = packed->seqs[id].len;
+    if (end0<beg0) beg0 = end0;
+    beg0 = std::min(std::max(beg0, 0), seq_len-1);
+    end0 = std::min(std::max(end0, 0), seq_len-1);
+
+    char* seq = (char*) malloc(end0-beg0+2);
+    packed->decode(id, beg0, end0, seq);
+    seq[end0-beg0+1] = 0;
+    *len = end0-beg0+1;
+
+    return seq;
+};
+
+/**
+ * Fetches the sequence chrom:beg0-end0 in upper case.
+ */
+char* ReferenceIndex::fetch_uc_seq(const char* chrom, int32_t beg0, int32_t end0, int32_t* len)
+{
+    if (!packed)
+    {
+        return faidx_fetch_uc_seq(fai, chrom, beg0, end0, len);
+    }
+
+    char* seq = fetch_seq(chrom, beg0, end0, len);
+    if (seq)
+    {
+        for (int32_t i=0; i<*len; ++i)
+        {
+            seq[i] = toupper(seq[i]);
+        }
+    }
+
+    return seq;
+};
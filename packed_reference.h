@@ -0,0 +1,179 @@
+/* The MIT License
+
+   Copyright (c) 2018 Adrian Tan <atks@umich.edu>
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef PACKED_REFERENCE_H
+#define PACKED_REFERENCE_H
+
+#include <map>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "hts_utils.h"
+#include "utils.h"
+
+#define PACKED_REFERENCE_MAGIC "VTPACK\1\0"
+#define PACKED_REFERENCE_EXTENSION ".pack"
+
+/**
+ * A sequence in a packed reference.
+ */
+class PackedSequence
+{
+    public:
+
+    std::string name;
+    int32_t len;
+
+    //2 bit bases, 4 bases to a byte with the first base in the lowest bits
+    const uint8_t* bases;
+
+    //runs of N, sorted half open intervals [beg0,end0) stored as pairs
+    const uint32_t* n_runs;
+    uint32_t no_n_runs;
+
+    //runs of soft masked bases stored as pairs
+    const uint32_t* mask_runs;
+    uint32_t no_mask_runs;
+
+    //other IUPAC codes, sorted positions and their bases
+    const uint32_t* other_pos0;
+    const char* other_bases;
+    uint32_t no_others;
+};
+
+/**
+ * Reference sequences packed in 2 bits per base with lists of N runs,
+ * soft masked runs and other IUPAC codes, read from a memory mapped file.
+ *
+ * The file is mapped read only and shared, so threads and processes reading
+ * the same reference share a single copy in the page cache and fetching
+ * bases does not involve any decompression.
+ *
+ * The file is built from a FASTA file with vt pack_reference and is
+ * placed next to it as <ref.fa>.pack.
+ */
+class PackedReference
+{
+    public:
+
+    std::string file_name;
+    int32_t fd;
+    uint8_t* map;
+    size_t map_size;
+
+    std::vector<PackedSequence> seqs;
+    std::map<std::string, int32_t> name2id;
+
+    //last sequence fetched
+    int32_t last_id;
+
+    /**
+     * Constructor, the file is memory mapped.
+     */
+    PackedReference(std::string file_name);
+
+    /**
+     * Destructor.
+     */
+    ~PackedReference();
+
+    /**
+     * Checks if file_name is a packed reference.
+     */
+    static bool is_packed_reference(std::string file_name);
+
+    /**
+     * Builds a packed reference from a FASTA file.
+     */
+    static void build(std::string ref_fasta_file, std::string packed_reference_file);
+
+    /**
+     * Gets the ID of a sequence, -1 if it does not exist.
+     */
+    int32_t get_id(const char* chrom);
+
+    /**
+     * Copies the bases of sequence id from beg0 to end0 inclusive into seq.
+     */
+    void decode(int32_t id, int32_t beg0, int32_t end0, char* seq);
+};
+
+/**
+ * Index of a reference sequence file.
+ *
+ * This is a packed reference when <ref.fa>.pack exists and is not older
+ * than the FASTA file, otherwise this is faidx.  Fetches follow the
+ * conventions of faidx, coordinates are 0 based, inclusive, clamped to
+ * the sequence and the returned sequence is freed by the caller.
+ */
+class ReferenceIndex
+{
+    public:
+
+    faidx_t *fai;
+    PackedReference *packed;
+
+    /**
+     * Loads the index of a reference sequence file, returns NULL on failure.
+     */
+    static ReferenceIndex* load(std::string ref_fasta_file);
+
+    /**
+     * Destructor.
+     */
+    ~ReferenceIndex();
+
+    /**
+     * Returns the number of sequences.
+     */
+    int32_t nseq();
+
+    /**
+     * Returns the name of the ith sequence.
+     */
+    const char* iseq(int32_t i);
+
+    /**
+     * Returns the length of a sequence, -1 if it does not exist.
+     */
+    int32_t seq_len(const char* chrom);
+
+    /**
+     * Fetches the sequence chrom:beg0-end0, len is -2 if the sequence does not exist.
+     */
+    char* fetch_seq(const char* chrom, int32_t beg0, int32_t end0, int32_t* len);
+
+    /**
+     * Fetches the sequence chrom:beg0-end0 in upper case.
+     */
+    char* fetch_uc_seq(const char* chrom, int32_t beg0, int32_t end0, int32_t* len);
+
+    private:
+
+    /**
+     * Constructor.
+     */
+    ReferenceIndex();
+};
+
+#endif
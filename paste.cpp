@@ -49,10 +49,16 @@ class Igor : Program
     ///////////////
     //general use//
     ///////////////
+    //types of the FORMAT fields of the pasted record
+    std::vector<int32_t> types;
+    //number of values per sample of the FORMAT fields of the pasted record
+    std::vector<int32_t> nvals;
 
     /////////
     //stats//
     /////////
+    uint32_t no_spliced_records;
+    uint32_t no_decoded_records;
 
     /////////
     //tools//
@@ -126,6 +132,8 @@ class Igor : Program
         ////////////////////////
         //stats initialization//
         ////////////////////////
+        no_spliced_records = 0;
+        no_decoded_records = 0;
 
         /////////
         //tools//
@@ -232,6 +240,14 @@ class Igor : Program
                 }
             }
 
+            //splice the raw FORMAT blocks when the layouts match
+            if (paste_format_blocks(nv, vs, nfiles, no_samples))
+            {
+                odw->write(nv);
+                ++no_spliced_records;
+                continue;
+            }
+
             //for each format, construct array
             for (size_t i=0; i<vs[0]->n_fmt; ++i)
             {
@@ -302,35 +318,43 @@ class Igor : Program
                     int32_t ndst = no_samples * sizeof(char *);
 
                     char **data = (char **) malloc(ndst);
+                    std::vector<char **> strs(nfiles, NULL);
                     int32_t cp = 0;
 
                     for (size_t j=0; j<nfiles; ++j)
                     {
-                        char** p = NULL;
                         int32_t np = 0;
-                        int32_t b = bcf_get_format_char(odrs[j]->hdr, vs[j], genotype_field, &p, &np);
-                        
+                        int32_t b = bcf_get_format_string(odrs[j]->hdr, vs[j], genotype_field, &strs[j], &np);
+
                         for (size_t k=0; k<bcf_hdr_nsamples(odrs[j]->hdr); ++k)
                         {
-                            data[cp+k] = p[k];
-                            ++cp;    
+                            data[cp] = b>0 ? strs[j][k] : const_cast<char*>(".");
+                            ++cp;
                         }
-                        free(p);
                     }
 
-                    bcf_update_format_string(odw->hdr, nv, genotype_field, const_cast<const char**>(data), no_samples * vs[0]->d.fmt[i].n);
-                    
-                    cp = 0;
+                    bcf_update_format_string(odw->hdr, nv, genotype_field, const_cast<const char**>(data), no_samples);
+
                     for (size_t j=0; j<nfiles; ++j)
                     {
-                        free(data[cp]);
-                        cp += bcf_hdr_nsamples(odrs[j]->hdr);
-                    }                    
+                        if (strs[j])
+                        {
+                            free(strs[j][0]);
+                            free(strs[j]);
+                        }
+                    }
                     free(data);
                 }
             }
 
             odw->write(nv);
+            ++no_decoded_records;
+        }
+
+        bcf_destroy(nv);
+        for (int32_t i=0; i<nfiles; ++i)
+        {
+            bcf_destroy(vs[i]);
         }
 
         for (size_t i=0; i<nfiles; ++i)
@@ -341,6 +365,155 @@ class Igor : Program
         odw->close();
     };
 
+    /**
+     * Pastes the FORMAT fields of records by concatenating the encoded
+     * blocks of the samples of each file into the individual data of nv.
+     * This requires the same type for every field, integer blocks of a
+     * narrower type are widened and samples with fewer values are padded
+     * with vector ends.
+     * Returns false without modifying nv if the layouts do not match.
+     */
+    bool paste_format_blocks(bcf1_t *nv, bcf1_t **vs, int32_t nfiles, int32_t no_samples)
+    {
+        types.resize(vs[0]->n_fmt);
+        nvals.resize(vs[0]->n_fmt);
+        for (size_t i=0; i<vs[0]->n_fmt; ++i)
+        {
+            bcf_fmt_t *fmt = &vs[0]->d.fmt[i];
+            types[i] = fmt->type;
+            nvals[i] = fmt->n;
+
+            for (int32_t j=1; j<nfiles; ++j)
+            {
+                bcf_fmt_t *f = &vs[j]->d.fmt[i];
+
+                if (f->type!=fmt->type)
+                {
+                    if (!is_int_type(f->type) || !is_int_type(fmt->type))
+                    {
+                        return false;
+                    }
+
+                    types[i] = std::max(types[i], f->type);
+                }
+
+                nvals[i] = std::max(nvals[i], f->n);
+            }
+        }
+
+        kstring_t *s = &nv->indiv;
+        s->l = 0;
+        for (size_t i=0; i<vs[0]->n_fmt; ++i)
+        {
+            bcf_enc_int1(s, vs[0]->d.fmt[i].id);
+            bcf_enc_size(s, nvals[i], types[i]);
+
+            for (int32_t j=0; j<nfiles; ++j)
+            {
+                append_format_block(s, &vs[j]->d.fmt[i], types[i], nvals[i]);
+            }
+        }
+
+        nv->n_sample = no_samples;
+
+        return true;
+    }
+
+    /**
+     * Appends the encoded block of a FORMAT field with n values per sample of the given type.
+     */
+    static void append_format_block(kstring_t *s, bcf_fmt_t *f, int32_t type, int32_t n)
+    {
+        if (f->type==type && f->n==n)
+        {
+            kputsn((char *) f->p, f->p_len, s);
+            return;
+        }
+
+        for (uint32_t k=0; k<f->p_len; k+=f->size)
+        {
+            uint8_t *p = f->p+k;
+
+            if (f->type==type)
+            {
+                kputsn((char *) p, f->size, s);
+            }
+            else
+            {
+                for (int32_t l=0; l<f->n; ++l)
+                {
+                    put_int(s, get_int(p, f->type, l), type);
+                }
+            }
+
+            for (int32_t l=f->n; l<n; ++l)
+            {
+                if (type==BCF_BT_FLOAT)
+                {
+                    kputsn((char *) &bcf_float_vector_end, sizeof(float), s);
+                }
+                else if (type==BCF_BT_CHAR)
+                {
+                    kputc('\0', s);
+                }
+                else
+                {
+                    put_int(s, bcf_int32_vector_end, type);
+                }
+            }
+        }
+    }
+
+    /**
+     * Checks if a BCF type is an integer type.
+     */
+    static bool is_int_type(int32_t type)
+    {
+        return type==BCF_BT_INT8 || type==BCF_BT_INT16 || type==BCF_BT_INT32;
+    }
+
+    /**
+     * Gets the lth value of an encoded integer vector, missing values and vector ends are kept.
+     */
+    static int32_t get_int(uint8_t *p, int32_t type, int32_t l)
+    {
+        if (type==BCF_BT_INT8)
+        {
+            int8_t x = ((int8_t *) p)[l];
+            return x==bcf_int8_missing ? bcf_int32_missing : (x==bcf_int8_vector_end ? bcf_int32_vector_end : x);
+        }
+        else if (type==BCF_BT_INT16)
+        {
+            int16_t x = ((int16_t *) p)[l];
+            return x==bcf_int16_missing ? bcf_int32_missing : (x==bcf_int16_vector_end ? bcf_int32_vector_end : x);
+        }
+        else
+        {
+            return ((int32_t *) p)[l];
+        }
+    }
+
+    /**
+     * Appends an integer encoded as type, missing values and vector ends are kept.
+     */
+    static void put_int(kstring_t *s, int32_t x, int32_t type)
+    {
+        if (type==BCF_BT_INT8)
+        {
+            int8_t y = x==bcf_int32_missing ? bcf_int8_missing : (x==bcf_int32_vector_end ? bcf_int8_vector_end : x);
+            kputc(y, s);
+        }
+        else if (type==BCF_BT_INT16)
+        {
+            int16_t y = x==bcf_int32_missing ? bcf_int16_missing : (x==bcf_int32_vector_end ? bcf_int16_vector_end : x);
+            kputsn((char *) &y, sizeof(int16_t), s);
+        }
+        else
+        {
+            kputsn((char *) &x, sizeof(int32_t), s);
+        }
+    }
+
     void print_options()
     {
         if (!print) return;
@@ -357,6 +530,8 @@ class Igor : Program
 
         std::clog << "\n";
         std::cerr << "stats: Total number of files pasted  " << input_vcf_files.size() << "\n";
+        std::cerr << "       Records spliced               " << no_spliced_records << "\n";
+        std::cerr << "       Records decoded               " << no_decoded_records << "\n";
         std::clog << "\n";
     };
 
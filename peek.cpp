@@ -146,6 +146,11 @@ class Igor : Program
         //i/o initialization//
         //////////////////////
         odr = new BCFOrderedReader(input_vcf_file, intervals);
+        //the header is only read
+        if (odr->ftype.format==bcf && hts_get_shared_thread_pool_size())
+        {
+            odr->enable_prefetch();
+        }
         v = bcf_init1();
 
         /////////////////////////
@@ -23,11 +23,280 @@
 
 #include "pileup.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Unpacks a stretch of 4 bit encoded bases of a read to characters,
+ * bases with quality below the cutoff are set to 0.
+ */
+static void unpack_bases_scalar(uint8_t* seq, uint32_t spos0, uint32_t len, uint8_t* qual, uint32_t baseq_cutoff, char* bases)
+{
+    for (uint32_t j=0; j<len; ++j)
+    {
+        char base = bam_base2char(bam_seqi(seq, spos0+j));
+        bases[j] = qual[spos0+j]>=baseq_cutoff ? base : 0;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+ * Unpacks 16 bases at a time with SSSE3.
+ */
+__attribute__((target("ssse3")))
+static void unpack_bases_ssse3(uint8_t* seq, uint32_t spos0, uint32_t len, uint8_t* qual, uint32_t baseq_cutoff, char* bases)
+{
+    uint32_t j = 0;
+
+    if (baseq_cutoff<=255)
+    {
+        //start on a byte boundary of the packed sequence
+        if ((spos0&1) && len)
+        {
+            unpack_bases_scalar(seq, spos0, 1, qual, baseq_cutoff, bases);
+            j = 1;
+        }
+
+        const __m128i table = _mm_setr_epi8('X','A','C','X','G','X','X','X','T','X','X','X','X','X','X','N');
+        const __m128i mask = _mm_set1_epi8(0x0F);
+        const __m128i cutoff = _mm_set1_epi8((char) baseq_cutoff);
+
+        for (; j+16<=len; j+=16)
+        {
+            __m128i packed = _mm_loadl_epi64((__m128i*) (seq+((spos0+j)>>1)));
+            __m128i hi = _mm_and_si128(_mm_srli_epi16(packed, 4), mask);
+            __m128i lo = _mm_and_si128(packed, mask);
+            __m128i b = _mm_shuffle_epi8(table, _mm_unpacklo_epi8(hi, lo));
+
+            __m128i q = _mm_loadu_si128((__m128i*) (qual+spos0+j));
+            __m128i pass = _mm_cmpeq_epi8(_mm_max_epu8(q, cutoff), q);
+            _mm_storeu_si128((__m128i*) (bases+j), _mm_and_si128(b, pass));
+        }
+    }
+
+    unpack_bases_scalar(seq, spos0+j, len-j, qual, baseq_cutoff, bases+j);
+}
+
+/**
+ * Unpacks 32 bases at a time with AVX2.
+ */
+__attribute__((target("avx2")))
+static void unpack_bases_avx2(uint8_t* seq, uint32_t spos0, uint32_t len, uint8_t* qual, uint32_t baseq_cutoff, char* bases)
+{
+    uint32_t j = 0;
+
+    if (baseq_cutoff<=255)
+    {
+        //start on a byte boundary of the packed sequence
+        if ((spos0&1) && len)
+        {
+            unpack_bases_scalar(seq, spos0, 1, qual, baseq_cutoff, bases);
+            j = 1;
+        }
+
+        const __m256i table = _mm256_setr_epi8('X','A','C','X','G','X','X','X','T','X','X','X','X','X','X','N',
+                                               'X','A','C','X','G','X','X','X','T','X','X','X','X','X','X','N');
+        const __m128i mask = _mm_set1_epi8(0x0F);
+        const __m256i cutoff = _mm256_set1_epi8((char) baseq_cutoff);
+
+        for (; j+32<=len; j+=32)
+        {
+            __m128i packed = _mm_loadu_si128((__m128i*) (seq+((spos0+j)>>1)));
+            __m128i hi = _mm_and_si128(_mm_srli_epi16(packed, 4), mask);
+            __m128i lo = _mm_and_si128(packed, mask);
+            __m256i codes = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi8(hi, lo)), _mm_unpackhi_epi8(hi, lo), 1);
+            __m256i b = _mm256_shuffle_epi8(table, codes);
+
+            __m256i q = _mm256_loadu_si256((__m256i*) (qual+spos0+j));
+            __m256i pass = _mm256_cmpeq_epi8(_mm256_max_epu8(q, cutoff), q);
+            _mm256_storeu_si256((__m256i*) (bases+j), _mm256_and_si256(b, pass));
+        }
+
+        //the remaining bases are unpacked with SSE instructions
+        _mm256_zeroupper();
+    }
+
+    unpack_bases_ssse3(seq, spos0+j, len-j, qual, baseq_cutoff, bases+j);
+}
+
+#endif
+
+/**
+ * Selects the fastest base unpacking supported by the CPU.
+ */
+static unpack_bases_t select_unpack_bases()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) return unpack_bases_avx2;
+    if (__builtin_cpu_supports("ssse3")) return unpack_bases_ssse3;
+#endif
+    return unpack_bases_scalar;
+}
+
+/**
+ * Checks the base unpacking kernels supported by the CPU against the scalar loop
+ * for odd and even starting positions and lengths that are not a multiple of the
+ * vector width.  Returns the number of mismatching unpackings.
+ */
+uint32_t Pileup::check_unpack_bases()
+{
+    std::vector<std::pair<std::string, unpack_bases_t> > kernels;
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("ssse3")) kernels.push_back(std::make_pair("ssse3", unpack_bases_ssse3));
+    if (__builtin_cpu_supports("avx2")) kernels.push_back(std::make_pair("avx2", unpack_bases_avx2));
+#endif
+
+    uint32_t cutoffs[] = {0, 1, 13, 20, 30, 93, 255, 256};
+    uint32_t no_cutoffs = sizeof(cutoffs)/sizeof(uint32_t);
+    uint32_t no_mismatches = 0;
+
+    //a fixed generator keeps the checked reads the same from run to run
+    uint32_t r = 11;
+
+    for (uint32_t l=1; l<=150; ++l)
+    {
+        std::vector<uint8_t> seq((l+1)>>1);
+        std::vector<uint8_t> qual(l);
+        for (uint32_t i=0; i<seq.size(); ++i)
+        {
+            r = r*1103515245 + 12345;
+            seq[i] = r>>16;
+        }
+        for (uint32_t i=0; i<l; ++i)
+        {
+            r = r*1103515245 + 12345;
+            qual[i] = (r>>16)%50==0 ? 255 : (r>>16)%94;
+        }
+
+        std::vector<char> expected(l+64);
+        std::vector<char> observed(l+64);
+
+        for (uint32_t k=0; k<kernels.size(); ++k)
+        {
+            for (uint32_t spos0=0; spos0<std::min(l,(uint32_t)4); ++spos0)
+            {
+                for (uint32_t c=0; c<no_cutoffs; ++c)
+                {
+                    uint32_t len = l-spos0;
+                    std::fill(expected.begin(), expected.end(), '#');
+                    std::fill(observed.begin(), observed.end(), '#');
+                    unpack_bases_scalar(seq.data(), spos0, len, qual.data(), cutoffs[c], expected.data());
+                    kernels[k].second(seq.data(), spos0, len, qual.data(), cutoffs[c], observed.data());
+
+                    if (expected!=observed)
+                    {
+                        fprintf(stderr, "[%s:%d %s] %s unpacking differs from scalar loop for read length %d, start %d, length %d, cutoff %d\n",
+                                          __FILE__,
+                                          __LINE__,
+                                          __FUNCTION__,
+                                          kernels[k].first.c_str(),
+                                          l,
+                                          spos0,
+                                          len,
+                                          cutoffs[c]);
+                        ++no_mismatches;
+                    }
+                }
+            }
+        }
+    }
+
+    return no_mismatches;
+}
+
+/**
+ * Constructor.
+ */
+PileupAlleleTable::PileupAlleleTable()
+{
+    h = kh_init(allele_id);
+}
+
+/**
+ * Destructor.
+ */
+PileupAlleleTable::~PileupAlleleTable()
+{
+    for (size_t i=0; i<seqs.size(); ++i)
+    {
+        if (seqs[i]) free(seqs[i]);
+    }
+    kh_destroy(allele_id, h);
+}
+
+/**
+ * Returns the id of a sequence of length len and adds a reference to it.
+ */
+uint32_t PileupAlleleTable::acquire(const char* seq, uint32_t len)
+{
+    allele_key_t key = {seq, len};
+    khiter_t k = kh_get(allele_id, h, key);
+    if (k!=kh_end(h))
+    {
+        uint32_t id = kh_val(h, k);
+        ++refs[id];
+        return id;
+    }
+
+    uint32_t id;
+    if (free_ids.size())
+    {
+        id = free_ids.back();
+        free_ids.pop_back();
+    }
+    else
+    {
+        id = seqs.size();
+        seqs.push_back(NULL);
+        lens.push_back(0);
+        refs.push_back(0);
+    }
+
+    int32_t ret;
+    seqs[id] = (char*) malloc(len+1);
+    memcpy(seqs[id], seq, len);
+    seqs[id][len] = 0;
+    lens[id] = len;
+    refs[id] = 1;
+    key.s = seqs[id];
+    k = kh_put(allele_id, h, key, &ret);
+    kh_val(h, k) = id;
+
+    return id;
+}
+
+/**
+ * Removes a reference to an id.
+ */
+void PileupAlleleTable::release(uint32_t id)
+{
+    if (--refs[id]==0)
+    {
+        allele_key_t key = {seqs[id], lens[id]};
+        khiter_t k = kh_get(allele_id, h, key);
+        kh_del(allele_id, h, k);
+        free(seqs[id]);
+        seqs[id] = NULL;
+        free_ids.push_back(id);
+    }
+}
+
+/**
+ * Gets the sequence of an id.
+ */
+const char* PileupAlleleTable::get(uint32_t id)
+{
+    return seqs[id];
+}
+
 /**
  * Clears the soft clipped information.
  */
 void SoftClipInfo::clear()
 {
+    id = 0;
     no = 0;
     mean_quals.clear();
     strands.clear();
@@ -38,6 +307,7 @@ void SoftClipInfo::clear()
  */
 PileupPosition::PileupPosition()
 {
+    alleles = NULL;
     clear();
 };
 
@@ -52,6 +322,10 @@ void PileupPosition::clear()
     X[4] = 0;
     X[8] = 0;
     X[15] = 0;
+    for (size_t i=0; i<D.size(); ++i) alleles->release(D[i].id);
+    for (size_t i=0; i<I.size(); ++i) alleles->release(I[i].id);
+    for (size_t i=0; i<J.size(); ++i) alleles->release(J[i].id);
+    for (size_t i=0; i<K.size(); ++i) alleles->release(K[i].id);
     D.clear();
     I.clear();
     J.clear();
@@ -63,6 +337,54 @@ void PileupPosition::clear()
     ALT_Q.clear();
 };
 
+/**
+ * Counts an occurence of an indel sequence in D or I.
+ */
+void PileupPosition::add_indel(std::vector<PileupAllele>& A, const char* seq, uint32_t len)
+{
+    uint32_t id = alleles->acquire(seq, len);
+
+    size_t i = 0;
+    while (i<A.size() && strcmp(alleles->get(A[i].id), alleles->get(id))<0) ++i;
+
+    if (i<A.size() && A[i].id==id)
+    {
+        ++A[i].count;
+        alleles->release(id);
+    }
+    else
+    {
+        PileupAllele a = {id, 1};
+        A.insert(A.begin()+i, a);
+    }
+}
+
+/**
+ * Counts an occurence of a soft clipped sequence in J or K.
+ */
+void PileupPosition::add_sclip(std::vector<SoftClipInfo>& S, const char* seq, uint32_t len, float mean_qual, char strand)
+{
+    uint32_t id = alleles->acquire(seq, len);
+
+    size_t i = 0;
+    while (i<S.size() && strcmp(alleles->get(S[i].id), alleles->get(id))<0) ++i;
+
+    if (i<S.size() && S[i].id==id)
+    {
+        alleles->release(id);
+    }
+    else
+    {
+        S.insert(S.begin()+i, SoftClipInfo());
+        S[i].id = id;
+    }
+
+    SoftClipInfo& info = S[i];
+    ++info.no;
+    info.mean_quals.push_back(mean_qual);
+    info.strands.push_back(strand);
+}
+
 /**
  * Returns true if pileup record is cleared.
  */
@@ -81,8 +403,8 @@ bool PileupPosition::is_cleared()
     N == 0 &&
     F == 0 &&
     E == 0 &&
-    REF_Q.empty()&&
-    ALT_Q.empty());
+    REF_Q.n==0 &&
+    ALT_Q.n==0);
 };
 
 /**
@@ -121,9 +443,9 @@ void PileupPosition::print()
     if (D.size()!=0)
     {
         std::cerr << "\tDEL: ";
-        for (std::map<std::string, uint32_t>::iterator i = D.begin(); i!=D.end(); ++i)
+        for (size_t i=0; i<D.size(); ++i)
         {
-            std::cerr << i->first << " (" << i->second << ")";
+            std::cerr << alleles->get(D[i].id) << " (" << D[i].count << ")";
         }
         std::cerr << "\n";
     }
@@ -131,9 +453,9 @@ void PileupPosition::print()
     if (I.size()!=0)
     {
         std::cerr << "\tINS: ";
-        for (std::map<std::string, uint32_t>::iterator i = I.begin(); i!=I.end(); ++i)
+        for (size_t i=0; i<I.size(); ++i)
         {
-            std::cerr << i->first << " (" << i->second << ")";
+            std::cerr << alleles->get(I[i].id) << " (" << I[i].count << ")";
         }
 
         std::cerr << "\n";
@@ -142,9 +464,9 @@ void PileupPosition::print()
     if (J.size()!=0)
     {
         std::cerr << "\tRSCLIP: ";
-        for (std::map<std::string, SoftClipInfo>::iterator i = J.begin(); i!=J.end(); ++i)
+        for (size_t i=0; i<J.size(); ++i)
         {
-            std::cerr << i->first << " (" << i->second.no << ")";
+            std::cerr << alleles->get(J[i].id) << " (" << J[i].no << ")";
         }
 
         std::cerr << "\n";
@@ -153,9 +475,9 @@ void PileupPosition::print()
     if (K.size()!=0)
     {
         std::cerr << "\tLSCLIP: ";
-        for (std::map<std::string, SoftClipInfo>::iterator i = K.begin(); i!=K.end(); ++i)
+        for (size_t i=0; i<K.size(); ++i)
         {
-            std::cerr << i->first << " (" << i->second.no << ")";
+            std::cerr << alleles->get(K[i].id) << " (" << K[i].no << ")";
         }
 
         std::cerr << "\n";
@@ -185,12 +507,27 @@ Pileup::Pileup(uint32_t k, uint32_t window_size)
     this->window_size = window_size;
 
     P.resize(buffer_size);
+    for (uint32_t i=0; i<buffer_size; ++i)
+    {
+        P[i].alleles = &alleles;
+    }
 
     tid = -1;
     beg0 = end0 = 0;
     gbeg1 = 0;
 
     debug = 0;
+    ref_index = NULL;
+
+    unpack_bases = select_unpack_bases();
+};
+
+/**
+ * Destructor.
+ */
+Pileup::~Pileup()
+{
+    if (ref_index) delete ref_index;
 };
 
 /**
@@ -232,8 +569,8 @@ void Pileup::set_reference(std::string& ref_fasta_file)
 {
     if (ref_fasta_file!="")
     {
-        fai = fai_load(ref_fasta_file.c_str());
-        if (fai==NULL)
+        ref_index = ReferenceIndex::load(ref_fasta_file);
+        if (ref_index==NULL)
         {
             fprintf(stderr, "[%s:%d %s] cannot load genome index: %s\n", __FILE__, __LINE__, __FUNCTION__, ref_fasta_file.c_str());
             exit(1);
@@ -435,6 +772,28 @@ void Pileup::update_read_end(uint32_t gpos1)
     }
 }
 
+/**
+ * Counts an aligned base with quality q, base is 0 if it fails the quality cutoff.
+ */
+inline void Pileup::add_base(PileupPosition& p, char base, uint8_t q)
+{
+    ++p.N;
+
+    if (!base)
+    {
+        ++p.F;
+    }
+    else if (base!=p.R)
+    {
+        ++p.X[base2index(base)];
+        p.ALT_Q.add(q);
+    }
+    else
+    {
+        p.REF_Q.add(q);
+    }
+}
+
 /**
  * Inserts a stretch of aligned bases identified by M in the cigar string.
  */
@@ -454,30 +813,13 @@ void Pileup::add_M(uint32_t mgpos1, uint32_t spos0, uint32_t len, uint8_t* seq,
 //    std::cerr << " mgend1: " << mgend1 << "\n";
 //    std::cerr << "      i: " << i << "\n";
 
+    if (bases.size()<len) bases.resize(len);
+    unpack_bases(seq, spos0, len, qual, snp_baseq_cutoff, bases.data());
+
     //existing reference
     for (uint32_t k=mgpos1; k<=std::min(mgend1,gend1); ++k)
     {
-        ++P[i].N;
-
-        uint8_t q = qual[spos0+j];
-        if (q>=snp_baseq_cutoff)
-        {
-            char alt = (bam_base2char(bam_seqi(seq, spos0+j)));
-
-            if (alt!=P[i].R)
-            {
-                ++P[i].X[base2index(alt)];
-                P[i].ALT_Q.push_back(q);
-            }
-            else
-            {
-                P[i].REF_Q.push_back(q);
-            }
-        }
-        else
-        {
-            ++P[i].F;
-        }
+        add_base(P[i], bases[j], qual[spos0+j]);
 
         i = inc(i);
         ++j;
@@ -493,27 +835,7 @@ void Pileup::add_M(uint32_t mgpos1, uint32_t spos0, uint32_t len, uint8_t* seq,
         for (uint32_t k=mgpos1+j; k<=mgend1; ++k)
         {
             P[i].R = ref[l];
-            ++P[i].N;
-
-            uint8_t q = qual[spos0+j];
-            if (q>=snp_baseq_cutoff)
-            {
-                char alt = (bam_base2char(bam_seqi(seq, spos0+j)));
-
-                if (alt!=P[i].R)
-                {
-                    ++P[i].X[base2index(alt)];
-                    P[i].ALT_Q.push_back(q);
-                }
-                else
-                {
-                    P[i].REF_Q.push_back(q);
-                }
-            }
-            else
-            {
-                ++P[i].F;
-            }
+            add_base(P[i], bases[j], qual[spos0+j]);
 
             inc_end0();
             i = inc(i);
@@ -541,16 +863,14 @@ void Pileup::add_D(uint32_t gpos1, uint32_t len)
         abort();
     }
 
-    char* ref = get_sequence(chrom, gpos1+1, len);
-    std::string del(ref);
-    free(ref);
+    char* del = get_sequence(chrom, gpos1+1, len);
 
     uint32_t i = g2i(gpos1);
-    if (!is_normalized(P[i].R, del))
+    if (!is_normalized(P[i].R, del, len))
     {
         uint32_t a_gpos1 = gpos1;
         std::string a_ref(1, P[i].R);
-        a_ref.append(del);
+        a_ref.append(del, len);
         std::string a_alt(1, P[i].R);
         normalize(chrom, a_gpos1, a_ref, a_alt);
 
@@ -562,20 +882,21 @@ void Pileup::add_D(uint32_t gpos1, uint32_t len)
 
         if (debug>=2)  std::cerr << "\t\t\tdeletion left aligned : " << chrom << ":" << gpos1 << ":" << P[i].R << del << "/" << P[i].R  << " => " << chrom << ":" << a_gpos1 << ":" << a_ref << "/" << a_alt << "\n";
         uint32_t j = g2i(a_gpos1);
-        ++P[j].D[a_ref.substr(1)];
+        P[j].add_indel(P[j].D, a_ref.c_str()+1, a_ref.size()-1);
     }
     else
     {
-        ++P[i].D[del];
+        P[i].add_indel(P[i].D, del, len);
     }
 
     i = g2i(gpos1+1);
-    for (uint32_t j = 0; j<del.size(); ++j)
+    for (uint32_t j = 0; j<len; ++j)
     {
         P[i].R = del[j];
         if (i==end0) inc_end0();
         i = inc(i);
     }
+    free(del);
 }
 
 /**
@@ -604,7 +925,7 @@ void Pileup::add_I(uint32_t gpos1, std::string& ins, uint32_t rpos1)
 
         if (debug>=2)  std::cerr << "\t\t\tinsertion left aligned : " << chrom << ":" << gpos1 << ":" << P[i].R << "/" << P[i].R << ins << " => " << chrom << ":" << a_gpos1 << ":" << a_ref << "/" << a_alt << "\n";
         uint32_t j = g2i(a_gpos1);
-        ++P[j].I[a_alt.substr(1)];
+        P[j].add_indel(P[j].I, a_alt.c_str()+1, a_alt.size()-1);
 
         //for insertions shifted beyond the edge of a read alignment
         if (a_gpos1 < rpos1)
@@ -614,7 +935,7 @@ void Pileup::add_I(uint32_t gpos1, std::string& ins, uint32_t rpos1)
     }
     else
     {
-        ++P[i].I[ins];
+        P[i].add_indel(P[i].I, ins.c_str(), ins.size());
     }
 }
 
@@ -626,10 +947,7 @@ void Pileup::add_LSC(uint32_t gpos1, std::string& alt, float mean_qual, char str
     add_3prime_padding(gpos1);
 
     uint32_t i = g2i(gpos1);
-    SoftClipInfo& info = P[i].J[alt];
-    ++info.no;
-    info.mean_quals.push_back(mean_qual);
-    info.strands.push_back(strand);
+    P[i].add_sclip(P[i].J, alt.c_str(), alt.size(), mean_qual, strand);
     if (i==end0)
     {
         P[i].R = get_base(chrom, gpos1);
@@ -646,10 +964,7 @@ void Pileup::add_RSC(uint32_t gpos1, std::string& alt, float mean_qual, char str
     //add_3prime_padding(gpos1);
 
     uint32_t i = g2i(gpos1);
-    SoftClipInfo& info = P[i].K[alt];
-    ++info.no;
-    info.mean_quals.push_back(mean_qual);
-    info.strands.push_back(strand);
+    P[i].add_sclip(P[i].K, alt.c_str(), alt.size(), mean_qual, strand);
     if (i==end0) inc_end0();
 }
 
@@ -755,11 +1070,11 @@ void Pileup::add_snp(uint32_t gpos1, char ref, char alt, uint8_t qual, uint32_t
         if (alt!=P[i].R)
         {
             ++P[i].X[base2index(alt)];
-            P[i].ALT_Q.push_back(qual);
+            P[i].ALT_Q.add(qual);
         }
         else
         {
-            P[i].REF_Q.push_back(qual);
+            P[i].REF_Q.add(qual);
         }
     }
     else
@@ -797,11 +1112,11 @@ void Pileup::add_del(uint32_t gpos1, std::string& del)
 
         if (debug>=2)  std::cerr << "\t\t\tdeletion left aligned : " << chrom << ":" << gpos1 << ":" << P[i].R << del << "/" << P[i].R << " => " << chrom << ":" << a_gpos1 << ":" << a_ref << "/" << a_alt << "\n";
         uint32_t j = g2i(a_gpos1);
-        ++P[j].D[a_ref.substr(1)];
+        P[j].add_indel(P[j].D, a_ref.c_str()+1, a_ref.size()-1);
     }
     else
     {
-        ++P[i].D[del];
+        P[i].add_indel(P[i].D, del.c_str(), del.size());
     }
 
     //fill up for reference too.
@@ -841,7 +1156,7 @@ void Pileup::add_ins(uint32_t gpos1, std::string& ins, uint32_t rpos1)
 
         if (debug>=2) std::cerr << "\t\t\tinsertion left aligned : " << chrom << ":" << gpos1 << ":" << P[i].R << "/" << P[i].R << ins << " => " << chrom << ":" << a_gpos1 << ":" << a_ref << "/" << a_alt << "\n";
         uint32_t j = g2i(a_gpos1);
-        ++P[j].I[a_alt.substr(1)];
+        P[j].add_indel(P[j].I, a_alt.c_str()+1, a_alt.size()-1);
 
         //for insertions shifted beyond the edge of a read alignment
         if (a_gpos1 < rpos1)
@@ -851,7 +1166,7 @@ void Pileup::add_ins(uint32_t gpos1, std::string& ins, uint32_t rpos1)
     }
     else
     {
-        ++P[i].I[ins];
+        P[i].add_indel(P[i].I, ins.c_str(), ins.size());
     }
 }
 
@@ -863,10 +1178,7 @@ void Pileup::add_lsclip(uint32_t gpos1, std::string& alt, float mean_qual, char
     add_3prime_padding(gpos1);
 
     uint32_t i = g2i(gpos1);
-    SoftClipInfo& info = P[i].J[alt];
-    ++info.no;
-    info.mean_quals.push_back(mean_qual);
-    info.strands.push_back(strand);
+    P[i].add_sclip(P[i].J, alt.c_str(), alt.size(), mean_qual, strand);
     if (i==end0) inc_end0();
 }
 
@@ -878,10 +1190,7 @@ void Pileup::add_rsclip(uint32_t gpos1, std::string& alt, float mean_qual, char
     //add_3prime_padding(gpos1);
 
     uint32_t i = g2i(gpos1);
-    SoftClipInfo& info = P[i].K[alt];
-    ++info.no;
-    info.mean_quals.push_back(mean_qual);
-    info.strands.push_back(strand);
+    P[i].add_sclip(P[i].K, alt.c_str(), alt.size(), mean_qual, strand);
 }
 
 /**
@@ -892,6 +1201,14 @@ bool Pileup::is_normalized(char ref, std::string& indel)
     return ref != indel.at(indel.size()-1);
 }
 
+/**
+ * Checks if an indel of length len is normalized.
+ */
+bool Pileup::is_normalized(char ref, const char* indel, uint32_t len)
+{
+    return ref != indel[len-1];
+}
+
 /**
  * Normalize a biallelic variant.
  *
@@ -940,7 +1257,7 @@ uint32_t Pileup::base2index(char base)
 char Pileup::get_base(std::string& chrom, uint32_t& pos1)
 {
     int ref_len = 0;
-    char *refseq = faidx_fetch_uc_seq(fai, chrom.c_str(), pos1-1, pos1-1, &ref_len);
+    char *refseq = ref_index->fetch_uc_seq(chrom.c_str(), pos1-1, pos1-1, &ref_len);
     if (!refseq)
     {
         fprintf(stderr, "[%s:%d %s] failure to extrac base from fasta file: %s:%d: >\n", __FILE__, __LINE__, __FUNCTION__, chrom.c_str(), pos1-1);
@@ -958,7 +1275,7 @@ char Pileup::get_base(std::string& chrom, uint32_t& pos1)
 char* Pileup::get_sequence(std::string& chrom, uint32_t pos1, uint32_t len)
 {
     int ref_len = 0;
-    char* seq = faidx_fetch_uc_seq(fai, chrom.c_str(), pos1-1, pos1+len-2, &ref_len);
+    char* seq = ref_index->fetch_uc_seq(chrom.c_str(), pos1-1, pos1+len-2, &ref_len);
     if (!seq || ref_len!=len)
     {
         fprintf(stderr, "[%s:%d %s] failure to extract sequence from fasta file: %s:%d: >\n", __FILE__, __LINE__, __FUNCTION__, chrom.c_str(), pos1-1);
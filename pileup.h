@@ -26,14 +26,136 @@
 
 #include "utils.h"
 #include "hts_utils.h"
+#include "packed_reference.h"
 #include "variant.h"
 
+#define PILEUP_MAX_BASEQ 93
+
+/**
+ * Unpacks a stretch of 4 bit encoded bases of a read to characters,
+ * bases with quality below the cutoff are set to 0.
+ */
+typedef void (*unpack_bases_t)(uint8_t* seq, uint32_t spos0, uint32_t len, uint8_t* qual, uint32_t baseq_cutoff, char* bases);
+
+/**
+ * Key of an interned sequence, the sequence need not be null terminated.
+ */
+typedef struct
+{
+    const char* s;
+    uint32_t l;
+} allele_key_t;
+
+static inline khint_t allele_key_hash(allele_key_t key)
+{
+    khint_t h = 0;
+    for (uint32_t i=0; i<key.l; ++i) h = (h << 5) - h + (khint_t)key.s[i];
+    return h;
+}
+
+#define allele_key_equal(a, b) ((a).l==(b).l && memcmp((a).s, (b).s, (a).l)==0)
+
+KHASH_INIT(allele_id, allele_key_t, uint32_t, 1, allele_key_hash, allele_key_equal)
+
+/**
+ * Interned indel and soft clipped sequences of a pileup.
+ *
+ * Each distinct sequence is stored once and identified by a small id,
+ * an id is reused once no pileup position refers to its sequence.
+ */
+class PileupAlleleTable
+{
+    public:
+    khash_t(allele_id) *h;
+    //sequence of each id, owned by the hash
+    std::vector<char*> seqs;
+    std::vector<uint32_t> lens;
+    //number of pileup positions referring to each id
+    std::vector<uint32_t> refs;
+    std::vector<uint32_t> free_ids;
+
+    /**
+     * Constructor.
+     */
+    PileupAlleleTable();
+
+    /**
+     * Destructor.
+     */
+    ~PileupAlleleTable();
+
+    /**
+     * Returns the id of a sequence of length len and adds a reference to it.
+     */
+    uint32_t acquire(const char* seq, uint32_t len);
+
+    /**
+     * Removes a reference to an id.
+     */
+    void release(uint32_t id);
+
+    /**
+     * Gets the sequence of an id.
+     */
+    const char* get(uint32_t id);
+};
+
+/**
+ * Count of an interned indel sequence.
+ */
+class PileupAllele
+{
+    public:
+    uint32_t id;
+    uint32_t count;
+};
+
+/**
+ * Histogram of base qualities, qualities above PILEUP_MAX_BASEQ are
+ * counted as PILEUP_MAX_BASEQ.
+ */
+class BaseQualityHistogram
+{
+    public:
+    //total number of bases
+    uint32_t n;
+    uint32_t counts[PILEUP_MAX_BASEQ+1];
+
+    /**
+     * Constructor.
+     */
+    BaseQualityHistogram() { n = 0; memset(counts, 0, sizeof(counts));};
+
+    /**
+     * Adds a base quality.
+     */
+    void add(uint8_t q)
+    {
+        ++counts[q<PILEUP_MAX_BASEQ ? q : PILEUP_MAX_BASEQ];
+        ++n;
+    };
+
+    /**
+     * Clears the histogram.
+     */
+    void clear()
+    {
+        if (n)
+        {
+            n = 0;
+            memset(counts, 0, sizeof(counts));
+        }
+    };
+};
+
 /**
  * Contains sufficient statistic for a position in the pileup.
  */
 class SoftClipInfo
 {
     public:
+    //id of the soft clipped sequence
+    uint32_t id;
     uint32_t no;
     std::vector<float> mean_quals;
     std::vector<char> strands;
@@ -51,19 +173,24 @@ class SoftClipInfo
 
 /**
  * Contains sufficient statistic for a position in the pileup.
+ *
+ * Indel and soft clipped sequences are kept in order of sequence as ids
+ * in the allele table of the pileup.
  */
 class PileupPosition
 {
     public:
+    //allele table of the pileup
+    PileupAlleleTable *alleles;
     //reference base
     char R;
     //alternative bases
     uint32_t X[16];
     //for deletions and insertions with anchor R
-    std::map<std::string, uint32_t> D;
-    std::map<std::string, uint32_t> I;
-    std::map<std::string, SoftClipInfo> J;
-    std::map<std::string, SoftClipInfo> K;
+    std::vector<PileupAllele> D;
+    std::vector<PileupAllele> I;
+    std::vector<SoftClipInfo> J;
+    std::vector<SoftClipInfo> K;
     //occurence of all observations for internal bases
     uint32_t N;
     //number of bases that fail quality cutoff
@@ -75,9 +202,9 @@ class PileupPosition
     //that indel is will be underestimated.
     uint32_t E;
     //base qualities for reference allele
-    std::vector<uint32_t> REF_Q;
+    BaseQualityHistogram REF_Q;
     //base qualities for alternative allele
-    std::vector<uint32_t> ALT_Q;
+    BaseQualityHistogram ALT_Q;
 
     //to count evidences
     //SNPs - X[A] / (N+E)
@@ -94,6 +221,16 @@ class PileupPosition
      */
     void clear();
 
+    /**
+     * Counts an occurence of an indel sequence in D or I.
+     */
+    void add_indel(std::vector<PileupAllele>& A, const char* seq, uint32_t len);
+
+    /**
+     * Counts an occurence of a soft clipped sequence in J or K.
+     */
+    void add_sclip(std::vector<SoftClipInfo>& S, const char* seq, uint32_t len, float mean_qual, char strand);
+
     /**
      * Returns true if pileup record is cleared.
      */
@@ -130,6 +267,7 @@ class Pileup
     uint32_t buffer_size_mask;
     uint32_t window_size;
     std::vector<PileupPosition> P;
+    PileupAlleleTable alleles;
 
     int32_t tid;
     uint32_t beg0, end0; // index of P for the start and end position in 0 base coordinates
@@ -166,7 +304,11 @@ class Pileup
 
     int32_t debug;
 
-    faidx_t *fai;
+    ReferenceIndex *ref_index;
+
+    //bases of a stretch of aligned bases, selected for the CPU
+    unpack_bases_t unpack_bases;
+    std::vector<char> bases;
 
     public:
 
@@ -177,6 +319,26 @@ class Pileup
      */
     Pileup(uint32_t k=10, uint32_t window_size=256);
 
+    /**
+     * Destructor.
+     */
+    ~Pileup();
+
+    private:
+
+    /**
+     * Not copyable, every pileup position points to alleles.
+     */
+    Pileup(const Pileup& pileup);
+    Pileup& operator=(const Pileup& pileup);
+
+    public:
+
+    /**
+     * Checks the base unpacking selected for the CPU against the scalar loop.
+     */
+    static uint32_t check_unpack_bases();
+
     /**
      * Overloads subscript operator for accessing pileup positions.
      */
@@ -302,6 +464,11 @@ class Pileup
      */
     void add_M(uint32_t gpos1, uint32_t spos0, uint32_t len, uint8_t* seq, uint8_t* qual, uint32_t snp_baseq_cutoff);
 
+    /**
+     * Counts an aligned base with quality q, base is 0 if it fails the quality cutoff.
+     */
+    void add_base(PileupPosition& p, char base, uint8_t q);
+
     /**
      * Updates a stretch of deleted bases identified by D in the cigar string.
      */
@@ -378,6 +545,11 @@ class Pileup
      */
     bool is_normalized(char ref, std::string& indel);
 
+    /**
+     * Checks if a variant is normalized.
+     */
+    bool is_normalized(char ref, const char* indel, uint32_t len);
+
     /**
      * Normalize a biallelic variant.
      *
@@ -0,0 +1,305 @@
+/* The MIT License
+
+   Copyright (c) 2018 Adrian Tan <atks@umich.edu>
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "pipe.h"
+#include "view.h"
+#include "decompose.h"
+#include "decompose_blocksub.h"
+#include "normalize.h"
+#include "rminfo.h"
+#include "uniq.h"
+
+namespace
+{
+
+/**
+ * A stage in the pipe, runs a vt program with its own arguments.
+ */
+class PipeStage
+{
+    public:
+    std::vector<std::string> args;
+    pthread_t thread;
+
+    /**
+     * Runs the vt program of the stage.
+     */
+    static void* run(void *arg)
+    {
+        PipeStage *stage = (PipeStage*) arg;
+
+        std::vector<char*> argv;
+        for (uint32_t i=0; i<stage->args.size(); ++i)
+        {
+            argv.push_back(const_cast<char*>(stage->args[i].c_str()));
+        }
+        argv.push_back(NULL);
+
+        int argc = argv.size()-1;
+        std::string& cmd = stage->args[0];
+
+        if (cmd=="view")
+        {
+            view(argc, &argv[0]);
+        }
+        else if (cmd=="decompose")
+        {
+            decompose(argc, &argv[0]);
+        }
+        else if (cmd=="decompose_blocksub")
+        {
+            decompose_blocksub(argc, &argv[0]);
+        }
+        else if (cmd=="normalize")
+        {
+            normalize(argc, &argv[0]);
+        }
+        else if (cmd=="rminfo")
+        {
+            rminfo(argc, &argv[0]);
+        }
+        else if (cmd=="uniq")
+        {
+            uniq(argc, &argv[0]);
+        }
+
+        return NULL;
+    };
+};
+
+class Igor : Program
+{
+    public:
+
+    ///////////
+    //options//
+    ///////////
+    std::string input_vcf_file;
+    std::string output_vcf_file;
+    std::string interval_list;
+    std::string interval_string;
+    std::vector<std::string> stage_specs;
+
+    //////////
+    //stages//
+    //////////
+    std::vector<PipeStage*> stages;
+    std::vector<BCFPipe*> pipes;
+
+    Igor(int argc, char **argv)
+    {
+        version = "0.5";
+
+        //////////////////////////
+        //options initialization//
+        //////////////////////////
+        try
+        {
+            std::string desc = "Runs a series of vt programs in a single process.  Each program runs in its own thread\n"
+                 "              and records are passed between consecutive programs in memory without being formatted\n"
+                 "              or parsed.  A stage is a program name followed by its options, stages may also be given\n"
+                 "              as a comma separated list of program names.\n"
+                 "              Supported programs : view, decompose, decompose_blocksub, normalize, rminfo, uniq.\n"
+                 "              e.g. vt pipe in.vcf.gz -o out.vcf.gz \"decompose -s\" \"normalize -r hs37d5.fa\"\n"
+                 "                   vt pipe in.vcf.gz -o out.vcf.gz decompose_blocksub,decompose\n"
+                 "                   vt pipe in.vcf.gz -o out.vcf.gz \"decompose -s\" \"normalize -r hs37d5.fa\" uniq";
+
+            TCLAP::CmdLine cmd(desc, ' ', version);
+            VTOutput my;
+            cmd.setOutput(&my);
+            TCLAP::ValueArg<std::string> arg_intervals("i", "i", "intervals, passed to the first stage []", false, "", "str", cmd);
+            TCLAP::ValueArg<std::string> arg_interval_list("I", "I", "file containing list of intervals, passed to the first stage []", false, "", "file", cmd);
+            TCLAP::ValueArg<std::string> arg_output_vcf_file("o", "o", "output VCF file [-]", false, "-", "str", cmd);
+            TCLAP::UnlabeledValueArg<std::string> arg_input_vcf_file("<in.vcf>", "input VCF file", true, "", "file", cmd);
+            TCLAP::UnlabeledMultiArg<std::string> arg_stage_specs("<stage>", "program and options of a stage", true, "str", cmd);
+
+            cmd.parse(argc, argv);
+
+            input_vcf_file = arg_input_vcf_file.getValue();
+            output_vcf_file = arg_output_vcf_file.getValue();
+            interval_list = arg_interval_list.getValue();
+            interval_string = arg_intervals.getValue();
+            stage_specs = arg_stage_specs.getValue();
+        }
+        catch (TCLAP::ArgException &e)
+        {
+            std::cerr << "error: " << e.error() << " for arg " << e.argId() << "\n";
+            abort();
+        }
+    };
+
+    void initialize()
+    {
+        /////////////////////////
+        //stages initialization//
+        /////////////////////////
+        for (uint32_t i=0; i<stage_specs.size(); ++i)
+        {
+            std::vector<std::string> args;
+            split(args, " \t", stage_specs[i]);
+
+            if (args.size()==1 && args[0].find(',')!=std::string::npos)
+            {
+                std::vector<std::string> cmds;
+                split(cmds, ",", args[0]);
+                for (uint32_t j=0; j<cmds.size(); ++j)
+                {
+                    add_stage(std::vector<std::string>(1, cmds[j]));
+                }
+            }
+            else if (args.size())
+            {
+                add_stage(args);
+            }
+        }
+
+        if (stages.empty())
+        {
+            fprintf(stderr, "[%s:%d %s] No stages specified.\n", __FILE__, __LINE__, __FUNCTION__);
+            exit(1);
+        }
+
+        /////////////////////////////
+        //connect stages with pipes//
+        /////////////////////////////
+        for (uint32_t i=0; i<stages.size(); ++i)
+        {
+            std::vector<std::string>& args = stages[i]->args;
+
+            if (i==0)
+            {
+                if (interval_list!="")
+                {
+                    args.push_back("-I");
+                    args.push_back(interval_list);
+                }
+                if (interval_string!="")
+                {
+                    args.push_back("-i");
+                    args.push_back(interval_string);
+                }
+            }
+
+            args.push_back("-o");
+            if (i==stages.size()-1)
+            {
+                args.push_back(output_vcf_file);
+            }
+            else
+            {
+                kstring_t s = {0,0,0};
+                ksprintf(&s, "pipe:%d", i+1);
+                pipes.push_back(new BCFPipe(s.s));
+                args.push_back(s.s);
+                if (s.m) free(s.s);
+            }
+
+            args.push_back(i==0 ? input_vcf_file : pipes[i-1]->name);
+        }
+    }
+
+    void pipe()
+    {
+        for (uint32_t i=0; i<stages.size(); ++i)
+        {
+            if (pthread_create(&stages[i]->thread, NULL, PipeStage::run, stages[i]))
+            {
+                fprintf(stderr, "[%s:%d %s] Cannot create thread for stage %s.\n", __FILE__, __LINE__, __FUNCTION__, stages[i]->args[0].c_str());
+                exit(1);
+            }
+        }
+
+        for (uint32_t i=0; i<stages.size(); ++i)
+        {
+            pthread_join(stages[i]->thread, NULL);
+            delete stages[i];
+        }
+
+        for (uint32_t i=0; i<pipes.size(); ++i)
+        {
+            delete pipes[i];
+        }
+    };
+
+    void print_options()
+    {
+        std::clog << "pipe v" << version << "\n\n";
+
+        std::clog << "options:     input VCF file        " << input_vcf_file << "\n";
+        std::clog << "         [o] output VCF file       " << output_vcf_file << "\n";
+        print_str_op("         [I] interval list         ", interval_list);
+        print_str_op("         [i] intervals             ", interval_string);
+        for (uint32_t i=0; i<stages.size(); ++i)
+        {
+            std::clog << "             stage " << (i+1) << "               ";
+            for (uint32_t j=0; j<stages[i]->args.size(); ++j)
+            {
+                std::clog << (j ? " " : "") << stages[i]->args[j];
+            }
+            std::clog << "\n";
+        }
+        std::clog << "\n";
+    }
+
+    void print_stats()
+    {
+    };
+
+    ~Igor() {};
+
+    private:
+
+    /**
+     * Adds a stage, exits if the program is not supported.
+     */
+    void add_stage(std::vector<std::string> args)
+    {
+        std::string& cmd = args[0];
+        if (cmd!="view" &&
+            cmd!="decompose" &&
+            cmd!="decompose_blocksub" &&
+            cmd!="normalize" &&
+            cmd!="rminfo" &&
+            cmd!="uniq")
+        {
+            fprintf(stderr, "[%s:%d %s] Program not supported in pipe: %s\n", __FILE__, __LINE__, __FUNCTION__, cmd.c_str());
+            exit(1);
+        }
+
+        PipeStage *stage = new PipeStage();
+        stage->args = args;
+        stages.push_back(stage);
+    }
+};
+
+}
+
+bool pipe(int argc, char ** argv)
+{
+    Igor igor(argc, argv);
+    igor.initialize();
+    igor.print_options();
+    igor.pipe();
+    igor.print_stats();
+    return true;
+};
@@ -31,6 +31,10 @@ PERLregex::PERLregex()
    regex = "";
    re = NULL;
    match_data = NULL;
+   current = -1;
+   no_sets = 0;
+   match_context = NULL;
+   jit_stack = NULL;
 };
 
 /**
@@ -38,8 +42,12 @@ PERLregex::PERLregex()
  */
 PERLregex::~PERLregex()
 {
-    if (re) pcre2_code_free(re);
-    if (match_data) pcre2_match_data_free(match_data);
+    for (uint32_t i=0; i<cache.size(); ++i)
+    {
+        free_entry(cache[i]);
+    }
+    if (match_context) pcre2_match_context_free(match_context);
+    if (jit_stack) pcre2_jit_stack_free(jit_stack);
 };
 
 /**
@@ -55,29 +63,49 @@ void PERLregex::set(std::string& regex)
  */
 void PERLregex::set(char* regex)
 {
-    if (re) pcre2_code_free(re);
-    if (match_data) pcre2_match_data_free(match_data);
-
-    this->regex = regex;
-    pattern = (PCRE2_SPTR) regex;
+    ++no_sets;
 
-    re = pcre2_compile(
-                pattern,               /* the pattern */
-                PCRE2_ZERO_TERMINATED, /* indicates pattern is zero-terminated */
-                0,                     /* default options */
-                &errornumber,          /* for error number */
-                &erroroffset,          /* for error offset */
-                NULL);
+    //reuse a previously compiled expression
+    int32_t k = -1;
+    for (uint32_t i=0; i<cache.size(); ++i)
+    {
+        if (cache[i].regex==regex)
+        {
+            k = i;
+            break;
+        }
+    }
 
-    if (re == NULL)
+    if (k==-1)
     {
-        PCRE2_UCHAR buffer[256];
-        pcre2_get_error_message(errornumber, buffer, sizeof(buffer));
-        fprintf(stderr, "[E:%s] Regular expression compilation failed : %s at position %d\n", __FUNCTION__, buffer, (int32_t) erroroffset);
-        exit(1);
+        if (cache.size()<MAX_CACHE_SIZE)
+        {
+            cache.push_back(PERLregexEntry());
+            k = cache.size()-1;
+        }
+        else
+        {
+            k = 0;
+            for (uint32_t i=1; i<cache.size(); ++i)
+            {
+                if (cache[i].last_used<cache[k].last_used)
+                {
+                    k = i;
+                }
+            }
+            free_entry(cache[k]);
+        }
+
+        compile(cache[k], regex, true);
     }
 
-    match_data = pcre2_match_data_create_from_pattern(re, NULL);
+    cache[k].last_used = no_sets;
+    current = k;
+
+    this->regex = cache[k].regex;
+    pattern = (PCRE2_SPTR) this->regex.c_str();
+    re = cache[k].re;
+    match_data = cache[k].match_data;
 };
 
 /**
@@ -103,7 +131,69 @@ bool PERLregex::match(char* text)
                 0,                    /* start at offset 0 in the subject */
                 0,                    /* default options */
                 match_data,           /* block for storing the result */
-                NULL);                /* use default match context */
+                match_context);       /* JIT stack for the compiled pattern */
+
+    //the interpreter is not limited by the JIT stack
+    if (rc==PCRE2_ERROR_JIT_STACKLIMIT)
+    {
+        PERLregexEntry& entry = cache[current];
+        std::string regex = entry.regex;
+        free_entry(entry);
+        compile(entry, regex.c_str(), false);
+        re = entry.re;
+        match_data = entry.match_data;
+
+        return match(text);
+    }
 
     return rc>0;
-};
\ No newline at end of file
+};
+
+/**
+ * Compiles a regular expression into an entry, the JIT compiler is used if jit is true.
+ */
+void PERLregex::compile(PERLregexEntry& entry, const char* regex, bool jit)
+{
+    entry.regex = regex;
+
+    entry.re = pcre2_compile(
+                (PCRE2_SPTR) regex,    /* the pattern */
+                PCRE2_ZERO_TERMINATED, /* indicates pattern is zero-terminated */
+                0,                     /* default options */
+                &errornumber,          /* for error number */
+                &erroroffset,          /* for error offset */
+                NULL);
+
+    if (entry.re == NULL)
+    {
+        PCRE2_UCHAR buffer[256];
+        pcre2_get_error_message(errornumber, buffer, sizeof(buffer));
+        fprintf(stderr, "[E:%s] Regular expression compilation failed : %s at position %d\n", __FUNCTION__, buffer, (int32_t) erroroffset);
+        exit(1);
+    }
+
+    //pcre2_match uses the machine code when it is available and
+    //falls back to the interpreter when JIT is not supported
+    entry.jit = jit && pcre2_jit_compile(entry.re, PCRE2_JIT_COMPLETE)==0;
+
+    if (entry.jit && !match_context)
+    {
+        match_context = pcre2_match_context_create(NULL);
+        jit_stack = pcre2_jit_stack_create(32*1024, 1024*1024, NULL);
+        pcre2_jit_stack_assign(match_context, NULL, jit_stack);
+    }
+
+    entry.match_data = pcre2_match_data_create_from_pattern(entry.re, NULL);
+};
+
+/**
+ * Frees a compiled regular expression.
+ */
+void PERLregex::free_entry(PERLregexEntry& entry)
+{
+    if (entry.re) pcre2_code_free(entry.re);
+    if (entry.match_data) pcre2_match_data_free(entry.match_data);
+    entry.re = NULL;
+    entry.match_data = NULL;
+    entry.jit = false;
+};
@@ -28,6 +28,28 @@
 #include <cstdlib>
 #include <cstring>
 #include <string>
+#include <vector>
+
+/**
+ * A compiled regular expression.
+ */
+class PERLregexEntry
+{
+    public:
+    std::string regex;
+    pcre2_code *re;
+    pcre2_match_data *match_data;
+    bool jit;           //if the expression is compiled to machine code
+    uint64_t last_used; //for evicting the least recently used expression
+
+    PERLregexEntry()
+    {
+        re = NULL;
+        match_data = NULL;
+        jit = false;
+        last_used = 0;
+    };
+};
 
 /**
  * Class for PERL regular expressions.
@@ -44,6 +66,10 @@
  * //using C strings
  * pregex.set(regex.s);
  * bool b = pregex.match(target.s);
+ *
+ * Expressions are JIT compiled when supported, and matched with the
+ * interpreter otherwise.  The last few compiled expressions are kept so
+ * that alternating between expressions does not recompile them.
  */
 class PERLregex
 {
@@ -72,6 +98,16 @@ class PERLregex
     size_t subject_length;
     pcre2_match_data *match_data;
 
+    //compiled expressions, the current expression is cache[current]
+    std::vector<PERLregexEntry> cache;
+    int32_t current;
+    uint64_t no_sets;
+    static const uint32_t MAX_CACHE_SIZE = 8;
+
+    //shared by the JIT compiled expressions
+    pcre2_match_context *match_context;
+    pcre2_jit_stack *jit_stack;
+
     /**
      * Constructor.
      */
@@ -101,6 +137,18 @@ class PERLregex
      * Matches a text against a regular expression that has been compiled in set().
      */
     bool match(char* text);
+
+    private:
+
+    /**
+     * Compiles a regular expression into an entry, the JIT compiler is used if jit is true.
+     */
+    void compile(PERLregexEntry& entry, const char* regex, bool jit);
+
+    /**
+     * Frees a compiled regular expression.
+     */
+    void free_entry(PERLregexEntry& entry);
 };
 
 #endif
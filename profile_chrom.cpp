@@ -120,6 +120,9 @@ class Igor : Program
         filter.parse(fexp.c_str());
         filter_exists = fexp=="" ? false : true;
 
+        //only site information is used unless the filter needs more
+        odr->set_max_unpack(filter_exists ? std::max(BCF_UN_INFO, filter.get_unpack_level()) : BCF_UN_INFO);
+
         chrom = kh_init(32);
         pass_chrom = kh_init(32);
 
@@ -142,7 +145,7 @@ class Igor : Program
 
         while(odr->read(v))
         {
-            bcf_unpack(v, BCF_UN_ALL);
+            bcf_unpack(v, BCF_UN_INFO);
 
             if (bcf_get_n_allele(v)!=2)
             {
@@ -151,8 +154,7 @@ class Igor : Program
 
             if (filter_exists)
             {
-                int32_t vtype = vm->classify_variant(odr->hdr, v, variant);
-                if (!filter.apply(odr->hdr, v, &variant))
+                if (!filter.apply(odr->hdr, v, &variant, vm))
                 {
                     continue;
                 }
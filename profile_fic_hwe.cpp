@@ -126,6 +126,9 @@ class Igor : Program
         filter.parse(fexp.c_str());
         filter_exists = fexp=="" ? false : true;
 
+        //only site information is used unless the filter needs more
+        odr->set_max_unpack(filter_exists ? std::max(BCF_UN_INFO, filter.get_unpack_level()) : BCF_UN_INFO);
+
         afs = kh_init(32);
         pass_afs = kh_init(32);
 
@@ -149,7 +152,7 @@ class Igor : Program
 
         while(odr->read(v))
         {
-            bcf_unpack(v, BCF_UN_ALL);
+            bcf_unpack(v, BCF_UN_INFO);
 
             bcf_print(odr->hdr, v);
 
@@ -160,8 +163,7 @@ class Igor : Program
 
             if (filter_exists)
             {
-                int32_t vtype = vm->classify_variant(odr->hdr, v, variant);
-                if (!filter.apply(odr->hdr, v, &variant))
+                if (!filter.apply(odr->hdr, v, &variant, vm))
                 {
                     continue;
                 }
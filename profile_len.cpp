@@ -132,6 +132,9 @@ class Igor : Program
         filter.parse(fexp.c_str());
         filter_exists = fexp=="" ? false : true;
 
+        //only site information is used unless the filter needs more
+        odr->set_max_unpack(filter_exists ? std::max(BCF_UN_INFO, filter.get_unpack_level()) : BCF_UN_INFO);
+
         ////////////////////////
         //stats initialization//
         ////////////////////////
@@ -154,7 +157,7 @@ class Igor : Program
 
         while(odr->read(v))
         {
-            bcf_unpack(v, BCF_UN_ALL);
+            bcf_unpack(v, BCF_UN_INFO);
 
             //bcf_print_liten(odr->hdr, v);
 
@@ -103,6 +103,62 @@ void VTOutput::usage(TCLAP::CmdLineInterface& c)
     std::clog  <<  "\n";
 }
 
+/**
+ * Parse the global thread option -@/--threads.  This is processed once for all
+ * programs before the program specific arguments are parsed, the option is removed
+ * from the argument list and a htslib thread pool is set up that is shared by
+ * BCFOrderedReader, BCFOrderedWriter, BAMOrderedReader and TBXOrderedReader.
+ *
+ * @argc - number of arguments, updated when the thread option is removed
+ * @argv - arguments, the thread option is removed in place
+ */
+void Program::parse_threads(int& argc, char** argv)
+{
+    int32_t nthreads = 0;
+    int32_t j = 1;
+    for (int32_t i=1; i<argc; ++i)
+    {
+        std::string arg(argv[i]);
+        const char* value = NULL;
+
+        if (arg=="-@" || arg=="--threads")
+        {
+            if (i+1==argc)
+            {
+                fprintf(stderr, "[%s:%d %s] Number of threads not specified for %s\n", __FILE__, __LINE__, __FUNCTION__, arg.c_str());
+                exit(1);
+            }
+            value = argv[++i];
+        }
+        else if (arg.compare(0, 2, "-@")==0)
+        {
+            value = argv[i]+2;
+        }
+        else if (arg.compare(0, 10, "--threads=")==0)
+        {
+            value = argv[i]+10;
+        }
+        else
+        {
+            argv[j++] = argv[i];
+            continue;
+        }
+
+        char *end = NULL;
+        nthreads = strtol(value, &end, 10);
+        if (*value=='\0' || *end!='\0' || nthreads<0)
+        {
+            fprintf(stderr, "[%s:%d %s] Invalid number of threads: %s\n", __FILE__, __LINE__, __FUNCTION__, value);
+            exit(1);
+        }
+    }
+
+    argc = j;
+    argv[argc] = NULL;
+
+    hts_create_shared_thread_pool(nthreads);
+}
+
 /**
  * Parse multiple files from command line unlabeled arguments or -L denoted file list.  If both are defined, the files are merged.
  *
@@ -32,6 +32,7 @@
 #include "bcf_ordered_reader.h"
 #include "bcf_ordered_writer.h"
 #include "bcf_synced_reader.h"
+#include "region_sharder.h"
 #include "ordered_bcf_overlap_matcher.h"
 #include "ordered_region_overlap_matcher.h"
 #include "hts_utils.h"
@@ -67,6 +68,17 @@ class Program
      */
     Program(){};
 
+    /**
+     * Parse the global thread option -@/--threads.  This is processed once for all
+     * programs before the program specific arguments are parsed, the option is removed
+     * from the argument list and a htslib thread pool is set up that is shared by
+     * BCFOrderedReader, BCFOrderedWriter, BAMOrderedReader and TBXOrderedReader.
+     *
+     * @argc - number of arguments, updated when the thread option is removed
+     * @argv - arguments, the thread option is removed in place
+     */
+    static void parse_threads(int& argc, char** argv);
+
     /**
      * Parse multiple files from command line unlabeled arguments or -L denoted file list.  If both are defined, the files are merged.
      *
@@ -31,10 +31,12 @@
 ReferenceSequence::ReferenceSequence(std::string& ref_fasta_file, uint32_t k, uint32_t window_size)
 {
     this->ref_fasta_file = ref_fasta_file;
+    ref_index = NULL;
+    shared_ref_index = false;
     if (ref_fasta_file!="")
     {
-        fai = fai_load(ref_fasta_file.c_str());
-        if (fai==NULL)
+        ref_index = ReferenceIndex::load(ref_fasta_file);
+        if (ref_index==NULL)
         {
             fprintf(stderr, "[%s:%d %s] cannot load genome index: %s\n", __FILE__, __LINE__, __FUNCTION__, ref_fasta_file.c_str());
             exit(1);
@@ -52,15 +54,49 @@ ReferenceSequence::ReferenceSequence(std::string& ref_fasta_file, uint32_t k, ui
     beg0 = end0 = 0;
     gbeg1 = 0;
 
+    window_beg1 = 0;
+
+    debug = 0;
+};
+
+/**
+ * Constructor with an index that is loaded by the caller.
+ *
+ * @k - size of buffered sequence is 2^k.
+ */
+ReferenceSequence::ReferenceSequence(ReferenceIndex *ref_index, uint32_t k, uint32_t window_size)
+{
+    this->ref_index = ref_index;
+    shared_ref_index = true;
+
+    buffer_size = 1 << k;
+    buffer_size_mask = (0xFFFFFFFF >> (32-k));
+    this->window_size = window_size;
+
+    seq.resize(buffer_size);
+
+    beg0 = end0 = 0;
+    gbeg1 = 0;
+
+    window_beg1 = 0;
+
     debug = 0;
 };
 
+/**
+ * Destructor.
+ */
+ReferenceSequence::~ReferenceSequence()
+{
+    if (ref_index && !shared_ref_index) delete ref_index;
+};
+
 /**
  * Fetches the number of sequences.
  */
 int32_t ReferenceSequence::fetch_nseq()
 {
-    return faidx_nseq(fai);
+    return ref_index->nseq();
 }
 
 /**
@@ -69,7 +105,7 @@ int32_t ReferenceSequence::fetch_nseq()
 std::string ReferenceSequence::fetch_iseq_name(int32_t i)
 {
     std::string s;
-    s.assign(faidx_iseq(fai, i));
+    s.assign(ref_index->iseq(i));
 
     return s;
 }
@@ -79,25 +115,28 @@ std::string ReferenceSequence::fetch_iseq_name(int32_t i)
  */
 int32_t ReferenceSequence::fetch_seq_len(std::string& seq)
 {
-    return faidx_seq_len(fai, seq.c_str());
+    return ref_index->seq_len(seq.c_str());
 }
 
 /**
  * Get a base.
+ *
+ * Bases are read from a buffered window of window_size bases on
+ * either side of the first base fetched, bases to the left of the
+ * window double the window so that walking leftwards base by base
+ * reads the reference a logarithmic number of times.
  */
 char ReferenceSequence::fetch_base(const char* chrom, int32_t pos1)
 {
-    int ref_len = 0;
-    char *refseq = faidx_fetch_uc_seq(fai, chrom, pos1-1, pos1-1, &ref_len);
-    if (!refseq)
+    //as in faidx, positions outside the sequence are clamped to its ends
+    pos1 = std::max(pos1, 1);
+
+    if (pos1<window_beg1 || pos1>=window_beg1+(int32_t)window_seq.size() || window_chrom!=chrom)
     {
-        fprintf(stderr, "[%s:%d %s] failure to extrac base from fasta file: %s:%d: >\n", __FILE__, __LINE__, __FUNCTION__, chrom, pos1-1);
-        exit(1);
+        pos1 = fetch_window(chrom, pos1);
     }
-    char base = refseq[0];
-    free(refseq);
 
-    return base;
+    return window_seq[pos1-window_beg1];
 }
 
 /**
@@ -105,24 +144,57 @@ char ReferenceSequence::fetch_base(const char* chrom, int32_t pos1)
  */
 char ReferenceSequence::fetch_base(std::string& chrom, int32_t pos1)
 {
-    int ref_len = 0;
-    char *refseq = faidx_fetch_uc_seq(fai, chrom.c_str(), pos1-1, pos1-1, &ref_len);
-    if (!refseq)
+    return fetch_base(chrom.c_str(), pos1);
+}
+
+/**
+ * Fills the window with a sequence that contains chrom:pos1.
+ * Returns pos1 clamped to the length of the sequence.
+ */
+int32_t ReferenceSequence::fetch_window(const char* chrom, int32_t pos1)
+{
+    int32_t window_len = window_seq.size();
+    int32_t ref_len = 0;
+
+    //extends the window backwards by at least its current length
+    if (window_len && window_chrom==chrom && pos1<window_beg1 && pos1>=window_beg1-window_len)
     {
-        fprintf(stderr, "[%s:%d %s] failure to extrac base from fasta file: %s:%d: >\n", __FILE__, __LINE__, __FUNCTION__, chrom.c_str(), pos1-1);
-        exit(1);
+        int32_t beg1 = std::max(1, window_beg1-window_len);
+        char *refseq = ref_index->fetch_uc_seq(chrom, beg1-1, window_beg1-2, &ref_len);
+        if (refseq && ref_len==window_beg1-beg1)
+        {
+            window_seq.insert(0, refseq, ref_len);
+            window_beg1 = beg1;
+            free(refseq);
+            return pos1;
+        }
+        if (refseq) free(refseq);
     }
-    char base = refseq[0];
-    free(refseq);
+    else
+    {
+        int32_t seq_len = ref_index->seq_len(chrom);
+        if (seq_len>0)
+        {
+            pos1 = std::min(pos1, seq_len);
+        }
 
-    return base;
+        int32_t beg1 = std::max(1, pos1-(int32_t)window_size);
+        int32_t end1 = pos1+window_size;
+        char *refseq = ref_index->fetch_uc_seq(chrom, beg1-1, end1-1, &ref_len);
+        if (refseq && ref_len>pos1-beg1)
+        {
+            window_chrom.assign(chrom);
+            window_seq.assign(refseq, ref_len);
+            window_beg1 = beg1;
+            free(refseq);
+            return pos1;
+        }
+        if (refseq) free(refseq);
+    }
 
-//todo: add buffer - use as an option switch.
-//    //check buffer and retrieve base if it is in it.
-//    if (this->chrom == chrom && pos1>=gbeg1 && pos1<=gbeg1+(end0-beg0))
-//    {
-//
-//    }
+    fprintf(stderr, "[%s:%d %s] failure to extract base from fasta file: %s:%d\n", __FILE__, __LINE__, __FUNCTION__, chrom, pos1-1);
+    fprintf(stderr, "FAQ: http://genome.sph.umich.edu/wiki/Vt#1._vt_cannot_retrieve_sequences_from_my_reference_sequence_file\n");
+    exit(1);
 }
 
 /**
@@ -167,7 +239,7 @@ char* ReferenceSequence::fetch_seq(const char* chrom, int32_t beg1, int32_t end1
 {
     char* seq = NULL;
     int32_t len = 0;
-    seq = faidx_fetch_uc_seq(fai, const_cast<char*>(chrom), beg1-1, end1-1, &len);
+    seq = ref_index->fetch_uc_seq(chrom, beg1-1, end1-1, &len);
 
     if (len==-1)
     {
@@ -238,8 +310,10 @@ void ReferenceSequence::set_reference(std::string& ref_fasta_file)
     this->ref_fasta_file = ref_fasta_file;
     if (ref_fasta_file!="")
     {
-        fai = fai_load(ref_fasta_file.c_str());
-        if (fai==NULL)
+        if (ref_index && !shared_ref_index) delete ref_index;
+        ref_index = ReferenceIndex::load(ref_fasta_file);
+        shared_ref_index = false;
+        if (ref_index==NULL)
         {
             fprintf(stderr, "[%s:%d %s] cannot load genome index: %s\n", __FILE__, __LINE__, __FUNCTION__, ref_fasta_file.c_str());
             exit(1);
@@ -26,9 +26,10 @@
 
 #include "utils.h"
 #include "hts_utils.h"
+#include "packed_reference.h"
 
 /**
- * A Reference Sequence object wrapping htslib's faidx.
+ * A Reference Sequence object wrapping a packed reference or htslib's faidx.
  * This allows for buffered reading of seqeunces.
  */
 class ReferenceSequence
@@ -37,7 +38,8 @@ class ReferenceSequence
 
     //reference file and index
     std::string ref_fasta_file;
-    faidx_t *fai;
+    ReferenceIndex *ref_index;
+    bool shared_ref_index;
 
     uint32_t buffer_size;
     uint32_t buffer_size_mask;
@@ -73,6 +75,12 @@ class ReferenceSequence
     //
     //  invariance:  buffered sequence is always continuous
 
+    //contiguous window of sequence for fetch_base, this is extended
+    //backwards geometrically when bases to its left are fetched.
+    std::string window_chrom;
+    int32_t window_beg1;
+    std::string window_seq;
+
     int32_t debug;
 
     public:
@@ -84,6 +92,18 @@ class ReferenceSequence
      */
     ReferenceSequence(std::string& ref_fasta_file, uint32_t k=10, uint32_t window_size=256);
 
+    /**
+     * Constructor with an index that is loaded by the caller.
+     *
+     * @k - size of buffered sequence is 2^k.
+     */
+    ReferenceSequence(ReferenceIndex *ref_index, uint32_t k=10, uint32_t window_size=256);
+
+    /**
+     * Destructor.
+     */
+    ~ReferenceSequence();
+
     /**
      * Fetches the number of sequences.
      */
@@ -101,6 +121,11 @@ class ReferenceSequence
 
     /**
      * Get a base.
+     *
+     * Bases are read from a buffered window of window_size bases on
+     * either side of the first base fetched, bases to the left of the
+     * window double the window so that walking leftwards base by base
+     * reads the reference a logarithmic number of times.
      */
     char fetch_base(const char* chrom, int32_t pos1);
 
@@ -143,6 +168,12 @@ class ReferenceSequence
 
     private:
 
+    /**
+     * Fills the window with a sequence that contains chrom:pos1.
+     * Returns pos1 clamped to the length of the sequence.
+     */
+    int32_t fetch_window(const char* chrom, int32_t pos1);
+
     /**
      * Overloads subscript operator for accessing buffered sequence positions.
      */
@@ -0,0 +1,342 @@
+/* The MIT License
+
+   Copyright (c) 2018 Adrian Tan <atks@umich.edu>
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+#include "region_sharder.h"
+
+/**
+ * Constructs shards for an indexed file.
+ *
+ * @odr        - reader of the input file, the index is used to find contigs with records
+ * @intervals  - intervals to be processed, if empty, all records are processed
+ * @nthreads   - number of worker threads
+ */
+RegionSharder::RegionSharder(BCFOrderedReader *odr, std::vector<GenomeInterval>& intervals, int32_t nthreads)
+{
+    this->nthreads = nthreads<1 ? 1 : nthreads;
+    next_shard = 0;
+    process_shard = NULL;
+    arg = NULL;
+
+    bcf_hdr_t *h = odr->hdr;
+
+    std::vector<GenomeInterval> units;
+    std::vector<int64_t> lengths;
+    int64_t total_length = 0;
+
+    if (intervals.size())
+    {
+        //specified intervals are kept whole
+        for (size_t i=0; i<intervals.size(); ++i)
+        {
+            int64_t len = (int64_t) intervals[i].end1 - intervals[i].start1 + 1;
+            int32_t rid = bcf_hdr_name2id(h, intervals[i].seq.c_str());
+            if (rid>=0 && h->id[BCF_DT_CTG][rid].val->info[0])
+            {
+                len = std::min(len, (int64_t) h->id[BCF_DT_CTG][rid].val->info[0]);
+            }
+            units.push_back(intervals[i]);
+            lengths.push_back(len);
+            total_length += len;
+        }
+    }
+    else
+    {
+        //contigs with records in the order of the index
+        int32_t nseqs = 0;
+        const char **seqs = NULL;
+        if (odr->ftype.format==bcf)
+        {
+            seqs = bcf_index_seqnames(odr->idx, h, &nseqs);
+        }
+        else
+        {
+            seqs = tbx_seqnames(odr->tbx, &nseqs);
+        }
+
+        for (int32_t i=0; i<nseqs; ++i)
+        {
+            std::string seq(seqs[i]);
+            GenomeInterval interval(seq);
+            int32_t rid = bcf_hdr_name2id(h, seqs[i]);
+            int64_t len = rid>=0 ? h->id[BCF_DT_CTG][rid].val->info[0] : 0;
+            units.push_back(interval);
+            lengths.push_back(len);
+            total_length += len;
+        }
+        free(seqs);
+
+        //contigs of unknown length are assigned the average length
+        int32_t nknown = 0;
+        for (size_t i=0; i<lengths.size(); ++i) nknown += lengths[i] ? 1 : 0;
+        for (size_t i=0; i<lengths.size(); ++i)
+        {
+            if (!lengths[i])
+            {
+                lengths[i] = nknown ? total_length/nknown : 1;
+                total_length += lengths[i];
+            }
+        }
+    }
+
+    std::vector<int64_t> contig_lengths;
+    for (size_t i=0; i<units.size(); ++i)
+    {
+        int32_t rid = bcf_hdr_name2id(h, units[i].seq.c_str());
+        contig_lengths.push_back(rid>=0 ? h->id[BCF_DT_CTG][rid].val->info[0] : 0);
+    }
+
+    make_shards(units, lengths, contig_lengths, total_length, intervals.size()==0);
+}
+
+/**
+ * Constructs shards for an indexed SAM/BAM/CRAM file.
+ *
+ * @odr        - reader of the input file, the index is used to find contigs with reads
+ * @intervals  - intervals to be processed, if empty, all reads are processed
+ * @nthreads   - number of worker threads
+ */
+RegionSharder::RegionSharder(BAMOrderedReader *odr, std::vector<GenomeInterval>& intervals, int32_t nthreads)
+{
+    this->nthreads = nthreads<1 ? 1 : nthreads;
+    next_shard = 0;
+    process_shard = NULL;
+    arg = NULL;
+
+    bam_hdr_t *h = odr->hdr;
+
+    std::vector<GenomeInterval> units;
+    std::vector<int64_t> lengths;
+    std::vector<int64_t> contig_lengths;
+    int64_t total_length = 0;
+
+    if (intervals.size())
+    {
+        //specified intervals are kept whole
+        for (size_t i=0; i<intervals.size(); ++i)
+        {
+            int64_t len = (int64_t) intervals[i].end1 - intervals[i].start1 + 1;
+            int32_t tid = bam_name2id(h, intervals[i].seq.c_str());
+            if (tid>=0)
+            {
+                len = std::min(len, (int64_t) h->target_len[tid]);
+            }
+            units.push_back(intervals[i]);
+            lengths.push_back(len);
+            contig_lengths.push_back(tid>=0 ? h->target_len[tid] : 0);
+            total_length += len;
+        }
+    }
+    else
+    {
+        //contigs with mapped reads, all contigs are kept when the index has no counts
+        for (int32_t i=0; i<h->n_targets; ++i)
+        {
+            uint64_t mapped, unmapped;
+            if (hts_idx_get_stat(odr->idx, i, &mapped, &unmapped)==0 && mapped==0)
+            {
+                continue;
+            }
+
+            std::string seq(h->target_name[i]);
+            GenomeInterval interval(seq);
+            units.push_back(interval);
+            lengths.push_back(h->target_len[i]);
+            contig_lengths.push_back(h->target_len[i]);
+            total_length += h->target_len[i];
+        }
+    }
+
+    make_shards(units, lengths, contig_lengths, total_length, intervals.size()==0);
+}
+
+/**
+ * Groups units into shards of about equal length.
+ */
+void RegionSharder::make_shards(std::vector<GenomeInterval>& units, std::vector<int64_t>& lengths, std::vector<int64_t>& contig_lengths, int64_t total_length, bool cut_contigs)
+{
+    int32_t nshards = nthreads*SHARDS_PER_THREAD;
+    int64_t shard_length = std::max((int64_t) 1, (total_length+nshards-1)/nshards);
+    int64_t current_length = 0;
+
+    for (size_t i=0; i<units.size(); ++i)
+    {
+        if (!cut_contigs)
+        {
+            add_interval(units[i], lengths[i], shard_length, current_length, false);
+        }
+        else
+        {
+            //cut up contigs of known length, the last piece extends to the end of the contig
+            GenomeInterval& contig = units[i];
+            bool known_length = contig_lengths[i]>0;
+            int64_t remaining = lengths[i];
+            int32_t start1 = 1;
+
+            while (known_length)
+            {
+                int64_t capacity = (shards.empty() || current_length>=shard_length) ? shard_length : shard_length-current_length;
+                if (remaining<=capacity) break;
+
+                GenomeInterval piece(contig.seq, start1, start1+capacity-1);
+                add_interval(piece, capacity, shard_length, current_length, true);
+                start1 += capacity;
+                remaining -= capacity;
+            }
+
+            GenomeInterval piece(contig.seq, start1, contig.end1);
+            add_interval(piece, remaining, shard_length, current_length, true);
+        }
+    }
+
+    //shard files of concurrent runs are kept apart in a directory of their own
+    const char* tmpdir = getenv("TMPDIR");
+    kstring_t s = {0,0,0};
+    kputs(tmpdir && *tmpdir ? tmpdir : "/tmp", &s);
+    kputs("/vt.XXXXXX", &s);
+    if (!mkdtemp(s.s))
+    {
+        fprintf(stderr, "[E:%s:%d %s] cannot create temporary directory %s: %s\n", __FILE__, __LINE__, __FUNCTION__, s.s, strerror(errno));
+        exit(1);
+    }
+    tmp_dir = std::string(s.s);
+
+    for (size_t i=0; i<shards.size(); ++i)
+    {
+        s.l = 0;
+        kputs(tmp_dir.c_str(), &s);
+        kputs("/shard", &s);
+        kputw(i+1, &s);
+        kputs(".ubcf", &s);
+        shards[i].index = i;
+        shards[i].output_vcf_file = std::string(s.s);
+    }
+    if (s.m) free(s.s);
+}
+
+/**
+ * Removes the temporary files that are left and their directory.
+ */
+RegionSharder::~RegionSharder()
+{
+    if (tmp_dir=="") return;
+
+    for (size_t i=0; i<shards.size(); ++i)
+    {
+        std::remove(shards[i].output_vcf_file.c_str());
+    }
+    rmdir(tmp_dir.c_str());
+}
+
+/**
+ * Adds an interval to the shards, a new shard is started when the current shard is full.
+ */
+void RegionSharder::add_interval(GenomeInterval& interval, int64_t length, int64_t shard_length, int64_t& current_length, bool interval_start_only)
+{
+    if (shards.empty() || current_length>=shard_length)
+    {
+        shards.push_back(RegionShard());
+        shards.back().interval_start_only = interval_start_only;
+        current_length = 0;
+    }
+
+    shards.back().intervals.push_back(interval);
+    current_length += length;
+}
+
+/**
+ * Runs process_shard on all shards with the worker threads.
+ * The function is called concurrently and should only
+ * modify the shard and objects local to it.
+ */
+void RegionSharder::run(void (*process_shard)(void *arg, RegionShard *shard), void *arg)
+{
+    this->process_shard = process_shard;
+    this->arg = arg;
+    next_shard = 0;
+
+    pthread_mutex_init(&mutex, NULL);
+
+    int32_t nworkers = std::min(nthreads, (int32_t) shards.size());
+    std::vector<pthread_t> workers(nworkers);
+    for (int32_t i=0; i<nworkers; ++i)
+    {
+        if (pthread_create(&workers[i], NULL, work, this))
+        {
+            fprintf(stderr, "[%s:%d %s] Cannot create worker thread\n", __FILE__, __LINE__, __FUNCTION__);
+            exit(1);
+        }
+    }
+
+    for (int32_t i=0; i<nworkers; ++i)
+    {
+        pthread_join(workers[i], NULL);
+    }
+
+    pthread_mutex_destroy(&mutex);
+}
+
+/**
+ * Processes shards until none are left, run by each worker thread.
+ */
+void* RegionSharder::work(void *arg)
+{
+    RegionSharder *sharder = (RegionSharder*) arg;
+
+    while (true)
+    {
+        pthread_mutex_lock(&sharder->mutex);
+        uint32_t i = sharder->next_shard++;
+        pthread_mutex_unlock(&sharder->mutex);
+
+        if (i>=sharder->shards.size()) break;
+
+        sharder->process_shard(sharder->arg, &sharder->shards[i]);
+    }
+
+    return NULL;
+}
+
+/**
+ * Writes the records of the shards out in order and removes the temporary files.
+ */
+void RegionSharder::stitch(BCFOrderedWriter *odw)
+{
+    std::vector<GenomeInterval> no_intervals;
+
+    for (size_t i=0; i<shards.size(); ++i)
+    {
+        BCFOrderedReader *odr = new BCFOrderedReader(shards[i].output_vcf_file, no_intervals);
+
+        bcf1_t *v = odw->get_bcf1_from_pool();
+        while (odr->read(v))
+        {
+            odw->write(v);
+            //records are only kept by the writer when it buffers them
+            if (odw->window) v = odw->get_bcf1_from_pool();
+        }
+        odw->store_bcf1_into_pool(v);
+
+        odr->close();
+        delete odr;
+        std::remove(shards[i].output_vcf_file.c_str());
+    }
+}
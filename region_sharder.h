@@ -0,0 +1,146 @@
+/* The MIT License
+
+   Copyright (c) 2018 Adrian Tan <atks@umich.edu>
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+#ifndef REGION_SHARDER_H
+#define REGION_SHARDER_H
+
+#include <pthread.h>
+#include <cerrno>
+#include "hts_utils.h"
+#include "utils.h"
+#include "genome_interval.h"
+#include "bcf_ordered_reader.h"
+#include "bcf_ordered_writer.h"
+#include "bam_ordered_reader.h"
+
+//number of shards created per thread for load balancing
+#define SHARDS_PER_THREAD 4
+
+/**
+ * A set of consecutive intervals that is processed independently
+ * of other shards and written to a temporary file.
+ */
+class RegionShard
+{
+    public:
+    int32_t index;
+    std::vector<GenomeInterval> intervals;
+    //when true, only records beginning in the intervals belong to the shard
+    bool interval_start_only;
+    std::string output_vcf_file;
+    //results of processing the shard, owned by the caller
+    void *data;
+
+    RegionShard()
+    {
+        index = 0;
+        interval_start_only = false;
+        data = NULL;
+    };
+};
+
+/**
+ * Splits the genome covered by an indexed VCF/BCF or SAM/BAM/CRAM file
+ * into shards that are processed in parallel by worker threads.  Each shard is
+ * written to a temporary uncompressed BCF file in a directory created under
+ * TMPDIR and the shards are stitched back in coordinate order.
+ *
+ * When no intervals are specified, contigs are cut up by length into
+ * shards and records are assigned to the shard in which they begin.
+ * Intervals that are specified are kept whole and grouped in order.
+ *
+ * Records may move before the start of their shard, for example
+ * during left alignment, these are put back in order when stitching
+ * as the records are passed through a locally sorting BCFOrderedWriter.
+ * The header of every shard has to be constructed in the same way as
+ * the header of the stitched output.
+ */
+class RegionSharder
+{
+    public:
+
+    std::vector<RegionShard> shards;
+    int32_t nthreads;
+
+    //unique directory holding the temporary shard files
+    std::string tmp_dir;
+
+    //for dispatching shards to threads
+    uint32_t next_shard;
+    pthread_mutex_t mutex;
+    void (*process_shard)(void *arg, RegionShard *shard);
+    void *arg;
+
+    /**
+     * Constructs shards for an indexed file.
+     *
+     * @odr        - reader of the input file, the index is used to find contigs with records
+     * @intervals  - intervals to be processed, if empty, all records are processed
+     * @nthreads   - number of worker threads
+     */
+    RegionSharder(BCFOrderedReader *odr, std::vector<GenomeInterval>& intervals, int32_t nthreads);
+
+    /**
+     * Constructs shards for an indexed SAM/BAM/CRAM file.
+     *
+     * @odr        - reader of the input file, the index is used to find contigs with reads
+     * @intervals  - intervals to be processed, if empty, all reads are processed
+     * @nthreads   - number of worker threads
+     */
+    RegionSharder(BAMOrderedReader *odr, std::vector<GenomeInterval>& intervals, int32_t nthreads);
+
+    /**
+     * Removes the temporary files that are left and their directory.
+     */
+    ~RegionSharder();
+
+    /**
+     * Runs process_shard on all shards with the worker threads.
+     * The function is called concurrently and should only
+     * modify the shard and objects local to it.
+     */
+    void run(void (*process_shard)(void *arg, RegionShard *shard), void *arg);
+
+    /**
+     * Writes the records of the shards out in order and removes the temporary files.
+     */
+    void stitch(BCFOrderedWriter *odw);
+
+    private:
+
+    /**
+     * Groups units into shards of about equal length.
+     */
+    void make_shards(std::vector<GenomeInterval>& units, std::vector<int64_t>& lengths, std::vector<int64_t>& contig_lengths, int64_t total_length, bool cut_contigs);
+
+    /**
+     * Adds an interval to the shards, a new shard is started when the current shard is full.
+     */
+    void add_interval(GenomeInterval& interval, int64_t length, int64_t shard_length, int64_t& current_length, bool interval_start_only);
+
+    /**
+     * Processes shards until none are left, run by each worker thread.
+     */
+    static void* work(void *arg);
+};
+
+#endif
@@ -34,6 +34,17 @@ SNPGenotypingRecord::SNPGenotypingRecord() {};
  * @v - VCF record.
  */
 SNPGenotypingRecord::SNPGenotypingRecord(bcf_hdr_t *h, bcf1_t *v, int32_t nsamples, int32_t ploidy, Estimator* est)
+{
+    pls = ads = NULL;
+    alleles = {0,0,0};
+
+    initialize(h, v, nsamples, ploidy);
+}
+
+/**
+ * Sets this record to genotype a VCF record, the buffers of the record are reused.
+ */
+void SNPGenotypingRecord::initialize(bcf_hdr_t *h, bcf1_t *v, int32_t nsamples, int32_t ploidy)
 {
     clear();
 
@@ -43,7 +54,8 @@ SNPGenotypingRecord::SNPGenotypingRecord(bcf_hdr_t *h, bcf1_t *v, int32_t nsampl
     this->pos1 = bcf_get_pos1(v);
     this->nsamples = nsamples;
 
-    this->alleles = {0,0,0};
+    this->alleles.l = 0;
+    v_alleles.clear();
     char** tmp_alleles = bcf_get_allele(v);
     for (size_t i=0; i< bcf_get_n_allele(v); ++i) {
       if (i) kputc(',', &this->alleles);
@@ -53,12 +65,12 @@ SNPGenotypingRecord::SNPGenotypingRecord(bcf_hdr_t *h, bcf1_t *v, int32_t nsampl
 
     n_filter = 0;
 
-    if (vtype==VT_SNP && v_alleles.size()==2)
+    vtype = VT_SNP;
+    beg1 = bcf_get_pos1(v);
+    end1 = beg1;
+
+    if (v_alleles.size()==2)
     {
-        //rid = bcf_get_rid(v);
-        beg1 = bcf_get_pos1(v);
-        end1 = beg1;
-        
         if (bcf_has_filter(h, v, const_cast<char*>("overlap_snp"))==1)
             n_filter |= FILTER_MASK_OVERLAP_SNP;
 
@@ -69,8 +81,11 @@ SNPGenotypingRecord::SNPGenotypingRecord(bcf_hdr_t *h, bcf1_t *v, int32_t nsampl
             n_filter |= FILTER_MASK_OVERLAP_VNTR;
     }
 
-    pls = (uint8_t*)calloc( nsamples*3, sizeof(uint8_t) );
-    ads = (uint8_t*)calloc( nsamples*3, sizeof(uint8_t) );
+    pls = (uint8_t*)realloc(pls, nsamples*3*sizeof(uint8_t));
+    ads = (uint8_t*)realloc(ads, nsamples*3*sizeof(uint8_t));
+    memset(pls, 0, nsamples*3*sizeof(uint8_t));
+    memset(ads, 0, nsamples*3*sizeof(uint8_t));
+    obs.resize(nsamples);
 }
 
 /**
@@ -81,7 +96,7 @@ SNPGenotypingRecord::~SNPGenotypingRecord()
   //if (v) bcf_destroy(v);
     if ( pls ) free(pls);
     if ( ads ) free(ads);
-    if ( alleles.l > 0 ) free(alleles.s);
+    if ( alleles.m ) free(alleles.s);
 }
 
 /**
@@ -109,8 +124,6 @@ void SNPGenotypingRecord::clear()
 {
     vtype = -1;
 
-    pls = ads = NULL;
-
     bqr_num = bqr_den = 0;
     mqr_num = mqr_den = 0;
     cyr_num = cyr_den = 0;
@@ -313,11 +326,6 @@ bcf1_t* SNPGenotypingRecord::flush_variant(bcf_hdr_t* hdr)
     free(ad);
     free(td);
 
-    free(pls); pls = NULL;
-    free(ads); ads = NULL;
-
-    free(alleles.s);
-
     return nv;
 }
 
@@ -476,8 +484,7 @@ void SNPGenotypingRecord::process_read(AugmentedBAMRecord& as, int32_t sampleInd
         int32_t cycle = 0;
 
         std::vector<uint32_t>& aug_cigar = as.aug_cigar;
-        std::vector<std::string>& aug_ref = as.aug_ref;
-        std::vector<std::string>& aug_alt = as.aug_alt;
+        std::vector<AugmentedSeq>& aug_alt = as.aug_alt;
 
         int32_t vpos1 = pos1;
         int32_t cpos1 = bam_get_pos1(s);
@@ -547,7 +554,7 @@ void SNPGenotypingRecord::process_read(AugmentedBAMRecord& as, int32_t sampleInd
             std::cerr << "something wrong\n";
         }
 
-        add_allele( contam, allele, mapq, strand == 'F', q, cycle, no_mismatches );
+        observe_allele(sampleIndex, allele, mapq, strand == 'F', q, cycle, no_mismatches);
     }
     else if (v_alleles.size()>2) //multiallelic
     {
@@ -564,8 +571,7 @@ void SNPGenotypingRecord::process_read(AugmentedBAMRecord& as, int32_t sampleInd
         int32_t cycle = 0;
 
         std::vector<uint32_t>& aug_cigar = as.aug_cigar;
-        std::vector<std::string>& aug_ref = as.aug_ref;
-        std::vector<std::string>& aug_alt = as.aug_alt;
+        std::vector<AugmentedSeq>& aug_alt = as.aug_alt;
 
         int32_t vpos1 = pos1;
         int32_t cpos1 = bam_get_pos1(s);
@@ -635,7 +641,7 @@ void SNPGenotypingRecord::process_read(AugmentedBAMRecord& as, int32_t sampleInd
             std::cerr << "something wrong\n";
         }
 
-        add_allele( contam, allele, mapq, strand == 'F', q, cycle, no_mismatches );
+        observe_allele(sampleIndex, allele, mapq, strand == 'F', q, cycle, no_mismatches);
 
         //abort();
     }
@@ -43,70 +43,6 @@
 class SNPGenotypingRecord : public GenotypingRecord
 {
     public:
-    bcf_hdr_t *h;
-    bcf1_t *v;
-    int32_t rid;
-    int32_t pos1; //position of variant
-    //[beg1,end1] is the required overlapping of the variant against the aligned read necessary to make a genotype call.
-    //for SNPs, beg1=end1=pos1
-    //
-    //for Indels, this refers to the flanking positions
-    //   insertion
-    //        if T/TG - beg1=pos1, end1=pos1+1
-    //        if T/GT - beg1=pos1-1, end1=pos1
-    //   deletion
-    //        if TG/T - beg1=pos1, end1=pos1+length(REF)
-    //        if TG/G - beg1=pos1-1, end1=pos1+length(REF)-1
-    int32_t beg1;
-    int32_t end1;
-   
-    //indel specific record
-    int32_t dlen;
-    int32_t len;
-    std::string indel;
-
-    //vntr specific record
-    std::string motif;
-
-    //vntr specific record
-    //std::vector<float> counts;
-
-    // sample level information
-    int32_t nsamples;
-    kstring_t alleles;
-    std::vector<std::string> v_alleles;
-    uint32_t n_filter;
-
-    uint8_t* pls;
-    uint8_t* ads;
-
-    // sufficient statistics for computing INFO field
-    float bqr_num, bqr_den;
-    float mqr_num, mqr_den;
-    float cyr_num, cyr_den;
-    float str_num, str_den;
-    float nmr_num, nmr_den;
-    float ior_num, ior_den;
-    float nm0_num, nm0_den;
-    float nm1_num, nm1_den;
-    float abe_num, abe_den;
-    float abz_num, abz_den;
-    float ns_nref, dp_sum, max_gq;
-
-    // temporary information to be cleared out per-sample basis
-    int32_t tmp_dp_q20;
-    int32_t tmp_dp_ra;
-    int32_t tmp_bq_s1, tmp_bq_s2;
-    int32_t tmp_mq_s1, tmp_mq_s2;
-    float tmp_cy_s1, tmp_cy_s2;
-    int32_t tmp_st_s1, tmp_st_s2;
-    int32_t tmp_al_s1, tmp_bq_al, tmp_mq_al;
-    float  tmp_cy_al;
-    int32_t tmp_st_al, tmp_nm_al;
-    int32_t tmp_nm_s1, tmp_nm_s2;
-    double tmp_oth_exp_q20, tmp_oth_obs_q20;
-    double tmp_pls[3];
-    double tmp_ads[3];
 
     /**
      * Constructor.
@@ -124,6 +60,11 @@ class SNPGenotypingRecord : public GenotypingRecord
      * Destructor.
      */
     ~SNPGenotypingRecord();
+
+    /**
+     * Sets this record to genotype a VCF record, the buffers of the record are reused.
+     */
+    void initialize(bcf_hdr_t *h, bcf1_t *v, int32_t nsamples, int32_t ploidy);
     
     /**
      * Clears this record.
@@ -151,7 +92,7 @@ class SNPGenotypingRecord : public GenotypingRecord
     void add_allele( double contam, int32_t allele, uint8_t mapq, bool fwd, uint32_t q, int32_t cycle, uint32_t nm );
             
     /**
-     * Clears this record.
+     * Observes the allele in a read for a sample, the allele is added when the samples are flushed.
      */
     void process_read(AugmentedBAMRecord& as, int32_t sampleIndex, double contam);
 
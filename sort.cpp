@@ -26,20 +26,79 @@
 namespace
 {
 
-//sort and write out
-int bcf_compare (const void * a, const void * b)
-{
-    bcf1_t *u = *(bcf1_t**) a;
-    bcf1_t *v = *(bcf1_t**) b;
+//maximum number of runs merged at once
+#define SORT_MAX_MERGE_FANIN 256
 
+/**
+ * Orders records by chromosome and position.
+ */
+bool bcf_less(bcf1_t *u, bcf1_t *v)
+{
     if (bcf_get_rid(u)==bcf_get_rid(v))
     {
-        return (bcf_get_pos1(u)-bcf_get_pos1(v));
+        return bcf_get_pos1(u)<bcf_get_pos1(v);
+    }
+
+    return bcf_get_rid(u)<bcf_get_rid(v);
+}
+
+/**
+ * Orders the current records of runs, exhausted runs are last
+ * and ties are broken by run so that the merge is stable.
+ */
+bool run_less(void *arg, int32_t i, int32_t j)
+{
+    std::vector<bcf1_t*>& recs = *((std::vector<bcf1_t*>*) arg);
+
+    if (!recs[i]) return false;
+    if (!recs[j]) return true;
+    if (bcf_get_rid(recs[i])!=bcf_get_rid(recs[j])) return bcf_get_rid(recs[i])<bcf_get_rid(recs[j]);
+    if (bcf_get_pos1(recs[i])!=bcf_get_pos1(recs[j])) return bcf_get_pos1(recs[i])<bcf_get_pos1(recs[j]);
+
+    return i<j;
+}
+
+/**
+ * Estimates the memory held by a record.
+ */
+size_t bcf_mem_size(bcf1_t *v)
+{
+    return sizeof(bcf1_t) + v->shared.m + v->indiv.m + v->d.m_als;
+}
+
+/**
+ * Parses a memory size with an optional K, M or G suffix, returns -1 if invalid.
+ */
+int64_t parse_mem_size(std::string& s)
+{
+    char *end;
+    double size = strtod(s.c_str(), &end);
+    switch (toupper(*end))
+    {
+        case 'K': size *= 1<<10; ++end; break;
+        case 'M': size *= 1<<20; ++end; break;
+        case 'G': size *= 1<<30; ++end; break;
+    }
+
+    if (end==s.c_str() || *end!='\0' || size<=0)
+    {
+        return -1;
     }
 
-    return (bcf_get_rid(u)-bcf_get_rid(v));
+    return (int64_t) size;
 }
 
+/**
+ * A run of records that is sorted in memory and written to a temporary file.
+ */
+class SortRun
+{
+    public:
+    std::vector<bcf1_t*> recs;
+    bcf_hdr_t *hdr;
+    std::string file_name;
+};
+
 class Igor : Program
 {
     public:
@@ -51,7 +110,11 @@ class Igor : Program
     std::string output_vcf_file;
     std::vector<GenomeInterval> intervals;
     uint32_t sort_window_size;
+    bool adaptive_window;
     std::string sort_mode;
+    int64_t max_mem;
+    std::string tmp_dir;
+    int32_t nthreads;
     bool print;
 
     ///////
@@ -69,6 +132,18 @@ class Igor : Program
     //tools//
     /////////
 
+    //for sorting runs in worker threads under full mode
+    int32_t nworkers;
+    std::vector<pthread_t> workers;
+    std::deque<SortRun*> queue;
+    int32_t no_pending;
+    bool done;
+    pthread_mutex_t mutex;
+    pthread_cond_t run_available;
+    pthread_cond_t run_done;
+    std::vector<std::string> run_files;
+    int32_t no_runs;
+
     Igor(int argc, char **argv)
     {
         version = "0.5";
@@ -85,6 +160,7 @@ class Igor : Program
             cmd.setOutput(&my);
             TCLAP::SwitchArg arg_print("p", "p", "print options and summary []", cmd, false);
             TCLAP::ValueArg<uint32_t> arg_sort_window_size("w", "w", "local sorting window size, set by default to 1000 under local mode. [0]", false, 0, "int", cmd);
+            TCLAP::SwitchArg arg_adaptive_window("a", "a", "enlarge local sorting window when out of order records are observed [false]", cmd, false);
             TCLAP::ValueArg<std::string> arg_output_vcf_file("o", "o", "output VCF/VCF.GZ/BCF file [-]"
                    , false, "-", "str", cmd);
             TCLAP::ValueArg<std::string> arg_sort_mode("m", "m", ""
@@ -94,6 +170,8 @@ class Igor : Program
                  "                      input must be indexed\n"
                  "              full  : full sort with no assumptions",
                                  false, "full", "str", cmd);
+            TCLAP::ValueArg<std::string> arg_max_mem("M", "max-mem", "maximum memory used for sorting records in full mode, K, M and G suffixes are recognized [768M]", false, "768M", "str", cmd);
+            TCLAP::ValueArg<std::string> arg_tmp_dir("T", "tmp-dir", "directory for temporary files in full mode [directory of output file]", false, "", "str", cmd);
             TCLAP::UnlabeledValueArg<std::string> arg_input_vcf_file("<in.vcf>", "input VCF file", true, "","file", cmd);
             cmd.parse(argc, argv);
 
@@ -102,6 +180,16 @@ class Igor : Program
             sort_mode = arg_sort_mode.getValue();
             print = arg_print.getValue();
             sort_window_size = arg_sort_window_size.getValue();
+            adaptive_window = arg_adaptive_window.getValue();
+            tmp_dir = arg_tmp_dir.getValue();
+            nthreads = hts_get_shared_thread_pool_size();
+            std::string max_mem_string = arg_max_mem.getValue();
+            max_mem = parse_mem_size(max_mem_string);
+            if (max_mem<0)
+            {
+                fprintf(stderr, "[%s:%d %s] Invalid memory size: %s\n", __FILE__,__LINE__,__FUNCTION__, max_mem_string.c_str());
+                exit(1);
+            }
 
             if (sort_mode=="local")
             {
@@ -150,9 +238,16 @@ class Igor : Program
             odr = new BCFOrderedReader(input_vcf_file, intervals);
 
             odw = new BCFOrderedWriter(output_vcf_file, sort_window_size);
+            odw->set_adaptive_window(adaptive_window);
             odw->link_hdr(odr->hdr);
             odw->write_hdr();
 
+            //the header is not modified after it is written
+            if (odr->ftype.format==bcf && hts_get_shared_thread_pool_size())
+            {
+                odr->enable_prefetch();
+            }
+
             bcf1_t *v = odw->get_bcf1_from_pool();
             bcf_hdr_t *h = odr->hdr;
 
@@ -180,12 +275,23 @@ class Igor : Program
             odw->link_hdr(odr->hdr);
             odw->write_hdr();
 
+            if (nthreads>1)
+            {
+                chrom_sort_shards();
+                return;
+            }
+
+            //the header is not modified after it is written
+            if (odr->ftype.format==bcf && hts_get_shared_thread_pool_size())
+            {
+                odr->enable_prefetch();
+            }
+
             int32_t nseqs;
             const char ** seqs = bcf_hdr_seqnames(odr->hdr, &nseqs);
             bcf1_t *v = bcf_init1();
-            bcf_hdr_t *h = odr->hdr;
 
-            for (size_t i=0; i<nseqs; ++i)
+            for (int32_t i=0; i<nseqs; ++i)
             {
                 std::string interval(seqs[i]);
                 GenomeInterval ginterval(interval);
@@ -204,141 +310,368 @@ class Igor : Program
         }
         else if (sort_mode=="full")
         {
-            //read into buffer 10000 records
-            odr = new BCFOrderedReader(input_vcf_file, intervals);
+            full_sort();
+        }
+    };
 
-            //need to change this to measure the amount of data read.  This can be
-            size_t buffer_size = 1000000;
+    /**
+     * Sorts contigs in parallel under chrom mode.
+     *
+     * The contigs with records in the index are taken in header order
+     * and grouped into shards that are read by worker threads into
+     * temporary files, these are concatenated in header order.
+     */
+    void chrom_sort_shards()
+    {
+        int32_t nseqs = 0;
+        const char **seqs = odr->ftype.format==bcf ? bcf_index_seqnames(odr->idx, odr->hdr, &nseqs) : tbx_seqnames(odr->tbx, &nseqs);
+        std::set<std::string> indexed_seqs;
+        for (int32_t i=0; i<nseqs; ++i)
+        {
+            indexed_seqs.insert(seqs[i]);
+        }
+        free(seqs);
 
-            bcf1_t *buffer[buffer_size];
-            for (size_t i=0; i<buffer_size; ++i)
+        std::vector<GenomeInterval> contigs;
+        const char **hdr_seqs = bcf_hdr_seqnames(odr->hdr, &nseqs);
+        for (int32_t i=0; i<nseqs; ++i)
+        {
+            if (indexed_seqs.find(hdr_seqs[i])!=indexed_seqs.end())
             {
-                buffer[i] = bcf_init1();
+                std::string seq(hdr_seqs[i]);
+                contigs.push_back(GenomeInterval(seq));
             }
+        }
+        free(hdr_seqs);
 
-            size_t bptr = 0;
-            std::vector<std::string> sorted_file_names;
+        if (contigs.size())
+        {
+            RegionSharder sharder(odr, contigs, nthreads);
+            sharder.run(chrom_sort_shard, this);
 
-            bcf1_t *v = buffer[bptr];
-            while (odr->read(v))
+            for (size_t i=0; i<sharder.shards.size(); ++i)
             {
-                if (bptr<buffer_size-1)
-                {
-                    ++bptr;
-                }
-                else
-                {
-                    ++bptr;
-
-                    //sort and write out
-                    qsort (buffer, bptr, sizeof(bcf1_t*), bcf_compare);
-
-                    kstring_t s = {0,0,0};
-                    if (output_vcf_file!="-")
-                    {
-                        kputs(output_vcf_file.c_str(), &s);
-                        kputs(".", &s);
-                    }
-                    kputw(sorted_file_names.size()+1, &s);
-                    kputs(".bcf", &s);
-                    std::string file_name(s.s);
-                    if (s.m) free(s.s);
-                    sorted_file_names.push_back(file_name);
-
-                    if (sorted_file_names.size()!=1)
-                    {
-                        odw->close();
-                        delete odw;
-                    }
-                    odw = new BCFOrderedWriter(file_name);
-                    odw->link_hdr(odr->hdr);
-                    odw->write_hdr();
-
-                    for (size_t i=0; i<bptr; ++i)
-                    {
-                        odw->write(buffer[i]);
-                    }
-
-                    bptr = 0;
-                }
-
-                v = buffer[bptr];
-                ++no_variants;
+                uint32_t *no_shard_variants = (uint32_t*) sharder.shards[i].data;
+                no_variants += *no_shard_variants;
+                delete no_shard_variants;
             }
 
-            if (bptr)
-            {
-                qsort (buffer, bptr, sizeof(bcf1_t*), bcf_compare);
+            sharder.stitch(odw);
+        }
 
-                kstring_t s = {0,0,0};
-                if (output_vcf_file!="-")
-                {
-                    kputs(output_vcf_file.c_str(), &s);
-                    kputs(".", &s);
-                }
-                kputw(sorted_file_names.size()+1, &s);
-                kputs(".bcf", &s);
-                std::string file_name(s.s);
-                if (s.m) free(s.s);
-                sorted_file_names.push_back(file_name);
+        odw->close();
+        odr->close();
+    };
 
-                if (sorted_file_names.size()!=1)
-                {
-                    odw->close();
-                    delete odw;
-                }
-                odw = new BCFOrderedWriter(file_name);
-                odw->link_hdr(odr->hdr);
-                odw->write_hdr();
+    /**
+     * Reads the contigs of a shard into its temporary file, called by the worker threads of RegionSharder.
+     */
+    static void chrom_sort_shard(void *arg, RegionShard *shard)
+    {
+        Igor *igor = (Igor*) arg;
 
-                for (size_t i=0; i<bptr; ++i)
-                {
-                    odw->write(buffer[i]);
-                }
+        BCFOrderedReader *shard_odr = new BCFOrderedReader(igor->input_vcf_file, shard->intervals);
+        BCFOrderedWriter *shard_odw = new BCFOrderedWriter(shard->output_vcf_file, igor->sort_window_size);
+        shard_odw->link_hdr(shard_odr->hdr);
+        shard_odw->write_hdr();
 
-                odw->close();
-                delete odw;
+        uint32_t *no_shard_variants = new uint32_t(0);
+        bcf1_t *v = shard_odw->get_bcf1_from_pool();
+        while (shard_odr->read(v))
+        {
+            shard_odw->write(v);
+            //records are only kept by the writer when it buffers them
+            if (shard_odw->window) v = shard_odw->get_bcf1_from_pool();
+            ++(*no_shard_variants);
+        }
+        shard_odw->store_bcf1_into_pool(v);
+
+        shard_odw->close();
+        shard_odr->close();
+        delete shard_odw;
+        delete shard_odr;
+
+        shard->data = no_shard_variants;
+    };
 
-                bptr = 0;
+    /**
+     * Sorts records with no assumptions on their order.
+     *
+     * Records are read into runs of up to max_mem/(nworkers+1) bytes
+     * which are sorted by worker threads while the next run is read,
+     * the sorted runs are written to uncompressed BCF files in tmp_dir
+     * and merged with a loser tree.  Records at the same position are
+     * kept in input order.
+     */
+    void full_sort()
+    {
+        odr = new BCFOrderedReader(input_vcf_file, intervals);
+
+        //the header is only read while sorting
+        if (odr->ftype.format==bcf && hts_get_shared_thread_pool_size())
+        {
+            odr->enable_prefetch();
+        }
+
+        nworkers = std::max(nthreads, 1);
+        int64_t run_mem = max_mem/(nworkers+1);
+        no_runs = 0;
+        no_pending = 0;
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&run_available, NULL);
+        pthread_cond_init(&run_done, NULL);
+        done = false;
+
+        SortRun *run = new SortRun();
+        int64_t mem = 0;
+        bcf1_t *v = bcf_init1();
+        while (odr->read(v))
+        {
+            run->recs.push_back(v);
+            mem += bcf_mem_size(v);
+            v = bcf_init1();
+            ++no_variants;
+
+            if (mem>=run_mem)
+            {
+                if (!no_runs) start_workers();
+                dispatch_run(run);
+                run = new SortRun();
+                mem = 0;
             }
+        }
+        bcf_destroy(v);
 
-            //merge records from temporary files
-            intervals.clear();
-            BCFSyncedReader sr(sorted_file_names, intervals);
+        odw = new BCFOrderedWriter(output_vcf_file);
+        odw->link_hdr(odr->hdr);
 
-            std::vector<bcfptr*> current_recs;
-            odw = new BCFOrderedWriter(output_vcf_file);
-            odw->link_hdr(odr->hdr);
+        if (!no_runs)
+        {
+            //all records fit in memory
+            std::stable_sort(run->recs.begin(), run->recs.end(), bcf_less);
             odw->write_hdr();
+            for (size_t i=0; i<run->recs.size(); ++i)
+            {
+                odw->write(run->recs[i]);
+                bcf_destroy(run->recs[i]);
+            }
+            delete run;
+        }
+        else
+        {
+            if (run->recs.size())
+            {
+                dispatch_run(run);
+            }
+            else
+            {
+                delete run;
+            }
+            stop_workers();
 
-            int32_t no = 0;
-            while(sr.read_next_position(current_recs))
+            //merge in passes when there are too many runs to open at once
+            while (run_files.size()>SORT_MAX_MERGE_FANIN)
             {
-                for (size_t i=0; i<current_recs.size(); ++i)
+                std::vector<std::string> merged_run_files;
+                for (size_t i=0; i<run_files.size(); i+=SORT_MAX_MERGE_FANIN)
                 {
-                    odw->write(current_recs[i]->v);
+                    size_t j = std::min(i+SORT_MAX_MERGE_FANIN, run_files.size());
+                    std::vector<std::string> group(run_files.begin()+i, run_files.begin()+j);
+                    std::string file_name = get_run_file_name(no_runs++);
+
+                    BCFOrderedWriter *run_odw = new BCFOrderedWriter(file_name);
+                    run_odw->link_hdr(odr->hdr);
+                    run_odw->write_hdr();
+                    merge_runs(group, run_odw);
+                    run_odw->close();
+                    delete run_odw;
+
+                    merged_run_files.push_back(file_name);
                 }
+                run_files.swap(merged_run_files);
+            }
+
+            odw->write_hdr();
+            merge_runs(run_files, odw);
+        }
+
+        pthread_cond_destroy(&run_done);
+        pthread_cond_destroy(&run_available);
+        pthread_mutex_destroy(&mutex);
+
+        odw->close();
+        delete odw;
+        odr->close();
+    };
+
+    /**
+     * Returns the name of the temporary file of the ith run.
+     */
+    std::string get_run_file_name(int32_t i)
+    {
+        kstring_t s = {0,0,0};
+        if (tmp_dir!="")
+        {
+            kputs(tmp_dir.c_str(), &s);
+            kputc('/', &s);
+        }
+        else if (output_vcf_file!="-" && output_vcf_file!="+")
+        {
+            kputs(output_vcf_file.c_str(), &s);
+            kputc('.', &s);
+        }
+        kputs("vt_sort.", &s);
+        kputw(getpid(), &s);
+        kputc('.', &s);
+        kputw(i+1, &s);
+        kputs(".ubcf", &s);
+        std::string file_name(s.s);
+        if (s.m) free(s.s);
+
+        return file_name;
+    };
+
+    /**
+     * Hands a run over to the workers, waits while all workers are busy
+     * so that no more than nworkers+1 runs are held in memory.
+     */
+    void dispatch_run(SortRun *run)
+    {
+        //the header is copied as parsing VCF records may add to it
+        run->hdr = bcf_hdr_dup(odr->hdr);
+        run->file_name = get_run_file_name(no_runs++);
+        run_files.push_back(run->file_name);
+
+        pthread_mutex_lock(&mutex);
+        while (no_pending>=nworkers)
+        {
+            pthread_cond_wait(&run_done, &mutex);
+        }
+        queue.push_back(run);
+        ++no_pending;
+        pthread_cond_signal(&run_available);
+        pthread_mutex_unlock(&mutex);
+    };
 
-                ++no;
+    /**
+     * Starts the worker threads.
+     */
+    void start_workers()
+    {
+        workers.resize(nworkers);
+        for (int32_t i=0; i<nworkers; ++i)
+        {
+            if (pthread_create(&workers[i], NULL, sort_runs, this))
+            {
+                fprintf(stderr, "[%s:%d %s] Cannot create worker thread\n", __FILE__, __LINE__, __FUNCTION__);
+                exit(1);
             }
+        }
+    };
+
+    /**
+     * Waits for the workers to finish the queued runs.
+     */
+    void stop_workers()
+    {
+        pthread_mutex_lock(&mutex);
+        done = true;
+        pthread_cond_broadcast(&run_available);
+        pthread_mutex_unlock(&mutex);
+
+        for (size_t i=0; i<workers.size(); ++i)
+        {
+            pthread_join(workers[i], NULL);
+        }
+        workers.clear();
+    };
 
-            sr.close();
+    /**
+     * Sorts runs and writes them out until none are left, run by each worker thread.
+     */
+    static void* sort_runs(void *arg)
+    {
+        Igor *igor = (Igor*) arg;
 
-            for (size_t i=0; i< sorted_file_names.size(); ++i)
+        while (true)
+        {
+            pthread_mutex_lock(&igor->mutex);
+            while (igor->queue.empty() && !igor->done)
             {
-                std::remove(sorted_file_names[i].c_str());
+                pthread_cond_wait(&igor->run_available, &igor->mutex);
             }
+            if (igor->queue.empty())
+            {
+                pthread_mutex_unlock(&igor->mutex);
+                break;
+            }
+            SortRun *run = igor->queue.front();
+            igor->queue.pop_front();
+            pthread_mutex_unlock(&igor->mutex);
 
-            odr->close();
+            std::stable_sort(run->recs.begin(), run->recs.end(), bcf_less);
 
-            odw->close();
-            delete odw;
+            BCFOrderedWriter *run_odw = new BCFOrderedWriter(run->file_name);
+            run_odw->link_hdr(run->hdr);
+            run_odw->write_hdr();
+            for (size_t i=0; i<run->recs.size(); ++i)
+            {
+                run_odw->write(run->recs[i]);
+                bcf_destroy(run->recs[i]);
+            }
+            run_odw->close();
+            delete run_odw;
+            bcf_hdr_destroy(run->hdr);
+            delete run;
+
+            pthread_mutex_lock(&igor->mutex);
+            --igor->no_pending;
+            pthread_cond_signal(&igor->run_done);
+            pthread_mutex_unlock(&igor->mutex);
+        }
+
+        return NULL;
+    };
 
-            for (size_t i=0; i<buffer_size; ++i)
+    /**
+     * Merges sorted runs into odw and removes the run files.
+     */
+    void merge_runs(std::vector<std::string>& files, BCFOrderedWriter *odw)
+    {
+        std::vector<GenomeInterval> no_intervals;
+        int32_t k = files.size();
+        std::vector<BCFOrderedReader*> readers(k);
+        std::vector<bcf1_t*> recs(k);
+        for (int32_t i=0; i<k; ++i)
+        {
+            readers[i] = new BCFOrderedReader(files[i], no_intervals);
+            recs[i] = bcf_init1();
+            if (!readers[i]->read(recs[i]))
             {
-                bcf_destroy(buffer[i]);
+                bcf_destroy(recs[i]);
+                recs[i] = NULL;
             }
         }
+
+        LoserTree tree(k, run_less, &recs);
+        tree.build();
+        for (int32_t i=tree.top(); recs[i]; i=tree.top())
+        {
+            odw->write(recs[i]);
+            if (!readers[i]->read(recs[i]))
+            {
+                bcf_destroy(recs[i]);
+                recs[i] = NULL;
+            }
+            tree.update();
+        }
+
+        for (int32_t i=0; i<k; ++i)
+        {
+            readers[i]->close();
+            delete readers[i];
+            std::remove(files[i].c_str());
+        }
     };
 
     void print_options()
@@ -350,7 +683,13 @@ class Igor : Program
         std::clog << "options:     input VCF file              " << input_vcf_file << "\n";
         std::clog << "         [o] output VCF file             " << output_vcf_file << "\n";
         std::clog << "         [w] sort window size            " << sort_window_size << "\n";
+        std::clog << "         [a] adaptive sort window        " << (adaptive_window ? "yes" : "no") << "\n";
         std::clog << "         [m] sorting mode                " << sort_mode << "\n";
+        if (sort_mode=="full")
+        {
+            std::clog << "         [M] maximum memory              " << max_mem << "\n";
+            print_str_op("         [T] temporary directory         ", tmp_dir);
+        }
         std::clog << "         [p] print options and stats     " << (print ? "yes" : "no") << "\n";
         std::clog << "\n";
     }
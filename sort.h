@@ -24,7 +24,10 @@
 #ifndef SORT_H
 #define SORT_H
 
+#include <deque>
+#include <set>
 #include "program.h"
+#include "loser_tree.h"
 
 bool sort(int argc, char ** argv);
 
@@ -40,6 +40,7 @@ TBXOrderedReader::TBXOrderedReader(std::string& hts_file, bool require_index)
     s = {0, 0, 0};
 
     hts = hts_open(hts_file.c_str(), "r");
+    hts_attach_shared_thread_pool(hts);
 
     index_loaded = false;
     if ((tbx = tbx_index_load(hts_file.c_str())))
@@ -77,6 +78,7 @@ TBXOrderedReader::TBXOrderedReader(std::string& hts_file, std::vector<GenomeInte
     s = {0, 0, 0};
 
     hts = hts_open(hts_file.c_str(), "r");
+    hts_attach_shared_thread_pool(hts);
 
     intervals_present =  intervals.size()!=0;
 
@@ -27,6 +27,7 @@
 #include "pcre2.h"
 #include "pregex.h"
 #include "reference_sequence.h"
+#include "pileup.h"
 
 namespace
 {
@@ -632,6 +633,17 @@ class Igor : Program
             }
         }
     };
+
+    /**
+     * Checks the base unpacking kernels against the scalar loop.
+     */
+    void test_unpack_bases(int argc, char ** argv)
+    {
+        uint32_t no_mismatches = Pileup::check_unpack_bases();
+        printf("unpack_bases mismatches: %d\n", no_mismatches);
+        if (no_mismatches) exit(1);
+    };
+
     ~Igor() {};
 
     private:
@@ -643,6 +655,11 @@ void test(int argc, char ** argv)
 {
     Igor igor(argc, argv);
     
+    if (argc>1 && !strcmp(argv[1], "unpack_bases"))
+    {
+        igor.test_unpack_bases(argc, argv);
+        return;
+    }
     
     igor.test_ip2g(argc, argv);
 //    printf ("std::isnan(0.0)       : %d\n",std::isnan(0.0));
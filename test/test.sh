@@ -60,6 +60,86 @@ else
     echo " NOT OK!!!"
 fi
 
+#----------------------------------------------
+echo "testing normalize with regions sharded"
+#----------------------------------------------
+
+if [ "$1" == "debug" ]; then
+    set -x
+fi
+
+${VT} view ${CMDDIR}/02_IN_sharded.vcf -o ${TMPDIR}/02_IN_sharded.vcf.gz 2> /dev/null
+${VT} index ${TMPDIR}/02_IN_sharded.vcf.gz 2> /dev/null
+
+${VT} \
+    normalize -@ 2 \
+    ${TMPDIR}/02_IN_sharded.vcf.gz \
+    -r ${DIR}/ref/small.fa \
+    -o ${TMPDIR}/02_OUT_sharded.vcf \
+    2>&1 | strip_stderr > ${TMPDIR}/02_OUT_sharded.stderr
+
+OUT=`diff ${CMDDIR}/02_OUT_sharded.vcf ${TMPDIR}/02_OUT_sharded.vcf`
+ERR=`diff ${CMDDIR}/02_OUT_sharded.stderr ${TMPDIR}/02_OUT_sharded.stderr`
+
+set +x
+
+((NO_TESTS++))
+
+echo -n "             output VCF file :"
+if [ "$OUT" == "" ]; then
+    echo " ok"
+    ((PASSED_TESTS++))
+else
+    echo " NOT OK!!!"
+fi
+
+echo -n "             output logs     :"
+if [ "$ERR" == "" ]; then
+    echo " ok"
+else
+    echo " NOT OK!!!"
+fi
+
+#----------------------------------------------
+echo "testing normalize with a packed reference"
+#----------------------------------------------
+
+if [ "$1" == "debug" ]; then
+    set -x
+fi
+
+cp ${DIR}/ref/small.fa ${DIR}/ref/small.fa.fai ${TMPDIR}
+
+${VT} \
+    normalize \
+    ${CMDDIR}/02_IN_sharded.vcf \
+    -r ${TMPDIR}/small.fa \
+    -o ${TMPDIR}/03_OUT_fasta.vcf \
+    2> /dev/null
+
+${VT} pack_reference ${TMPDIR}/small.fa 2> /dev/null
+
+${VT} \
+    normalize \
+    ${CMDDIR}/02_IN_sharded.vcf \
+    -r ${TMPDIR}/small.fa \
+    -o ${TMPDIR}/03_OUT_packed.vcf \
+    2> /dev/null
+
+OUT=`diff ${CMDDIR}/02_OUT_sharded.vcf ${TMPDIR}/03_OUT_fasta.vcf; diff ${CMDDIR}/02_OUT_sharded.vcf ${TMPDIR}/03_OUT_packed.vcf`
+
+set +x
+
+((NO_TESTS++))
+
+echo -n "             output VCF file :"
+if [ "$OUT" == "" ]; then
+    echo " ok"
+    ((PASSED_TESTS++))
+else
+    echo " NOT OK!!!"
+fi
+
 echo "+++++++++++++++++++++++++++++++" >&2
 echo "Tests for vt decompose_blocksub" >&2
 echo "+++++++++++++++++++++++++++++++" >&2
@@ -229,6 +309,560 @@ else
     echo " NOT OK!!!"
 fi
 
+#----------------------------------------------
+echo "testing decompose -s with regions sharded"
+#----------------------------------------------
+
+if [ "$1" == "debug" ]; then
+    set -x
+fi
+
+${VT} view ${CMDDIR}/02_IN_sharded.vcf -o ${TMPDIR}/02_IN_sharded.vcf.gz 2> /dev/null
+${VT} index ${TMPDIR}/02_IN_sharded.vcf.gz 2> /dev/null
+
+${VT} \
+    decompose -s -@ 2 \
+    ${TMPDIR}/02_IN_sharded.vcf.gz \
+    -o ${TMPDIR}/02_OUT_sharded.vcf \
+    2>&1 | strip_stderr > ${TMPDIR}/02_OUT_sharded.stderr
+
+OUT=`diff ${CMDDIR}/02_OUT_sharded.vcf ${TMPDIR}/02_OUT_sharded.vcf`
+ERR=`diff ${CMDDIR}/02_OUT_sharded.stderr ${TMPDIR}/02_OUT_sharded.stderr`
+
+set +x
+
+((NO_TESTS++))
+
+echo -n "             output VCF file :"
+if [ "$OUT" == "" ]; then
+    echo " ok"
+    ((PASSED_TESTS++))
+else
+    echo " NOT OK!!!"
+fi
+
+echo -n "             output logs     :"
+if [ "$ERR" == "" ]; then
+    echo " ok"
+else
+    echo " NOT OK!!!"
+fi
+
+if [ "$1" != "debug" ]; then
+    trap "rm -rf ${TMPDIRS}" EXIT KILL TERM INT HUP
+fi
+
+echo "+++++++++++++++++" >&2
+echo "Tests for vt sort" >&2
+echo "+++++++++++++++++" >&2
+
+# create temporary directory and ensure cleanup on termination
+CMDDIR=${DIR}/sort
+TMPDIR=${CMDDIR}/tmp
+mkdir -p ${TMPDIR}
+TMPDIRS+=" $TMPDIR";
+
+#-----------------------------------------------------
+echo "testing full sort with runs merged from tmp files"
+#-----------------------------------------------------
+
+if [ "$1" == "debug" ]; then
+    set -x
+fi
+
+${VT} \
+    sort -m full -M 8K \
+    ${CMDDIR}/01_IN_unsorted.vcf \
+    -o ${TMPDIR}/01_OUT.vcf \
+    2>&1 | strip_stderr > ${TMPDIR}/01_OUT.stderr
+
+OUT=`diff ${CMDDIR}/01_OUT.vcf ${TMPDIR}/01_OUT.vcf`
+ERR=`diff ${CMDDIR}/01_OUT.stderr ${TMPDIR}/01_OUT.stderr`
+
+set +x
+
+((NO_TESTS++))
+
+echo -n "             output VCF file :"
+if [ "$OUT" == "" ]; then
+    echo " ok"
+    ((PASSED_TESTS++))
+else
+    echo " NOT OK!!!"
+fi
+
+echo -n "             output logs     :"
+if [ "$ERR" == "" ]; then
+    echo " ok"
+else
+    echo " NOT OK!!!"
+fi
+
+#------------------------------------------------
+echo "testing chromosome sort with contigs sharded"
+#------------------------------------------------
+
+if [ "$1" == "debug" ]; then
+    set -x
+fi
+
+${VT} view ${CMDDIR}/02_IN_unsorted_contigs.vcf -o ${TMPDIR}/02_IN_unsorted_contigs.vcf.gz 2> /dev/null
+${VT} index ${TMPDIR}/02_IN_unsorted_contigs.vcf.gz 2> /dev/null
+
+${VT} \
+    sort -m chrom -@ 2 \
+    ${TMPDIR}/02_IN_unsorted_contigs.vcf.gz \
+    -o ${TMPDIR}/02_OUT_sharded.vcf \
+    2>&1 | strip_stderr > ${TMPDIR}/02_OUT_sharded.stderr
+
+OUT=`diff ${CMDDIR}/02_OUT_sharded.vcf ${TMPDIR}/02_OUT_sharded.vcf`
+ERR=`diff ${CMDDIR}/02_OUT_sharded.stderr ${TMPDIR}/02_OUT_sharded.stderr`
+
+set +x
+
+((NO_TESTS++))
+
+echo -n "             output VCF file :"
+if [ "$OUT" == "" ]; then
+    echo " ok"
+    ((PASSED_TESTS++))
+else
+    echo " NOT OK!!!"
+fi
+
+echo -n "             output logs     :"
+if [ "$ERR" == "" ]; then
+    echo " ok"
+else
+    echo " NOT OK!!!"
+fi
+
+echo "+++++++++++++++++++++" >&2
+echo "Tests for vt genotype" >&2
+echo "+++++++++++++++++++++" >&2
+
+# create temporary directory and ensure cleanup on termination
+CMDDIR=${DIR}/genotype
+TMPDIR=${CMDDIR}/tmp
+mkdir -p ${TMPDIR}
+TMPDIRS+=" $TMPDIR";
+
+#--------------------------------------------
+echo "testing genotype of a sample in dense mode"
+#--------------------------------------------
+
+if [ "$1" == "debug" ]; then
+    set -x
+fi
+
+${VT} \
+    genotype -m d \
+    ${CMDDIR}/01_IN.vcf \
+    -b ${CMDDIR}/01_IN_S1.bam \
+    -s S1 \
+    -r ${DIR}/ref/small.fa \
+    -o ${TMPDIR}/01_OUT_dense.vcf \
+    2> /dev/null
+
+OUT=`diff ${CMDDIR}/01_OUT.vcf ${TMPDIR}/01_OUT_dense.vcf`
+
+set +x
+
+((NO_TESTS++))
+
+echo -n "             output VCF file :"
+if [ "$OUT" == "" ]; then
+    echo " ok"
+    ((PASSED_TESTS++))
+else
+    echo " NOT OK!!!"
+fi
+
+#---------------------------------------------
+echo "testing genotype of a sample in sparse mode"
+#---------------------------------------------
+
+if [ "$1" == "debug" ]; then
+    set -x
+fi
+
+${VT} \
+    genotype -m s \
+    ${CMDDIR}/01_IN.vcf \
+    -b ${CMDDIR}/01_IN_S1.bam \
+    -s S1 \
+    -r ${DIR}/ref/small.fa \
+    -o ${TMPDIR}/01_OUT_sparse.vcf \
+    2> /dev/null
+
+OUT=`diff ${CMDDIR}/01_OUT.vcf ${TMPDIR}/01_OUT_sparse.vcf`
+
+set +x
+
+((NO_TESTS++))
+
+echo -n "             output VCF file :"
+if [ "$OUT" == "" ]; then
+    echo " ok"
+    ((PASSED_TESTS++))
+else
+    echo " NOT OK!!!"
+fi
+
+#-------------------------------------------------
+echo "testing joint genotype of samples in dense mode"
+#-------------------------------------------------
+
+if [ "$1" == "debug" ]; then
+    set -x
+fi
+
+printf "${CMDDIR}/01_IN_S1.bam\tS1\n${CMDDIR}/02_IN_S2.bam\tS2\n" > ${TMPDIR}/02_IN.txt
+
+${VT} \
+    genotype -m d \
+    ${CMDDIR}/01_IN.vcf \
+    -L ${TMPDIR}/02_IN.txt \
+    -r ${DIR}/ref/small.fa \
+    -o ${TMPDIR}/02_OUT_dense.vcf \
+    2> /dev/null
+
+OUT=`diff ${CMDDIR}/02_OUT.vcf ${TMPDIR}/02_OUT_dense.vcf`
+
+set +x
+
+((NO_TESTS++))
+
+echo -n "             output VCF file :"
+if [ "$OUT" == "" ]; then
+    echo " ok"
+    ((PASSED_TESTS++))
+else
+    echo " NOT OK!!!"
+fi
+
+#--------------------------------------------------
+echo "testing joint genotype of samples in sparse mode"
+#--------------------------------------------------
+
+if [ "$1" == "debug" ]; then
+    set -x
+fi
+
+${VT} \
+    genotype -m s \
+    ${CMDDIR}/01_IN.vcf \
+    -L ${TMPDIR}/02_IN.txt \
+    -r ${DIR}/ref/small.fa \
+    -o ${TMPDIR}/02_OUT_sparse.vcf \
+    2> /dev/null
+
+OUT=`diff ${CMDDIR}/02_OUT.vcf ${TMPDIR}/02_OUT_sparse.vcf`
+
+set +x
+
+((NO_TESTS++))
+
+echo -n "             output VCF file :"
+if [ "$OUT" == "" ]; then
+    echo " ok"
+    ((PASSED_TESTS++))
+else
+    echo " NOT OK!!!"
+fi
+
+#----------------------------------------------
+echo "testing genotype of a sample without MD tags"
+#----------------------------------------------
+
+if [ "$1" == "debug" ]; then
+    set -x
+fi
+
+${VT} \
+    genotype -m s \
+    ${CMDDIR}/01_IN.vcf \
+    -b ${CMDDIR}/03_IN_S1_nomd.bam \
+    -s S1 \
+    -r ${DIR}/ref/small.fa \
+    -o ${TMPDIR}/03_OUT_nomd.vcf \
+    2> /dev/null
+
+OUT=`diff ${CMDDIR}/01_OUT.vcf ${TMPDIR}/03_OUT_nomd.vcf`
+
+set +x
+
+((NO_TESTS++))
+
+echo -n "             output VCF file :"
+if [ "$OUT" == "" ]; then
+    echo " ok"
+    ((PASSED_TESTS++))
+else
+    echo " NOT OK!!!"
+fi
+
+echo "+++++++++++++++++++++" >&2
+echo "Tests for vt discover" >&2
+echo "+++++++++++++++++++++" >&2
+
+# create temporary directory and ensure cleanup on termination
+CMDDIR=${DIR}/discover
+TMPDIR=${CMDDIR}/tmp
+mkdir -p ${TMPDIR}
+TMPDIRS+=" $TMPDIR";
+
+#-------------------------
+echo "testing discover"
+#-------------------------
+
+if [ "$1" == "debug" ]; then
+    set -x
+fi
+
+${VT} \
+    discover \
+    -b ${CMDDIR}/01_IN.bam \
+    -s S1 \
+    -r ${DIR}/ref/small.fa \
+    -o ${TMPDIR}/01_OUT.vcf \
+    2>&1 | strip_stderr | sed -n '/^stats/,$p' > ${TMPDIR}/01_OUT.stderr
+
+OUT=`diff ${CMDDIR}/01_OUT.vcf ${TMPDIR}/01_OUT.vcf`
+ERR=`diff ${CMDDIR}/01_OUT.stderr ${TMPDIR}/01_OUT.stderr`
+
+set +x
+
+((NO_TESTS++))
+
+echo -n "             output VCF file :"
+if [ "$OUT" == "" ]; then
+    echo " ok"
+    ((PASSED_TESTS++))
+else
+    echo " NOT OK!!!"
+fi
+
+echo -n "             output logs     :"
+if [ "$ERR" == "" ]; then
+    echo " ok"
+else
+    echo " NOT OK!!!"
+fi
+
+#-------------------------------------------
+echo "testing discover with regions sharded"
+#-------------------------------------------
+
+if [ "$1" == "debug" ]; then
+    set -x
+fi
+
+${VT} \
+    discover -@ 2 \
+    -b ${CMDDIR}/01_IN.bam \
+    -s S1 \
+    -r ${DIR}/ref/small.fa \
+    -o ${TMPDIR}/02_OUT_sharded.vcf \
+    2>&1 | strip_stderr | sed -n '/^stats/,$p' > ${TMPDIR}/02_OUT_sharded.stderr
+
+OUT=`diff ${CMDDIR}/01_OUT.vcf ${TMPDIR}/02_OUT_sharded.vcf`
+ERR=`diff ${CMDDIR}/01_OUT.stderr ${TMPDIR}/02_OUT_sharded.stderr`
+
+set +x
+
+((NO_TESTS++))
+
+echo -n "             output VCF file :"
+if [ "$OUT" == "" ]; then
+    echo " ok"
+    ((PASSED_TESTS++))
+else
+    echo " NOT OK!!!"
+fi
+
+echo -n "             output logs     :"
+if [ "$ERR" == "" ]; then
+    echo " ok"
+else
+    echo " NOT OK!!!"
+fi
+
+echo "+++++++++++++++++++++++++++++++++++++++++++++" >&2
+echo "Tests for FORMAT fields in filter expressions" >&2
+echo "+++++++++++++++++++++++++++++++++++++++++++++" >&2
+
+# create temporary directory and ensure cleanup on termination
+CMDDIR=${DIR}/filter
+TMPDIR=${CMDDIR}/tmp
+mkdir -p ${TMPDIR}
+TMPDIRS+=" $TMPDIR";
+
+#-----------------------------------------------
+echo "testing filter with a count of samples"
+#-----------------------------------------------
+
+if [ "$1" == "debug" ]; then
+    set -x
+fi
+
+${VT} \
+    view \
+    -f "COUNT(FORMAT.GQ>=20&&FORMAT.DP>=8)>=4" \
+    ${CMDDIR}/01_IN.vcf \
+    -o ${TMPDIR}/01_OUT.vcf \
+    2> /dev/null
+
+OUT=`diff ${CMDDIR}/01_OUT.vcf ${TMPDIR}/01_OUT.vcf`
+
+set +x
+
+((NO_TESTS++))
+
+echo -n "             output VCF file :"
+if [ "$OUT" == "" ]; then
+    echo " ok"
+    ((PASSED_TESTS++))
+else
+    echo " NOT OK!!!"
+fi
+
+#----------------------------------------------------
+echo "testing filter with an indexed FORMAT field"
+#----------------------------------------------------
+
+if [ "$1" == "debug" ]; then
+    set -x
+fi
+
+${VT} \
+    view \
+    -f "~ANY(FORMAT.AD[2]/FORMAT.DP>0.9)" \
+    ${CMDDIR}/01_IN.vcf \
+    -o ${TMPDIR}/02_OUT.vcf \
+    2> /dev/null
+
+OUT=`diff ${CMDDIR}/02_OUT.vcf ${TMPDIR}/02_OUT.vcf`
+
+set +x
+
+((NO_TESTS++))
+
+echo -n "             output VCF file :"
+if [ "$OUT" == "" ]; then
+    echo " ok"
+    ((PASSED_TESTS++))
+else
+    echo " NOT OK!!!"
+fi
+
+#----------------------------------------------------------------
+echo "testing filter with a mean over samples and all samples"
+#----------------------------------------------------------------
+
+if [ "$1" == "debug" ]; then
+    set -x
+fi
+
+${VT} \
+    view \
+    -f "MEAN(FORMAT.DP)>20&&ALL(FORMAT.GQ>=10)" \
+    ${CMDDIR}/01_IN.vcf \
+    -o ${TMPDIR}/03_OUT.vcf \
+    2> /dev/null
+
+OUT=`diff ${CMDDIR}/03_OUT.vcf ${TMPDIR}/03_OUT.vcf`
+
+set +x
+
+((NO_TESTS++))
+
+echo -n "             output VCF file :"
+if [ "$OUT" == "" ]; then
+    echo " ok"
+    ((PASSED_TESTS++))
+else
+    echo " NOT OK!!!"
+fi
+
+echo "+++++++++++++++++" >&2
+echo "Tests for vt pipe" >&2
+echo "+++++++++++++++++" >&2
+
+# create temporary directory and ensure cleanup on termination
+CMDDIR=${DIR}/pipe
+TMPDIR=${CMDDIR}/tmp
+mkdir -p ${TMPDIR}
+TMPDIRS+=" $TMPDIR";
+
+#-------------------------------------------------
+echo "testing pipe of decompose, normalize and uniq"
+#-------------------------------------------------
+
+if [ "$1" == "debug" ]; then
+    set -x
+fi
+
+${VT} \
+    pipe \
+    ${CMDDIR}/01_IN.vcf \
+    -o ${TMPDIR}/01_OUT.vcf \
+    "decompose -s" \
+    "normalize -r ${DIR}/ref/small.fa" \
+    uniq \
+    2> /dev/null
+
+OUT=`diff ${CMDDIR}/01_OUT.vcf ${TMPDIR}/01_OUT.vcf`
+
+set +x
+
+((NO_TESTS++))
+
+echo -n "             output VCF file :"
+if [ "$OUT" == "" ]; then
+    echo " ok"
+    ((PASSED_TESTS++))
+else
+    echo " NOT OK!!!"
+fi
+
+echo "+++++++++++++++++++++++++++++++++++++++" >&2
+echo "Tests for pileup base unpacking kernels" >&2
+echo "+++++++++++++++++++++++++++++++++++++++" >&2
+
+# create temporary directory and ensure cleanup on termination
+CMDDIR=${DIR}/pileup
+TMPDIR=${CMDDIR}/tmp
+mkdir -p ${TMPDIR}
+TMPDIRS+=" $TMPDIR";
+
+#---------------------------------------------------------
+echo "testing SIMD base unpacking against the scalar loop"
+#---------------------------------------------------------
+
+if [ "$1" == "debug" ]; then
+    set -x
+fi
+
+${VT} \
+    test unpack_bases \
+    > ${TMPDIR}/01_OUT.txt \
+    2> /dev/null
+
+OUT=`diff ${CMDDIR}/01_OUT.txt ${TMPDIR}/01_OUT.txt`
+
+set +x
+
+((NO_TESTS++))
+
+echo -n "             output          :"
+if [ "$OUT" == "" ]; then
+    echo " ok"
+    ((PASSED_TESTS++))
+else
+    echo " NOT OK!!!"
+fi
+
 if [ "$1" != "debug" ]; then
     trap "rm -rf ${TMPDIRS}" EXIT KILL TERM INT HUP
 fi
@@ -55,7 +55,7 @@ class Igor : Program
     /////////
     //tools//
     /////////
-    faidx_t *fai;
+    ReferenceIndex *ref_index;
 
     Igor(int argc, char **argv)
     {
@@ -111,11 +111,11 @@ class Igor : Program
         ////////////////////////
         //tools initialization//
         ////////////////////////
-        fai = NULL;
+        ref_index = NULL;
         if (ref_fasta_file!="")
         {
-            fai = fai_load(ref_fasta_file.c_str());
-            if (fai==NULL)
+            ref_index = ReferenceIndex::load(ref_fasta_file);
+            if (ref_index==NULL)
             {
                 fprintf(stderr, "[%s:%d %s] Cannot load genome index: %s\n", __FILE__, __LINE__, __FUNCTION__, ref_fasta_file.c_str());
                 exit(1);
@@ -155,7 +155,7 @@ class Igor : Program
             last_rid = rid;
             last_pos1 = pos1;
 
-            if (fai)
+            if (ref_index)
             {
                 const char* chrom = odr->get_seqname(v);
 
@@ -163,7 +163,7 @@ class Igor : Program
                 char** alleles = bcf_get_allele(v);
                 int32_t len = strlen(alleles[0]);
 
-                char* ref = faidx_fetch_uc_seq(fai, chrom, pos1-1, pos1+len-2, &ref_len);
+                char* ref = ref_index->fetch_uc_seq(chrom, pos1-1, pos1+len-2, &ref_len);
 
                 if (strcasecmp(ref, alleles[0]))
                 {
@@ -202,7 +202,7 @@ class Igor : Program
         std::clog << "stats:    no. unordered                     : " << no_unordered << "\n";
         std::clog << "          no. unordered chrom               : " << no_unordered_chrom << "\n";
         std::clog << "\n";
-        if (fai)
+        if (ref_index)
         {
             std::clog << "          no. inconsistent REF              : " << no_inconsistent_ref << "\n";
             std::clog << "\n";
@@ -25,6 +25,7 @@
 #define VALIDATE_H
 
 #include "program.h"
+#include "packed_reference.h"
 
 bool validate(int argc, char ** argv);
 
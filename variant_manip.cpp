@@ -30,16 +30,21 @@
  */
 VariantManip::VariantManip(std::string ref_fasta_file)
 {
+    ref_index = NULL;
+    reference_present = false;
+
     if (ref_fasta_file!="")
     {
-        fai = fai_load(ref_fasta_file.c_str());
-        if (fai==NULL)
+        ref_index = ReferenceIndex::load(ref_fasta_file);
+        if (ref_index==NULL)
         {
             fprintf(stderr, "[%s:%d %s] Cannot load genome index: %s\n", __FILE__, __LINE__, __FUNCTION__, ref_fasta_file.c_str());
             exit(1);
         }
-        reference_present = (fai!=NULL);
+        reference_present = (ref_index!=NULL);
     }
+
+    rs = ref_index ? new ReferenceSequence(ref_index) : NULL;
 };
 
 /**
@@ -47,7 +52,18 @@ VariantManip::VariantManip(std::string ref_fasta_file)
  */
 VariantManip::VariantManip()
 {
+    ref_index = NULL;
     reference_present = false;
+    rs = NULL;
+}
+
+/**
+ * Destructor.
+ */
+VariantManip::~VariantManip()
+{
+    if (rs) delete rs;
+    if (ref_index) delete ref_index;
 }
 
 /**
@@ -66,7 +82,7 @@ int32_t VariantManip::is_not_ref_consistent(bcf_hdr_t *h, bcf1_t *v)
     uint32_t rlen = strlen(vcf_ref);
 
     int32_t ref_len = 0;
-    char *ref = faidx_fetch_seq(fai, chrom, pos0, pos0+rlen-1, &ref_len);
+    char *ref = ref_index->fetch_seq(chrom, pos0, pos0+rlen-1, &ref_len);
     if (!ref)
     {
         fprintf(stderr, "[%s:%d %s] failure to extract base from fasta file: %s:%d-%d\n", __FILE__, __LINE__, __FUNCTION__, chrom, pos0, pos0+rlen-1);
@@ -560,17 +576,9 @@ void VariantManip::right_trim_or_left_extend(std::vector<std::string>& alleles,
         if (to_left_extend)
         {
             --pos1;
-            int ref_len = 0;
 
-            char *ref = faidx_fetch_uc_seq(fai, chrom, pos1-1, pos1-1, &ref_len);
-            if (!ref)
-            {
-                fprintf(stderr, "[%s:%d %s] failure to extract base from fasta file: %s:%d\n", __FILE__, __LINE__, __FUNCTION__, chrom, pos1-1);
-                fprintf(stderr, "FAQ: http://genome.sph.umich.edu/wiki/Vt#1._vt_cannot_retrieve_sequences_from_my_reference_sequence_file\n");
-                exit(1);
-            }
-            char base = ref[0];
-            free(ref);
+            //the window of reference around the variant is fetched once
+            char base = rs->fetch_base(chrom, pos1);
 
             for (size_t i=0; i<alleles.size(); ++i)
             {
@@ -648,7 +656,7 @@ void VariantManip::generate_probes(const char* chrom,
         int32_t ref_len;
         while (bases.size()<4 || preamble.size()<min_flank_length)
         {
-            base = faidx_fetch_uc_seq(fai, const_cast<char*>(chrom), pos1-1, pos1-1, &ref_len);
+            base = ref_index->fetch_uc_seq(chrom, pos1-1, pos1-1, &ref_len);
             preamble.append(1,base[0]);
             bases[base[0]] = 1;
             if (ref_len>0) free(base);
@@ -660,7 +668,7 @@ void VariantManip::generate_probes(const char* chrom,
         uint32_t alleleLength = alleles[0].size();
         while (bases.size()<4 || postamble.size()<min_flank_length)
         {
-            base = faidx_fetch_uc_seq(fai, const_cast<char*>(chrom), pos1+alleleLength+i, pos1+alleleLength+i, &ref_len);
+            base = ref_index->fetch_uc_seq(chrom, pos1+alleleLength+i, pos1+alleleLength+i, &ref_len);
             postamble.append(1,base[0]);
             bases[base[0]] = 1;
             if (ref_len>0) free(base);
@@ -707,7 +715,7 @@ void VariantManip::generate_probes(const char* chrom,
         int32_t ref_len = 0;
         while (bases.size()<4 && preamble.size()<min_flank_length)
         {
-            base = faidx_fetch_uc_seq(fai, const_cast<char*>(chrom), pos1-i-1, pos1-i-1, &ref_len);
+            base = ref_index->fetch_uc_seq(chrom, pos1-i-1, pos1-i-1, &ref_len);
             preamble.append(1,base[0]);
             bases[base[0]] = 1;
             ++i;
@@ -756,7 +764,7 @@ void VariantManip::generate_probes(const char* chrom,
                 {
                     int32_t start1 = (pos1+length-alleles[i].size()+alleles[0].size()-1);
                     int32_t ref_len;
-                    char* base = faidx_fetch_uc_seq(fai, const_cast<char*>(chrom), start1 , start1, &ref_len);
+                    char* base = ref_index->fetch_uc_seq(chrom, start1 , start1, &ref_len);
                     probes[i].append(1, base[0]);
                     if (ref_len>0) free(base);
                 }
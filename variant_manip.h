@@ -28,6 +28,7 @@
 #include "hts_utils.h"
 #include "variant.h"
 #include "allele.h"
+#include "reference_sequence.h"
 
 /**
  * Methods for manipulating variants
@@ -35,9 +36,12 @@
 class VariantManip
 {
     public:
-    faidx_t *fai;
+    ReferenceIndex *ref_index;
     bool reference_present;
 
+    //buffered reference for left extension
+    ReferenceSequence *rs;
+
     /**
      * Constructor.
      *
@@ -50,6 +54,11 @@ class VariantManip
      */
     VariantManip();
 
+    /**
+     * Destructor.
+     */
+    ~VariantManip();
+
     /**
      * Classifies variants.
      */
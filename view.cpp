@@ -207,8 +207,7 @@ class Igor : Program
 
             if (filter_exists)
             {
-                vm->classify_variant(h, v, variant);
-                if (!filter.apply(h, v, &variant, debug))
+                if (!filter.apply(h, v, &variant, vm, debug))
                 {
                     continue;
                 }
@@ -475,8 +475,7 @@ void VNTRGenotypingRecord::process_read(AugmentedBAMRecord& as, int32_t sampleIn
             int32_t cycle = 0;
 
             std::vector<uint32_t>& aug_cigar = as.aug_cigar;
-            std::vector<std::string>& aug_ref = as.aug_ref;
-            std::vector<std::string>& aug_alt = as.aug_alt;
+            std::vector<AugmentedSeq>& aug_alt = as.aug_alt;
 
             int32_t vpos1 = pos1;
             int32_t cpos1 = bam_get_pos1(s);
@@ -573,8 +572,8 @@ void VNTRGenotypingRecord::process_read(AugmentedBAMRecord& as, int32_t sampleIn
                 uint32_t cycle = 10;
 
                 std::vector<uint32_t>& aug_cigar = as.aug_cigar;
-                std::vector<std::string>& aug_ref = as.aug_ref;
-                std::vector<std::string>& aug_alt = as.aug_alt;
+                std::vector<AugmentedSeq>& aug_ref = as.aug_ref;
+                std::vector<AugmentedSeq>& aug_alt = as.aug_alt;
 
                 int32_t vpos1 = pos1;
 
@@ -699,8 +698,8 @@ void VNTRGenotypingRecord::process_read(AugmentedBAMRecord& as, int32_t sampleIn
 //     uint8_t mapq = bam_get_mapq(s);
 
 //     std::vector<uint32_t>& aug_cigar = as.aug_cigar;
-//     std::vector<std::string>& aug_ref = as.aug_ref;
-//     std::vector<std::string>& aug_alt = as.aug_alt;
+//     std::vector<AugmentedSeq>& aug_ref = as.aug_ref;
+//     std::vector<AugmentedSeq>& aug_alt = as.aug_alt;
 
 //     //genomic bookend positions of VNTR
 //     int32_t vpos1 = g->beg1-1;